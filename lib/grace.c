@@ -0,0 +1,217 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "grace.h"
+
+__thread int grace_thread_shard = -1;
+static int grace_shard_next;
+
+
+/*
+ *	Grace period
+ */
+int
+grace_shard_assign(void)
+{
+	grace_thread_shard = __atomic_fetch_add(&grace_shard_next, 1, __ATOMIC_RELAXED)
+			     % GRACE_SHARDS;
+	return grace_thread_shard;
+}
+
+static bool
+grace_drained(grace_t *gp, int slot)
+{
+	int i;
+
+	for (i = 0; i < GRACE_SHARDS; i++) {
+		if (__atomic_load_n(&gp->shard[i].readers[slot], __ATOMIC_SEQ_CST))
+			return false;
+	}
+
+	return true;
+}
+
+static void
+grace_drain(grace_t *gp, int slot)
+{
+	while (!grace_drained(gp, slot))
+		sched_yield();
+}
+
+/* A reader may have sampled the epoch before a previous flip and only
+ * entered its slot afterwards, so both slots are drained. */
+void
+grace_synchronize(grace_t *gp)
+{
+	unsigned long epoch;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		epoch = __atomic_add_fetch(&gp->epoch, 1, __ATOMIC_SEQ_CST);
+		grace_drain(gp, (epoch - 1) & 1);
+	}
+}
+
+
+/*
+ *	Published snapshot
+ */
+grace_obj_t *
+grace_ptr_get(grace_ptr_t *p)
+{
+	grace_obj_t *obj;
+	int slot;
+
+	slot = grace_read_lock(&p->gp);
+	obj = __atomic_load_n(&p->ptr, __ATOMIC_SEQ_CST);
+	if (obj)
+		__atomic_add_fetch(&obj->refcnt, 1, __ATOMIC_SEQ_CST);
+	grace_read_unlock(&p->gp, slot);
+	return obj;
+}
+
+void
+grace_ptr_put(grace_obj_t *obj)
+{
+	__atomic_sub_fetch(&obj->refcnt, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Every object on the retired list went through a grace period, only
+ * pinned ones are kept. */
+void
+grace_ptr_reap(grace_ptr_t *p, grace_release_t release)
+{
+	grace_obj_t *obj, **pobj = &p->retired;
+
+	while ((obj = *pobj)) {
+		if (__atomic_load_n(&obj->refcnt, __ATOMIC_SEQ_CST)) {
+			pobj = &obj->next;
+			continue;
+		}
+
+		*pobj = obj->next;
+		(*release) (obj);
+	}
+}
+
+void
+grace_ptr_publish(grace_ptr_t *p, grace_obj_t *obj, grace_release_t release)
+{
+	grace_obj_t *old;
+
+	old = __atomic_exchange_n(&p->ptr, obj, __ATOMIC_SEQ_CST);
+	if (old) {
+		grace_synchronize(&p->gp);
+		old->next = p->retired;
+		p->retired = old;
+	}
+
+	grace_ptr_reap(p, release);
+}
+
+
+/*
+ *	Deferred release
+ */
+void
+grace_defer_init(grace_defer_t *d, grace_t *gp, grace_release_t release)
+{
+	d->gp = gp;
+	d->release = release;
+}
+
+static void
+grace_defer_release(grace_defer_t *d, grace_obj_t *obj)
+{
+	grace_obj_t *next;
+
+	for (; obj; obj = next) {
+		next = obj->next;
+		(*d->release) (obj);
+		d->released++;
+	}
+}
+
+/* Advance by at most one phase. Return number of queued batches
+ * still waiting, caller may poll again later. */
+int
+grace_defer_poll(grace_defer_t *d)
+{
+	int waiting;
+
+	if (__sync_lock_test_and_set(&d->lock, 1))
+		return 1;
+
+	/* Phase done once readers of previous parity are gone */
+	if (d->flip) {
+		if (!grace_drained(d->gp, (d->flip - 1) & 1))
+			goto end;
+
+		grace_defer_release(d, d->batch[1]);
+		d->batch[1] = d->batch[0];
+		d->batch[0] = NULL;
+		d->flip = 0;
+	}
+
+	/* Start next phase: newly retired objects enter their first
+	 * one, previous batch its second one */
+	d->batch[0] = __atomic_exchange_n(&d->pending, NULL, __ATOMIC_ACQUIRE);
+	if (d->batch[0] || d->batch[1])
+		d->flip = __atomic_add_fetch(&d->gp->epoch, 1, __ATOMIC_SEQ_CST);
+
+  end:
+	waiting = !!d->batch[0] + !!d->batch[1] +
+		  !!__atomic_load_n(&d->pending, __ATOMIC_RELAXED);
+	__sync_lock_release(&d->lock);
+	return waiting;
+}
+
+void
+grace_defer(grace_defer_t *d, grace_obj_t *obj)
+{
+	obj->next = __atomic_load_n(&d->pending, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&d->pending, &obj->next, obj, true
+					    , __ATOMIC_RELEASE, __ATOMIC_RELAXED)) ;
+
+	grace_defer_poll(d);
+}
+
+/* Blocking, for teardown */
+void
+grace_defer_flush(grace_defer_t *d)
+{
+	while (__sync_lock_test_and_set(&d->lock, 1))
+		sched_yield();
+
+	grace_synchronize(d->gp);
+	grace_defer_release(d, d->batch[1]);
+	grace_defer_release(d, d->batch[0]);
+	grace_defer_release(d, __atomic_exchange_n(&d->pending, NULL, __ATOMIC_ACQUIRE));
+	d->batch[0] = d->batch[1] = NULL;
+	d->flip = 0;
+	__sync_lock_release(&d->lock);
+}
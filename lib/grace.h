@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GRACE_H
+#define _GRACE_H
+
+#define GRACE_SHARDS		16	/* reader counters, per thread */
+
+/*
+ *	Grace period for lock-free readers.
+ *
+ *	Readers open a short read-side section around the pointer load and
+ *	the refcount increment that pins what they found. Writers unpublish
+ *	an object then call grace_synchronize(): on return, no reader can
+ *	still be between its load and its refcount increment, so refcnt is
+ *	the only thing left to check before releasing.
+ *
+ *	Readers are counted in two slots selected by epoch parity. A writer
+ *	flips the epoch and drains each slot in turn: new readers always land
+ *	in the other slot, so the wait is bounded by in-flight sections only.
+ *	Counters are sharded per thread on their own cache line, so that
+ *	concurrent readers don't bounce a shared one.
+ */
+typedef struct _grace_shard {
+	int			readers[2];
+	char			pad[64 - 2 * sizeof(int)];
+} grace_shard_t;
+
+typedef struct _grace {
+	unsigned long		epoch;
+	grace_shard_t		shard[GRACE_SHARDS];
+} grace_t;
+
+extern __thread int grace_thread_shard;
+extern int grace_shard_assign(void);
+
+static inline int
+grace_read_lock(grace_t *gp)
+{
+	int shard = grace_thread_shard;
+	int slot;
+
+	if (shard < 0)
+		shard = grace_shard_assign();
+
+	slot = __atomic_load_n(&gp->epoch, __ATOMIC_SEQ_CST) & 1;
+	__atomic_add_fetch(&gp->shard[shard].readers[slot], 1, __ATOMIC_SEQ_CST);
+	return (shard << 1) | slot;
+}
+
+static inline void
+grace_read_unlock(grace_t *gp, int cookie)
+{
+	__atomic_sub_fetch(&gp->shard[cookie >> 1].readers[cookie & 1], 1
+			   , __ATOMIC_SEQ_CST);
+}
+
+/*
+ *	Published immutable snapshot. Objects embed a grace_obj_t, readers
+ *	pin the current one with grace_ptr_get()/grace_ptr_put(). Writers
+ *	are serialized by the caller.
+ */
+typedef struct _grace_obj {
+	int			refcnt;
+	struct _grace_obj	*next;		/* retired list */
+} grace_obj_t;
+
+typedef struct _grace_ptr {
+	grace_obj_t		*ptr;		/* published, lock-free */
+	grace_obj_t		*retired;
+	grace_t			gp;
+} grace_ptr_t;
+
+typedef void (*grace_release_t) (grace_obj_t *);
+
+/*
+ *	Deferred release, call_rcu style. Objects already unreachable for
+ *	new readers are queued without waiting. A queued batch is released
+ *	once two epoch flips, each followed by a drained reader slot, went
+ *	by: grace_defer_poll() only checks and flips, it never waits.
+ */
+typedef struct _grace_defer {
+	grace_t			*gp;
+	grace_release_t		release;
+	grace_obj_t		*pending;	/* lock-free push */
+	grace_obj_t		*batch[2];	/* flip done, phase done */
+	unsigned long		flip;		/* epoch to drain, 0: none */
+	uint32_t		lock;
+	uint64_t		released;
+} grace_defer_t;
+
+static inline bool
+grace_defer_waiting(grace_defer_t *d)
+{
+	return __atomic_load_n(&d->pending, __ATOMIC_RELAXED) ||
+	       __atomic_load_n(&d->flip, __ATOMIC_RELAXED);
+}
+
+
+/* Prototypes */
+extern void grace_synchronize(grace_t *);
+extern grace_obj_t *grace_ptr_get(grace_ptr_t *);
+extern void grace_ptr_put(grace_obj_t *);
+extern void grace_ptr_publish(grace_ptr_t *, grace_obj_t *, grace_release_t);
+extern void grace_ptr_reap(grace_ptr_t *, grace_release_t);
+extern void grace_defer_init(grace_defer_t *, grace_t *, grace_release_t);
+extern void grace_defer(grace_defer_t *, grace_obj_t *);
+extern int grace_defer_poll(grace_defer_t *);
+extern void grace_defer_flush(grace_defer_t *);
+
+#endif
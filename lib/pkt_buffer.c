@@ -26,7 +26,12 @@
 #include <sys/prctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
+#include <linux/if_packet.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <poll.h>
 #include <errno.h>
 
 /* local includes */
@@ -356,6 +361,202 @@ pkt_queue_mput(pkt_queue_t *q, mpkt_t *mpkt)
 }
 
 
+/*
+ *	PACKET_MMAP TPACKET_V3 ring helpers
+ *
+ * RX ring is block oriented: kernel fills a whole block of frames and
+ * hands it over either when full or when block_tmo expires. We process
+ * every frame of a block in place then give block back to kernel.
+ * TX ring is frame oriented: frames are filled in ring and kernel is
+ * kicked once for a batch of pending frames.
+ */
+static int
+pkt_ring_setsockopt(int fd, pkt_ring_t *r)
+{
+	struct tpacket_req3 req;
+	int ret, version = TPACKET_V3;
+
+	ret = setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version));
+	if (ret < 0)
+		return -1;
+
+	memset(&req, 0, sizeof(struct tpacket_req3));
+	req.tp_block_size = r->block_size;
+	req.tp_block_nr = r->block_nr;
+	req.tp_frame_size = r->frame_size;
+	req.tp_frame_nr = (r->block_size / r->frame_size) * r->block_nr;
+	req.tp_retire_blk_tov = r->block_tmo;
+	ret = setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+	if (ret < 0)
+		return -1;
+
+	/* TX ring doesnt support block retire timer */
+	req.tp_retire_blk_tov = 0;
+	ret = setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+	if (ret < 0)
+		return -1;
+
+	r->tx_frame_nr = req.tp_frame_nr;
+	return 0;
+}
+
+int
+pkt_ring_init(pkt_ring_t *r, int fd)
+{
+	size_t ring_len;
+
+	if (!r->block_size)
+		r->block_size = PKT_RING_BLOCK_SIZE;
+	if (!r->block_nr)
+		r->block_nr = PKT_RING_BLOCK_NR;
+	if (!r->frame_size)
+		r->frame_size = PKT_RING_FRAME_SIZE;
+	if (!r->block_tmo)
+		r->block_tmo = PKT_RING_BLOCK_TMO;
+
+	if (pkt_ring_setsockopt(fd, r) < 0)
+		return -1;
+
+	/* RX & TX rings are mapped contiguously */
+	ring_len = (size_t) r->block_size * r->block_nr;
+	r->map_len = 2 * ring_len;
+	r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE
+			  , MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (r->map == MAP_FAILED) {
+		r->map = NULL;
+		return -1;
+	}
+
+	r->rx_ring = r->map;
+	r->tx_ring = r->map + ring_len;
+	r->rx_block = r->tx_frame = r->tx_pending = 0;
+	pthread_mutex_init(&r->tx_mutex, NULL);
+	return 0;
+}
+
+int
+pkt_ring_recv(int fd, pkt_ring_t *r, int timeout, void (*process) (pkt_t *, void *), void *arg)
+{
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *hdr;
+	struct pollfd pfd;
+	pkt_buffer_t pbuff;
+	pkt_t pkt;
+	int ret, i, num_pkts;
+
+	bd = (struct tpacket_block_desc *) (r->rx_ring + r->rx_block * r->block_size);
+	if (!(bd->hdr.bh1.block_status & TP_STATUS_USER)) {
+		pfd.fd = fd;
+		pfd.events = POLLIN | POLLERR;
+		pfd.revents = 0;
+		ret = poll(&pfd, 1, timeout);
+		if (ret <= 0)
+			return ret;
+
+		if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+			return 0;
+	}
+
+	/* Frames are processed in place: pkt simply wraps ring memory */
+	pkt.pbuff = &pbuff;
+	INIT_LIST_HEAD(&pkt.next);
+	num_pkts = bd->hdr.bh1.num_pkts;
+	hdr = (struct tpacket3_hdr *) ((uint8_t *) bd + bd->hdr.bh1.offset_to_first_pkt);
+	for (i = 0; i < num_pkts; i++) {
+		pbuff.head = pbuff.data = (uint8_t *) hdr + hdr->tp_mac;
+		pbuff.end = pbuff.tail = pbuff.head + hdr->tp_snaplen;
+		(*process) (&pkt, arg);
+		hdr = (struct tpacket3_hdr *) ((uint8_t *) hdr + hdr->tp_next_offset);
+	}
+
+	/* Release block to kernel */
+	__sync_synchronize();
+	bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	r->rx_block = (r->rx_block + 1) % r->block_nr;
+	r->rx_blocks++;
+	return num_pkts;
+}
+
+static int
+__pkt_ring_flush(int fd, pkt_ring_t *r)
+{
+	ssize_t ret;
+	int state;
+
+	if (!r->tx_pending)
+		return 0;
+
+	r->tx_pending = 0;
+	r->tx_kicks++;
+
+	/* send() is a cancellation point and tx_mutex is held here:
+	 * workers are stopped via pthread_cancel() */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+	ret = send(fd, NULL, 0, MSG_DONTWAIT);
+	pthread_setcancelstate(state, NULL);
+	if (ret < 0 && errno != EAGAIN && errno != ENOBUFS)
+		return -1;
+	return 0;
+}
+
+int
+pkt_ring_flush(int fd, pkt_ring_t *r)
+{
+	int ret;
+
+	pthread_mutex_lock(&r->tx_mutex);
+	ret = __pkt_ring_flush(fd, r);
+	pthread_mutex_unlock(&r->tx_mutex);
+	return ret;
+}
+
+int
+pkt_ring_send(int fd, pkt_ring_t *r, pkt_t *pkt, bool flush)
+{
+	unsigned int len = pkt_buffer_len(pkt->pbuff);
+	unsigned int off = TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+	struct tpacket3_hdr *hdr;
+	int ret = 0;
+
+	if (len > r->frame_size - off)
+		return -1;
+
+	pthread_mutex_lock(&r->tx_mutex);
+	hdr = (struct tpacket3_hdr *) (r->tx_ring + r->tx_frame * r->frame_size);
+	if (hdr->tp_status != TP_STATUS_AVAILABLE) {
+		/* Ring is full, kick kernel and drop */
+		r->tx_full++;
+		__pkt_ring_flush(fd, r);
+		pthread_mutex_unlock(&r->tx_mutex);
+		return -1;
+	}
+
+	memcpy((uint8_t *) hdr + off, pkt->pbuff->head, len);
+	hdr->tp_len = len;
+	hdr->tp_next_offset = 0;
+	__sync_synchronize();
+	hdr->tp_status = TP_STATUS_SEND_REQUEST;
+	r->tx_frame = (r->tx_frame + 1) % r->tx_frame_nr;
+	r->tx_pending++;
+
+	if (flush)
+		ret = __pkt_ring_flush(fd, r);
+	pthread_mutex_unlock(&r->tx_mutex);
+	return (ret < 0) ? -1 : len;
+}
+
+void
+pkt_ring_destroy(pkt_ring_t *r)
+{
+	if (!r->map)
+		return;
+
+	munmap(r->map, r->map_len);
+	pthread_mutex_destroy(&r->tx_mutex);
+	r->map = r->rx_ring = r->tx_ring = NULL;
+}
+
+
 /*
  *	Pkt buffer helpers
  */
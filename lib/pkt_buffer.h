@@ -46,6 +46,34 @@ typedef struct _mpkt {
 	pkt_t			**pkt;
 } mpkt_t;
 
+/* PACKET_MMAP TPACKET_V3 ring */
+#define PKT_RING_BLOCK_SIZE	(1 << 16)
+#define PKT_RING_BLOCK_NR	64
+#define PKT_RING_FRAME_SIZE	(1 << 11)
+#define PKT_RING_BLOCK_TMO	10	/* msec */
+
+typedef struct _pkt_ring {
+	unsigned int		block_size;
+	unsigned int		block_nr;
+	unsigned int		frame_size;
+	unsigned int		block_tmo;
+
+	unsigned char		*map;
+	size_t			map_len;
+	unsigned char		*rx_ring;
+	unsigned char		*tx_ring;
+	unsigned int		rx_block;	/* Next RX block to read */
+	unsigned int		tx_frame;	/* Next TX frame to fill */
+	unsigned int		tx_frame_nr;
+	unsigned int		tx_pending;	/* Frames waiting for a kick */
+	pthread_mutex_t		tx_mutex;
+
+	/* Stats */
+	uint64_t		rx_blocks;
+	uint64_t		tx_kicks;
+	uint64_t		tx_full;
+} pkt_ring_t;
+
 typedef struct _pkt_queue {
 	pthread_mutex_t		mutex;
 	list_head_t		queue;
@@ -112,6 +140,11 @@ extern int __pkt_queue_mget(pkt_queue_t *, mpkt_t *);
 extern int pkt_queue_mget(pkt_queue_t *, mpkt_t *);
 extern int __pkt_queue_mput(pkt_queue_t *, mpkt_t *);
 extern int pkt_queue_mput(pkt_queue_t *, mpkt_t *);
+extern int pkt_ring_init(pkt_ring_t *, int);
+extern int pkt_ring_recv(int, pkt_ring_t *, int, void (*process) (pkt_t *, void *), void *);
+extern int pkt_ring_send(int, pkt_ring_t *, pkt_t *, bool);
+extern int pkt_ring_flush(int, pkt_ring_t *);
+extern void pkt_ring_destroy(pkt_ring_t *);
 extern int pkt_queue_init(pkt_queue_t *);
 extern int pkt_queue_destroy(pkt_queue_t *);
 extern ssize_t pkt_buffer_send(int, pkt_buffer_t *, struct sockaddr_storage *);
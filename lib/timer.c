@@ -35,6 +35,7 @@
 #include "rbtree_api.h"
 #include "timer.h"
 #include "timer_thread.h"
+#include "timer_wheel.h"
 #ifdef _TIMER_CHECK_
 #include "logger.h"
 #endif
@@ -236,6 +237,11 @@ timer_node_clear(timer_node_t *n)
 void
 timer_node_expire_now(timer_thread_t *t, timer_node_t *t_node)
 {
+	if (t->wheel) {
+		timer_wheel_node_expire_now(t->wheel, t_node);
+		return;
+	}
+
 	pthread_mutex_lock(&t->timer_mutex);
 	rb_erase_cached(&t_node->n, &t->timer);
 	gettimeofday(&t_node->sands, NULL);
@@ -272,6 +278,9 @@ timer_node_del(timer_thread_t *t, timer_node_t *t_node)
 	if (!timer_node_pending(t_node))
 		return -1;
 
+	if (t->wheel)
+		return timer_wheel_node_del(t->wheel, t_node);
+
 	pthread_mutex_lock(&t->timer_mutex);
 	__timer_node_del(t, t_node);
 	pthread_mutex_unlock(&t->timer_mutex);
@@ -281,6 +290,11 @@ timer_node_del(timer_thread_t *t, timer_node_t *t_node)
 void
 timer_node_add(timer_thread_t *t, timer_node_t *t_node, int sec)
 {
+	if (t->wheel) {
+		timer_wheel_node_add(t->wheel, t_node, sec);
+		return;
+	}
+
 	pthread_mutex_lock(&t->timer_mutex);
 	if (timer_node_pending(t_node))
 		__timer_node_del(t, t_node);
@@ -368,9 +382,22 @@ timer_thread_init(timer_thread_t *t, const char *name, int (*fired) (void *))
 	return 0;
 }
 
+int
+timer_thread_wheel_init(timer_thread_t *t, const char *name, int (*fired) (void *),
+			int nr_shards)
+{
+	t->fired = fired;
+	bsd_strlcpy(t->name, name, TIMER_THREAD_NAMESIZ);
+	t->wheel = timer_wheel_init(t, nr_shards);
+	return 0;
+}
+
 int
 timer_thread_signal(timer_thread_t *t)
 {
+	if (t->wheel)
+		return timer_wheel_signal(t->wheel);
+
 	pthread_mutex_lock(&t->cond_mutex);
 	pthread_cond_signal(&t->cond);
 	pthread_mutex_unlock(&t->cond_mutex);
@@ -380,6 +407,12 @@ timer_thread_signal(timer_thread_t *t)
 int
 timer_thread_destroy(timer_thread_t *t)
 {
+	if (t->wheel) {
+		timer_wheel_destroy(t->wheel);
+		t->wheel = NULL;
+		return 0;
+	}
+
 	__set_bit(TIMER_THREAD_FL_STOP_BIT, &t->flags);
 	timer_thread_signal(t);
 	pthread_join(t->task, NULL);
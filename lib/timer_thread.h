@@ -22,6 +22,9 @@
 #ifndef _TIMER_THREAD_H
 #define _TIMER_THREAD_H
 
+#include <stdint.h>
+#include "list_head.h"
+
 enum {
 	TIMER_THREAD_FL_STOP_BIT,
 };
@@ -35,6 +38,7 @@ typedef struct _timer_thread {
 	pthread_cond_t		cond;
 	pthread_mutex_t		cond_mutex;
 	int			(*fired) (void *);
+	struct _timer_wheel	*wheel;		/* Timing wheel backend */
 
 	unsigned long		flags;
 } timer_thread_t;
@@ -43,7 +47,13 @@ typedef struct _timer_node {
 	int		(*to_func) (void *);
 	void		*to_arg;
 	timeval_t	sands;
-	rb_node_t	n;
+	union {
+		rb_node_t	n;		/* rbtree backend */
+		struct {
+			hlist_node_t	w_node;	/* timing wheel backend */
+			uint64_t	w_expires;
+		};
+	};
 } timer_node_t;
 
 
@@ -54,6 +64,7 @@ extern void timer_node_add(timer_thread_t *, timer_node_t *, int);
 extern int timer_node_pending(timer_node_t *);
 extern int timer_node_del(timer_thread_t *, timer_node_t *);
 extern int timer_thread_init(timer_thread_t *, const char *, int (*fired) (void *));
+extern int timer_thread_wheel_init(timer_thread_t *, const char *, int (*fired) (void *), int);
 extern int timer_thread_signal(timer_thread_t *);
 extern int timer_thread_destroy(timer_thread_t *);
 
@@ -0,0 +1,336 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/prctl.h>
+#include <pthread.h>
+
+#include "memory.h"
+#include "bitops.h"
+#include "utils.h"
+#include "rbtree_api.h"
+#include "timer.h"
+#include "timer_thread.h"
+#include "timer_wheel.h"
+
+
+/*
+ *	Wheel helpers
+ */
+static inline uint64_t
+timer_wheel_now(void)
+{
+	return timer_long(timer_now()) / TIMER_WHEEL_TICK;
+}
+
+static inline timer_wheel_shard_t *
+timer_wheel_shard_get(timer_wheel_t *w, timer_node_t *n)
+{
+	uint64_t h = (uintptr_t) n;
+
+	/* node address hashing: nodes stay on the same shard for their
+	 * whole lifetime so del always hit the owner shard */
+	h = (h >> 4) * 0x9e3779b97f4a7c15ULL;
+	return &w->shard[(h >> 32) % w->nr_shards];
+}
+
+static inline void
+timer_wheel_list_move(hlist_head_t *from, hlist_head_t *to)
+{
+	to->first = from->first;
+	if (to->first)
+		to->first->pprev = &to->first;
+	from->first = NULL;
+}
+
+static void
+__timer_wheel_add(timer_wheel_shard_t *s, timer_node_t *n)
+{
+	uint64_t expires = n->w_expires;
+	uint64_t idx = expires - s->clk;
+	hlist_head_t *vec;
+	int i;
+
+	if ((int64_t) idx < 0) {
+		/* Already expired: fire on next tick */
+		vec = &s->root[s->clk & TIMER_WHEEL_ROOT_MASK];
+	} else if (idx < TIMER_WHEEL_ROOT_SIZE) {
+		vec = &s->root[expires & TIMER_WHEEL_ROOT_MASK];
+	} else {
+		if (idx > TIMER_WHEEL_MAX_TICKS) {
+			expires = s->clk + TIMER_WHEEL_MAX_TICKS;
+			n->w_expires = expires;
+			idx = TIMER_WHEEL_MAX_TICKS;
+		}
+
+		for (i = 0; i < TIMER_WHEEL_LVL_NR - 1; i++) {
+			if (idx < 1ULL << (TIMER_WHEEL_ROOT_BITS + (i+1) * TIMER_WHEEL_LVL_BITS))
+				break;
+		}
+
+		vec = &s->lvl[i][(expires >> (TIMER_WHEEL_ROOT_BITS + i * TIMER_WHEEL_LVL_BITS)) &
+				 TIMER_WHEEL_LVL_MASK];
+	}
+
+	hlist_add_head(&n->w_node, vec);
+}
+
+static void
+__timer_wheel_del(timer_wheel_shard_t *s, timer_node_t *n)
+{
+	hlist_del_init(&n->w_node);
+	timerclear(&n->sands);
+	s->pending--;
+}
+
+static int
+timer_wheel_cascade(timer_wheel_shard_t *s, int lvl)
+{
+	int idx = (s->clk >> (TIMER_WHEEL_ROOT_BITS + lvl * TIMER_WHEEL_LVL_BITS)) &
+		  TIMER_WHEEL_LVL_MASK;
+	hlist_head_t work;
+	timer_node_t *n;
+
+	timer_wheel_list_move(&s->lvl[lvl][idx], &work);
+	while (!hlist_empty(&work)) {
+		n = hlist_entry(work.first, timer_node_t, w_node);
+		hlist_del_init(&n->w_node);
+		__timer_wheel_add(s, n);
+		s->cascaded++;
+	}
+
+	return idx;
+}
+
+/* Expired slots are spliced out in one go and drained in order. The
+ * shard lock is released around each handler, as with rbtree backend,
+ * so handlers can freely re-arm or delete any node, including the ones
+ * still sitting in the expired batch. */
+static void
+timer_wheel_run(timer_wheel_shard_t *s, uint64_t now)
+{
+	timer_thread_t *t = s->wheel->t;
+	hlist_head_t work;
+	timer_node_t *n;
+	int idx, i;
+
+	pthread_mutex_lock(&s->mutex);
+	while (s->clk <= now) {
+		idx = s->clk & TIMER_WHEEL_ROOT_MASK;
+		if (!idx) {
+			for (i = 0; i < TIMER_WHEEL_LVL_NR; i++) {
+				if (timer_wheel_cascade(s, i))
+					break;
+			}
+		}
+
+		timer_wheel_list_move(&s->root[idx], &work);
+		s->clk++;
+
+		while (!hlist_empty(&work)) {
+			n = hlist_entry(work.first, timer_node_t, w_node);
+			__timer_wheel_del(s, n);
+			s->expired++;
+
+			pthread_mutex_unlock(&s->mutex);
+			/* Cascade handlers */
+			if (n->to_func)
+				(*n->to_func) (n->to_arg);
+			if (t->fired)
+				(*t->fired) (n->to_arg);
+			pthread_mutex_lock(&s->mutex);
+		}
+	}
+	pthread_mutex_unlock(&s->mutex);
+}
+
+
+/*
+ *	Timer node API
+ */
+void
+timer_wheel_node_add(timer_wheel_t *w, timer_node_t *n, int sec)
+{
+	timer_wheel_shard_t *s = timer_wheel_shard_get(w, n);
+	uint64_t now;
+
+	/* Deadline is taken from current time, not from s->clk which
+	 * lags it by up to one tick between two shard runs */
+	now = timer_wheel_now();
+
+	pthread_mutex_lock(&s->mutex);
+	if (timerisset(&n->sands))
+		__timer_wheel_del(s, n);
+	n->sands = timer_add_now_sec(n->sands, sec);
+	n->w_expires = now + (uint64_t) sec * TIMER_WHEEL_TICK_HZ;
+	__timer_wheel_add(s, n);
+	s->pending++;
+	pthread_mutex_unlock(&s->mutex);
+}
+
+int
+timer_wheel_node_del(timer_wheel_t *w, timer_node_t *n)
+{
+	timer_wheel_shard_t *s = timer_wheel_shard_get(w, n);
+
+	pthread_mutex_lock(&s->mutex);
+	if (!timerisset(&n->sands)) {
+		pthread_mutex_unlock(&s->mutex);
+		return -1;
+	}
+	__timer_wheel_del(s, n);
+	pthread_mutex_unlock(&s->mutex);
+	return 0;
+}
+
+void
+timer_wheel_node_expire_now(timer_wheel_t *w, timer_node_t *n)
+{
+	timer_wheel_shard_t *s = timer_wheel_shard_get(w, n);
+
+	pthread_mutex_lock(&s->mutex);
+	if (timerisset(&n->sands))
+		__timer_wheel_del(s, n);
+	n->sands = timer_now();
+	n->w_expires = s->clk;
+	__timer_wheel_add(s, n);
+	s->pending++;
+	pthread_mutex_unlock(&s->mutex);
+
+	pthread_mutex_lock(&s->cond_mutex);
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->cond_mutex);
+}
+
+
+/*
+ *	Shard thread
+ */
+static void *
+timer_wheel_task(void *arg)
+{
+	timer_wheel_shard_t *s = arg;
+	timer_thread_t *t = s->wheel->t;
+	struct timespec timeout;
+	timeval_t now;
+
+	/* Our identity */
+	prctl(PR_SET_NAME, t->name, 0, 0, 0, 0);
+
+  wheel_process:
+	/* Schedule interruptible timeout */
+	pthread_mutex_lock(&s->cond_mutex);
+	now = timer_now();
+	timeout.tv_sec = now.tv_sec;
+	timeout.tv_nsec = (now.tv_usec + TIMER_WHEEL_TICK) * 1000;
+	if (timeout.tv_nsec >= NSEC_PER_SEC) {
+		timeout.tv_sec++;
+		timeout.tv_nsec -= NSEC_PER_SEC;
+	}
+	pthread_cond_timedwait(&s->cond, &s->cond_mutex, &timeout);
+	pthread_mutex_unlock(&s->cond_mutex);
+
+	if (__test_bit(TIMER_THREAD_FL_STOP_BIT, &t->flags))
+		return NULL;
+
+	/* Expiration handling */
+	timer_wheel_run(s, timer_wheel_now());
+
+	goto wheel_process;
+}
+
+int
+timer_wheel_signal(timer_wheel_t *w)
+{
+	timer_wheel_shard_t *s;
+	int i;
+
+	for (i = 0; i < w->nr_shards; i++) {
+		s = &w->shard[i];
+		pthread_mutex_lock(&s->cond_mutex);
+		pthread_cond_signal(&s->cond);
+		pthread_mutex_unlock(&s->cond_mutex);
+	}
+
+	return 0;
+}
+
+
+/*
+ *	Wheel init
+ */
+timer_wheel_t *
+timer_wheel_init(timer_thread_t *t, int nr_shards)
+{
+	timer_wheel_shard_t *s;
+	timer_wheel_t *w;
+	uint64_t now = timer_wheel_now();
+	int i;
+
+	if (nr_shards < 1)
+		nr_shards = 1;
+	if (nr_shards > TIMER_WHEEL_SHARD_MAX)
+		nr_shards = TIMER_WHEEL_SHARD_MAX;
+
+	PMALLOC(w);
+	w->t = t;
+	w->nr_shards = nr_shards;
+	w->shard = MALLOC(sizeof(timer_wheel_shard_t) * nr_shards);
+
+	for (i = 0; i < nr_shards; i++) {
+		s = &w->shard[i];
+		s->wheel = w;
+		s->id = i;
+		s->clk = now;
+		pthread_mutex_init(&s->mutex, NULL);
+		pthread_mutex_init(&s->cond_mutex, NULL);
+		pthread_cond_init(&s->cond, NULL);
+		pthread_create(&s->task, NULL, timer_wheel_task, s);
+	}
+
+	return w;
+}
+
+int
+timer_wheel_destroy(timer_wheel_t *w)
+{
+	timer_thread_t *t = w->t;
+	timer_wheel_shard_t *s;
+	int i;
+
+	__set_bit(TIMER_THREAD_FL_STOP_BIT, &t->flags);
+	timer_wheel_signal(w);
+	for (i = 0; i < w->nr_shards; i++) {
+		s = &w->shard[i];
+		pthread_join(s->task, NULL);
+		pthread_mutex_destroy(&s->mutex);
+		pthread_mutex_destroy(&s->cond_mutex);
+		pthread_cond_destroy(&s->cond);
+	}
+
+	FREE(w->shard);
+	FREE(w);
+	return 0;
+}
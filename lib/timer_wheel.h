@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _TIMER_WHEEL_H
+#define _TIMER_WHEEL_H
+
+/*
+ *	Hierarchical timing wheel. Root level is 256 slots of TIMER_WHEEL_TICK,
+ *	followed by 4 cascading levels of 64 slots. Max range is 2^32 ticks.
+ *	Timers are sharded by node address, each shard owning its wheel, lock
+ *	and expiry thread.
+ */
+#define TIMER_WHEEL_TICK	(100 * 1000)	/* 100ms in TIMER_HZ units */
+#define TIMER_WHEEL_TICK_HZ	(TIMER_HZ / TIMER_WHEEL_TICK)
+#define TIMER_WHEEL_ROOT_BITS	8
+#define TIMER_WHEEL_LVL_BITS	6
+#define TIMER_WHEEL_ROOT_SIZE	(1 << TIMER_WHEEL_ROOT_BITS)
+#define TIMER_WHEEL_LVL_SIZE	(1 << TIMER_WHEEL_LVL_BITS)
+#define TIMER_WHEEL_ROOT_MASK	(TIMER_WHEEL_ROOT_SIZE - 1)
+#define TIMER_WHEEL_LVL_MASK	(TIMER_WHEEL_LVL_SIZE - 1)
+#define TIMER_WHEEL_LVL_NR	4
+#define TIMER_WHEEL_MAX_TICKS	0xffffffffULL
+#define TIMER_WHEEL_SHARD_MAX	64
+
+typedef struct _timer_wheel_shard {
+	struct _timer_wheel	*wheel;
+	hlist_head_t		root[TIMER_WHEEL_ROOT_SIZE];
+	hlist_head_t		lvl[TIMER_WHEEL_LVL_NR][TIMER_WHEEL_LVL_SIZE];
+	uint64_t		clk;		/* next tick to process */
+	pthread_mutex_t		mutex;
+	pthread_t		task;
+	pthread_cond_t		cond;
+	pthread_mutex_t		cond_mutex;
+	int			id;
+
+	/* stats */
+	uint64_t		pending;
+	uint64_t		expired;
+	uint64_t		cascaded;
+} timer_wheel_shard_t;
+
+typedef struct _timer_wheel {
+	timer_thread_t		*t;
+	int			nr_shards;
+	timer_wheel_shard_t	*shard;
+} timer_wheel_t;
+
+
+/* prototypes */
+extern void timer_wheel_node_add(timer_wheel_t *, timer_node_t *, int);
+extern int timer_wheel_node_del(timer_wheel_t *, timer_node_t *);
+extern void timer_wheel_node_expire_now(timer_wheel_t *, timer_node_t *);
+extern int timer_wheel_signal(timer_wheel_t *);
+extern timer_wheel_t *timer_wheel_init(timer_thread_t *, int);
+extern int timer_wheel_destroy(timer_wheel_t *);
+
+#endif
@@ -191,5 +191,12 @@ struct rps_opts {
 	__u16 max_id;
 } __attribute__ ((__aligned__(8)));
 
+/* GTP-C SO_REUSEPORT steering related */
+#define GTP_REUSEPORT_MAX_WORKERS	256
+struct reuseport_opts {
+	__u16 max_id;
+	__u8 shard_bits;
+} __attribute__ ((__aligned__(8)));
+
 
 #endif
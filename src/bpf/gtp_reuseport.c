@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#define KBUILD_MODNAME "gtp_reuseport"
+#include <stddef.h>
+#include <stdbool.h>
+#include <linux/in.h>
+#include <linux/types.h>
+#include <linux/udp.h>
+#include <uapi/linux/bpf.h>
+#include <bpf_endian.h>
+#include <bpf_helpers.h>
+#include "gtp.h"
+
+
+/*
+ *	MAPs
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_REUSEPORT_SOCKARRAY);
+	__uint(max_entries, GTP_REUSEPORT_MAX_WORKERS);
+	__type(key, __u32);
+	__type(value, __u64);
+} reuseport_socks SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, int);
+	__type(value, struct reuseport_opts);
+} reuseport_opts SEC(".maps");
+
+
+/*
+ *	GTP-C header helpers
+ */
+#define GTPV1_IE_IMSI			2
+#define GTPV1_CREATE_PDP_CONTEXT_REQ	16
+#define GTPV2_IE_IMSI			1
+#define GTPV2_CREATE_SESSION_REQ	32
+#define GTP_IMSI_LEN			8
+
+static __always_inline __u32
+imsi_hash(__u8 *imsi, __u16 len)
+{
+	__u32 lo, hi, hash;
+	int i;
+
+	/* Short IMSI are padded the BCD way so that trailing
+	 * garbage never contributes to the hash */
+#pragma unroll
+	for (i = 0; i < GTP_IMSI_LEN; i++) {
+		if (i >= len)
+			imsi[i] = 0xff;
+	}
+
+	__builtin_memcpy(&lo, imsi, sizeof(__u32));
+	__builtin_memcpy(&hi, imsi + sizeof(__u32), sizeof(__u32));
+	hash = lo ^ (hi * 0x9e3779b1);
+	hash ^= hash >> 16;
+	hash *= 0x45d9f3b;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static __always_inline int
+gtpc_imsi_hash(struct sk_reuseport_md *md, __u8 version, __u32 offset, __u32 *hash)
+{
+	__u8 ie[4], imsi[GTP_IMSI_LEN];
+	__u16 len = GTP_IMSI_LEN;
+
+	/* IMSI is the very first IE of initial messages in both
+	 * protocol versions. This is not mandatory, but it is what
+	 * every implementation we know of is doing. Anything else
+	 * will fallback to default kernel selection. */
+	if (bpf_skb_load_bytes(md, offset, ie, sizeof(ie)) < 0)
+		return -1;
+
+	if (version == 1) {
+		if (ie[0] != GTPV1_IE_IMSI)
+			return -1;
+		offset += 1;
+	} else {
+		if (ie[0] != GTPV2_IE_IMSI)
+			return -1;
+		len = (ie[1] << 8) | ie[2];
+		if (!len || len > GTP_IMSI_LEN)
+			return -1;
+		offset += 4;
+	}
+
+	if (bpf_skb_load_bytes(md, offset, imsi, GTP_IMSI_LEN) < 0)
+		return -1;
+
+	*hash = imsi_hash(imsi, len);
+	return 0;
+}
+
+
+/*
+ *	SO_REUSEPORT socket selection
+ *
+ * VTEID are allocated by workers with worker id encoded into
+ * shard_bits high-bits. Steering on it brings every message of a
+ * tunnel back to the worker that created it. Initial messages
+ * carry no TEID and are spread over IMSI so that a given
+ * subscriber always hits the same worker.
+ */
+SEC("sk_reuseport")
+int gtpc_reuseport(struct sk_reuseport_md *md)
+{
+	struct reuseport_opts *opts;
+	struct gtphdr gtph;
+	__u32 offset = sizeof(struct udphdr);
+	__u32 teid, key, hash;
+	__u8 version;
+	int idx = 0;
+
+	opts = bpf_map_lookup_elem(&reuseport_opts, &idx);
+	if (!opts || !opts->max_id || !opts->shard_bits || opts->shard_bits > 8)
+		return SK_PASS;
+
+	if (bpf_skb_load_bytes(md, offset, &gtph, sizeof(struct gtphdr)) < 0)
+		return SK_PASS;
+
+	version = gtph.flags >> 5;
+	teid = bpf_ntohl(gtph.teid);
+	if (version == 1) {
+		offset += (gtph.flags & 0x07) ? 12 : 8;
+	} else if (version == 2) {
+		if (!(gtph.flags & 0x08))
+			return SK_PASS;
+		offset += 12;
+	} else
+		return SK_PASS;
+
+	if (teid) {
+		key = teid >> (32 - opts->shard_bits);
+		goto select;
+	}
+
+	if (gtph.type != ((version == 1) ? GTPV1_CREATE_PDP_CONTEXT_REQ :
+					   GTPV2_CREATE_SESSION_REQ))
+		return SK_PASS;
+
+	if (gtpc_imsi_hash(md, version, offset, &hash) < 0)
+		return SK_PASS;
+	key = hash % opts->max_id;
+
+  select:
+	if (key >= opts->max_id)
+		return SK_PASS;
+
+	/* Worker socket may not be registered yet, kernel default
+	 * selection is then used */
+	bpf_sk_select_reuseport(md, &reuseport_socks, &key, 0);
+	return SK_PASS;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -29,7 +29,6 @@
 #include <ctype.h>
 #include <netdb.h>
 #include <resolv.h>
-#include <fnmatch.h>
 #include <errno.h>
 
 /* local includes */
@@ -50,6 +49,7 @@ cmd_node_t apn_node = {
 
 /* Local data */
 pthread_mutex_t gtp_apn_mutex = PTHREAD_MUTEX_INITIALIZER;
+static grace_ptr_t gtp_apn_matcher;
 
 
 
@@ -82,8 +82,11 @@ gtp_service_alloc(gtp_apn_t *apn, const char *str, int prio)
 	list_add_tail(&new->next, &apn->service_selection);
 	/* Just a few elements to be added so that is ok */
 	list_sort(&apn->service_selection, gtp_service_cmp);
+	__gtp_sched_index_rebuild(apn);
 	pthread_mutex_unlock(&apn->mutex);
 
+	/* Dynamic entries were indexed against previous selection */
+	gtp_resolv_cache_apn_flush(apn);
 	return new;
 }
 
@@ -180,6 +183,7 @@ apn_resolv_cache_realloc(gtp_apn_t *apn)
 	pthread_mutex_lock(&apn->mutex);
 	list_copy(&old_naptr, &apn->naptr);
 	list_copy(&apn->naptr, &l);
+	__gtp_sched_index_rebuild(apn);
 	pthread_mutex_unlock(&apn->mutex);
 
 	/* Release previous elements */
@@ -239,6 +243,7 @@ apn_resolv_cache_destroy(gtp_apn_t *apn)
 {
 	apn_resolv_cache_signal(apn);
 	pthread_join(apn->cache_task, NULL);
+	gtp_sched_index_destroy(apn);
 	gtp_naptr_destroy(&apn->naptr);
 	return 0;
 }
@@ -247,74 +252,89 @@ apn_resolv_cache_destroy(gtp_apn_t *apn)
 /*
  *	Static IP Pool related
  */
-static gtp_ip_pool_t *
-gtp_ip_pool_alloc(uint32_t network, uint32_t netmask)
+uint32_t
+gtp_ip_pool_get(gtp_apn_t *apn, int shard)
 {
-	gtp_ip_pool_t *new;
+	gtp_ip_pool_t *ip_pool = apn->ip_pool;
+	uint64_t idx;
 
-	PMALLOC(new);
-	if (!new)
-		return NULL;
-	new->network = network;
-	new->netmask = netmask;
-	new->lease = (bool *) MALLOC(ntohl(~netmask) * sizeof(bool));
-	new->next_lease_idx = 10;
+	if (!ip_pool)
+		return 0;
 
-	return new;
+	if (gtp_ip_pool_lease(ip_pool, shard, &idx) < 0)
+		return 0;
+
+	return gtp_ip_pool_addr(ip_pool, idx);
 }
 
-static void
-gtp_ip_pool_destroy(gtp_ip_pool_t *ip_pool)
+int
+gtp_ip_pool_put(gtp_apn_t *apn, int shard, uint32_t addr_ip)
 {
-	if (!ip_pool)
-		return;
+	gtp_ip_pool_t *ip_pool = apn->ip_pool;
+	uint64_t idx;
+
+	if (!ip_pool || !addr_ip)
+		return 0;
 
-	FREE(ip_pool->lease);
-	FREE(ip_pool);
+	if (gtp_ip_pool_addr_idx(ip_pool, addr_ip, &idx) < 0)
+		return -1;
+
+	return gtp_ip_pool_release(ip_pool, shard, idx);
 }
 
-uint32_t
-gtp_ip_pool_get(gtp_apn_t *apn)
+int
+gtp_ip_pool_restore(gtp_apn_t *apn, uint32_t addr_ip)
 {
 	gtp_ip_pool_t *ip_pool = apn->ip_pool;
-	int idx;
+	uint64_t idx;
 
-	if (!ip_pool)
-		return 0;
+	if (!ip_pool || gtp_ip_pool_addr_idx(ip_pool, addr_ip, &idx) < 0)
+		return -1;
 
-	/* fast-path */
-	idx = ip_pool->next_lease_idx;
-	if (!ip_pool->lease[idx])
-		goto match;
+	return gtp_ip_pool_reserve(ip_pool, idx);
+}
 
-	/* slow-path */
-	for (idx = 10; idx < ntohl(~ip_pool->netmask)-10; idx++) {
-		if (!ip_pool->lease[idx]) {
-			goto match;
-		}
-	}
+int
+gtp_ip6_pool_get(gtp_apn_t *apn, int shard, struct in6_addr *prefix)
+{
+	gtp_ip_pool_t *ip_pool = apn->ip6_pool;
+	uint64_t idx;
 
-	return 0;
+	if (!ip_pool)
+		return -1;
 
-  match:
-	ip_pool->lease[idx] = true;
-	ip_pool->next_lease_idx = idx + 1;
-	return htonl(ntohl(ip_pool->network) + idx);
+	if (gtp_ip_pool_lease(ip_pool, shard, &idx) < 0)
+		return -1;
+
+	gtp_ip6_pool_prefix(ip_pool, idx, prefix);
+	return 0;
 }
 
 int
-gtp_ip_pool_put(gtp_apn_t *apn, uint32_t addr_ip)
+gtp_ip6_pool_put(gtp_apn_t *apn, int shard, struct in6_addr *prefix)
 {
-	gtp_ip_pool_t *ip_pool = apn->ip_pool;
-	int idx;
+	gtp_ip_pool_t *ip_pool = apn->ip6_pool;
+	uint64_t idx;
 
-	if (!ip_pool)
+	if (!ip_pool || IN6_IS_ADDR_UNSPECIFIED(prefix))
 		return 0;
 
-	idx = ntohl(addr_ip & ~ip_pool->network);
-	ip_pool->lease[idx] = false;
-	ip_pool->next_lease_idx = idx;
-	return 0;
+	if (gtp_ip6_pool_prefix_idx(ip_pool, prefix, &idx) < 0)
+		return -1;
+
+	return gtp_ip_pool_release(ip_pool, shard, idx);
+}
+
+int
+gtp_ip6_pool_restore(gtp_apn_t *apn, struct in6_addr *prefix)
+{
+	gtp_ip_pool_t *ip_pool = apn->ip6_pool;
+	uint64_t idx;
+
+	if (!ip_pool || gtp_ip6_pool_prefix_idx(ip_pool, prefix, &idx) < 0)
+		return -1;
+
+	return gtp_ip_pool_reserve(ip_pool, idx);
 }
 
 /*
@@ -353,6 +373,71 @@ gtp_pco_destroy(gtp_pco_t *pco)
 /*
  *	APN related
  */
+void
+gtp_apn_tpl_invalidate(gtp_apn_t *apn)
+{
+	/* Response template will be rebuilt on next use */
+	__sync_add_and_fetch(&apn->tpl_gen, 1);
+}
+
+static void
+gtp_apn_tpl_release(grace_obj_t *obj)
+{
+	FREE(container_of(obj, gtp_apn_tpl_t, gp));
+}
+
+/* Publishers are serialized by tpl_building */
+void
+gtp_apn_tpl_publish(gtp_apn_t *apn, gtp_apn_tpl_t *tpl)
+{
+	grace_ptr_publish(&apn->tpl, (tpl) ? &tpl->gp : NULL
+				   , gtp_apn_tpl_release);
+}
+
+/*
+ *	APN matcher snapshot
+ */
+static void
+gtp_apn_matcher_release(grace_obj_t *obj)
+{
+	gtp_apn_match_free(container_of(obj, gtp_apn_match_t, gp));
+}
+
+static void
+__gtp_apn_matcher_publish(gtp_apn_match_t *m)
+{
+	grace_ptr_publish(&gtp_apn_matcher, (m) ? &m->gp : NULL
+					  , gtp_apn_matcher_release);
+}
+
+/* Must be called under gtp_apn_mutex */
+static int
+__gtp_apn_matcher_rebuild(void)
+{
+	gtp_apn_match_t *m;
+
+	m = gtp_apn_match_build(&daemon_data->gtp_apn);
+	if (!m)
+		return -1;
+
+	__gtp_apn_matcher_publish(m);
+	return 0;
+}
+
+static gtp_apn_match_t *
+gtp_apn_matcher_get(void)
+{
+	grace_obj_t *obj = grace_ptr_get(&gtp_apn_matcher);
+
+	return (obj) ? container_of(obj, gtp_apn_match_t, gp) : NULL;
+}
+
+static void
+gtp_apn_matcher_put(gtp_apn_match_t *m)
+{
+	grace_ptr_put(&m->gp);
+}
+
 static gtp_apn_t *
 gtp_apn_alloc(const char *name)
 {
@@ -366,10 +451,12 @@ gtp_apn_alloc(const char *name)
 	INIT_LIST_HEAD(&new->next);
         pthread_mutex_init(&new->mutex, NULL);
 	bsd_strlcpy(new->name, name, GTP_APN_MAX_LEN - 1);
+	gtp_apn_tpl_invalidate(new);
 
 	/* FIXME: lookup before insert */
 	pthread_mutex_lock(&gtp_apn_mutex);
 	list_add_tail(&new->next, &daemon_data->gtp_apn);
+	__gtp_apn_matcher_rebuild();
 	pthread_mutex_unlock(&gtp_apn_mutex);
 
 	/* Point default pGW to list head */
@@ -394,13 +481,18 @@ gtp_apn_destroy(void)
 	gtp_apn_t *apn, *_apn;
 
 	pthread_mutex_lock(&gtp_apn_mutex);
+	__gtp_apn_matcher_publish(NULL);
 	list_for_each_entry_safe(apn, _apn, l, next) {
 		gtp_service_destroy(apn);
+		gtp_rewrite_trie_destroy(apn);
 		gtp_rewrite_rule_destroy(apn, &apn->imsi_match);
 		gtp_rewrite_rule_destroy(apn, &apn->oi_match);
 		gtp_ip_pool_destroy(apn->ip_pool);
+		gtp_ip_pool_destroy(apn->ip6_pool);
 		gtp_pco_destroy(apn->pco);
+		gtp_apn_tpl_publish(apn, NULL);
 		apn_resolv_cache_destroy(apn);
+		gtp_resolv_cache_apn_flush(apn);
 		list_head_del(&apn->next);
 		FREE(apn);
 	}
@@ -412,19 +504,29 @@ gtp_apn_destroy(void)
 gtp_apn_t *
 gtp_apn_get(const char *name)
 {
+	gtp_apn_match_t *m;
 	gtp_apn_t *apn;
 
-	pthread_mutex_lock(&gtp_apn_mutex);
-	list_for_each_entry(apn, &daemon_data->gtp_apn, next) {
-		if (!fnmatch(apn->name, name, 0)) {
-			pthread_mutex_unlock(&gtp_apn_mutex);
-			return apn;
-		}
+	m = gtp_apn_matcher_get();
+	if (!m)
+		return NULL;
 
-	}
-	pthread_mutex_unlock(&gtp_apn_mutex);
+	apn = gtp_apn_match_lookup(m, name);
+	gtp_apn_matcher_put(m);
+	return apn;
+}
 
-	return NULL;
+static void
+gtp_apn_ip_pool_show(vty_t *vty, gtp_apn_t *apn)
+{
+	if (!apn->ip_pool && !apn->ip6_pool)
+		return;
+
+	vty_out(vty, "Access-Point-Name %s%s", apn->name, VTY_NEWLINE);
+	if (apn->ip_pool)
+		gtp_ip_pool_vty(vty, apn->ip_pool);
+	if (apn->ip6_pool)
+		gtp_ip_pool_vty(vty, apn->ip6_pool);
 }
 
 static int
@@ -435,12 +537,15 @@ gtp_apn_show(vty_t *vty, gtp_apn_t *apn)
 
 	if (apn) {
 		gtp_naptr_show(vty, apn);
+		gtp_apn_ip_pool_show(vty, apn);
 		return 0;
 	}
 
 	pthread_mutex_lock(&gtp_apn_mutex);
-	list_for_each_entry(_apn, l, next)
+	list_for_each_entry(_apn, l, next) {
 		gtp_naptr_show(vty, _apn);
+		gtp_apn_ip_pool_show(vty, _apn);
+	}
 	pthread_mutex_unlock(&gtp_apn_mutex);
 
 	return 0;
@@ -723,6 +828,7 @@ DEFUN(apn_imsi_match,
 	stringtohex(argv[1], 15, rule->rewrite, GTP_MATCH_MAX_LEN);
 	swapbuffer((uint8_t *)rule->rewrite, 8, (uint8_t *)rule->rewrite);
 	rule->rewrite_len = strlen(argv[1]);
+	gtp_rewrite_trie_rebuild(apn, GTP_REWRITE_IMSI);
 
 	return CMD_SUCCESS;
 }
@@ -757,7 +863,10 @@ DEFUN(apn_oi_match,
 
 	rule = gtp_rewrite_rule_alloc(apn, &apn->oi_match);
 	strncpy(rule->match, argv[0], GTP_MATCH_MAX_LEN-1);
+	rule->match_len = strlen(rule->match);
 	strncpy(rule->rewrite, argv[1], GTP_MATCH_MAX_LEN-1);
+	rule->rewrite_len = strlen(rule->rewrite);
+	gtp_rewrite_trie_rebuild(apn, GTP_REWRITE_OI);
 
 	return CMD_SUCCESS;
 }
@@ -819,6 +928,7 @@ DEFUN(apn_restriction,
 	VTY_GET_INTEGER_RANGE("restriction", value, argv[0], 0, 255);
 	apn->restriction = value;
 
+	gtp_apn_tpl_invalidate(apn);
 	return CMD_SUCCESS;
 }
 
@@ -928,6 +1038,7 @@ DEFUN(apn_indication_flags,
 	}
 
 	__set_bit(fl, &apn->indication_flags);
+	gtp_apn_tpl_invalidate(apn);
 	return CMD_SUCCESS;
 }
 
@@ -965,6 +1076,7 @@ DEFUN(apn_pco_ipcp_primary_ns,
 	}
 
 	__set_bit(GTP_PCO_IPCP_PRIMARY_NS, &pco->flags);
+	gtp_apn_tpl_invalidate(apn);
 	return CMD_SUCCESS;
 }
 
@@ -1002,6 +1114,7 @@ DEFUN(apn_pco_ipcp_secondary_ns,
 	}
 
 	__set_bit(GTP_PCO_IPCP_SECONDARY_NS, &pco->flags);
+	gtp_apn_tpl_invalidate(apn);
 	return CMD_SUCCESS;
 }
 
@@ -1086,6 +1199,7 @@ DEFUN(apn_pco_ip_ns,
 	list_add_tail(&new->next, &pco->ns);
 
 	__set_bit(GTP_PCO_IP_NS, &pco->flags);
+	gtp_apn_tpl_invalidate(apn);
 	return CMD_SUCCESS;
 }
 
@@ -1112,6 +1226,7 @@ DEFUN(apn_pco_ip_link_mtu,
 
 	pco->link_mtu = strtoul(argv[0], NULL, 10);
 
+	gtp_apn_tpl_invalidate(apn);
 	return CMD_SUCCESS;
 }
 
@@ -1137,6 +1252,7 @@ DEFUN(apn_pco_selected_bearer_control_mode,
 
 	pco->selected_bearer_control_mode = strtoul(argv[0], NULL, 10);
 
+	gtp_apn_tpl_invalidate(apn);
 	return CMD_SUCCESS;
 }
 
@@ -1166,6 +1282,59 @@ DEFUN(apn_pdn_address_allocation_pool,
 	inet_ston(argv[0], &network);
 	inet_ston(argv[1], &netmask);
 	apn->ip_pool = gtp_ip_pool_alloc(network, netmask);
+	if (!apn->ip_pool) {
+		vty_out(vty, "%% Unable to allocate IP Pool%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(apn_pdn_address_allocation_pool6,
+      apn_pdn_address_allocation_pool6_cmd,
+      "pdn-address-allocation-pool6 local prefix STRING",
+      "PDN IPv6 Prefix Allocation Pool\n"
+      "locally configured\n"
+      "Prefix\n"
+      "IPv6 Prefix X:X::X:X/M, one /64 per PDN\n")
+{
+	gtp_apn_t *apn = vty->index;
+	struct in6_addr prefix;
+	char addr_str[INET6_ADDRSTRLEN];
+	char *slash;
+	int plen;
+
+	if (argc < 1) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (apn->ip6_pool) {
+		vty_out(vty, "%% IPv6 Pool already configured%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	bsd_strlcpy(addr_str, argv[0], sizeof(addr_str));
+	slash = strchr(addr_str, '/');
+	if (!slash) {
+		vty_out(vty, "%% missing prefix length%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+	*slash++ = '\0';
+
+	plen = strtoul(slash, NULL, 10);
+	if (inet_pton(AF_INET6, addr_str, &prefix) != 1 ||
+	    plen < GTP_IP_POOL_V6_MIN_PLEN || plen > 64) {
+		vty_out(vty, "%% invalid prefix %s (length must be in [%d..64])%s"
+			   , argv[0], GTP_IP_POOL_V6_MIN_PLEN, VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	apn->ip6_pool = gtp_ip6_pool_alloc(&prefix, plen);
+	if (!apn->ip6_pool) {
+		vty_out(vty, "%% Unable to allocate IPv6 Pool%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
 
 	return CMD_SUCCESS;
 }
@@ -1274,6 +1443,7 @@ apn_config_write(vty_t *vty)
 {
         list_head_t *l = &daemon_data->gtp_apn;
         gtp_apn_t *apn;
+	char addr_str[INET6_ADDRSTRLEN];
 
         list_for_each_entry(apn, l, next) {
         	vty_out(vty, "access-point-name %s%s", apn->name, VTY_NEWLINE);
@@ -1319,6 +1489,12 @@ apn_config_write(vty_t *vty)
 				   , NIPQUAD(apn->ip_pool->network)
 				   , NIPQUAD(apn->ip_pool->netmask)
 				   , VTY_NEWLINE);
+		if (apn->ip6_pool)
+			vty_out(vty, " pdn-address-allocation-pool6 local prefix %s/%u%s"
+				   , inet_ntop(AF_INET6, &apn->ip6_pool->prefix
+						      , addr_str, sizeof(addr_str))
+				   , apn->ip6_pool->prefix_len
+				   , VTY_NEWLINE);
 		if (apn->vrf)
 			vty_out(vty, " ip vrf forwarding %s%s"
 				   , apn->vrf->name
@@ -1365,6 +1541,7 @@ gtp_apn_vty_init(void)
 	install_element(APN_NODE, &apn_pco_ip_link_mtu_cmd);
 	install_element(APN_NODE, &apn_pco_selected_bearer_control_mode_cmd);
 	install_element(APN_NODE, &apn_pdn_address_allocation_pool_cmd);
+	install_element(APN_NODE, &apn_pdn_address_allocation_pool6_cmd);
 	install_element(APN_NODE, &apn_ip_vrf_forwarding_cmd);
 	install_element(APN_NODE, &apn_gtp_session_uniq_ptype_cmd);
 
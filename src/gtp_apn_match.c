@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <string.h>
+#include <fnmatch.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/*
+ *	Label trie
+ */
+static gtp_apn_match_node_t *
+gtp_apn_match_child(gtp_apn_match_node_t *node, const char *label, size_t len)
+{
+	gtp_apn_match_node_t *n;
+
+	for (n = node->child; n; n = n->sibling) {
+		if (!strncmp(n->label, label, len) && !n->label[len])
+			return n;
+	}
+
+	return NULL;
+}
+
+static gtp_apn_match_node_t *
+gtp_apn_match_child_add(gtp_apn_match_node_t *node, const char *label, size_t len)
+{
+	gtp_apn_match_node_t *n = gtp_apn_match_child(node, label, len);
+
+	if (n)
+		return n;
+
+	PMALLOC(n);
+	n->label = MALLOC(len + 1);
+	memcpy(n->label, label, len);
+	n->sibling = node->child;
+	node->child = n;
+	return n;
+}
+
+static void
+gtp_apn_match_node_free(gtp_apn_match_node_t *node)
+{
+	gtp_apn_match_node_t *n, *next;
+
+	for (n = node->child; n; n = next) {
+		next = n->sibling;
+		gtp_apn_match_node_free(n);
+	}
+
+	if (node->pattern)
+		FREE(node->pattern);
+	if (node->label)
+		FREE(node->label);
+	FREE(node);
+}
+
+static const char *
+gtp_apn_match_last_meta(const char *pattern)
+{
+	const char *cp, *last = NULL;
+
+	for (cp = pattern; (cp = strpbrk(cp, GTP_APN_MATCH_META)); cp++)
+		last = cp;
+
+	return last;
+}
+
+/* Only labels fully inside the literal suffix are indexed */
+static void
+gtp_apn_match_pattern_add(gtp_apn_match_t *m, const char *meta, uint32_t idx)
+{
+	gtp_apn_match_node_t *node = m->root;
+	const char *first = strchr(meta, '.'), *end, *dot;
+
+	if (first) {
+		end = first + strlen(first);
+		while (end > first) {
+			dot = memrchr(first, '.', end - first);
+			node = gtp_apn_match_child_add(node, dot + 1, end - dot - 1);
+			end = dot;
+		}
+	}
+
+	node->pattern = REALLOC(node->pattern, (node->nr_pattern + 1) * sizeof(uint32_t));
+	node->pattern[node->nr_pattern++] = idx;
+	m->nr_pattern++;
+}
+
+static bool
+gtp_apn_match_node_lookup(gtp_apn_match_t *m, gtp_apn_match_node_t *node,
+			  const char *name, uint32_t *best)
+{
+	uint32_t i, idx;
+
+	for (i = 0; i < node->nr_pattern; i++) {
+		idx = node->pattern[i];
+		if (idx >= *best)
+			return false;
+
+		if (!fnmatch(m->apn[idx]->name, name, 0)) {
+			*best = idx;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ *	Exact names
+ */
+static uint32_t
+gtp_apn_match_hash(gtp_apn_match_t *m, const char *name)
+{
+	return jhash_oaat((ub1 *) name, strlen(name)) & m->exact_mask;
+}
+
+static void
+gtp_apn_match_exact_add(gtp_apn_match_t *m, const char *name, uint32_t idx)
+{
+	gtp_apn_match_exact_t **head = &m->exact[gtp_apn_match_hash(m, name)];
+	gtp_apn_match_exact_t *e;
+
+	/* Duplicate name: first one wins */
+	for (e = *head; e; e = e->next) {
+		if (!strcmp(e->name, name))
+			return;
+	}
+
+	e = &m->exact_entry[m->nr_exact++];
+	e->name = name;
+	e->idx = idx;
+	e->next = *head;
+	*head = e;
+}
+
+
+/*
+ *	Snapshot
+ */
+gtp_apn_match_t *
+gtp_apn_match_build(list_head_t *l)
+{
+	gtp_apn_match_t *m;
+	gtp_apn_t *apn;
+	const char *meta;
+	uint32_t i = 0, size = 16;
+
+	PMALLOC(m);
+	list_for_each_entry(apn, l, next)
+		m->nr_apn++;
+	while (size < 2 * m->nr_apn)
+		size <<= 1;
+
+	m->apn = MALLOC((m->nr_apn + 1) * sizeof(gtp_apn_t *));
+	m->exact = MALLOC(size * sizeof(gtp_apn_match_exact_t *));
+	m->exact_entry = MALLOC((m->nr_apn + 1) * sizeof(gtp_apn_match_exact_t));
+	m->exact_mask = size - 1;
+	PMALLOC(m->root);
+
+	list_for_each_entry(apn, l, next) {
+		m->apn[i] = apn;
+		meta = gtp_apn_match_last_meta(apn->name);
+		if (meta)
+			gtp_apn_match_pattern_add(m, meta, i);
+		else
+			gtp_apn_match_exact_add(m, apn->name, i);
+		i++;
+	}
+
+	return m;
+}
+
+void
+gtp_apn_match_free(gtp_apn_match_t *m)
+{
+	if (!m)
+		return;
+
+	gtp_apn_match_node_free(m->root);
+	FREE(m->exact_entry);
+	FREE(m->exact);
+	FREE(m->apn);
+	FREE(m);
+}
+
+gtp_apn_t *
+gtp_apn_match_lookup(gtp_apn_match_t *m, const char *name)
+{
+	gtp_apn_match_node_t *node = m->root;
+	gtp_apn_match_exact_t *e;
+	uint32_t best = m->nr_apn;
+	const char *end, *dot;
+
+	for (e = m->exact[gtp_apn_match_hash(m, name)]; e; e = e->next) {
+		if (!strcmp(e->name, name)) {
+			best = e->idx;
+			break;
+		}
+	}
+
+	if (!m->nr_pattern)
+		goto end;
+
+	/* Walk labels right to left, every visited node may match */
+	gtp_apn_match_node_lookup(m, node, name, &best);
+	end = name + strlen(name);
+	while (node->child) {
+		dot = memrchr(name, '.', end - name);
+		if (!dot)
+			break;
+
+		node = gtp_apn_match_child(node, dot + 1, end - dot - 1);
+		if (!node)
+			break;
+
+		gtp_apn_match_node_lookup(m, node, name, &best);
+		end = dot;
+	}
+
+  end:
+	return (best < m->nr_apn) ? m->apn[best] : NULL;
+}
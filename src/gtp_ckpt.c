@@ -0,0 +1,1204 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/* Extern data */
+extern data_t *daemon_data;
+
+/* Local data */
+static gtp_ckpt_t *gtp_ckpt;
+
+#define GTP_CKPT_TEID_FL_MASK	((1UL << GTP_TEID_FL_HASHED) | \
+				 (1UL << GTP_TEID_FL_VTEID_HASHED) | \
+				 (1UL << GTP_TEID_FL_VSQN_HASHED) | \
+				 (1UL << GTP_TEID_FL_INGRESS) | \
+				 (1UL << GTP_TEID_FL_EGRESS) | \
+				 (1UL << GTP_TEID_FL_FWD) | \
+				 (1UL << GTP_TEID_FL_RT) | \
+				 (1UL << GTP_TEID_FL_XDP_SET))
+#define GTP_CKPT_TEID_FL_RESTORE ((1UL << GTP_TEID_FL_INGRESS) | \
+				  (1UL << GTP_TEID_FL_EGRESS) | \
+				  (1UL << GTP_TEID_FL_FWD) | \
+				  (1UL << GTP_TEID_FL_RT))
+#define GTP_CKPT_REC_ALIGN(X)	(((X) + 7) & ~7UL)
+
+
+/*
+ *	Mapped log file
+ */
+static uint64_t
+gtp_ckpt_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void
+gtp_ckpt_log_close(gtp_ckpt_log_t *log)
+{
+	if (!log)
+		return;
+
+	munmap(log->base, log->size);
+	close(log->fd);
+	FREE(log);
+}
+
+static gtp_ckpt_log_t *
+gtp_ckpt_log_map(const char *path, uint64_t size, bool create)
+{
+	gtp_ckpt_log_t *log;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDWR | ((create) ? O_CREAT | O_TRUNC : 0), 0600);
+	if (fd < 0)
+		return NULL;
+
+	if (create && ftruncate(fd, size) < 0)
+		goto err;
+
+	if (!create) {
+		if (fstat(fd, &st) < 0 || st.st_size < GTP_CKPT_HDR_SIZE)
+			goto err;
+		size = st.st_size;
+	}
+
+	PMALLOC(log);
+	if (!log)
+		goto err;
+	strncpy(log->path, path, GTP_STR_MAX_LEN - 1);
+	log->fd = fd;
+	log->size = size;
+	log->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (log->base == MAP_FAILED) {
+		FREE(log);
+		goto err;
+	}
+	log->hdr = (gtp_ckpt_hdr_t *) log->base;
+
+	if (create) {
+		log->hdr->magic = GTP_CKPT_MAGIC;
+		log->hdr->version = GTP_CKPT_VERSION;
+		log->hdr->restart_counter = daemon_data->restart_counter;
+		log->hdr->size = size;
+		log->hdr->tail = GTP_CKPT_HDR_SIZE;
+		log->hdr->sync_time = time(NULL);
+	}
+
+	return log;
+
+  err:
+	close(fd);
+	return NULL;
+}
+
+static void
+gtp_ckpt_log_sync(gtp_ckpt_log_t *log, int flags)
+{
+	log->hdr->restart_counter = daemon_data->restart_counter;
+	log->hdr->sync_time = time(NULL);
+	msync(log->base, log->hdr->tail, flags);
+}
+
+/* Caller holds append mutex */
+static int
+__gtp_ckpt_log_append(gtp_ckpt_log_t *log, int type, void *data, uint32_t len)
+{
+	uint64_t off = log->hdr->tail;
+	uint64_t need = sizeof(gtp_ckpt_rec_t) + GTP_CKPT_REC_ALIGN(len);
+	gtp_ckpt_rec_t *rec;
+
+	/* Keep room for end marker */
+	if (off + need + sizeof(gtp_ckpt_rec_t) > log->size) {
+		log->hdr->flags |= GTP_CKPT_HDR_FL_OVERFLOW;
+		return -1;
+	}
+
+	/* End marker: zeroed record header following this one, so replay
+	 * never parses stale bytes past tail */
+	memset(log->base + off + need, 0, sizeof(gtp_ckpt_rec_t));
+
+	rec = (gtp_ckpt_rec_t *) (log->base + off);
+	memcpy(rec + 1, data, len);
+	rec->len = len;
+	rec->crc = adler_crc32(data, len);
+
+	/* Payload first, type makes record visible */
+	__sync_synchronize();
+	rec->type = type;
+	log->hdr->tail = off + need;
+	return 0;
+}
+
+static int
+gtp_ckpt_append(gtp_ckpt_t *r, int type, void *data, uint32_t len)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&r->mutex);
+	if (!__test_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags)) {
+		pthread_mutex_unlock(&r->mutex);
+		return -1;
+	}
+
+	/* Both logs are fed while compaction is running so that
+	 * current one stays complete until switchover */
+	if (r->log)
+		err |= __gtp_ckpt_log_append(r->log, type, data, len);
+	if (r->next)
+		err |= __gtp_ckpt_log_append(r->next, type, data, len);
+	r->appended++;
+	r->appended_bytes += len;
+	if (err)
+		r->overflow++;
+	pthread_mutex_unlock(&r->mutex);
+
+	if (err)
+		pthread_cond_signal(&r->cond);
+	return err;
+}
+
+
+/*
+ *	Session image
+ */
+static int
+gtp_ckpt_srv_type(gtp_server_t *srv, char *name, size_t size)
+{
+	gtp_switch_t *sw;
+	gtp_router_t *rt;
+
+	if (srv->init == gtp_router_ingress_init) {
+		rt = srv->ctx;
+		bsd_strlcpy(name, rt->name, size);
+		return GTP_CKPT_SRV_ROUTER;
+	}
+
+	sw = srv->ctx;
+	bsd_strlcpy(name, sw->name, size);
+	return (srv == &sw->gtpc_egress) ? GTP_CKPT_SRV_SWITCH_EGRESS : GTP_CKPT_SRV_SWITCH;
+}
+
+static uint16_t
+gtp_ckpt_teid_index(gtp_teid_t **t, int n, gtp_teid_t *teid)
+{
+	int i;
+
+	for (i = 0; teid && i < n; i++) {
+		if (t[i] == teid)
+			return i;
+	}
+
+	return GTP_CKPT_NONE;
+}
+
+static void
+gtp_ckpt_teid_image(gtp_ckpt_teid_t *img, gtp_teid_t *teid, gtp_teid_t **t, int n)
+{
+	img->id = teid->id;
+	img->vid = teid->vid;
+	img->ipv4 = teid->ipv4;
+	img->sqn = teid->sqn;
+	img->vsqn = teid->vsqn;
+	img->flags = teid->flags & GTP_CKPT_TEID_FL_MASK;
+	img->version = teid->version;
+	img->type = teid->type;
+	img->bearer_id = teid->bearer_id;
+	img->family = teid->family;
+	img->peer = gtp_ckpt_teid_index(t, n, teid->peer_teid);
+	img->bearer = gtp_ckpt_teid_index(t, n, teid->bearer_teid);
+	img->sgw_addr = teid->sgw_addr.sin_addr.s_addr;
+	img->sgw_port = teid->sgw_addr.sin_port;
+	img->pgw_addr = teid->pgw_addr.sin_addr.s_addr;
+	img->pgw_port = teid->pgw_addr.sin_port;
+}
+
+/* Caller holds session_mutex */
+int
+gtp_ckpt_session_image(gtp_session_t *s, gtp_ckpt_session_t *img)
+{
+	gtp_teid_t *t[GTP_CKPT_TEID_MAX], *teid;
+	gtp_path_t *p = s->path;
+	int n = 0, nr = 0, i;
+
+	/* PPPoE sessions rely on BRAS side state, not restorable */
+	if (!s->w || s->s_pppoe)
+		return -1;
+
+	memset(img, 0, sizeof(*img));
+	img->key.imsi = s->conn->imsi;
+	img->key.id = s->id;
+	img->srv = gtp_ckpt_srv_type(s->w->srv, img->ctx, GTP_NAME_MAX_LEN);
+	img->worker = s->w->id;
+	bsd_strlcpy(img->apn, s->apn->name, GTP_APN_MAX_LEN);
+	img->ptype = s->ptype;
+	img->ipv4 = s->ipv4;
+	img->ipv4_lease = s->ipv4_lease;
+	img->ipv6_prefix = s->ipv6_prefix;
+	img->charging_id = s->charging_id;
+	img->mei = s->mei;
+	img->msisdn = s->msisdn;
+	img->creation_time = s->creation_time;
+	img->expire = (timerisset(&s->t_node.sands)) ? s->t_node.sands.tv_sec : 0;
+	img->sgw_addr = s->conn->sgw_addr.sin_addr.s_addr;
+	img->sgw_port = s->conn->sgw_addr.sin_port;
+	if (p) {
+		img->path_addr = p->addr.sin_addr.s_addr;
+		img->path_port = p->addr.sin_port;
+		img->path_version = p->version;
+		img->path_recovery = p->recovery;
+		img->path_has_recovery = __test_bit(GTP_PATH_FL_RECOVERY_BIT, &p->flags);
+	}
+
+	/* GTP-C then GTP-U, links are stored as image index */
+	list_for_each_entry(teid, &s->gtpc_teid, next) {
+		if (nr++ < GTP_CKPT_TEID_MAX)
+			t[n++] = teid;
+	}
+	img->nr_gtpc = n;
+	list_for_each_entry(teid, &s->gtpu_teid, next) {
+		if (nr++ < GTP_CKPT_TEID_MAX)
+			t[n++] = teid;
+	}
+	img->nr_gtpu = n - img->nr_gtpc;
+
+	if (nr > n)
+		log_message(LOG_INFO, "%s(): IMSI:%ld session-id:0x%.8x has %d TEIDs,"
+				      " image truncated to %d"
+				    , __FUNCTION__, img->key.imsi, img->key.id, nr, n);
+
+	for (i = 0; i < n; i++)
+		gtp_ckpt_teid_image(&img->teid[i], t[i], t, n);
+
+	return sizeof(gtp_ckpt_session_t) + n * sizeof(gtp_ckpt_teid_t);
+}
+
+int
+gtp_ckpt_session_put(gtp_session_t *s)
+{
+	uint8_t buffer[GTP_CKPT_IMAGE_MAX];
+	gtp_ckpt_session_t *img = (gtp_ckpt_session_t *) buffer;
+	gtp_ckpt_t *r = gtp_ckpt;
+	gtp_conn_t *c = s->conn;
+	bool ckpt = r && __test_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags);
+	int len;
+
+	if (!ckpt && !gtp_repl_running())
+		return -1;
+
+	/* Image and append are serialized per conn with compaction
+	 * and replication resync. Session handled locally is ours
+	 * from now on, even if replicated from peer at first. */
+	pthread_mutex_lock(&c->session_mutex);
+	__clear_bit(GTP_SESSION_FL_REPLICA_BIT, &s->flags);
+	len = gtp_ckpt_session_image(s, img);
+	if (len > 0) {
+		if (ckpt)
+			gtp_ckpt_append(r, GTP_CKPT_REC_SESSION, img, len);
+		gtp_repl_send(GTP_CKPT_REC_SESSION, img, len);
+	}
+	pthread_mutex_unlock(&c->session_mutex);
+	return 0;
+}
+
+/* Caller holds session_mutex */
+int
+gtp_ckpt_session_del(gtp_session_t *s)
+{
+	gtp_ckpt_t *r = gtp_ckpt;
+	gtp_ckpt_key_t key = { .imsi = s->conn->imsi, .id = s->id };
+
+	/* Sessions released on shutdown are kept in checkpoint and
+	 * on replication peer */
+	if (__test_bit(GTP_FL_STOP_BIT, &daemon_data->flags))
+		return -1;
+
+	/* Peer owns replicas, their local expiration is not news */
+	if (!__test_bit(GTP_SESSION_FL_REPLICA_BIT, &s->flags))
+		gtp_repl_send(GTP_CKPT_REC_SESSION_DEL, &key, sizeof(key));
+
+	if (!r || !__test_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags))
+		return -1;
+
+	return gtp_ckpt_append(r, GTP_CKPT_REC_SESSION_DEL, &key, sizeof(key));
+}
+
+/*
+ *	Compaction
+ */
+int
+gtp_ckpt_imsi_iter(void *value, void *arg)
+{
+	gtp_ckpt_imsi_t *list = arg;
+	gtp_conn_t *c = value;
+	uint64_t *imsi;
+
+	if (list->nr == list->max) {
+		imsi = REALLOC(list->imsi, (list->max + 4096) * sizeof(uint64_t));
+		if (!imsi)
+			return -1;
+		list->imsi = imsi;
+		list->max += 4096;
+	}
+
+	list->imsi[list->nr++] = c->imsi;
+	return 0;
+}
+
+static void
+gtp_ckpt_compact_conn(gtp_ckpt_t *r, gtp_ckpt_log_t *next, gtp_conn_t *c)
+{
+	uint8_t buffer[GTP_CKPT_IMAGE_MAX];
+	gtp_ckpt_session_t *img = (gtp_ckpt_session_t *) buffer;
+	gtp_session_t *s;
+	int len;
+
+	pthread_mutex_lock(&c->session_mutex);
+	list_for_each_entry(s, &c->gtp_sessions, next) {
+		len = gtp_ckpt_session_image(s, img);
+		if (len < 0)
+			continue;
+
+		pthread_mutex_lock(&r->mutex);
+		__gtp_ckpt_log_append(next, GTP_CKPT_REC_SESSION, img, len);
+		pthread_mutex_unlock(&r->mutex);
+	}
+	pthread_mutex_unlock(&c->session_mutex);
+}
+
+/* Rewrite live sessions into a fresh log, then atomically replace
+ * current one. Session updates hitting meanwhile are written to
+ * both logs, per conn ordering is kept by session_mutex. */
+static int
+gtp_ckpt_compact(gtp_ckpt_t *r)
+{
+	char tmp[GTP_STR_MAX_LEN + 8];
+	gtp_ckpt_imsi_t list = { 0 };
+	gtp_ckpt_log_t *next, *old;
+	gtp_conn_t *c;
+	uint32_t i;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", r->path);
+	next = gtp_ckpt_log_map(tmp, r->size, true);
+	if (!next) {
+		log_message(LOG_INFO, "%s(): unable to create checkpoint file %s (%m)"
+				    , __FUNCTION__, tmp);
+		return -1;
+	}
+
+	pthread_mutex_lock(&r->mutex);
+	next->hdr->generation = (r->log) ? r->log->hdr->generation + 1 : 1;
+	r->next = next;
+	pthread_mutex_unlock(&r->mutex);
+
+	/* Conns showing up after this point are fully written
+	 * through dual append */
+	gtp_conn_iterate(gtp_ckpt_imsi_iter, &list);
+	for (i = 0; i < list.nr; i++) {
+		if (__test_bit(GTP_CKPT_FL_STOP_BIT, &r->flags))
+			break;
+
+		c = gtp_conn_get_by_imsi(list.imsi[i]);
+		if (!c)
+			continue;
+		gtp_ckpt_compact_conn(r, next, c);
+		gtp_conn_put(c);
+	}
+	if (list.imsi)
+		FREE(list.imsi);
+
+	pthread_mutex_lock(&r->mutex);
+	r->next = NULL;
+	if (i < list.nr || (next->hdr->flags & GTP_CKPT_HDR_FL_OVERFLOW)) {
+		pthread_mutex_unlock(&r->mutex);
+		log_message(LOG_INFO, "%s(): checkpoint compaction %s"
+				    , __FUNCTION__
+				    , (i < list.nr) ? "aborted" : "overflow, increase size");
+		gtp_ckpt_log_close(next);
+		unlink(tmp);
+		return -1;
+	}
+
+	next->hdr->flags |= GTP_CKPT_HDR_FL_COMPLETE;
+	gtp_ckpt_log_sync(next, MS_SYNC);
+	if (rename(tmp, r->path) < 0) {
+		pthread_mutex_unlock(&r->mutex);
+		log_message(LOG_INFO, "%s(): unable to rename %s (%m)"
+				    , __FUNCTION__, tmp);
+		gtp_ckpt_log_close(next);
+		unlink(tmp);
+		return -1;
+	}
+	bsd_strlcpy(next->path, r->path, GTP_STR_MAX_LEN);
+	old = r->log;
+	r->log = next;
+	r->compactions++;
+	r->last_compaction = time(NULL);
+	pthread_mutex_unlock(&r->mutex);
+
+	gtp_ckpt_log_close(old);
+	return 0;
+}
+
+
+/*
+ *	Restore
+ */
+typedef struct _gtp_ckpt_slot {
+	gtp_ckpt_key_t		key;
+	uint64_t		off;		/* latest image, 0: deleted */
+} gtp_ckpt_slot_t;
+
+typedef struct _gtp_ckpt_index {
+	gtp_ckpt_slot_t		*slot;
+	uint64_t		mask;
+} gtp_ckpt_index_t;
+
+static gtp_ckpt_slot_t *
+gtp_ckpt_index_slot(gtp_ckpt_index_t *idx, gtp_ckpt_key_t *key)
+{
+	uint64_t h = (key->imsi ^ ((uint64_t) key->id << 32)) * 0x9e3779b97f4a7c15ULL;
+	gtp_ckpt_slot_t *slot;
+
+	for (h >>= 16;; h++) {
+		slot = &idx->slot[h & idx->mask];
+		if (!slot->key.imsi && !slot->key.id)
+			return slot;
+		if (slot->key.imsi == key->imsi && slot->key.id == key->id)
+			return slot;
+	}
+
+	return NULL;
+}
+
+static gtp_ckpt_rec_t *
+gtp_ckpt_rec_next(gtp_ckpt_log_t *log, uint64_t *off)
+{
+	gtp_ckpt_rec_t *rec;
+	uint64_t need;
+
+	if (*off + sizeof(gtp_ckpt_rec_t) > log->size)
+		return NULL;
+
+	rec = (gtp_ckpt_rec_t *) (log->base + *off);
+	need = sizeof(gtp_ckpt_rec_t) + GTP_CKPT_REC_ALIGN(rec->len);
+	if (!rec->type || *off + need > log->size ||
+	    adler_crc32((uint8_t *) (rec + 1), rec->len) != rec->crc)
+		return NULL;
+
+	*off += need;
+	return rec;
+}
+
+static gtp_server_worker_t *
+gtp_ckpt_worker_get(gtp_server_t *srv, int id)
+{
+	gtp_server_worker_t *w, *found = NULL;
+
+	pthread_mutex_lock(&srv->workers_mutex);
+	list_for_each_entry(w, &srv->workers, next) {
+		if (!found || w->id == id)
+			found = w;
+		if (w->id == id)
+			break;
+	}
+	pthread_mutex_unlock(&srv->workers_mutex);
+	return found;
+}
+
+static gtp_server_t *
+gtp_ckpt_srv_get(gtp_ckpt_session_t *img, gtp_switch_t **sw)
+{
+	gtp_router_t *rt;
+
+	*sw = NULL;
+	if (img->srv == GTP_CKPT_SRV_ROUTER) {
+		rt = gtp_router_get(img->ctx);
+		return (rt) ? &rt->gtpc : NULL;
+	}
+
+	*sw = gtp_switch_get(img->ctx);
+	if (!*sw)
+		return NULL;
+	return (img->srv == GTP_CKPT_SRV_SWITCH_EGRESS) ? &(*sw)->gtpc_egress : &(*sw)->gtpc;
+}
+
+/* Image strings come from disk or from the wire */
+static void
+gtp_ckpt_session_bound(gtp_ckpt_session_t *img)
+{
+	img->ctx[sizeof(img->ctx) - 1] = '\0';
+	img->apn[sizeof(img->apn) - 1] = '\0';
+}
+
+static gtp_teid_t *
+gtp_ckpt_teid_restore(gtp_session_t *s, gtp_switch_t *sw, gtp_ckpt_teid_t *img)
+{
+	gtp_f_teid_t f_teid = { .version = img->version
+			      , .teid_grekey = &img->id
+			      , .ipv4 = &img->ipv4 };
+	gtp_idpool_t *pool;
+	gtp_teid_t *t;
+	int id = 0;
+
+	if (sw)
+		t = gtp_teid_alloc((img->type == GTP_TEID_C) ? &sw->gtpc_teid_tab :
+							       &sw->gtpu_teid_tab
+				   , &f_teid, NULL);
+	else
+		t = (img->type == GTP_TEID_C) ? gtpc_teid_alloc(&f_teid, NULL) :
+						gtpu_teid_alloc(&f_teid, NULL);
+	if (!t)
+		return NULL;
+
+	t->type = img->type;
+	t->bearer_id = img->bearer_id;
+	t->family = img->family;
+	t->sqn = img->sqn;
+	t->session = s;
+	t->flags |= img->flags & GTP_CKPT_TEID_FL_RESTORE;
+	t->sgw_addr.sin_family = AF_INET;
+	t->sgw_addr.sin_addr.s_addr = img->sgw_addr;
+	t->sgw_addr.sin_port = img->sgw_port;
+	t->pgw_addr.sin_family = AF_INET;
+	t->pgw_addr.sin_addr.s_addr = img->pgw_addr;
+	t->pgw_addr.sin_port = img->pgw_port;
+
+	if (!sw)
+		return t;
+
+	/* Virtual TEID and SQN mapping */
+	if (img->flags & (1UL << GTP_TEID_FL_VTEID_HASHED)) {
+		if (sw->vteid_pool_bits)
+			id = img->vid >> (32 - sw->vteid_pool_bits);
+		pool = gtp_switch_vteid_pool(sw, id);
+		if (gtp_vteid_reserve(&sw->vteid_tab, t, pool, img->vid) < 0)
+			log_message(LOG_INFO, "%s(): VTEID:0x%.8x already in use"
+					    , __FUNCTION__, img->vid);
+	}
+
+	if (img->flags & (1UL << GTP_TEID_FL_VSQN_HASHED))
+		gtp_switch_vsqn_reserve(sw, t, img->vsqn);
+
+	return t;
+}
+
+/* Rebuild a session from its image. Returns 1 when restored,
+ * 0 when expired meanwhile. */
+int
+gtp_ckpt_session_restore(gtp_ckpt_session_t *img, time_t now, unsigned long flags)
+{
+	gtp_teid_t *t[GTP_CKPT_TEID_MAX];
+	gtp_ckpt_teid_t *timg;
+	gtp_server_worker_t *w;
+	struct sockaddr_in addr;
+	gtp_server_t *srv;
+	gtp_switch_t *sw;
+	gtp_session_t *s;
+	gtp_apn_t *apn;
+	gtp_conn_t *c;
+	int i, n = img->nr_gtpc + img->nr_gtpu;
+
+	/* Expired while we were down */
+	if (img->expire && img->expire <= now)
+		return 0;
+
+	gtp_ckpt_session_bound(img);
+	apn = gtp_apn_get(img->apn);
+	srv = gtp_ckpt_srv_get(img, &sw);
+	if (!apn || !srv || n > GTP_CKPT_TEID_MAX)
+		return -1;
+
+	w = gtp_ckpt_worker_get(srv, img->worker);
+	if (!w)
+		return -1;
+
+	c = gtp_conn_get_by_imsi(img->key.imsi);
+	if (!c)
+		c = gtp_conn_alloc(img->key.imsi);
+	if (img->sgw_addr) {
+		c->sgw_addr.sin_family = AF_INET;
+		c->sgw_addr.sin_addr.s_addr = img->sgw_addr;
+		c->sgw_addr.sin_port = img->sgw_port;
+	}
+
+	s = (sw) ? gtp_session_alloc(c, apn, gtp_switch_gtpc_teid_destroy
+					   , gtp_switch_gtpu_teid_destroy) :
+		   gtp_session_alloc(c, apn, gtpc_teid_unhash, gtpu_teid_unhash);
+	s->id = img->key.id;
+	gtp_session_id_update(s->id);
+	s->flags = flags;
+	s->w = w;
+	s->ptype = img->ptype;
+	gtp_session_set_ipv4(s, img->ipv4);
+	s->charging_id = img->charging_id;
+	s->mei = img->mei;
+	gtp_session_set_msisdn(s, img->msisdn);
+	s->creation_time = img->creation_time;
+	if (img->expire)
+		gtp_session_mod_timer(s, img->expire - now);
+
+	/* Leases are taken back from APN pools, a pool changed
+	 * meanwhile simply leaves address unmanaged */
+	if (img->ipv4_lease) {
+		if (!gtp_ip_pool_restore(apn, img->ipv4_lease))
+			s->ipv4_lease = img->ipv4_lease;
+		else
+			log_message(LOG_INFO, "%s(): IMSI:%ld unable to restore lease %u.%u.%u.%u"
+					    , __FUNCTION__, img->key.imsi, NIPQUAD(img->ipv4_lease));
+	}
+	if (!IN6_IS_ADDR_UNSPECIFIED(&img->ipv6_prefix) &&
+	    !gtp_ip6_pool_restore(apn, &img->ipv6_prefix))
+		s->ipv6_prefix = img->ipv6_prefix;
+
+	/* TEIDs, then links, then session lists: GTP-U XDP rules
+	 * are installed when linked */
+	for (i = 0; i < n; i++)
+		t[i] = gtp_ckpt_teid_restore(s, sw, &img->teid[i]);
+
+	for (i = 0; i < n; i++) {
+		timg = &img->teid[i];
+		if (!t[i])
+			continue;
+		if (timg->peer < n)
+			t[i]->peer_teid = t[timg->peer];
+		if (timg->bearer < n)
+			t[i]->bearer_teid = t[timg->bearer];
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!t[i])
+			continue;
+		if (i < img->nr_gtpc) {
+			gtp_session_gtpc_teid_add(s, t[i]);
+			continue;
+		}
+
+		if (!(img->teid[i].flags & (1UL << GTP_TEID_FL_XDP_SET)))
+			__set_bit(GTP_TEID_FL_XDP_DELAYED, &t[i]->flags);
+		gtp_session_gtpu_teid_add(s, t[i]);
+	}
+
+	/* Peer tracking, with Recovery known before restart so that
+	 * a peer restarted meanwhile is detected */
+	if (img->path_addr) {
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = img->path_addr;
+		addr.sin_port = img->path_port;
+		gtp_path_session_register(srv, &addr, img->path_version, GTP_PATH_FL_SGW_BIT, s);
+		if (img->path_has_recovery)
+			gtp_path_recovery_update(&addr, &img->path_recovery);
+	}
+
+	gtp_conn_put(c);
+	return 1;
+}
+
+static gtp_teid_t *
+gtp_ckpt_teid_lookup(list_head_t *l, gtp_ckpt_teid_t *img, gtp_teid_t **t, int n)
+{
+	gtp_teid_t *teid;
+	int i;
+
+	list_for_each_entry(teid, l, next) {
+		if (teid->type != img->type || teid->id != img->id ||
+		    teid->ipv4 != img->ipv4)
+			continue;
+
+		/* Each live TEID backs a single image entry */
+		for (i = 0; i < n && t[i] != teid; i++) ;
+		if (i == n)
+			return teid;
+	}
+
+	return NULL;
+}
+
+/* Same TEID as far as hash tables and XDP rules are concerned */
+static bool
+gtp_ckpt_teid_same(gtp_teid_t *t, gtp_ckpt_teid_t *img)
+{
+	unsigned long keep = GTP_CKPT_TEID_FL_RESTORE | (1UL << GTP_TEID_FL_VTEID_HASHED);
+
+	if (t->version != img->version || t->vid != img->vid ||
+	    (t->flags & keep) != (img->flags & keep))
+		return false;
+
+	if (t->type != GTP_TEID_U)
+		return true;
+
+	if ((t->flags ^ img->flags) & (1UL << GTP_TEID_FL_XDP_SET))
+		return false;
+	if (!__test_bit(GTP_TEID_FL_XDP_SET, &t->flags))
+		return true;
+
+	return t->sgw_addr.sin_addr.s_addr == img->sgw_addr &&
+	       t->sgw_addr.sin_port == img->sgw_port &&
+	       t->pgw_addr.sin_addr.s_addr == img->pgw_addr &&
+	       t->pgw_addr.sin_port == img->pgw_port;
+}
+
+static void
+gtp_ckpt_teid_update(gtp_teid_t *t, gtp_switch_t *sw, gtp_ckpt_teid_t *img)
+{
+	bool vsqn = img->flags & (1UL << GTP_TEID_FL_VSQN_HASHED);
+
+	t->sqn = img->sqn;
+	t->bearer_id = img->bearer_id;
+	t->family = img->family;
+	t->sgw_addr.sin_addr.s_addr = img->sgw_addr;
+	t->sgw_addr.sin_port = img->sgw_port;
+	t->pgw_addr.sin_addr.s_addr = img->pgw_addr;
+	t->pgw_addr.sin_port = img->pgw_port;
+
+	if (!sw)
+		return;
+
+	if (__test_bit(GTP_TEID_FL_VSQN_HASHED, &t->flags)) {
+		if (vsqn && t->vsqn == img->vsqn)
+			return;
+		gtp_switch_vsqn_release(sw, t);
+	}
+
+	if (vsqn)
+		gtp_switch_vsqn_reserve(sw, t, img->vsqn);
+}
+
+/* Refresh a live session from a newer image, keeping its TEIDs,
+ * XDP rules and leases in place. Returns 1 when updated, 0 when
+ * session is unknown or expired, -1 when image diverged enough to
+ * need a full release and restore. */
+int
+gtp_ckpt_session_update(gtp_ckpt_session_t *img, time_t now, unsigned long flags)
+{
+	gtp_teid_t *t[GTP_CKPT_TEID_MAX], *teid;
+	gtp_ckpt_teid_t *timg;
+	gtp_server_worker_t *w;
+	struct sockaddr_in addr;
+	gtp_server_t *srv;
+	gtp_switch_t *sw;
+	gtp_session_t *s;
+	gtp_path_t *p;
+	gtp_apn_t *apn;
+	gtp_conn_t *c;
+	int i, nr_gtpc = 0, nr_gtpu = 0, n = img->nr_gtpc + img->nr_gtpu;
+	int ret = -1;
+
+	if (img->expire && img->expire <= now)
+		return 0;
+
+	gtp_ckpt_session_bound(img);
+	apn = gtp_apn_get(img->apn);
+	srv = gtp_ckpt_srv_get(img, &sw);
+	if (!apn || !srv || n > GTP_CKPT_TEID_MAX)
+		return -1;
+
+	w = gtp_ckpt_worker_get(srv, img->worker);
+	if (!w)
+		return -1;
+
+	c = gtp_conn_get_by_imsi(img->key.imsi);
+	if (!c)
+		return 0;
+
+	pthread_mutex_lock(&c->session_mutex);
+	list_for_each_entry(s, &c->gtp_sessions, next) {
+		if (s->id == img->key.id)
+			goto found;
+	}
+	ret = 0;
+	goto end;
+
+  found:
+	p = s->path;
+	if (s->apn != apn || !s->w || s->w->srv != srv || s->s_pppoe ||
+	    s->ipv4_lease != img->ipv4_lease ||
+	    memcmp(&s->ipv6_prefix, &img->ipv6_prefix, sizeof(struct in6_addr)) ||
+	    (!img->expire && timerisset(&s->t_node.sands)))
+		goto end;
+
+	if (img->path_addr && (!p || p->addr.sin_addr.s_addr != img->path_addr ||
+				p->addr.sin_port != img->path_port))
+		goto end;
+
+	list_for_each_entry(teid, &s->gtpc_teid, next)
+		nr_gtpc++;
+	list_for_each_entry(teid, &s->gtpu_teid, next)
+		nr_gtpu++;
+	if (nr_gtpc != img->nr_gtpc || nr_gtpu != img->nr_gtpu)
+		goto end;
+
+	for (i = 0; i < n; i++) {
+		timg = &img->teid[i];
+		t[i] = gtp_ckpt_teid_lookup((i < img->nr_gtpc) ? &s->gtpc_teid : &s->gtpu_teid
+					    , timg, t, i);
+		if (!t[i] || !gtp_ckpt_teid_same(t[i], timg))
+			goto end;
+	}
+
+	/* Same layout: mutable state only */
+	for (i = 0; i < n; i++) {
+		timg = &img->teid[i];
+		gtp_ckpt_teid_update(t[i], sw, timg);
+		t[i]->peer_teid = (timg->peer < n) ? t[timg->peer] : NULL;
+		t[i]->bearer_teid = (timg->bearer < n) ? t[timg->bearer] : NULL;
+	}
+
+	if (img->sgw_addr) {
+		c->sgw_addr.sin_family = AF_INET;
+		c->sgw_addr.sin_addr.s_addr = img->sgw_addr;
+		c->sgw_addr.sin_port = img->sgw_port;
+	}
+
+	s->flags = flags;
+	s->w = w;
+	s->ptype = img->ptype;
+	__gtp_session_set_ipv4(s, img->ipv4);
+	s->charging_id = img->charging_id;
+	s->mei = img->mei;
+	__gtp_session_set_msisdn(s, img->msisdn);
+	s->creation_time = img->creation_time;
+	if (img->expire)
+		gtp_session_mod_timer(s, img->expire - now);
+	ret = 1;
+
+  end:
+	pthread_mutex_unlock(&c->session_mutex);
+	gtp_conn_put(c);
+
+	if (ret > 0 && img->path_addr && img->path_has_recovery) {
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = img->path_addr;
+		addr.sin_port = img->path_port;
+		gtp_path_recovery_update(&addr, &img->path_recovery);
+	}
+	return ret;
+}
+
+static int
+gtp_ckpt_restore(gtp_ckpt_t *r, uint8_t *restart_counter)
+{
+	gtp_ckpt_index_t idx = { 0 };
+	time_t now = time(NULL);
+	gtp_ckpt_key_t *key;
+	gtp_ckpt_slot_t *slot;
+	gtp_ckpt_log_t *log;
+	gtp_ckpt_rec_t *rec;
+	uint64_t off, nr = 0, i;
+	int ret, restored = 0;
+
+	log = gtp_ckpt_log_map(r->path, 0, false);
+	if (!log)
+		return -1;
+
+	if (log->hdr->magic != GTP_CKPT_MAGIC || log->hdr->version != GTP_CKPT_VERSION ||
+	    !(log->hdr->flags & GTP_CKPT_HDR_FL_COMPLETE) ||
+	    (log->hdr->flags & GTP_CKPT_HDR_FL_OVERFLOW)) {
+		log_message(LOG_INFO, "%s(): checkpoint %s is not usable, ignoring"
+				    , __FUNCTION__, r->path);
+		goto end;
+	}
+
+	if (now - log->hdr->sync_time > GTP_CKPT_MAX_AGE) {
+		log_message(LOG_INFO, "%s(): checkpoint %s is %lds old, ignoring"
+				    , __FUNCTION__, r->path, (long) (now - log->hdr->sync_time));
+		goto end;
+	}
+
+	/* Last image wins, deletion clears it */
+	for (off = GTP_CKPT_HDR_SIZE; gtp_ckpt_rec_next(log, &off); nr++) ;
+	for (idx.mask = 1; idx.mask < nr * 2; idx.mask <<= 1) ;
+	idx.slot = MALLOC(idx.mask * sizeof(gtp_ckpt_slot_t));
+	if (!idx.slot)
+		goto end;
+	idx.mask--;
+
+	for (off = GTP_CKPT_HDR_SIZE; (rec = gtp_ckpt_rec_next(log, &off)); ) {
+		key = (gtp_ckpt_key_t *) (rec + 1);
+		slot = gtp_ckpt_index_slot(&idx, key);
+		slot->key = *key;
+		slot->off = (rec->type == GTP_CKPT_REC_SESSION) ?
+			    (uint8_t *) key - log->base : 0;
+	}
+
+	for (i = 0; i <= idx.mask; i++) {
+		slot = &idx.slot[i];
+		if (!slot->off)
+			continue;
+
+		ret = gtp_ckpt_session_restore((gtp_ckpt_session_t *) (log->base + slot->off)
+					       , now, 0);
+		if (ret < 0) {
+			r->restore_errors++;
+			continue;
+		}
+		restored += ret;
+	}
+	FREE(idx.slot);
+
+	*restart_counter = log->hdr->restart_counter;
+	gtp_ckpt_log_close(log);
+	return restored;
+
+  end:
+	gtp_ckpt_log_close(log);
+	return -1;
+}
+
+
+/*
+ *	Checkpoint task
+ */
+static void *
+gtp_ckpt_task(void *arg)
+{
+	gtp_ckpt_t *r = arg;
+	struct timespec timeout;
+	uint64_t used;
+	bool compact;
+
+	/* Our identity */
+	prctl(PR_SET_NAME, "gtp_ckpt", 0, 0, 0, 0);
+
+	pthread_mutex_lock(&r->task_mutex);
+	while (!__test_bit(GTP_CKPT_FL_STOP_BIT, &r->flags)) {
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_sec += GTP_CKPT_SYNC_TIMER;
+		pthread_cond_timedwait(&r->cond, &r->task_mutex, &timeout);
+		if (__test_bit(GTP_CKPT_FL_STOP_BIT, &r->flags))
+			break;
+
+		/* Write-back is left to kernel, header age tells
+		 * restore how fresh log is */
+		pthread_mutex_lock(&r->mutex);
+		used = r->log->hdr->tail - GTP_CKPT_HDR_SIZE;
+		compact = (r->log->hdr->flags & GTP_CKPT_HDR_FL_OVERFLOW) ||
+			  used * 100 > (r->size - GTP_CKPT_HDR_SIZE) * GTP_CKPT_COMPACT_RATIO;
+		gtp_ckpt_log_sync(r->log, MS_ASYNC);
+		pthread_mutex_unlock(&r->mutex);
+
+		if (!compact)
+			continue;
+
+		pthread_mutex_unlock(&r->task_mutex);
+		gtp_ckpt_compact(r);
+		pthread_mutex_lock(&r->task_mutex);
+	}
+	pthread_mutex_unlock(&r->task_mutex);
+
+	return NULL;
+}
+
+/* Called once configuration is loaded: servers and APNs are
+ * known, sessions can be rebuilt */
+int
+gtp_ckpt_start(void)
+{
+	gtp_ckpt_t *r = gtp_ckpt;
+	uint8_t restart_counter = 0;
+	uint64_t start;
+	int ret;
+
+	if (!r || !__test_bit(GTP_CKPT_FL_CONFIGURED_BIT, &r->flags))
+		return -1;
+
+	start = gtp_ckpt_usec();
+	ret = gtp_ckpt_restore(r, &restart_counter);
+	r->restore_usec = gtp_ckpt_usec() - start;
+	if (ret >= 0) {
+		r->restored = ret;
+		log_message(LOG_INFO, "%s(): %d sessions restored from %s in %lums (%lu errors)"
+				    , __FUNCTION__, ret, r->path
+				    , r->restore_usec / 1000, r->restore_errors);
+
+		/* Peers must not see us restarting */
+		daemon_data->restart_counter = restart_counter;
+		if (__test_bit(GTP_FL_RESTART_COUNTER_LOADED_BIT, &daemon_data->flags))
+			gtp_disk_write_restart_counter();
+	}
+
+	/* Start over from a compacted log */
+	__set_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags);
+	if (gtp_ckpt_compact(r) < 0) {
+		__clear_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags);
+		return -1;
+	}
+
+	pthread_create(&r->task, NULL, gtp_ckpt_task, r);
+	return 0;
+}
+
+
+/*
+ *	Checkpoint init
+ */
+int
+gtp_ckpt_init(void)
+{
+	gtp_ckpt_t *r;
+
+	PMALLOC(r);
+	if (!r)
+		return -1;
+	r->size = (uint64_t) GTP_CKPT_SIZE << 20;
+	pthread_mutex_init(&r->mutex, NULL);
+	pthread_mutex_init(&r->task_mutex, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	gtp_ckpt = r;
+	return 0;
+}
+
+int
+gtp_ckpt_destroy(void)
+{
+	gtp_ckpt_t *r = gtp_ckpt;
+
+	if (!r)
+		return -1;
+
+	if (__test_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags)) {
+		pthread_mutex_lock(&r->task_mutex);
+		__set_bit(GTP_CKPT_FL_STOP_BIT, &r->flags);
+		pthread_cond_signal(&r->cond);
+		pthread_mutex_unlock(&r->task_mutex);
+		pthread_join(r->task, NULL);
+
+		/* Sessions are left in log for next start */
+		pthread_mutex_lock(&r->mutex);
+		__clear_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags);
+		gtp_ckpt_log_sync(r->log, MS_SYNC);
+		gtp_ckpt_log_close(r->log);
+		r->log = NULL;
+		pthread_mutex_unlock(&r->mutex);
+	}
+
+	gtp_ckpt = NULL;
+	pthread_mutex_destroy(&r->mutex);
+	pthread_mutex_destroy(&r->task_mutex);
+	pthread_cond_destroy(&r->cond);
+	FREE(r);
+	return 0;
+}
+
+
+/*
+ *	VTY
+ */
+int
+gtp_ckpt_config_write(vty_t *vty)
+{
+	gtp_ckpt_t *r = gtp_ckpt;
+
+	if (!__test_bit(GTP_CKPT_FL_CONFIGURED_BIT, &r->flags))
+		return 0;
+
+	vty_out(vty, " session-checkpoint %s size %lu%s"
+		   , r->path, r->size >> 20, VTY_NEWLINE);
+	return 0;
+}
+
+DEFUN(pdn_session_checkpoint,
+      pdn_session_checkpoint_cmd,
+      "session-checkpoint STRING size <16-65536>",
+      "Session checkpoint for warm restart\n"
+      "path to checkpoint file\n"
+      "Checkpoint file size\n"
+      "MBytes\n")
+{
+	gtp_ckpt_t *r = gtp_ckpt;
+	int size;
+
+	if (argc < 2) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (__test_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags)) {
+		vty_out(vty, "%% session-checkpoint already running%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("size", size, argv[1], 16, 65536);
+	strncpy(r->path, argv[0], GTP_STR_MAX_LEN - 1);
+	r->size = (uint64_t) size << 20;
+	__set_bit(GTP_CKPT_FL_CONFIGURED_BIT, &r->flags);
+	return CMD_SUCCESS;
+}
+
+DEFUN(show_gtp_session_checkpoint,
+      show_gtp_session_checkpoint_cmd,
+      "show gtp session-checkpoint",
+      SHOW_STR
+      "GTP related informations\n"
+      "Session checkpoint\n")
+{
+	gtp_ckpt_t *r = gtp_ckpt;
+	gtp_ckpt_hdr_t *hdr;
+
+	if (!__test_bit(GTP_CKPT_FL_RUNNING_BIT, &r->flags)) {
+		vty_out(vty, "%% session-checkpoint not running%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	pthread_mutex_lock(&r->mutex);
+	hdr = r->log->hdr;
+	vty_out(vty, "Session checkpoint: %s generation:%lu%s"
+		     " log used:%lu/%lu bytes (%lu%%)%s"
+		     " appended:%lu records (%lu bytes) overflow:%lu compactions:%lu%s"
+		     " restored:%lu sessions in %lums (%lu errors)%s"
+		   , r->path, hdr->generation, VTY_NEWLINE
+		   , hdr->tail - GTP_CKPT_HDR_SIZE, r->size - GTP_CKPT_HDR_SIZE
+		   , (hdr->tail - GTP_CKPT_HDR_SIZE) * 100 / (r->size - GTP_CKPT_HDR_SIZE)
+		   , VTY_NEWLINE
+		   , r->appended, r->appended_bytes, r->overflow, r->compactions, VTY_NEWLINE
+		   , r->restored, r->restore_usec / 1000, r->restore_errors, VTY_NEWLINE);
+	pthread_mutex_unlock(&r->mutex);
+
+	return CMD_SUCCESS;
+}
+
+int
+gtp_ckpt_vty_init(void)
+{
+	install_element(PDN_NODE, &pdn_session_checkpoint_cmd);
+	install_element(VIEW_NODE, &show_gtp_session_checkpoint_cmd);
+	install_element(ENABLE_NODE, &show_gtp_session_checkpoint_cmd);
+
+	return 0;
+}
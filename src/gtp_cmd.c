@@ -113,6 +113,12 @@ gtp_cmd_build_gtp_v2(gtp_cmd_args_t *args)
 	return 0;
 }
 
+int
+gtp_cmd_echo_build(gtp_cmd_args_t *args)
+{
+	return (args->version == 1) ? gtp_cmd_build_gtp_v1(args) : gtp_cmd_build_gtp_v2(args);
+}
+
 static int
 gtp_cmd_update_udp_hlen(char *buffer, size_t len)
 {
@@ -305,7 +311,7 @@ gtp_cmd_write_thread(thread_ref_t thread)
 		args->buffer_offset = gtp_cmd_build_pkt(args);
 
 	/* GTP */
-	ret = (args->version == 1) ? gtp_cmd_build_gtp_v1(args) : gtp_cmd_build_gtp_v2(args);
+	ret = gtp_cmd_echo_build(args);
 
 	/* Warm the road */
 	ret = gtp_cmd_sendmsg(args);
@@ -37,39 +37,8 @@ extern data_t *daemon_data;
 extern thread_master_t *master;
 
 /* Local data */
-struct hlist_head *gtp_conn_tab;
-static int gtp_conn_tab_cnt = 0;
-dlock_mutex_t *__gtp_conn_lock_array;
-
-
-/*
- *      Distributate lock handling
- */
-int
-gtp_conn_lock_id(uint64_t id)
-{
-	return dlock_lock_id(__gtp_conn_lock_array, (uint32_t)id, (uint32_t) (id >> 32));
-}
-
-int
-gtp_conn_unlock_id(uint64_t id)
-{
-	return dlock_unlock_id(__gtp_conn_lock_array, (uint32_t)id, (uint32_t) (id >> 32));
-}
-
-int
-gtp_conn_lock_init(void)
-{
-        __gtp_conn_lock_array = dlock_init();
-        return 0;
-}
-
-int
-gtp_conn_lock_destroy(void)
-{
-	FREE(__gtp_conn_lock_array);
-        return 0;
-}
+static gtp_oatab_t gtp_conn_tab;
+static grace_defer_t gtp_conn_retired;
 
 
 /*
@@ -97,48 +66,44 @@ gtp_conn_put(gtp_conn_t *c)
 /*
  *	IMSI Hashtab handling
  */
-static struct hlist_head *
-gtp_conn_hashkey(uint64_t id)
-{
-	return gtp_conn_tab + (jhash_2words((uint32_t)id, (uint32_t) (id >> 32), 0) & CONN_HASHTAB_MASK);
-}
-
 gtp_conn_t *
 gtp_conn_get_by_imsi(uint64_t imsi)
 {
-	struct hlist_head *head = gtp_conn_hashkey(imsi);
-	struct hlist_node *n;
 	gtp_conn_t *c;
+	int refcnt, cookie;
 
-	gtp_conn_lock_id(imsi);
-	hlist_for_each_entry(c, n, head, hlist) {
-		if (c->imsi == imsi) {
-			__sync_add_and_fetch(&c->refcnt, 1);
-			gtp_conn_unlock_id(imsi);
-			return c;
+	/* Lookup is lock-free, so conn may be concurrently released:
+	 * only take a ref if one is still held. Conn memory is kept
+	 * until table read section is left, see gtp_conn_free() */
+	cookie = gtp_oatab_read_lock(&gtp_conn_tab);
+	c = __gtp_oatab_get(&gtp_conn_tab, imsi);
+	if (!c)
+		goto end;
+
+	refcnt = __atomic_load_n(&c->refcnt, __ATOMIC_RELAXED);
+	do {
+		if (refcnt <= 0) {
+			c = NULL;
+			goto end;
 		}
-	}
-	gtp_conn_unlock_id(imsi);
+	} while (!__atomic_compare_exchange_n(&c->refcnt, &refcnt, refcnt + 1, false
+					      , __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
 
-	return NULL;
+  end:
+	gtp_oatab_read_unlock(&gtp_conn_tab, cookie);
+	return c;
 }
 
 int
 gtp_conn_hash(gtp_conn_t *c)
 {
-	struct hlist_head *head;
-
 	if (!c)
 		return -1;
 
-	head = gtp_conn_hashkey(c->imsi);
-
-	gtp_conn_lock_id(c->imsi);
-	hlist_add_head(&c->hlist, head);
-	gtp_conn_unlock_id(c->imsi);
+	if (gtp_oatab_add(&gtp_conn_tab, c->imsi, c) < 0)
+		return -1;
 
 	__set_bit(GTP_CONN_F_HASHED, &c->flags);
-	__sync_add_and_fetch(&gtp_conn_tab_cnt, 1);
 	__sync_add_and_fetch(&c->refcnt, 1);
 	return 0;
 }
@@ -149,22 +114,36 @@ gtp_conn_unhash(gtp_conn_t *c)
 	if (!c)
 		return -1;
 
-	gtp_conn_lock_id(c->imsi);
-	hlist_del(&c->hlist);
-	gtp_conn_unlock_id(c->imsi);
+	if (gtp_oatab_del(&gtp_conn_tab, c->imsi, c) < 0)
+		return -1;
 
 	__clear_bit(GTP_CONN_F_HASHED, &c->flags);
-	__sync_sub_and_fetch(&gtp_conn_tab_cnt, 1);
 	__sync_sub_and_fetch(&c->refcnt, 1);
 	return 0;
 }
 
+typedef struct _gtp_conn_vty_arg {
+	vty_t			*vty;
+	int			(*vty_conn) (vty_t *, gtp_conn_t *);
+} gtp_conn_vty_arg_t;
+
+static int
+gtp_conn_vty_iter(void *value, void *arg)
+{
+	gtp_conn_vty_arg_t *a = arg;
+	gtp_conn_t *c = value;
+
+	gtp_conn_get(c);
+	(*a->vty_conn) (a->vty, c);
+	gtp_conn_put(c);
+	return 0;
+}
+
 int
 gtp_conn_vty(vty_t *vty, int (*vty_conn) (vty_t *, gtp_conn_t *), uint64_t imsi)
 {
-	struct hlist_node *n;
+	gtp_conn_vty_arg_t arg = { .vty = vty, .vty_conn = vty_conn };
 	gtp_conn_t *c;
-	int i;
 
 	if (imsi) {
 		c = gtp_conn_get_by_imsi(imsi);
@@ -176,27 +155,54 @@ gtp_conn_vty(vty_t *vty, int (*vty_conn) (vty_t *, gtp_conn_t *), uint64_t imsi)
 		return 0;
 	}
 
-	/* Iterate */
-	for (i = 0; i < CONN_HASHTAB_SIZE; i++) {
-		gtp_conn_lock_id(i);
-		hlist_for_each_entry(c, n, &gtp_conn_tab[i], hlist) {
-			gtp_conn_get(c);
-			(*vty_conn) (vty, c);
-			gtp_conn_put(c);
-		}
-		gtp_conn_unlock_id(i);
-	}
+	return gtp_oatab_iterate(&gtp_conn_tab, gtp_conn_vty_iter, &arg);
+}
 
+int
+gtp_conn_tab_vty(vty_t *vty)
+{
+	vty_out(vty, "IMSI tracking table: %u connections, %zu bytes, %lu resize%s"
+		   , gtp_oatab_count(&gtp_conn_tab)
+		   , gtp_oatab_memory(&gtp_conn_tab)
+		   , gtp_conn_tab.resize
+		   , VTY_NEWLINE);
 	return 0;
 }
 
+int
+gtp_conn_iterate(int (*cb) (void *, void *), void *arg)
+{
+	return gtp_oatab_iterate(&gtp_conn_tab, cb, arg);
+}
+
+int
+gtp_conn_count(void)
+{
+	return gtp_oatab_count(&gtp_conn_tab);
+}
+
 /*
  *	Connection related
  */
+static void
+gtp_conn_release_deferred(grace_obj_t *obj)
+{
+	FREE(container_of(obj, gtp_conn_t, gp));
+}
+
+/* Lock-free lookups may have found c before it was unhashed,
+ * release is deferred until they are all gone */
+void
+gtp_conn_free(gtp_conn_t *c)
+{
+	grace_defer(&gtp_conn_retired, &c->gp);
+}
+
 gtp_conn_t *
 gtp_conn_alloc(uint64_t imsi)
 {
-	gtp_conn_t *new;
+	gtp_conn_t *new, *c;
+	int retry;
 
 	PMALLOC(new);
 	new->imsi = imsi;
@@ -205,8 +211,23 @@ gtp_conn_alloc(uint64_t imsi)
 	INIT_LIST_HEAD(&new->pppoe_sessions);
 	pthread_mutex_init(&new->session_mutex, NULL);
 
-	gtp_conn_hash(new);
+	/* Concurrent allocation for same IMSI: use the one that won.
+	 * A conn being released is unhashed right after, try again */
+	for (retry = 0; retry < GTP_CONN_HASH_RETRY; retry++) {
+		if (!gtp_conn_hash(new))
+			return new;
+
+		c = gtp_conn_get_by_imsi(imsi);
+		if (c) {
+			pthread_mutex_destroy(&new->session_mutex);
+			FREE(new);
+			return c;
+		}
+		sched_yield();
+	}
 
+	log_message(LOG_INFO, "%s(): IMSI:%ld unable to hash connection"
+			    , __FUNCTION__, imsi);
 	return new;
 }
 
@@ -217,29 +238,38 @@ gtp_conn_alloc(uint64_t imsi)
 int
 gtp_conn_init(void)
 {
-	gtp_conn_tab = (struct hlist_head *) MALLOC(sizeof(struct hlist_head) *
-						    CONN_HASHTAB_SIZE);
-	gtp_conn_lock_init();
+	int err;
+
+	err = gtp_oatab_init(&gtp_conn_tab, CONN_HASHTAB_SIZE, GTP_HASH_CONN);
+	grace_defer_init(&gtp_conn_retired, &gtp_conn_tab.gp, gtp_conn_release_deferred);
+	return err;
+}
+
+static int
+gtp_conn_release(void *value, void *arg)
+{
+	gtp_conn_t *c = value;
+	list_head_t *l = arg;
+
+	list_add_tail(&c->next, l);
 	return 0;
 }
 
 int
 gtp_conn_destroy(void)
 {
-	struct hlist_node *n, *n2;
-	gtp_conn_t *c;
-	int i;
-
-	for (i = 0; i < CONN_HASHTAB_SIZE; i++) {
-		gtp_conn_lock_id(i);
-		hlist_for_each_entry_safe(c, n, n2, &gtp_conn_tab[i], hlist) {
-			gtp_sessions_free(c);
-			FREE(c);
-		}
-		gtp_conn_unlock_id(i);
+	gtp_conn_t *c, *_c;
+	LIST_HEAD(l);
+
+	/* Collect first: table cant be updated while iterating */
+	gtp_oatab_iterate(&gtp_conn_tab, gtp_conn_release, &l);
+	list_for_each_entry_safe(c, _c, &l, next) {
+		list_head_del(&c->next);
+		gtp_sessions_free(c);
+		FREE(c);
 	}
 
-	FREE(gtp_conn_tab);
-	gtp_conn_lock_destroy();
+	grace_defer_flush(&gtp_conn_retired);
+	gtp_oatab_destroy(&gtp_conn_tab);
 	return 0;
 }
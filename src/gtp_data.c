@@ -291,6 +291,10 @@ free_daemon_data(void)
 		gtp_xdp_mirror_unload(&daemon_data->xdp_mirror);
 	if (__test_bit(GTP_FL_GTP_ROUTE_LOADED_BIT, &daemon_data->flags))
 		gtp_bpf_opts_destroy(&daemon_data->xdp_gtp_route, gtp_xdp_rt_unload);
+	gtp_repl_destroy();
+	gtp_ckpt_destroy();
+	gtp_reaper_destroy();
+	gtp_path_destroy();
 	gtp_switch_server_destroy();
 	gtp_router_server_destroy();
 	gtp_request_destroy();
@@ -304,6 +308,7 @@ free_daemon_data(void)
 	gtp_teid_destroy();
 	gtp_mirror_destroy();
 	gtp_vrf_destroy();
+	gtp_resolv_destroy();
 	gtp_apn_destroy();
 	FREE(daemon_data);
 }
@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/* Local data */
+uint8_t gtp_hash_algo[GTP_HASH_ID_MAX] = {
+	[0 ... GTP_HASH_ID_MAX - 1] = GTP_HASH_DEFAULT
+};
+uint64_t gtp_hash_secret[2];
+
+static const char *gtp_hash_algo_str[GTP_HASH_ALGO_MAX] = {
+	[GTP_HASH_JHASH]	= "jhash",
+	[GTP_HASH_CRC32C]	= "crc32c",
+	[GTP_HASH_XXH3]		= "xxh3",
+};
+
+static const char *gtp_hash_id_str[GTP_HASH_ID_MAX] = {
+	[GTP_HASH_TEID]		= "teid",
+	[GTP_HASH_SQN]		= "sqn",
+	[GTP_HASH_CONN]		= "conn",
+	[GTP_HASH_PPPOE]	= "pppoe",
+	[GTP_HASH_DLOCK]	= "dlock",
+};
+
+
+/*
+ *	CRC32C, hardware only
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define GTP_HASH_CRC32C_TARGET	__attribute__ ((target("sse4.2")))
+#define gtp_hash_crc32c_u32	_mm_crc32_u32
+#elif defined(__ARM_FEATURE_CRC32)
+#define GTP_HASH_CRC32C_TARGET
+#define gtp_hash_crc32c_u32	__crc32cw
+#endif
+
+#ifdef GTP_HASH_CRC32C_TARGET
+GTP_HASH_CRC32C_TARGET uint32_t
+gtp_hash_crc32c_1word(uint32_t a)
+{
+	return gtp_hash_crc32c_u32((uint32_t) gtp_hash_secret[1], a);
+}
+
+GTP_HASH_CRC32C_TARGET uint32_t
+gtp_hash_crc32c_2words(uint32_t a, uint32_t b)
+{
+	uint32_t crc = gtp_hash_crc32c_u32((uint32_t) gtp_hash_secret[1], a);
+	return gtp_hash_crc32c_u32(crc, b);
+}
+
+GTP_HASH_CRC32C_TARGET uint32_t
+gtp_hash_crc32c_3words(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t crc = gtp_hash_crc32c_u32((uint32_t) gtp_hash_secret[1], a);
+	crc = gtp_hash_crc32c_u32(crc, b);
+	return gtp_hash_crc32c_u32(crc, c);
+}
+
+static bool
+gtp_hash_crc32c_supported(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_cpu_supports("sse4.2");
+#else
+	return true;
+#endif
+}
+#else
+/* No CRC instruction: never selected, see gtp_hash_init() */
+uint32_t
+gtp_hash_crc32c_1word(uint32_t a)
+{
+	return jhash_1word(a, 0);
+}
+
+uint32_t
+gtp_hash_crc32c_2words(uint32_t a, uint32_t b)
+{
+	return jhash_2words(a, b, 0);
+}
+
+uint32_t
+gtp_hash_crc32c_3words(uint32_t a, uint32_t b, uint32_t c)
+{
+	return jhash_3words(a, b, c, 0);
+}
+
+static bool
+gtp_hash_crc32c_supported(void)
+{
+	return false;
+}
+#endif
+
+
+/*
+ *	Selection
+ */
+const char *
+gtp_hash_algo_name(int algo)
+{
+	return (algo < GTP_HASH_ALGO_MAX) ? gtp_hash_algo_str[algo] : "unknown";
+}
+
+const char *
+gtp_hash_id_name(int id)
+{
+	return (id < GTP_HASH_ID_MAX) ? gtp_hash_id_str[id] : "unknown";
+}
+
+static int
+gtp_hash_lookup(const char **str, int max, const char *name, size_t len)
+{
+	int i;
+
+	for (i = 0; i < max; i++) {
+		if (strlen(str[i]) == len && !strncmp(str[i], name, len))
+			return i;
+	}
+
+	return -1;
+}
+
+/* <table|all>=<algo>[,...] : must run before any table is populated */
+int
+gtp_hash_parse(const char *arg)
+{
+	const char *cp = arg, *eq, *end;
+	int id, algo;
+
+	while (*cp) {
+		end = strchrnul(cp, ',');
+		eq = memchr(cp, '=', end - cp);
+		if (!eq)
+			return -1;
+
+		algo = gtp_hash_lookup(gtp_hash_algo_str, GTP_HASH_ALGO_MAX
+				       , eq + 1, end - eq - 1);
+		if (algo < 0)
+			return -1;
+
+		if (eq - cp == 3 && !strncmp(cp, "all", 3)) {
+			for (id = 0; id < GTP_HASH_ID_MAX; id++)
+				gtp_hash_algo[id] = algo;
+		} else {
+			id = gtp_hash_lookup(gtp_hash_id_str, GTP_HASH_ID_MAX, cp, eq - cp);
+			if (id < 0)
+				return -1;
+			gtp_hash_algo[id] = algo;
+		}
+
+		cp = (*end) ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+int
+gtp_hash_init(void)
+{
+	bool crc32c = gtp_hash_crc32c_supported();
+	int i;
+
+	/* Per-boot secret */
+	if (getrandom(gtp_hash_secret, sizeof(gtp_hash_secret), 0) != sizeof(gtp_hash_secret)) {
+		gtp_hash_secret[0] = time(NULL) * GTP_HASH_PRIME64_1;
+		gtp_hash_secret[1] = getpid() * GTP_HASH_PRIME64_1;
+	}
+
+	for (i = 0; i < GTP_HASH_ID_MAX; i++) {
+		if (gtp_hash_algo[i] == GTP_HASH_CRC32C && !crc32c) {
+			log_message(LOG_INFO, "%s(): no CRC32C instruction, %s table"
+					      " falling back to jhash"
+					    , __FUNCTION__, gtp_hash_id_str[i]);
+			gtp_hash_algo[i] = GTP_HASH_JHASH;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ *	VTY
+ */
+DEFUN(show_gtp_hash,
+      show_gtp_hash_cmd,
+      "show gtp hash",
+      SHOW_STR
+      "GTP related informations\n"
+      "Hash function in use per table\n")
+{
+	int i;
+
+	for (i = 0; i < GTP_HASH_ID_MAX; i++)
+		vty_out(vty, " %-8s: %s%s"
+			   , gtp_hash_id_str[i]
+			   , gtp_hash_algo_str[gtp_hash_algo[i]]
+			   , VTY_NEWLINE);
+	return CMD_SUCCESS;
+}
+
+int
+gtp_hash_vty_init(void)
+{
+	install_element(VIEW_NODE, &show_gtp_hash_cmd);
+	install_element(ENABLE_NODE, &show_gtp_hash_cmd);
+
+	return 0;
+}
@@ -38,7 +38,7 @@
 static dlock_mutex_t *
 dlock_hash(dlock_mutex_t *__array, uint32_t w1, uint32_t w2)
 {
-	return __array + (jhash_2words(w1, w2, 0) & DLOCK_HASHTAB_MASK);
+	return __array + (gtp_hash_2words(GTP_HASH_DLOCK, w1, w2) & DLOCK_HASHTAB_MASK);
 }
 
 int
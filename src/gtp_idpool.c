@@ -0,0 +1,319 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <errno.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/*
+ *	Index to id bijection
+ *
+ * Multiplication by an odd number, addition and right xorshift are
+ * all bijective over n-bits integers, so is their composition.
+ */
+static uint32_t
+gtp_idpool_mul_inv(uint32_t k)
+{
+	uint32_t inv = k;
+	int i;
+
+	/* Newton iteration, each step doubles precision */
+	for (i = 0; i < 5; i++)
+		inv *= 2 - k * inv;
+	return inv;
+}
+
+static uint32_t
+gtp_idpool_xorshift_inv(uint32_t y, uint8_t shift, uint32_t mask)
+{
+	uint32_t x = y;
+	int s;
+
+	for (s = shift; s < 32; s += shift)
+		x ^= y >> s;
+	return x & mask;
+}
+
+static uint32_t
+gtp_idpool_permute(gtp_idpool_t *p, uint32_t x)
+{
+	if (!__test_bit(GTP_IDPOOL_FL_PERMUTE_BIT, &p->flags))
+		return x;
+
+	x = (x * p->key[0]) & p->mask;
+	x ^= x >> p->shift;
+	x = (x + p->key[1]) & p->mask;
+	x = (x * p->key[2]) & p->mask;
+	x ^= x >> p->shift;
+	return x;
+}
+
+static uint32_t
+gtp_idpool_permute_inv(gtp_idpool_t *p, uint32_t x)
+{
+	if (!__test_bit(GTP_IDPOOL_FL_PERMUTE_BIT, &p->flags))
+		return x;
+
+	x = gtp_idpool_xorshift_inv(x, p->shift, p->mask);
+	x = (x * p->key_inv[1]) & p->mask;
+	x = (x - p->key[1]) & p->mask;
+	x = gtp_idpool_xorshift_inv(x, p->shift, p->mask);
+	x = (x * p->key_inv[0]) & p->mask;
+	return x;
+}
+
+static int
+gtp_idpool_index(gtp_idpool_t *p, uint32_t id, uint32_t *idx)
+{
+	if ((id & ~p->mask) != p->base)
+		return -1;
+
+	*idx = gtp_idpool_permute_inv(p, id & p->mask);
+	return (*idx < p->size) ? 0 : -1;
+}
+
+
+/*
+ *	Bitmap & ring of not-full words
+ */
+static void
+__gtp_idpool_ring_push(gtp_idpool_t *p, uint32_t word)
+{
+	uint32_t nr_words = p->size / GTP_IDPOOL_WORD_BITS;
+
+	p->ring[(p->ring_head + p->ring_cnt) % nr_words] = word;
+	p->ring_cnt++;
+}
+
+static void
+__gtp_idpool_ring_pop(gtp_idpool_t *p)
+{
+	uint32_t nr_words = p->size / GTP_IDPOOL_WORD_BITS;
+
+	p->ring_head = (p->ring_head + 1) % nr_words;
+	p->ring_cnt--;
+}
+
+static int
+__gtp_idpool_set(gtp_idpool_t *p, uint32_t idx)
+{
+	uint32_t word = idx / GTP_IDPOOL_WORD_BITS;
+	uint64_t bit = 1ULL << (idx % GTP_IDPOOL_WORD_BITS);
+
+	if (p->bitmap[word] & bit)
+		return -1;
+
+	p->bitmap[word] |= bit;
+	p->used++;
+	return 0;
+}
+
+int
+gtp_idpool_get(gtp_idpool_t *p, uint32_t *id)
+{
+	uint32_t word, idx, bit;
+	uint64_t free;
+
+	if (!p)
+		return -1;
+
+	pthread_mutex_lock(&p->mutex);
+	if (!p->ring_cnt) {
+		p->exhausted++;
+		pthread_mutex_unlock(&p->mutex);
+		return -1;
+	}
+
+	/* Sweep head word from cursor, so that ids released in
+	 * this word are not handed out again before next round */
+	for (;;) {
+		word = p->ring[p->ring_head];
+		free = ~p->bitmap[word] & (~0ULL << p->cursor);
+		if (free)
+			break;
+
+		__gtp_idpool_ring_pop(p);
+		__gtp_idpool_ring_push(p, word);
+		p->cursor = 0;
+	}
+
+	bit = __builtin_ctzll(free);
+	idx = word * GTP_IDPOOL_WORD_BITS + bit;
+	__gtp_idpool_set(p, idx);
+	p->cursor = bit + 1;
+	if (!~p->bitmap[word]) {
+		__gtp_idpool_ring_pop(p);
+		p->cursor = 0;
+	} else if (p->cursor == GTP_IDPOOL_WORD_BITS) {
+		__gtp_idpool_ring_pop(p);
+		__gtp_idpool_ring_push(p, word);
+		p->cursor = 0;
+	}
+	p->alloc++;
+	pthread_mutex_unlock(&p->mutex);
+
+	*id = p->base | gtp_idpool_permute(p, idx);
+	return 0;
+}
+
+int
+gtp_idpool_put(gtp_idpool_t *p, uint32_t id)
+{
+	uint32_t word, idx;
+	uint64_t bit;
+
+	if (!p || gtp_idpool_index(p, id, &idx) < 0)
+		return -1;
+
+	word = idx / GTP_IDPOOL_WORD_BITS;
+	bit = 1ULL << (idx % GTP_IDPOOL_WORD_BITS);
+
+	pthread_mutex_lock(&p->mutex);
+	if (!(p->bitmap[word] & bit)) {
+		pthread_mutex_unlock(&p->mutex);
+		return -1;
+	}
+
+	if (!~p->bitmap[word])
+		__gtp_idpool_ring_push(p, word);
+	p->bitmap[word] &= ~bit;
+	p->used--;
+	p->release++;
+	pthread_mutex_unlock(&p->mutex);
+	return 0;
+}
+
+/* Keep an id out of allocation. Meant for a few well-known ids
+ * (ie: 0), reserving a whole word is refused so that ring only
+ * ever holds not-full words */
+int
+gtp_idpool_reserve(gtp_idpool_t *p, uint32_t id)
+{
+	uint32_t word, idx;
+	uint64_t bit;
+	int err = -1;
+
+	if (!p || gtp_idpool_index(p, id, &idx) < 0)
+		return -1;
+
+	word = idx / GTP_IDPOOL_WORD_BITS;
+	bit = 1ULL << (idx % GTP_IDPOOL_WORD_BITS);
+
+	pthread_mutex_lock(&p->mutex);
+	if (!(p->bitmap[word] & bit) && ~(p->bitmap[word] | bit))
+		err = __gtp_idpool_set(p, idx);
+	pthread_mutex_unlock(&p->mutex);
+	return err;
+}
+
+bool
+gtp_idpool_owns(gtp_idpool_t *p, uint32_t id)
+{
+	uint32_t idx;
+
+	return p && !gtp_idpool_index(p, id, &idx);
+}
+
+
+/*
+ *	VTY helper
+ */
+int
+gtp_idpool_vty(vty_t *vty, const char *label, gtp_idpool_t *p)
+{
+	if (!p)
+		return -1;
+
+	vty_out(vty, "  %-12s used:%u/%u (%u.%.2u%%) alloc:%" PRIu64
+		     " release:%" PRIu64 " exhausted:%" PRIu64 "%s"
+		   , label, p->used, p->size
+		   , (uint32_t) ((uint64_t) p->used * 100 / p->size)
+		   , (uint32_t) ((uint64_t) p->used * 10000 / p->size % 100)
+		   , p->alloc, p->release, p->exhausted
+		   , VTY_NEWLINE);
+	return 0;
+}
+
+
+/*
+ *	Pool init
+ */
+gtp_idpool_t *
+gtp_idpool_alloc(uint32_t base, int bits, uint32_t size, bool permute)
+{
+	unsigned int seed = time(NULL) ^ base;
+	uint32_t nr_words, i;
+	gtp_idpool_t *new;
+
+	if (bits < 8 || bits > 32)
+		return NULL;
+
+	/* Index space is a whole number of words */
+	if (bits < 32 && size > (1U << bits))
+		size = 1U << bits;
+	size &= ~(GTP_IDPOOL_WORD_BITS - 1);
+	if (!size)
+		return NULL;
+	nr_words = size / GTP_IDPOOL_WORD_BITS;
+
+	PMALLOC(new);
+	new->mask = (bits == 32) ? ~0U : (1U << bits) - 1;
+	new->base = base & ~new->mask;
+	new->size = size;
+	new->shift = (bits + 1) / 2;
+	new->bitmap = MALLOC(nr_words * sizeof(uint64_t));
+	new->ring = MALLOC(nr_words * sizeof(uint32_t));
+	pthread_mutex_init(&new->mutex, NULL);
+
+	for (i = 0; i < nr_words; i++)
+		__gtp_idpool_ring_push(new, i);
+
+	if (permute) {
+		for (i = 0; i < 3; i++)
+			new->key[i] = poor_prng(&seed) ^ (poor_prng(&seed) << 16);
+		new->key[0] |= 1;
+		new->key[2] |= 1;
+		new->key_inv[0] = gtp_idpool_mul_inv(new->key[0]);
+		new->key_inv[1] = gtp_idpool_mul_inv(new->key[2]);
+		__set_bit(GTP_IDPOOL_FL_PERMUTE_BIT, &new->flags);
+	}
+
+	return new;
+}
+
+void
+gtp_idpool_free(gtp_idpool_t *p)
+{
+	if (!p)
+		return;
+
+	pthread_mutex_destroy(&p->mutex);
+	FREE(p->bitmap);
+	FREE(p->ring);
+	FREE(p);
+}
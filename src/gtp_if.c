@@ -361,6 +361,22 @@ if_setsockopt_attach_bpf(int sd, int prog_fd)
 	return sd;
 }
 
+int
+if_setsockopt_attach_reuseport_bpf(int sd, int prog_fd)
+{
+	int ret;
+
+	ret = setsockopt(sd, SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, &prog_fd, sizeof(prog_fd));
+	if (ret < 0) {
+		log_message(LOG_INFO, "%s(): Error attaching reuseport eBPF program to socket (%m)\n"
+				    , __FUNCTION__);
+		close(sd);
+		return -1;
+	}
+
+	return sd;
+}
+
 /*
  *	BPF L3 filtering code. Only work on SOCK_RAW !!!
  *
@@ -0,0 +1,452 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <string.h>
+#include <endian.h>
+#include <inttypes.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/*
+ *	Locking
+ */
+static inline void
+gtp_ip_pool_lock(uint32_t *lock)
+{
+	while (__sync_lock_test_and_set(lock, 1))
+		cpu_relax();
+}
+
+static inline void
+gtp_ip_pool_unlock(uint32_t *lock)
+{
+	__sync_lock_release(lock);
+}
+
+
+/*
+ *	Bitmap, under pool lock
+ */
+static inline void
+__gtp_ip_pool_set_free(gtp_ip_pool_t *p, uint64_t idx)
+{
+	uint32_t w = idx / 64;
+
+	p->bitmap[w] |= 1ULL << (idx % 64);
+	p->summary[w / 64] |= 1ULL << (w % 64);
+}
+
+static int
+__gtp_ip_pool_bitmap_get(gtp_ip_pool_t *p, uint64_t *idx)
+{
+	uint32_t s = p->hint, i, w;
+	int b;
+
+	for (i = 0; i < p->nr_summary; i++, s++) {
+		if (s == p->nr_summary)
+			s = 0;
+		if (!p->summary[s])
+			continue;
+
+		w = s * 64 + __builtin_ctzll(p->summary[s]);
+		b = __builtin_ctzll(p->bitmap[w]);
+		p->bitmap[w] &= ~(1ULL << b);
+		if (!p->bitmap[w])
+			p->summary[s] &= ~(1ULL << (w % 64));
+
+		p->hint = s;
+		*idx = (uint64_t) w * 64 + b;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int
+__gtp_ip_pool_bitmap_put(gtp_ip_pool_t *p, uint64_t idx)
+{
+	if (p->bitmap[idx / 64] & (1ULL << (idx % 64)))
+		return -1;
+
+	__gtp_ip_pool_set_free(p, idx);
+	return 0;
+}
+
+
+/*
+ *	Leased units, lock-free
+ */
+static inline void
+gtp_ip_pool_leased_set(gtp_ip_pool_t *p, uint64_t idx)
+{
+	__atomic_fetch_or(&p->leased[idx / 64], 1ULL << (idx % 64), __ATOMIC_RELAXED);
+}
+
+static inline bool
+gtp_ip_pool_leased_clear(gtp_ip_pool_t *p, uint64_t idx)
+{
+	uint64_t bit = 1ULL << (idx % 64);
+
+	return __atomic_fetch_and(&p->leased[idx / 64], ~bit, __ATOMIC_RELAXED) & bit;
+}
+
+
+/*
+ *	Lease
+ */
+static int
+gtp_ip_pool_cache_refill(gtp_ip_pool_t *p, gtp_ip_pool_cache_t *c)
+{
+	uint32_t n = 0;
+
+	gtp_ip_pool_lock(&p->lock);
+	while (n < GTP_IP_POOL_CACHE_BATCH && !__gtp_ip_pool_bitmap_get(p, &c->idx[c->cnt]))
+		c->cnt++, n++;
+	gtp_ip_pool_unlock(&p->lock);
+
+	__sync_add_and_fetch(&p->cached, n);
+	return n;
+}
+
+static void
+gtp_ip_pool_cache_flush(gtp_ip_pool_t *p, gtp_ip_pool_cache_t *c, uint32_t n)
+{
+	uint32_t i;
+
+	/* Oldest entries go back first */
+	gtp_ip_pool_lock(&p->lock);
+	for (i = 0; i < n; i++)
+		__gtp_ip_pool_bitmap_put(p, c->idx[i]);
+	gtp_ip_pool_unlock(&p->lock);
+
+	c->cnt -= n;
+	memmove(c->idx, c->idx + n, c->cnt * sizeof(uint64_t));
+	__sync_sub_and_fetch(&p->cached, n);
+}
+
+/* Bitmap is empty, last leases are held by other caches */
+static int
+gtp_ip_pool_steal(gtp_ip_pool_t *p, int shard, uint64_t *idx)
+{
+	gtp_ip_pool_cache_t *c;
+	int i, ret = -1;
+
+	for (i = 1; i < GTP_IP_POOL_SHARDS && ret; i++) {
+		c = &p->cache[(shard + i) & GTP_IP_POOL_SHARDS_MASK];
+		gtp_ip_pool_lock(&c->lock);
+		if (c->cnt) {
+			*idx = c->idx[--c->cnt];
+			__sync_sub_and_fetch(&p->cached, 1);
+			ret = 0;
+		}
+		gtp_ip_pool_unlock(&c->lock);
+	}
+
+	return ret;
+}
+
+int
+gtp_ip_pool_lease(gtp_ip_pool_t *p, int shard, uint64_t *idx)
+{
+	gtp_ip_pool_cache_t *c = &p->cache[shard & GTP_IP_POOL_SHARDS_MASK];
+
+	gtp_ip_pool_lock(&c->lock);
+	if (!c->cnt && !gtp_ip_pool_cache_refill(p, c)) {
+		gtp_ip_pool_unlock(&c->lock);
+		if (gtp_ip_pool_steal(p, shard, idx) < 0) {
+			__sync_add_and_fetch(&p->exhausted, 1);
+			return -1;
+		}
+		goto end;
+	}
+
+	*idx = c->idx[--c->cnt];
+	gtp_ip_pool_unlock(&c->lock);
+	__sync_sub_and_fetch(&p->cached, 1);
+
+  end:
+	gtp_ip_pool_leased_set(p, *idx);
+	__sync_add_and_fetch(&p->used, 1);
+	__sync_add_and_fetch(&p->alloc, 1);
+	return 0;
+}
+
+int
+gtp_ip_pool_release(gtp_ip_pool_t *p, int shard, uint64_t idx)
+{
+	gtp_ip_pool_cache_t *c = &p->cache[shard & GTP_IP_POOL_SHARDS_MASK];
+
+	if (idx < p->first || idx >= p->last)
+		return -1;
+
+	/* Already free, would be handed out twice */
+	if (!gtp_ip_pool_leased_clear(p, idx)) {
+		__sync_add_and_fetch(&p->invalid, 1);
+		return -1;
+	}
+
+	gtp_ip_pool_lock(&c->lock);
+	if (c->cnt == GTP_IP_POOL_CACHE_SIZE)
+		gtp_ip_pool_cache_flush(p, c, GTP_IP_POOL_CACHE_BATCH);
+	c->idx[c->cnt++] = idx;
+	gtp_ip_pool_unlock(&c->lock);
+
+	__sync_add_and_fetch(&p->cached, 1);
+	__sync_sub_and_fetch(&p->used, 1);
+	__sync_add_and_fetch(&p->release, 1);
+	return 0;
+}
+
+
+/* Take a given lease unit out of the pool, used when restoring
+ * sessions. Unit may sit in bitmap or in any lease cache. */
+int
+gtp_ip_pool_reserve(gtp_ip_pool_t *p, uint64_t idx)
+{
+	uint64_t bit = 1ULL << (idx % 64);
+	gtp_ip_pool_cache_t *c;
+	uint32_t w = idx / 64, i, j;
+	int ret = -1;
+
+	if (idx < p->first || idx >= p->last)
+		return -1;
+
+	gtp_ip_pool_lock(&p->lock);
+	if (p->bitmap[w] & bit) {
+		p->bitmap[w] &= ~bit;
+		if (!p->bitmap[w])
+			p->summary[w / 64] &= ~(1ULL << (w % 64));
+		ret = 0;
+	}
+	gtp_ip_pool_unlock(&p->lock);
+
+	for (i = 0; i < GTP_IP_POOL_SHARDS && ret; i++) {
+		c = &p->cache[i];
+		gtp_ip_pool_lock(&c->lock);
+		for (j = 0; j < c->cnt; j++) {
+			if (c->idx[j] != idx)
+				continue;
+			c->idx[j] = c->idx[--c->cnt];
+			__sync_sub_and_fetch(&p->cached, 1);
+			ret = 0;
+			break;
+		}
+		gtp_ip_pool_unlock(&c->lock);
+	}
+
+	/* Already leased */
+	if (ret)
+		return -1;
+
+	gtp_ip_pool_leased_set(p, idx);
+	__sync_add_and_fetch(&p->used, 1);
+	__sync_add_and_fetch(&p->alloc, 1);
+	return 0;
+}
+
+/*
+ *	Address mapping
+ */
+uint32_t
+gtp_ip_pool_addr(gtp_ip_pool_t *p, uint64_t idx)
+{
+	return htonl(ntohl(p->network) + idx);
+}
+
+int
+gtp_ip_pool_addr_idx(gtp_ip_pool_t *p, uint32_t addr, uint64_t *idx)
+{
+	if ((addr & p->netmask) != p->network)
+		return -1;
+
+	*idx = ntohl(addr & ~p->netmask);
+	return 0;
+}
+
+void
+gtp_ip6_pool_prefix(gtp_ip_pool_t *p, uint64_t idx, struct in6_addr *prefix)
+{
+	uint64_t hi;
+
+	memcpy(&hi, &p->prefix, sizeof(uint64_t));
+	hi = htobe64(be64toh(hi) | idx);
+	memset(prefix, 0, sizeof(*prefix));
+	memcpy(prefix, &hi, sizeof(uint64_t));
+}
+
+int
+gtp_ip6_pool_prefix_idx(gtp_ip_pool_t *p, struct in6_addr *prefix, uint64_t *idx)
+{
+	uint64_t hi, net, mask = ~0ULL << (64 - p->prefix_len);
+
+	memcpy(&hi, prefix, sizeof(uint64_t));
+	memcpy(&net, &p->prefix, sizeof(uint64_t));
+	hi = be64toh(hi);
+	if ((hi & mask) != be64toh(net))
+		return -1;
+
+	*idx = hi & ~mask;
+	return 0;
+}
+
+
+/*
+ *	Pool
+ */
+static gtp_ip_pool_t *
+gtp_ip_pool_bitmap_alloc(gtp_ip_pool_t *new)
+{
+	uint64_t idx;
+
+	new->nr_word = (new->size + 63) / 64;
+	new->nr_summary = (new->nr_word + 63) / 64;
+	new->bitmap = MALLOC(new->nr_word * sizeof(uint64_t));
+	new->summary = MALLOC(new->nr_summary * sizeof(uint64_t));
+	new->leased = MALLOC(new->nr_word * sizeof(uint64_t));
+	if (!new->bitmap || !new->summary || !new->leased) {
+		gtp_ip_pool_destroy(new);
+		return NULL;
+	}
+
+	for (idx = new->first; idx < new->last; idx++)
+		__gtp_ip_pool_set_free(new, idx);
+	return new;
+}
+
+gtp_ip_pool_t *
+gtp_ip_pool_alloc(uint32_t network, uint32_t netmask)
+{
+	gtp_ip_pool_t *new;
+
+	PMALLOC(new);
+	if (!new)
+		return NULL;
+	new->family = AF_INET;
+	new->network = network & netmask;
+	new->netmask = netmask;
+	new->size = (uint64_t) ntohl(~netmask) + 1;
+	new->first = GTP_IP_POOL_V4_RESERVED;
+	new->last = (new->size > 2 * GTP_IP_POOL_V4_RESERVED + 1) ?
+		    new->size - 1 - GTP_IP_POOL_V4_RESERVED : new->first;
+
+	return gtp_ip_pool_bitmap_alloc(new);
+}
+
+gtp_ip_pool_t *
+gtp_ip6_pool_alloc(struct in6_addr *prefix, uint8_t prefix_len)
+{
+	gtp_ip_pool_t *new;
+	uint64_t hi;
+
+	if (prefix_len < GTP_IP_POOL_V6_MIN_PLEN || prefix_len > 64)
+		return NULL;
+
+	PMALLOC(new);
+	if (!new)
+		return NULL;
+	new->family = AF_INET6;
+	new->prefix_len = prefix_len;
+	memcpy(&hi, prefix, sizeof(uint64_t));
+	hi = htobe64(be64toh(hi) & (~0ULL << (64 - prefix_len)));
+	memcpy(&new->prefix, &hi, sizeof(uint64_t));
+
+	/* One /64 per lease, first one is kept */
+	new->size = 1ULL << (64 - prefix_len);
+	new->first = (new->size > 1) ? 1 : 0;
+	new->last = new->size;
+
+	return gtp_ip_pool_bitmap_alloc(new);
+}
+
+void
+gtp_ip_pool_destroy(gtp_ip_pool_t *p)
+{
+	if (!p)
+		return;
+
+	if (p->bitmap)
+		FREE(p->bitmap);
+	if (p->summary)
+		FREE(p->summary);
+	if (p->leased)
+		FREE(p->leased);
+	FREE(p);
+}
+
+
+/*
+ *	VTY
+ */
+void
+gtp_ip_pool_vty(vty_t *vty, gtp_ip_pool_t *p)
+{
+	uint64_t usable = p->last - p->first, free = 0, run = 0, largest = 0, extents = 0;
+	uint64_t word;
+	uint32_t w;
+	char addr_str[INET6_ADDRSTRLEN];
+	int b;
+
+	/* Free units still in the bitmap, cached ones are not counted
+	 * as fragmentation */
+	gtp_ip_pool_lock(&p->lock);
+	for (w = 0; w < p->nr_word; w++) {
+		word = p->bitmap[w];
+		if (word == ~0ULL) {
+			extents += !run;
+			run += 64;
+			free += 64;
+			continue;
+		}
+
+		for (b = 0; b < 64; b++) {
+			if (word & (1ULL << b)) {
+				extents += !run;
+				run++;
+				free++;
+				continue;
+			}
+			largest = (run > largest) ? run : largest;
+			run = 0;
+		}
+	}
+	largest = (run > largest) ? run : largest;
+	gtp_ip_pool_unlock(&p->lock);
+
+	if (p->family == AF_INET)
+		vty_out(vty, " ip-pool %u.%u.%u.%u/%u.%u.%u.%u%s"
+			   , NIPQUAD(p->network), NIPQUAD(p->netmask), VTY_NEWLINE);
+	else
+		vty_out(vty, " ip6-pool %s/%u (/64 prefixes)%s"
+			   , inet_ntop(AF_INET6, &p->prefix, addr_str, sizeof(addr_str))
+			   , p->prefix_len, VTY_NEWLINE);
+	vty_out(vty, "  leased:%" PRIu64 "/%" PRIu64 " (%.1f%%) cached:%" PRIu64
+		     " alloc:%" PRIu64 " release:%" PRIu64 " exhausted:%" PRIu64
+		     " invalid-release:%" PRIu64 "%s"
+		   , p->used, usable, (usable) ? 100.0 * p->used / usable : 0.0
+		   , p->cached, p->alloc, p->release, p->exhausted, p->invalid, VTY_NEWLINE);
+	vty_out(vty, "  free extents:%" PRIu64 " largest:%" PRIu64 " fragmentation:%.1f%%%s"
+		   , extents, largest, (free) ? 100.0 * (free - largest) / free : 0.0
+		   , VTY_NEWLINE);
+}
@@ -43,73 +43,121 @@ gtp_msg_hlen(gtp_hdr_t *h)
 	return len;
 }
 
-static inline bool
-gtp_msg_ie_less(rb_node_t *a, const rb_node_t *b)
+void
+gtp_msg_ie_dump(const gtp_msg_ie_t *msg_ie)
 {
-	const gtp_msg_ie_t *r1 = rb_entry_const(a, gtp_msg_ie_t, n);
-	const gtp_msg_ie_t *r2 = rb_entry_const(b, gtp_msg_ie_t, n);
+	printf("IE Type : %d (instance:%d)\n", msg_ie->h->type, msg_ie->h->instance);
+	dump_buffer("  ", (char *) msg_ie->data, ntohs(msg_ie->h->length));
+}
 
-	return r1->h->type < r2->h->type;
+gtp_msg_ie_t *
+gtp_msg_ie_get(gtp_msg_t *msg, uint8_t type)
+{
+	return msg->type[type];
 }
 
-static gtp_msg_ie_t *
-gtp_msg_ie_alloc(const uint8_t *buffer, rb_root_cached_t *rbroot)
+gtp_msg_ie_t *
+gtp_msg_ie_get_instance(gtp_msg_t *msg, uint8_t type, uint8_t instance)
 {
 	gtp_msg_ie_t *msg_ie;
 
-	PMALLOC(msg_ie);
-	if (!msg_ie)
-		return NULL;
-	msg_ie->h = (gtp_ie_t *) buffer;
-	msg_ie->data = buffer + sizeof(gtp_ie_t);
-	rb_add_cached(&msg_ie->n, rbroot, gtp_msg_ie_less);
+	for (msg_ie = msg->type[type]; msg_ie; msg_ie = msg_ie->next) {
+		if (msg_ie->h->instance == instance)
+			return msg_ie;
+	}
 
-	return msg_ie;
+	return NULL;
 }
 
-void
-gtp_msg_ie_destroy(gtp_msg_ie_t *msg_ie)
+gtp_msg_ie_t *
+gtp_msg_ie_child_get(gtp_msg_ie_t *parent, uint8_t type)
 {
-	FREE(msg_ie);
+	gtp_msg_ie_t *msg_ie;
+
+	gtp_msg_ie_for_each_child(parent, msg_ie) {
+		if (msg_ie->type == type)
+			return msg_ie;
+	}
+
+	return NULL;
 }
 
-void
-gtp_msg_ie_dump(const gtp_msg_ie_t *msg_ie)
+uint8_t *
+gtp_msg_ie_buffer(gtp_msg_t *msg, uint8_t type)
 {
-	printf("IE Type : %d\n", msg_ie->h->type);
-	dump_buffer("  ", (char *) msg_ie->data, ntohs(msg_ie->h->length));
-}
+	gtp_msg_ie_t *msg_ie = msg->type[type];
 
+	return (msg_ie) ? (uint8_t *) msg_ie->h : NULL;
+}
 
-static int
-gtp_msg_ie_cmp(const void *type, const struct rb_node *a)
+static gtp_msg_ie_t *
+gtp_msg_ie_add(gtp_msg_t *msg, const uint8_t *buffer, const uint8_t *data, bool child)
 {
-	return less_equal_greater_than(*((uint8_t *) type), rb_entry_const(a, gtp_msg_ie_t, n)->h->type);
+	gtp_msg_ie_t *msg_ie, **pprev;
+
+	if (msg->ie_cnt >= GTP_MSG_IE_MAX) {
+		msg->ie_dropped++;
+		msg->ie_dropped_total++;
+		return NULL;
+	}
+
+	msg_ie = &msg->ie[msg->ie_cnt++];
+	msg_ie->h = (gtp_ie_t *) buffer;
+	msg_ie->data = data;
+	msg_ie->type = *buffer;
+	msg_ie->nr_child = 0;
+	msg_ie->next = NULL;
+	if (child)
+		return msg_ie;
+
+	/* Keep message order for same type IEs */
+	for (pprev = &msg->type[msg_ie->type]; *pprev; pprev = &(*pprev)->next) ;
+	*pprev = msg_ie;
+	return msg_ie;
 }
 
-gtp_msg_ie_t *
-gtp_msg_ie_get(gtp_msg_t *msg, uint8_t type)
+static void
+gtp_msg_ie_grouped_parse(gtp_msg_t *msg, gtp_msg_ie_t *parent, const uint8_t *end)
 {
-	rb_root_cached_t *root = &msg->ie;
-	rb_node_t *node;
+	const uint8_t *cp;
+	size_t offset;
+	gtp_ie_t *ie;
+
+	for (cp = parent->data; cp < end; cp += offset) {
+		ie = (gtp_ie_t *) cp;
+		offset = sizeof(gtp_ie_t) + ntohs(ie->length);
+		if (cp + offset > end)
+			return;
 
-	node = rb_find(&type, &root->rb_root, gtp_msg_ie_cmp);
-	return (node) ? rb_entry(node, gtp_msg_ie_t, n) : NULL;
+		if (!gtp_msg_ie_add(msg, cp, cp + sizeof(gtp_ie_t), true))
+			return;
+		parent->nr_child++;
+	}
 }
 
-gtp_msg_t *
-gtp_msg_alloc(const pkt_buffer_t *pbuff)
+void
+gtp_msg_reset(gtp_msg_t *msg)
+{
+	int i;
+
+	/* Only clear what previous message used. Children are not
+	 * referenced by type table but clearing is harmless */
+	for (i = 0; i < msg->ie_cnt; i++)
+		msg->type[msg->ie[i].type] = NULL;
+	msg->ie_cnt = msg->ie_dropped = 0;
+	msg->h = NULL;
+}
+
+int
+gtp_msg_parse(gtp_msg_t *msg, const pkt_buffer_t *pbuff)
 {
+	gtp_msg_ie_t *msg_ie;
 	const uint8_t *cp;
 	size_t offset;
-	gtp_msg_t *msg;
 	gtp_ie_t *ie;
 
-	PMALLOC(msg);
-	if (!msg)
-		return NULL;
+	gtp_msg_reset(msg);
 	msg->h = (gtp_hdr_t *) pbuff->head;
-	msg->ie = RB_ROOT_CACHED;
 	offset = gtp_msg_hlen(msg->h);
 
 	for (cp = pbuff->head + offset; cp < pbuff->end; cp += offset) {
@@ -120,22 +168,64 @@ gtp_msg_alloc(const pkt_buffer_t *pbuff)
 		if (cp + offset > pbuff->end)
 			continue;
 
-		gtp_msg_ie_alloc(cp, &msg->ie);
+		msg_ie = gtp_msg_ie_add(msg, cp, cp + sizeof(gtp_ie_t), false);
+		if (msg_ie && ie->type == GTP_IE_BEARER_CONTEXT_TYPE)
+			gtp_msg_ie_grouped_parse(msg, msg_ie, cp + offset);
 	}
 
+	return msg->ie_cnt;
+}
+
+int
+gtp1_msg_parse(gtp_msg_t *msg, const pkt_buffer_t *pbuff)
+{
+	gtp1_hdr_t *h = (gtp1_hdr_t *) pbuff->head;
+	const uint8_t *cp;
+	size_t offset;
+	gtp1_ie_t *ie;
+
+	gtp_msg_reset(msg);
+	msg->h = (gtp_hdr_t *) pbuff->head;
+	offset = gtp1_get_header_len(h);
+
+	for (cp = pbuff->head + offset; cp < pbuff->end; cp += offset) {
+		/* TV format */
+		if (*cp < 0x80) {
+			offset = gtp1_ie_tv_len(*cp) + 1;
+			if (cp + offset > pbuff->end)
+				break;
+			gtp_msg_ie_add(msg, cp, cp + 1, false);
+			continue;
+		}
+
+		/* TLV format */
+		ie = (gtp1_ie_t *) cp;
+		offset = sizeof(gtp1_ie_t) + ntohs(ie->length);
+		if (cp + offset > pbuff->end)
+			break;
+		gtp_msg_ie_add(msg, cp, cp + sizeof(gtp1_ie_t), false);
+	}
+
+	return msg->ie_cnt;
+}
+
+gtp_msg_t *
+gtp_msg_alloc(const pkt_buffer_t *pbuff)
+{
+	gtp_msg_t *msg;
+
+	PMALLOC(msg);
+	if (!msg)
+		return NULL;
+
+	if (pbuff)
+		gtp_msg_parse(msg, pbuff);
 	return msg;
 }
 
 void
 gtp_msg_destroy(gtp_msg_t *msg)
 {
-	gtp_msg_ie_t *msg_ie, *_msg_ie;
-	rb_root_cached_t *root = &msg->ie;
-	
-	rb_for_each_entry_safe_cached(msg_ie, _msg_ie, root, n) {
-		rb_erase_cached(&msg_ie->n, root);
-		gtp_msg_ie_destroy(msg_ie);
-	}
 	FREE(msg);
 }
 
@@ -143,10 +233,10 @@ void
 gtp_msg_dump(gtp_msg_t *msg)
 {
 	gtp_hdr_t *h = msg->h;
-	gtp_msg_ie_t *msg_ie;
+	int i;
 
 	printf("GPRS Tunneling Protocol V2\n");
 	printf("Flags : 0x%.x\n", h->flags);
-	rb_for_each_entry_cached(msg_ie, &msg->ie, n)
-		gtp_msg_ie_dump(msg_ie);
+	for (i = 0; i < msg->ie_cnt; i++)
+		gtp_msg_ie_dump(&msg->ie[i]);
 }
@@ -0,0 +1,624 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <errno.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/*
+ *	Control bytes helpers
+ */
+static inline uint32_t
+gtp_oatab_hash(gtp_oatab_t *t, uint64_t key)
+{
+	if (gtp_hash_algo[t->hash] == GTP_HASH_JHASH)
+		return jhash_2words((uint32_t) key, (uint32_t) (key >> 32), t->seed);
+	return gtp_hash_2words(t->hash, (uint32_t) key, (uint32_t) (key >> 32));
+}
+
+static inline uint8_t
+gtp_oatab_tag(uint32_t hash)
+{
+	return hash >> 25;
+}
+
+static inline uint32_t
+gtp_oatab_match(const uint8_t *ctrl, uint8_t c)
+{
+#if defined(__SSE2__)
+	__m128i v = _mm_loadu_si128((const __m128i *) ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+#else
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < GTP_OATAB_GROUP_SLOTS; i++)
+		mask |= (ctrl[i] == c) << i;
+	return mask;
+#endif
+}
+
+/* EMPTY or DELETED, both have MSB set */
+static inline uint32_t
+gtp_oatab_match_free(const uint8_t *ctrl)
+{
+#if defined(__SSE2__)
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < GTP_OATAB_GROUP_SLOTS; i++)
+		mask |= (ctrl[i] >> 7) << i;
+	return mask;
+#endif
+}
+
+
+/*
+ *	Group write side
+ */
+static inline void
+gtp_oatab_spin_lock(uint32_t *lock)
+{
+	while (__sync_lock_test_and_set(lock, 1))
+		cpu_relax();
+}
+
+static inline void
+gtp_oatab_spin_unlock(uint32_t *lock)
+{
+	__sync_lock_release(lock);
+}
+
+static inline void
+gtp_oatab_group_lock(gtp_oatab_group_t *g)
+{
+	gtp_oatab_spin_lock(&g->lock);
+}
+
+static inline void
+gtp_oatab_group_unlock(gtp_oatab_group_t *g)
+{
+	gtp_oatab_spin_unlock(&g->lock);
+}
+
+static inline void
+gtp_oatab_write_begin(gtp_oatab_group_t *g)
+{
+	__atomic_store_n(&g->seq, g->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+gtp_oatab_write_end(gtp_oatab_group_t *g)
+{
+	__atomic_store_n(&g->seq, g->seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ *	Table
+ */
+static gtp_oatab_table_t *
+gtp_oatab_table_alloc(uint32_t nr_groups)
+{
+	gtp_oatab_table_t *new;
+	size_t size = sizeof(gtp_oatab_group_t) * nr_groups;
+	uint32_t i;
+
+	PMALLOC(new);
+	if (posix_memalign((void **) &new->group, 64, size)) {
+		FREE(new);
+		return NULL;
+	}
+
+	memset(new->group, 0, size);
+	for (i = 0; i < nr_groups; i++)
+		memset(new->group[i].ctrl, GTP_OATAB_CTRL_EMPTY, GTP_OATAB_GROUP_SLOTS);
+	new->mask = nr_groups - 1;
+	return new;
+}
+
+static void
+gtp_oatab_table_free(gtp_oatab_table_t *tab)
+{
+	free(tab->group);
+	FREE(tab);
+}
+
+static size_t
+gtp_oatab_table_size(gtp_oatab_table_t *tab)
+{
+	return (tab->mask + 1) * sizeof(gtp_oatab_group_t);
+}
+
+static void
+gtp_oatab_table_release(grace_obj_t *obj)
+{
+	gtp_oatab_table_t *tab = container_of(obj, gtp_oatab_table_t, gp);
+
+	__sync_sub_and_fetch(&tab->owner->retired_size, gtp_oatab_table_size(tab));
+	gtp_oatab_table_free(tab);
+}
+
+static inline uint32_t
+gtp_oatab_table_slots(gtp_oatab_table_t *tab)
+{
+	return (tab->mask + 1) * GTP_OATAB_GROUP_SLOTS;
+}
+
+/* Unlocked insert, table not published yet */
+static void
+__gtp_oatab_table_insert(gtp_oatab_table_t *tab, uint32_t hash, uint64_t key, void *value)
+{
+	uint32_t idx = hash & tab->mask, i, free;
+	gtp_oatab_group_t *g;
+	int s;
+
+	for (i = 0; i <= tab->mask; i++) {
+		g = &tab->group[idx];
+		free = gtp_oatab_match_free(g->ctrl);
+		if (free) {
+			s = __builtin_ctz(free);
+			g->slot[s].key = key;
+			g->slot[s].value = value;
+			g->ctrl[s] = gtp_oatab_tag(hash);
+			tab->live++;
+			tab->used++;
+			return;
+		}
+		idx = (idx + i + 1) & tab->mask;
+	}
+}
+
+/* Grow when live entries fill more than half of slots, otherwise
+ * simply purge DELETED marks */
+static int
+gtp_oatab_resize(gtp_oatab_t *t, gtp_oatab_table_t *old)
+{
+	gtp_oatab_table_t *new;
+	gtp_oatab_group_t *g;
+	uint32_t nr_groups = old->mask + 1, i;
+	int s;
+
+	pthread_mutex_lock(&t->resize_mutex);
+	if (t->tab != old) {
+		pthread_mutex_unlock(&t->resize_mutex);
+		return 0;
+	}
+
+	for (i = 0; i < nr_groups; i++)
+		gtp_oatab_group_lock(&old->group[i]);
+
+	if (old->live > gtp_oatab_table_slots(old) / 2)
+		nr_groups <<= 1;
+	new = gtp_oatab_table_alloc(nr_groups);
+	if (!new) {
+		log_message(LOG_INFO, "%s(): Cant grow hashtab to %u groups (%m)"
+				    , __FUNCTION__, nr_groups);
+		goto end;
+	}
+
+	for (i = 0; i <= old->mask; i++) {
+		g = &old->group[i];
+		for (s = 0; s < GTP_OATAB_GROUP_SLOTS; s++) {
+			if (g->ctrl[s] & GTP_OATAB_CTRL_EMPTY)
+				continue;
+			__gtp_oatab_table_insert(new, gtp_oatab_hash(t, g->slot[s].key)
+						    , g->slot[s].key, g->slot[s].value);
+		}
+	}
+
+	/* Publish. Writers waiting on old group locks will notice
+	 * retirement and restart on new table, old one is released
+	 * once they all left their read section */
+	new->owner = t;
+	__atomic_store_n(&t->tab, new, __ATOMIC_RELEASE);
+	__atomic_store_n(&old->retired, 1, __ATOMIC_RELEASE);
+	__sync_add_and_fetch(&t->retired_size, gtp_oatab_table_size(old));
+	t->resize++;
+
+  end:
+	for (i = 0; i <= old->mask; i++)
+		gtp_oatab_group_unlock(&old->group[i]);
+	if (new)
+		grace_defer(&t->retired, &old->gp);
+	pthread_mutex_unlock(&t->resize_mutex);
+	return (new) ? 0 : -1;
+}
+
+
+/*
+ *	Lookup, lock-free
+ */
+
+/* Caller is within read section */
+void *
+__gtp_oatab_get(gtp_oatab_t *t, uint64_t key)
+{
+	uint32_t hash = gtp_oatab_hash(t, key);
+	uint8_t tag = gtp_oatab_tag(hash);
+	gtp_oatab_table_t *tab;
+	gtp_oatab_group_t *g;
+	uint32_t idx, i, seq, match, empty;
+	void *value;
+	int s;
+
+  retry:
+	tab = __atomic_load_n(&t->tab, __ATOMIC_ACQUIRE);
+	idx = hash & tab->mask;
+	for (i = 0; i <= tab->mask; i++) {
+		g = &tab->group[idx];
+
+	  group_retry:
+		seq = __atomic_load_n(&g->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			cpu_relax();
+			goto group_retry;
+		}
+
+		value = NULL;
+		match = gtp_oatab_match(g->ctrl, tag);
+		while (match) {
+			s = __builtin_ctz(match);
+			if (g->slot[s].key == key) {
+				value = g->slot[s].value;
+				break;
+			}
+			match &= match - 1;
+		}
+		empty = gtp_oatab_match(g->ctrl, GTP_OATAB_CTRL_EMPTY);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&g->seq, __ATOMIC_RELAXED) != seq)
+			goto group_retry;
+
+		if (value || empty)
+			break;
+		idx = (idx + i + 1) & tab->mask;
+	}
+
+	/* Table has been grown under us */
+	if (__atomic_load_n(&tab->retired, __ATOMIC_ACQUIRE))
+		goto retry;
+
+	return value;
+}
+
+void *
+gtp_oatab_get(gtp_oatab_t *t, uint64_t key)
+{
+	void *value;
+	int cookie;
+
+	cookie = gtp_oatab_read_lock(t);
+	value = __gtp_oatab_get(t, key);
+	gtp_oatab_read_unlock(t, cookie);
+	return value;
+}
+
+/* Let retired tables go once readers are done with them */
+static void
+gtp_oatab_reap(gtp_oatab_t *t)
+{
+	if (grace_defer_waiting(&t->retired))
+		grace_defer_poll(&t->retired);
+}
+
+
+/*
+ *	Update, per group locking
+ */
+static int
+__gtp_oatab_add(gtp_oatab_t *t, uint32_t hash, uint64_t key, void *value)
+{
+	gtp_oatab_table_t *tab;
+	gtp_oatab_group_t *g;
+	uint32_t idx, i, free, used;
+	bool was_empty;
+	int s;
+
+  retry:
+	tab = __atomic_load_n(&t->tab, __ATOMIC_ACQUIRE);
+	idx = hash & tab->mask;
+	for (i = 0; i <= tab->mask; i++) {
+		g = &tab->group[idx];
+		gtp_oatab_group_lock(g);
+		if (__atomic_load_n(&tab->retired, __ATOMIC_ACQUIRE)) {
+			gtp_oatab_group_unlock(g);
+			goto retry;
+		}
+
+		free = gtp_oatab_match_free(g->ctrl);
+		if (!free) {
+			gtp_oatab_group_unlock(g);
+			idx = (idx + i + 1) & tab->mask;
+			continue;
+		}
+
+		s = __builtin_ctz(free);
+		was_empty = (g->ctrl[s] == GTP_OATAB_CTRL_EMPTY);
+		gtp_oatab_write_begin(g);
+		g->slot[s].key = key;
+		g->slot[s].value = value;
+		g->ctrl[s] = gtp_oatab_tag(hash);
+		gtp_oatab_write_end(g);
+		gtp_oatab_group_unlock(g);
+
+		__sync_add_and_fetch(&tab->live, 1);
+		used = (was_empty) ? __sync_add_and_fetch(&tab->used, 1) : tab->used;
+		if (used > gtp_oatab_table_slots(tab) / 8 * 7)
+			gtp_oatab_resize(t, tab);
+		return 0;
+	}
+
+	/* Full of DELETED marks */
+	if (gtp_oatab_resize(t, tab) < 0)
+		return -1;
+	goto retry;
+}
+
+int
+gtp_oatab_add(gtp_oatab_t *t, uint64_t key, void *value)
+{
+	uint32_t hash = gtp_oatab_hash(t, key);
+	uint32_t *lock = &t->add_lock[hash % GTP_OATAB_ADD_LOCKS];
+	int err = -1, cookie;
+
+	gtp_oatab_spin_lock(lock);
+	cookie = gtp_oatab_read_lock(t);
+	if (!__gtp_oatab_get(t, key))
+		err = __gtp_oatab_add(t, hash, key, value);
+	gtp_oatab_read_unlock(t, cookie);
+	gtp_oatab_spin_unlock(lock);
+
+	gtp_oatab_reap(t);
+	return err;
+}
+
+/* Swap value of an existing key, previous one returned. Caller
+ * holds key add lock so that key can't show up meanwhile */
+static void *
+__gtp_oatab_swap(gtp_oatab_t *t, uint32_t hash, uint64_t key, void *value)
+{
+	uint8_t tag = gtp_oatab_tag(hash);
+	gtp_oatab_table_t *tab;
+	gtp_oatab_group_t *g;
+	uint32_t idx, i, match, empty;
+	void *old;
+	int s;
+
+  retry:
+	tab = __atomic_load_n(&t->tab, __ATOMIC_ACQUIRE);
+	idx = hash & tab->mask;
+	for (i = 0; i <= tab->mask; i++) {
+		g = &tab->group[idx];
+		gtp_oatab_group_lock(g);
+		if (__atomic_load_n(&tab->retired, __ATOMIC_ACQUIRE)) {
+			gtp_oatab_group_unlock(g);
+			goto retry;
+		}
+
+		match = gtp_oatab_match(g->ctrl, tag);
+		while (match) {
+			s = __builtin_ctz(match);
+			match &= match - 1;
+			if (g->slot[s].key != key)
+				continue;
+
+			old = g->slot[s].value;
+			gtp_oatab_write_begin(g);
+			g->slot[s].value = value;
+			gtp_oatab_write_end(g);
+			gtp_oatab_group_unlock(g);
+			return old;
+		}
+
+		empty = gtp_oatab_match(g->ctrl, GTP_OATAB_CTRL_EMPTY);
+		gtp_oatab_group_unlock(g);
+		if (empty)
+			break;
+		idx = (idx + i + 1) & tab->mask;
+	}
+
+	return NULL;
+}
+
+/* Insert or take over key, previous value is returned into old
+ * (NULL if key was not present) */
+int
+gtp_oatab_replace(gtp_oatab_t *t, uint64_t key, void *value, void **old)
+{
+	uint32_t hash = gtp_oatab_hash(t, key);
+	uint32_t *lock = &t->add_lock[hash % GTP_OATAB_ADD_LOCKS];
+	int err = 0, cookie;
+
+	gtp_oatab_spin_lock(lock);
+	cookie = gtp_oatab_read_lock(t);
+	*old = __gtp_oatab_swap(t, hash, key, value);
+	if (!*old)
+		err = __gtp_oatab_add(t, hash, key, value);
+	gtp_oatab_read_unlock(t, cookie);
+	gtp_oatab_spin_unlock(lock);
+
+	gtp_oatab_reap(t);
+	return err;
+}
+
+static int
+__gtp_oatab_del(gtp_oatab_t *t, uint64_t key, void *value)
+{
+	uint32_t hash = gtp_oatab_hash(t, key);
+	uint8_t tag = gtp_oatab_tag(hash);
+	gtp_oatab_table_t *tab;
+	gtp_oatab_group_t *g;
+	uint32_t idx, i, match, empty;
+	int s;
+
+  retry:
+	tab = __atomic_load_n(&t->tab, __ATOMIC_ACQUIRE);
+	idx = hash & tab->mask;
+	for (i = 0; i <= tab->mask; i++) {
+		g = &tab->group[idx];
+		gtp_oatab_group_lock(g);
+		if (__atomic_load_n(&tab->retired, __ATOMIC_ACQUIRE)) {
+			gtp_oatab_group_unlock(g);
+			goto retry;
+		}
+
+		empty = gtp_oatab_match(g->ctrl, GTP_OATAB_CTRL_EMPTY);
+		match = gtp_oatab_match(g->ctrl, tag);
+		while (match) {
+			s = __builtin_ctz(match);
+			match &= match - 1;
+			if (g->slot[s].key != key || g->slot[s].value != value)
+				continue;
+
+			/* A group having an EMPTY slot has never been full,
+			 * so no probe ever went through it */
+			gtp_oatab_write_begin(g);
+			g->ctrl[s] = (empty) ? GTP_OATAB_CTRL_EMPTY : GTP_OATAB_CTRL_DELETED;
+			g->slot[s].value = NULL;
+			gtp_oatab_write_end(g);
+			gtp_oatab_group_unlock(g);
+
+			__sync_sub_and_fetch(&tab->live, 1);
+			if (empty)
+				__sync_sub_and_fetch(&tab->used, 1);
+			return 0;
+		}
+
+		gtp_oatab_group_unlock(g);
+		if (empty)
+			break;
+		idx = (idx + i + 1) & tab->mask;
+	}
+
+	return -1;
+}
+
+int
+gtp_oatab_del(gtp_oatab_t *t, uint64_t key, void *value)
+{
+	int err, cookie;
+
+	cookie = gtp_oatab_read_lock(t);
+	err = __gtp_oatab_del(t, key, value);
+	gtp_oatab_read_unlock(t, cookie);
+
+	gtp_oatab_reap(t);
+	return err;
+}
+
+/* Callback is run under group lock and must not update table */
+int
+gtp_oatab_iterate(gtp_oatab_t *t, int (*cb) (void *, void *), void *arg)
+{
+	gtp_oatab_table_t *tab;
+	gtp_oatab_group_t *g;
+	uint32_t i;
+	int s;
+
+	pthread_mutex_lock(&t->resize_mutex);
+	tab = t->tab;
+	for (i = 0; i <= tab->mask; i++) {
+		g = &tab->group[i];
+		gtp_oatab_group_lock(g);
+		for (s = 0; s < GTP_OATAB_GROUP_SLOTS; s++) {
+			if (!(g->ctrl[s] & GTP_OATAB_CTRL_EMPTY))
+				(*cb) (g->slot[s].value, arg);
+		}
+		gtp_oatab_group_unlock(g);
+	}
+	pthread_mutex_unlock(&t->resize_mutex);
+	return 0;
+}
+
+uint32_t
+gtp_oatab_count(gtp_oatab_t *t)
+{
+	uint32_t live;
+	int cookie;
+
+	cookie = gtp_oatab_read_lock(t);
+	live = __atomic_load_n(&t->tab, __ATOMIC_ACQUIRE)->live;
+	gtp_oatab_read_unlock(t, cookie);
+	return live;
+}
+
+/* Current table and retired ones not released yet */
+size_t
+gtp_oatab_memory(gtp_oatab_t *t)
+{
+	size_t size;
+
+	pthread_mutex_lock(&t->resize_mutex);
+	size = gtp_oatab_table_size(t->tab);
+	pthread_mutex_unlock(&t->resize_mutex);
+	return size + __atomic_load_n(&t->retired_size, __ATOMIC_RELAXED);
+}
+
+
+/*
+ *	Init
+ */
+int
+gtp_oatab_init(gtp_oatab_t *t, uint32_t size, int hash)
+{
+	uint32_t nr_groups = GTP_OATAB_MIN_GROUPS;
+
+	/* Sized for 7/8 max load */
+	while ((uint64_t) nr_groups * GTP_OATAB_GROUP_SLOTS * 7 / 8 < size)
+		nr_groups <<= 1;
+
+	memset(t, 0, sizeof(*t));
+	pthread_mutex_init(&t->resize_mutex, NULL);
+	grace_defer_init(&t->retired, &t->gp, gtp_oatab_table_release);
+	t->hash = hash;
+	t->seed = poor_prng(&(unsigned int) { time(NULL) });
+	t->tab = gtp_oatab_table_alloc(nr_groups);
+	if (!t->tab)
+		return -1;
+	t->tab->owner = t;
+	return 0;
+}
+
+void
+gtp_oatab_destroy(gtp_oatab_t *t)
+{
+	if (!t->tab)
+		return;
+
+	grace_defer_flush(&t->retired);
+	gtp_oatab_table_free(t->tab);
+	pthread_mutex_destroy(&t->resize_mutex);
+	t->tab = NULL;
+}
@@ -0,0 +1,523 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <linux/sock_diag.h>
+#include <inttypes.h>
+#include <time.h>
+#include <errno.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/* Extern data */
+extern data_t *daemon_data;
+
+/* Local data */
+static uint32_t gtp_overload_sqn;
+
+
+/*
+ *	Message classification
+ */
+static int
+gtp_overload_prio(uint8_t version, uint8_t type)
+{
+	if (version == 1) {
+		switch (type) {
+		case GTP_CREATE_PDP_CONTEXT_REQUEST:
+			return GTP_OVERLOAD_PRIO_LOW;
+		case GTP_ECHO_REQUEST_TYPE:
+		case GTP_ECHO_RESPONSE_TYPE:
+		case GTP_CREATE_PDP_CONTEXT_RESPONSE:
+		case GTP_UPDATE_PDP_CONTEXT_RESPONSE:
+		case GTP_DELETE_PDP_CONTEXT_REQUEST:
+		case GTP_DELETE_PDP_CONTEXT_RESPONSE:
+			return GTP_OVERLOAD_PRIO_HIGH;
+		}
+
+		return GTP_OVERLOAD_PRIO_NORMAL;
+	}
+
+	switch (type) {
+	case GTP_CREATE_SESSION_REQUEST_TYPE:
+		return GTP_OVERLOAD_PRIO_LOW;
+	case GTP_ECHO_REQUEST_TYPE:
+	case GTP_ECHO_RESPONSE_TYPE:
+	case GTP_VERSION_NOT_SUPPORTED_INDICATION_TYPE:
+	case GTP_CREATE_SESSION_RESPONSE_TYPE:
+	case GTP_MODIFY_BEARER_RESPONSE_TYPE:
+	case GTP_DELETE_SESSION_REQUEST_TYPE:
+	case GTP_DELETE_SESSION_RESPONSE_TYPE:
+	case GTP_CHANGE_NOTIFICATION_RESPONSE:
+	case GTP_MODIFY_BEARER_FAILURE_IND:
+	case GTP_DELETE_BEARER_FAILURE_IND:
+	case GTP_BEARER_RESSOURCE_FAILURE_IND:
+	case GTP_CREATE_BEARER_RESPONSE:
+	case GTP_UPDATE_BEARER_RESPONSE:
+	case GTP_DELETE_BEARER_REQUEST:
+	case GTP_DELETE_BEARER_RESPONSE:
+	case GTP_DELETE_PDN_CONNECTION_SET_REQUEST:
+	case GTP_RESUME_ACK:
+	case GTP_UPDATE_PDN_CONNECTION_SET_RESPONSE:
+		return GTP_OVERLOAD_PRIO_HIGH;
+	}
+
+	return GTP_OVERLOAD_PRIO_NORMAL;
+}
+
+
+/*
+ *	Per peer admission
+ */
+static uint32_t
+gtp_overload_peer_key(struct sockaddr_storage *addr)
+{
+	struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *) addr;
+
+	if (addr->ss_family == AF_INET)
+		return ((struct sockaddr_in *) addr)->sin_addr.s_addr;
+
+	return jhash_oaat((ub1 *) &addr6->sin6_addr, sizeof(struct in6_addr));
+}
+
+/* With SO_REUSEPORT steering, Create Session is hashed on IMSI and
+ * others on TEID shard, so one peer is spread over every worker. Bucket
+ * is then kept per server: a worker local one would admit rate times
+ * the worker count. GCRA keeps all the state in one word, so workers
+ * share it lock-free. A colliding peer shares the slot, which can only
+ * make admission stricter. */
+static bool
+gtp_overload_bucket_take(gtp_overload_t *cfg, struct sockaddr_storage *addr, uint64_t now)
+{
+	uint32_t key = gtp_overload_peer_key(addr);
+	gtp_overload_bucket_t *b = &cfg->bucket[jhash_1word(key, 0) & GTP_OVERLOAD_PEER_MASK];
+	uint64_t interval = NSEC_PER_SEC / cfg->rate;
+	uint64_t tolerance = (uint64_t) (cfg->burst - 1) * interval;
+	uint64_t tat, next;
+
+	now *= 1000;
+	tat = __atomic_load_n(&b->tat, __ATOMIC_RELAXED);
+	do {
+		next = (tat > now) ? tat : now;
+		if (next - now > tolerance)
+			return false;
+		next += interval;
+	} while (!__atomic_compare_exchange_n(&b->tat, &tat, next, true
+					      , __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	return true;
+}
+
+
+/*
+ *	Overload state
+ */
+uint64_t
+gtp_overload_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void
+gtp_overload_update(gtp_server_worker_t *w)
+{
+	gtp_overload_t *cfg = &w->srv->overload;
+	gtp_overload_worker_t *ow = w->overload;
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len = sizeof(meminfo);
+	int load, low, metric;
+
+	/* Receive queue occupancy */
+	if (!getsockopt(w->fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) &&
+	    meminfo[SK_MEMINFO_RCVBUF])
+		ow->backlog = (uint64_t) meminfo[SK_MEMINFO_RMEM_ALLOC] * 100 /
+			      meminfo[SK_MEMINFO_RCVBUF];
+
+	load = (uint64_t) ow->service * 100 / cfg->latency;
+	load = (ow->backlog > load) ? ow->backlog : load;
+	ow->load = (load > 100) ? 100 : load;
+
+	low = cfg->threshold - GTP_OVERLOAD_HYSTERESIS;
+	if (!__test_bit(GTP_OVERLOAD_FL_OVERLOADED_BIT, &ow->flags) &&
+	    ow->load >= cfg->threshold) {
+		__set_bit(GTP_OVERLOAD_FL_OVERLOADED_BIT, &ow->flags);
+		ow->stats.overload++;
+		log_message(LOG_INFO, "%s(): %s entering overload (load:%d%% backlog:%d%% service:%uus)"
+				    , __FUNCTION__, w->pname, ow->load, ow->backlog, ow->service);
+	} else if (__test_bit(GTP_OVERLOAD_FL_OVERLOADED_BIT, &ow->flags) &&
+		   ow->load < low) {
+		__clear_bit(GTP_OVERLOAD_FL_OVERLOADED_BIT, &ow->flags);
+		log_message(LOG_INFO, "%s(): %s leaving overload (load:%d%%)"
+				    , __FUNCTION__, w->pname, ow->load);
+	}
+
+	/* Requested traffic reduction, scaled over the overload range */
+	metric = 0;
+	if (__test_bit(GTP_OVERLOAD_FL_OVERLOADED_BIT, &ow->flags)) {
+		metric = (ow->load - low) * 100 / (100 - low);
+		metric = (metric < 1) ? 1 : (metric > 100) ? 100 : metric;
+		ow->oci_expire = time(NULL) + cfg->validity;
+	}
+
+	if (metric != ow->metric) {
+		ow->metric = metric;
+		ow->oci_sqn = __sync_add_and_fetch(&gtp_overload_sqn, 1);
+	}
+}
+
+int
+gtp_overload_admit(gtp_server_worker_t *w, struct sockaddr_storage *addr, uint64_t now)
+{
+	gtp_overload_t *cfg = &w->srv->overload;
+	gtp_overload_worker_t *ow = w->overload;
+	gtp_hdr_t *h = (gtp_hdr_t *) w->pbuff->head;
+	int prio;
+
+	if (!ow || pkt_buffer_len(w->pbuff) < 4)
+		return 0;
+
+	prio = gtp_overload_prio(h->version, h->type);
+
+	if (__test_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &cfg->flags) &&
+	    ++ow->sample >= GTP_OVERLOAD_SAMPLE) {
+		ow->sample = 0;
+		gtp_overload_update(w);
+	}
+
+	if (prio == GTP_OVERLOAD_PRIO_LOW && cfg->bucket &&
+	    __test_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &cfg->flags) &&
+	    !gtp_overload_bucket_take(cfg, addr, now)) {
+		ow->stats.rate_limited++;
+		return -1;
+	}
+
+	/* Lowest priority is shed first, the rest only once saturated */
+	if (__test_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &cfg->flags) &&
+	    __test_bit(GTP_OVERLOAD_FL_OVERLOADED_BIT, &ow->flags)) {
+		if (prio == GTP_OVERLOAD_PRIO_LOW ||
+		    (prio == GTP_OVERLOAD_PRIO_NORMAL && ow->load >= GTP_OVERLOAD_SATURATED)) {
+			ow->stats.shed[prio]++;
+			return -1;
+		}
+	}
+
+	ow->stats.admitted++;
+	return 0;
+}
+
+void
+gtp_overload_account(gtp_server_worker_t *w, uint64_t start)
+{
+	gtp_overload_worker_t *ow = w->overload;
+	uint32_t service = gtp_overload_usec() - start;
+
+	if (!__test_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &w->srv->overload.flags))
+		return;
+
+	ow->service = (ow->service) ? (7 * ow->service + service) / 8 : service;
+}
+
+
+/*
+ *	Overload Control Information IE (3GPP.TS.29.274 8.117)
+ */
+int
+gtp_overload_oci_peer_add(gtp_overload_t *cfg, uint32_t addr)
+{
+	int i;
+
+	for (i = 0; i < cfg->nr_oci_peer; i++) {
+		if (cfg->oci_peer[i] == addr)
+			return 0;
+	}
+
+	if (cfg->nr_oci_peer >= GTP_OVERLOAD_OCI_PEER_MAX)
+		return -1;
+
+	cfg->oci_peer[cfg->nr_oci_peer++] = addr;
+	return 0;
+}
+
+int
+gtp_overload_oci_peer_del(gtp_overload_t *cfg, uint32_t addr)
+{
+	int i;
+
+	for (i = 0; i < cfg->nr_oci_peer; i++) {
+		if (cfg->oci_peer[i] == addr) {
+			cfg->oci_peer[i] = cfg->oci_peer[--cfg->nr_oci_peer];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/* OCI is only sent to peers known to support overload control,
+ * feature support is not negotiated over S5/S8 */
+static bool
+gtp_overload_oci_peer_supported(gtp_overload_t *cfg, struct sockaddr_in *addr)
+{
+	int i;
+
+	if (addr->sin_family != AF_INET)
+		return false;
+
+	for (i = 0; i < cfg->nr_oci_peer; i++) {
+		if (cfg->oci_peer[i] == addr->sin_addr.s_addr)
+			return true;
+	}
+
+	return false;
+}
+
+/* IE is inserted at the end of first message, a piggybacked one
+ * (P flag) is moved after it */
+int
+gtp_overload_oci_append(gtp_server_worker_t *w, struct sockaddr_in *addr, int instance)
+{
+	gtp_overload_worker_t *ow = w->overload;
+	gtp_overload_t *cfg = &w->srv->overload;
+	pkt_buffer_t *pbuff = w->pbuff;
+	gtp_hdr_t *h = (gtp_hdr_t *) pbuff->head;
+	gtp_ie_overload_control_info_t *oci;
+	gtp_ie_sequence_number_t *sqn;
+	gtp_ie_metric_t *metric;
+	gtp_ie_epc_timer_t *timer;
+	size_t len = sizeof(*oci) + sizeof(*sqn) + sizeof(*metric) + sizeof(*timer);
+	size_t msg_len, off;
+	time_t now = time(NULL);
+	uint8_t *cp;
+
+	if (!ow || !__test_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &cfg->flags))
+		return -1;
+
+	/* Keep advertising until peers saw metric going back to 0 */
+	if (h->version != 2 || ow->oci_expire < now)
+		return -1;
+
+	switch (h->type) {
+	case GTP_CREATE_SESSION_RESPONSE_TYPE:
+	case GTP_MODIFY_BEARER_RESPONSE_TYPE:
+	case GTP_DELETE_SESSION_RESPONSE_TYPE:
+		break;
+	default:
+		return -1;
+	}
+
+	msg_len = offsetof(gtp_hdr_t, teid) + ntohs(h->length);
+	if (msg_len > pkt_buffer_len(pbuff) || pkt_buffer_tailroom(pbuff) < len ||
+	    !gtp_overload_oci_peer_supported(cfg, addr))
+		return -1;
+
+	/* Relayed node already advertising with same instance */
+	off = gtp_msg_hlen(h);
+	while ((cp = gtp_get_ie_offset(GTP_IE_OVERLOAD_CONTROL_INFO_TYPE, pbuff->head
+				       , msg_len, off))) {
+		if (((gtp_ie_t *) cp)->instance == instance)
+			return -1;
+		off = cp - pbuff->head + sizeof(gtp_ie_t) + ntohs(((gtp_ie_t *) cp)->length);
+	}
+
+	cp = pbuff->head + msg_len;
+	memmove(cp + len, cp, pkt_buffer_len(pbuff) - msg_len);
+	memset(cp, 0, len);
+	oci = (gtp_ie_overload_control_info_t *) cp;
+	oci->h.type = GTP_IE_OVERLOAD_CONTROL_INFO_TYPE;
+	oci->h.length = htons(len - sizeof(gtp_ie_t));
+	oci->h.instance = instance;
+	cp += sizeof(*oci);
+
+	sqn = (gtp_ie_sequence_number_t *) cp;
+	sqn->h.type = GTP_IE_SEQUENCE_NUMBER_TYPE;
+	sqn->h.length = htons(sizeof(*sqn) - sizeof(gtp_ie_t));
+	sqn->sqn = htonl(ow->oci_sqn);
+	cp += sizeof(*sqn);
+
+	metric = (gtp_ie_metric_t *) cp;
+	metric->h.type = GTP_IE_METRIC_TYPE;
+	metric->h.length = htons(sizeof(*metric) - sizeof(gtp_ie_t));
+	metric->value = ow->metric;
+	cp += sizeof(*metric);
+
+	timer = (gtp_ie_epc_timer_t *) cp;
+	timer->h.type = GTP_IE_EPC_TIMER_TYPE;
+	timer->h.length = htons(sizeof(*timer) - sizeof(gtp_ie_t));
+	if (cfg->validity < 64) {
+		timer->unit = GTP_EPC_TIMER_UNIT_2S;
+		timer->value = cfg->validity / 2;
+	} else {
+		timer->unit = GTP_EPC_TIMER_UNIT_1M;
+		timer->value = cfg->validity / 60;
+	}
+
+	pkt_buffer_set_end_pointer(pbuff, pkt_buffer_len(pbuff) + len);
+	h->length = htons(ntohs(h->length) + len);
+	ow->stats.oci++;
+	return 0;
+}
+
+
+/*
+ *	Worker init
+ */
+gtp_overload_worker_t *
+gtp_overload_worker_alloc(void)
+{
+	gtp_overload_worker_t *new;
+
+	/* Start sequence from wall clock so it keeps increasing
+	 * across restart */
+	__sync_bool_compare_and_swap(&gtp_overload_sqn, 0, (uint32_t) time(NULL));
+
+	PMALLOC(new);
+	return new;
+}
+
+void
+gtp_overload_worker_free(gtp_overload_worker_t *ow)
+{
+	if (!ow)
+		return;
+
+	FREE(ow);
+}
+
+int
+gtp_overload_init(gtp_overload_t *cfg)
+{
+	cfg->bucket = MALLOC(sizeof(gtp_overload_bucket_t) * GTP_OVERLOAD_PEER_SIZE);
+	return (cfg->bucket) ? 0 : -1;
+}
+
+void
+gtp_overload_destroy(gtp_overload_t *cfg)
+{
+	if (cfg->bucket)
+		FREE(cfg->bucket);
+	cfg->bucket = NULL;
+}
+
+
+/*
+ *	VTY helpers
+ */
+int
+gtp_overload_config_write(vty_t *vty, gtp_overload_t *cfg)
+{
+	int i;
+
+	if (__test_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &cfg->flags))
+		vty_out(vty, " gtpc-admission-control rate %u burst %u%s"
+			   , cfg->rate, cfg->burst, VTY_NEWLINE);
+	if (__test_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &cfg->flags))
+		vty_out(vty, " gtpc-overload-control threshold %d latency %u validity %d%s"
+			   , cfg->threshold, cfg->latency, cfg->validity, VTY_NEWLINE);
+	for (i = 0; i < cfg->nr_oci_peer; i++)
+		vty_out(vty, " gtpc-overload-control peer %u.%u.%u.%u%s"
+			   , NIPQUAD(cfg->oci_peer[i]), VTY_NEWLINE);
+	return 0;
+}
+
+static int
+gtp_overload_worker_show(gtp_server_worker_t *w, void *arg)
+{
+	gtp_overload_worker_t *ow = w->overload;
+	vty_t *vty = arg;
+
+	if (!ow)
+		return 0;
+
+	vty_out(vty, "   %s worker:#%.2d state:%s load:%d%% backlog:%d%% service:%uus metric:%d%s"
+		     "    admitted:%"PRIu64" rate-limited:%"PRIu64
+		     " shed-low:%"PRIu64" shed-normal:%"PRIu64
+		     " overload:%"PRIu64" oci-sent:%"PRIu64"%s"
+		   , w->pname, w->id
+		   , __test_bit(GTP_OVERLOAD_FL_OVERLOADED_BIT, &ow->flags) ? "overload" : "normal"
+		   , ow->load, ow->backlog, ow->service, ow->metric, VTY_NEWLINE
+		   , ow->stats.admitted, ow->stats.rate_limited
+		   , ow->stats.shed[GTP_OVERLOAD_PRIO_LOW]
+		   , ow->stats.shed[GTP_OVERLOAD_PRIO_NORMAL]
+		   , ow->stats.overload, ow->stats.oci, VTY_NEWLINE);
+	return 0;
+}
+
+static void
+gtp_overload_server_show(vty_t *vty, gtp_server_t *srv, const char *name)
+{
+	gtp_overload_t *cfg = &srv->overload;
+
+	if (!__test_bit(GTP_FL_CTL_BIT, &srv->flags))
+		return;
+
+	vty_out(vty, "  %s: %s port %d%s", name
+		   , inet_sockaddrtos(&srv->addr)
+		   , ntohs(inet_sockaddrport(&srv->addr))
+		   , VTY_NEWLINE);
+	if (__test_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &cfg->flags))
+		vty_out(vty, "   admission-control rate:%u/s burst:%u%s"
+			   , cfg->rate, cfg->burst, VTY_NEWLINE);
+	if (__test_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &cfg->flags))
+		vty_out(vty, "   overload-control threshold:%d%% latency:%uus validity:%ds%s"
+			   , cfg->threshold, cfg->latency, cfg->validity, VTY_NEWLINE);
+	gtp_server_for_each_worker(srv, gtp_overload_worker_show, vty);
+}
+
+DEFUN(show_gtp_overload,
+      show_gtp_overload_cmd,
+      "show gtp overload",
+      SHOW_STR
+      "GTP related informations\n"
+      "GTP-C admission & overload control\n")
+{
+	gtp_switch_t *sw;
+	gtp_router_t *rt;
+
+	list_for_each_entry(sw, &daemon_data->gtp_switch_ctx, next) {
+		vty_out(vty, "gtp-switch %s%s", sw->name, VTY_NEWLINE);
+		gtp_overload_server_show(vty, &sw->gtpc, "gtpc");
+		gtp_overload_server_show(vty, &sw->gtpc_egress, "gtpc-egress");
+	}
+
+	list_for_each_entry(rt, &daemon_data->gtp_router_ctx, next) {
+		vty_out(vty, "gtp-router %s%s", rt->name, VTY_NEWLINE);
+		gtp_overload_server_show(vty, &rt->gtpc, "gtpc");
+	}
+
+	return CMD_SUCCESS;
+}
+
+int
+gtp_overload_vty_init(void)
+{
+	install_element(VIEW_NODE, &show_gtp_overload_cmd);
+	install_element(ENABLE_NODE, &show_gtp_overload_cmd);
+
+	return 0;
+}
@@ -0,0 +1,842 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <errno.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/* Extern data */
+extern data_t *daemon_data;
+
+/* Local data */
+static gtp_path_ctx_t *gtp_path_ctx;
+static const uint32_t gtp_path_rtt_bound[GTP_PATH_RTT_BUCKETS - 1] = {
+	1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000
+};
+static const char *gtp_path_rtt_str[GTP_PATH_RTT_BUCKETS] = {
+	"<1ms", "<2ms", "<5ms", "<10ms", "<20ms", "<50ms",
+	"<100ms", "<200ms", "<500ms", ">=500ms"
+};
+
+
+/*
+ *	Path helpers
+ */
+static uint64_t
+gtp_path_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static const char *
+gtp_path_state_str(int state)
+{
+	switch (state) {
+	case GTP_PATH_UP:
+		return "up";
+	case GTP_PATH_DOWN:
+		return "down";
+	}
+
+	return "unknown";
+}
+
+static hlist_head_t *
+gtp_path_hash(gtp_path_ctx_t *ctx, struct sockaddr_in *addr)
+{
+	return ctx->htab + (jhash_1word(addr->sin_addr.s_addr, 0) & GTP_PATH_HASHTAB_MASK);
+}
+
+static gtp_path_t *
+__gtp_path_lookup(gtp_path_ctx_t *ctx, struct sockaddr_in *addr)
+{
+	hlist_head_t *head = gtp_path_hash(ctx, addr);
+	hlist_node_t *n;
+	gtp_path_t *p;
+
+	hlist_for_each_entry(p, n, head, hlist) {
+		if (p->addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+			return p;
+	}
+
+	return NULL;
+}
+
+static gtp_path_t *
+__gtp_path_alloc(gtp_path_ctx_t *ctx, struct sockaddr_in *addr)
+{
+	gtp_path_t *new;
+
+	if (!addr->sin_addr.s_addr || ctx->nr_paths >= GTP_PATH_MAX)
+		return NULL;
+
+	PMALLOC(new);
+	if (!new)
+		return NULL;
+	INIT_LIST_HEAD(&new->next);
+	INIT_LIST_HEAD(&new->sessions);
+	INIT_LIST_HEAD(&new->purge);
+	pthread_mutex_init(&new->sessions_mutex, NULL);
+	new->addr.sin_family = AF_INET;
+	new->addr.sin_addr = addr->sin_addr;
+	new->addr.sin_port = htons(GTP_C_PORT);
+	new->version = 2;
+	new->rtt_min = UINT32_MAX;
+	new->last_change = time(NULL);
+	new->idle_since = new->last_change;
+
+	hlist_add_head(&new->hlist, gtp_path_hash(ctx, addr));
+	list_add_tail(&new->next, &ctx->paths);
+	ctx->nr_paths++;
+	return new;
+}
+
+static void
+__gtp_path_free(gtp_path_ctx_t *ctx, gtp_path_t *p)
+{
+	hlist_del(&p->hlist);
+	list_head_del(&p->next);
+	pthread_mutex_destroy(&p->sessions_mutex);
+	FREE(p);
+	ctx->nr_paths--;
+}
+
+static void
+__gtp_path_state(gtp_path_t *p, int state)
+{
+	if (p->state == state)
+		return;
+
+	log_message(LOG_INFO, "%s(): GTP path [%s]:%d %s -> %s"
+			    , __FUNCTION__
+			    , inet_ntoa(p->addr.sin_addr)
+			    , ntohs(p->addr.sin_port)
+			    , gtp_path_state_str(p->state)
+			    , gtp_path_state_str(state));
+	p->state = state;
+	p->last_change = time(NULL);
+}
+
+static void
+__gtp_path_recovery(gtp_path_t *p, uint8_t recovery)
+{
+	if (!__test_and_set_bit(GTP_PATH_FL_RECOVERY_BIT, &p->flags)) {
+		p->recovery = recovery;
+		return;
+	}
+
+	if (p->recovery == recovery)
+		return;
+
+	log_message(LOG_INFO, "%s(): GTP path [%s]:%d peer restarted (Recovery %d -> %d)"
+			    , __FUNCTION__
+			    , inet_ntoa(p->addr.sin_addr)
+			    , ntohs(p->addr.sin_port)
+			    , p->recovery, recovery);
+
+	/* Sessions established before restart are gone on peer side.
+	 * Hand them over to path task, new ones keep going. */
+	pthread_mutex_lock(&p->sessions_mutex);
+	list_splice_init(&p->sessions, &p->purge);
+	pthread_mutex_unlock(&p->sessions_mutex);
+	if (gtp_path_ctx)
+		pthread_cond_signal(&gtp_path_ctx->cond);
+
+	/* Restart path supervision from scratch */
+	p->recovery = recovery;
+	p->restart++;
+	p->srtt = 0;
+	p->retry = 0;
+	__clear_bit(GTP_PATH_FL_ECHO_PENDING_BIT, &p->flags);
+	p->echo_next = 0;
+}
+
+
+/*
+ *	Path registration
+ */
+static gtp_path_t *
+__gtp_path_register(gtp_path_ctx_t *ctx, gtp_server_t *srv, struct sockaddr_in *addr,
+		    uint8_t version, int role)
+{
+	gtp_path_t *p;
+
+	p = __gtp_path_lookup(ctx, addr);
+	p = (p) ? : __gtp_path_alloc(ctx, addr);
+	if (p) {
+		__set_bit(role, &p->flags);
+		p->idle_since = time(NULL);
+		if (srv) {
+			p->srv = srv;
+			p->version = version;
+		}
+	}
+
+	/* First GTP-C server seen is used to reach unbound peers */
+	if (srv && !ctx->srv)
+		ctx->srv = srv;
+
+	return p;
+}
+
+gtp_path_t *
+gtp_path_register(gtp_server_t *srv, struct sockaddr_in *addr, uint8_t version, int role)
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	gtp_path_t *p;
+
+	if (!ctx)
+		return NULL;
+
+	pthread_mutex_lock(&ctx->mutex);
+	p = __gtp_path_register(ctx, srv, addr, version, role);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return p;
+}
+
+gtp_path_t *
+gtp_path_get(struct sockaddr_in *addr, int role)
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	gtp_path_t *p;
+
+	if (!ctx)
+		return NULL;
+
+	/* Caller keeps a reference for its lifetime: never released */
+	pthread_mutex_lock(&ctx->mutex);
+	p = __gtp_path_register(ctx, NULL, addr, 0, role);
+	if (p)
+		__set_bit(GTP_PATH_FL_PINNED_BIT, &p->flags);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return p;
+}
+
+
+/*
+ *	Session tracking
+ */
+gtp_path_t *
+gtp_path_session_register(gtp_server_t *srv, struct sockaddr_in *addr, uint8_t version,
+			  int role, gtp_session_t *s)
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	gtp_path_t *p;
+
+	if (!ctx)
+		return NULL;
+
+	pthread_mutex_lock(&ctx->mutex);
+	p = __gtp_path_register(ctx, srv, addr, version, role);
+	if (!p || s->path) {
+		pthread_mutex_unlock(&ctx->mutex);
+		return p;
+	}
+
+	pthread_mutex_lock(&p->sessions_mutex);
+	list_add_tail(&s->path_next, &p->sessions);
+	p->nr_sessions++;
+	pthread_mutex_unlock(&p->sessions_mutex);
+	__sync_add_and_fetch(&p->refcnt, 1);
+	s->path = p;
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return p;
+}
+
+int
+gtp_path_session_unregister(gtp_session_t *s)
+{
+	gtp_path_t *p = s->path;
+
+	if (!p)
+		return -1;
+
+	/* Release order is path task business */
+	pthread_mutex_lock(&p->sessions_mutex);
+	list_head_del(&s->path_next);
+	p->nr_sessions--;
+	if (!p->nr_sessions)
+		p->idle_since = time(NULL);
+	pthread_mutex_unlock(&p->sessions_mutex);
+	__sync_sub_and_fetch(&p->refcnt, 1);
+	s->path = NULL;
+	return 0;
+}
+
+static int
+__gtp_path_purge(gtp_path_t *p, int budget)
+{
+	gtp_session_t *s;
+	int n = 0;
+
+	/* Sessions stay linked to the path until destroyed: pop them
+	 * from purge list so each one is queued only once. Reaper is
+	 * rate limiting release. */
+	pthread_mutex_lock(&p->sessions_mutex);
+	while (n < budget && !list_empty(&p->purge)) {
+		s = list_first_entry(&p->purge, gtp_session_t, path_next);
+		list_del_init(&s->path_next);
+		gtp_reaper_session_add(s);
+		n++;
+	}
+	p->purged += n;
+	pthread_mutex_unlock(&p->sessions_mutex);
+
+	return n;
+}
+
+int
+gtp_path_recovery_update(struct sockaddr_in *addr, uint8_t *recovery)
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	gtp_path_t *p;
+
+	if (!ctx || !recovery)
+		return -1;
+
+	pthread_mutex_lock(&ctx->mutex);
+	p = __gtp_path_lookup(ctx, addr);
+	if (p)
+		__gtp_path_recovery(p, *recovery);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return (p) ? 0 : -1;
+}
+
+int
+gtp_path_echo_response(struct sockaddr_in *addr, uint8_t version, uint32_t seq, uint8_t *recovery)
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	uint64_t now = gtp_path_usec();
+	uint32_t rtt;
+	gtp_path_t *p;
+	int i;
+
+	if (!ctx)
+		return -1;
+
+	pthread_mutex_lock(&ctx->mutex);
+	p = __gtp_path_lookup(ctx, addr);
+	if (!p)
+		goto end;
+
+	if (recovery)
+		__gtp_path_recovery(p, *recovery);
+
+	/* Late or unsolicited response */
+	if (!__test_bit(GTP_PATH_FL_ECHO_PENDING_BIT, &p->flags) ||
+	    p->version != version || p->seq != seq)
+		goto end;
+
+	__clear_bit(GTP_PATH_FL_ECHO_PENDING_BIT, &p->flags);
+	p->retry = 0;
+	p->echo_rx++;
+
+	/* RTT estimator: RFC6298 like smoothing */
+	rtt = now - p->echo_sent;
+	p->srtt = (p->srtt) ? (7 * p->srtt + rtt) / 8 : rtt;
+	if (rtt < p->rtt_min)
+		p->rtt_min = rtt;
+	if (rtt > p->rtt_max)
+		p->rtt_max = rtt;
+	for (i = 0; i < GTP_PATH_RTT_BUCKETS - 1 && rtt >= gtp_path_rtt_bound[i]; i++) ;
+	p->rtt[i]++;
+
+	__gtp_path_state(p, GTP_PATH_UP);
+
+  end:
+	pthread_mutex_unlock(&ctx->mutex);
+	return (p) ? 0 : -1;
+}
+
+
+/*
+ *	Scheduler feedback
+ */
+bool
+gtp_path_is_alive(gtp_path_t *p)
+{
+	return !p || p->state != GTP_PATH_DOWN;
+}
+
+uint64_t
+gtp_path_weight(gtp_path_t *p, uint16_t weight)
+{
+	uint32_t srtt = (p) ? p->srtt : 0;
+	uint64_t w;
+
+	/* Scale up to keep precision, then halve weight every
+	 * GTP_PATH_RTT_REF usec of smoothed RTT */
+	w = ((uint64_t) weight << 10) * GTP_PATH_RTT_REF / (GTP_PATH_RTT_REF + srtt);
+	return (w) ? : 1;
+}
+
+
+/*
+ *	Echo scheduling
+ */
+static int
+gtp_path_server_fd(gtp_server_t *srv)
+{
+	gtp_server_worker_t *w;
+	int fd = -1;
+
+	pthread_mutex_lock(&srv->workers_mutex);
+	list_for_each_entry(w, &srv->workers, next) {
+		if (__test_bit(GTP_FL_RUNNING_BIT, &w->flags) && w->fd > 0) {
+			fd = w->fd;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&srv->workers_mutex);
+
+	return fd;
+}
+
+static gtp_path_echo_t *
+__gtp_path_echo_alloc(gtp_path_ctx_t *ctx)
+{
+	gtp_path_echo_t *echo;
+
+	if (ctx->nr_echo == ctx->max_echo) {
+		echo = REALLOC(ctx->echo, (ctx->max_echo + GTP_PATH_ECHO_CHUNK) *
+					  sizeof(gtp_path_echo_t));
+		if (!echo)
+			return NULL;
+		ctx->echo = echo;
+		ctx->max_echo += GTP_PATH_ECHO_CHUNK;
+	}
+
+	return &ctx->echo[ctx->nr_echo];
+}
+
+static int
+__gtp_path_echo_send(gtp_path_ctx_t *ctx, gtp_path_t *p, uint64_t now)
+{
+	gtp_server_t *srv = (p->srv) ? : ctx->srv;
+	gtp_path_echo_t *echo;
+	gtp_cmd_args_t args;
+	gtp_hdr_t *h;
+	int fd;
+
+	if (!srv)
+		return -1;
+
+	fd = gtp_path_server_fd(srv);
+	if (fd < 0)
+		return -1;
+
+	echo = __gtp_path_echo_alloc(ctx);
+	if (!echo)
+		return -1;
+
+	/* Reuse gtp_send_echo_request_* builders. GTPv1 builder
+	 * stamps sqn, GTPv2 one leaves it to caller */
+	memset(&args, 0, sizeof(gtp_cmd_args_t));
+	args.type = GTP_CMD_ECHO_REQUEST;
+	args.version = p->version;
+	args.sqn = p->seq;
+	gtp_cmd_echo_build(&args);
+	if (p->version == 2) {
+		h = (gtp_hdr_t *) args.buffer;
+		h->sqn_only = htonl(p->seq << 8);
+	}
+
+	/* Sent by gtp_path_echo_flush() once ctx lock is released. A
+	 * failed send shows up as T3-RESPONSE expiry */
+	echo->fd = fd;
+	echo->addr = p->addr;
+	echo->len = args.buffer_len;
+	memcpy(echo->buffer, args.buffer, args.buffer_len);
+	ctx->nr_echo++;
+
+	__set_bit(GTP_PATH_FL_ECHO_PENDING_BIT, &p->flags);
+	p->echo_sent = now;
+	p->echo_tx++;
+	return 0;
+}
+
+static void
+gtp_path_echo_flush(gtp_path_ctx_t *ctx)
+{
+	gtp_path_echo_t *echo;
+	int i;
+
+	for (i = 0; i < ctx->nr_echo; i++) {
+		echo = &ctx->echo[i];
+		sendto(echo->fd, echo->buffer, echo->len, 0
+		       , (struct sockaddr *) &echo->addr, sizeof(struct sockaddr_in));
+	}
+
+	ctx->nr_echo = 0;
+}
+
+static bool
+__gtp_path_purge_run(gtp_path_ctx_t *ctx)
+{
+	int budget = GTP_PATH_PURGE_BATCH;
+	time_t now = time(NULL);
+	gtp_path_t *p, *_p;
+	bool pending = false;
+
+	list_for_each_entry_safe(p, _p, &ctx->paths, next) {
+		if (!list_empty(&p->purge)) {
+			budget -= __gtp_path_purge(p, budget);
+			pending |= !list_empty(&p->purge);
+			continue;
+		}
+
+		/* Release peers we no longer have business with */
+		if (!__sync_add_and_fetch(&p->refcnt, 0) &&
+		    !__test_bit(GTP_PATH_FL_PINNED_BIT, &p->flags) &&
+		    now - p->idle_since >= GTP_PATH_GC_IDLE)
+			__gtp_path_free(ctx, p);
+	}
+
+	return pending;
+}
+
+static void
+__gtp_path_timer(gtp_path_ctx_t *ctx)
+{
+	uint64_t now_usec = gtp_path_usec();
+	time_t now = time(NULL);
+	gtp_path_t *p;
+
+	list_for_each_entry(p, &ctx->paths, next) {
+		if (__test_bit(GTP_PATH_FL_ECHO_PENDING_BIT, &p->flags)) {
+			if (now_usec - p->echo_sent < ctx->t3_response * 1000000ULL)
+				continue;
+
+			/* T3-RESPONSE expired */
+			p->echo_lost++;
+			if (++p->retry < ctx->n3_requests) {
+				__gtp_path_echo_send(ctx, p, now_usec);
+				continue;
+			}
+
+			/* N3-REQUESTS exhausted */
+			__clear_bit(GTP_PATH_FL_ECHO_PENDING_BIT, &p->flags);
+			p->retry = 0;
+			__gtp_path_state(p, GTP_PATH_DOWN);
+			continue;
+		}
+
+		if (now < p->echo_next)
+			continue;
+
+		p->echo_next = now + ctx->interval;
+		p->seq = (p->seq + 1) & ((p->version == 1) ? 0xffff : 0xffffff);
+		__gtp_path_echo_send(ctx, p, now_usec);
+	}
+}
+
+static void *
+gtp_path_task(void *arg)
+{
+	gtp_path_ctx_t *ctx = arg;
+	struct timespec timeout;
+	uint64_t next_timer = 0, now;
+	bool purge = false;
+
+	/* Our identity */
+	prctl(PR_SET_NAME, "gtp_path", 0, 0, 0, 0);
+
+	pthread_mutex_lock(&ctx->mutex);
+	while (!__test_bit(GTP_PATH_FL_STOP_BIT, &ctx->flags)) {
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_nsec += ((purge) ? GTP_PATH_PURGE_TIMER : GTP_PATH_TIMER) * 1000000;
+		if (timeout.tv_nsec >= 1000000000) {
+			timeout.tv_sec++;
+			timeout.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&ctx->cond, &ctx->mutex, &timeout);
+
+		/* Purge runs even with path-management disabled, it
+		 * is driven by Recovery seen in signalling too */
+		purge = __gtp_path_purge_run(ctx);
+
+		now = gtp_path_usec();
+		if (now < next_timer)
+			continue;
+		next_timer = now + GTP_PATH_TIMER * 1000;
+
+		if (!__test_bit(GTP_PATH_FL_DISABLED_BIT, &ctx->flags))
+			__gtp_path_timer(ctx);
+
+		if (ctx->nr_echo) {
+			pthread_mutex_unlock(&ctx->mutex);
+			gtp_path_echo_flush(ctx);
+			pthread_mutex_lock(&ctx->mutex);
+		}
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return NULL;
+}
+
+
+/*
+ *	Path show
+ */
+static int
+gtp_path_show(vty_t *vty)
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	time_t now = time(NULL);
+	gtp_path_t *p;
+	int i;
+
+	pthread_mutex_lock(&ctx->mutex);
+	vty_out(vty, "GTP path management: %s, %d paths, echo-interval:%ds t3-response:%ds n3-requests:%d%s"
+		   , __test_bit(GTP_PATH_FL_DISABLED_BIT, &ctx->flags) ? "disabled" : "enabled"
+		   , ctx->nr_paths, ctx->interval, ctx->t3_response, ctx->n3_requests
+		   , VTY_NEWLINE);
+	list_for_each_entry(p, &ctx->paths, next) {
+		vty_out(vty, " [%s]:%d GTPv%d%s%s state:%s (%lds) recovery:%d restart:%u%s"
+			     "   sessions:%u purged:%lu%s%s"
+			     "   echo tx:%ld rx:%ld lost:%ld (loss:%ld%%)"
+			     " rtt srtt:%uus min:%uus max:%uus%s"
+			     "   rtt:"
+			   , inet_ntoa(p->addr.sin_addr), ntohs(p->addr.sin_port)
+			   , p->version
+			   , __test_bit(GTP_PATH_FL_PGW_BIT, &p->flags) ? " pGW" : ""
+			   , __test_bit(GTP_PATH_FL_SGW_BIT, &p->flags) ? " sGW" : ""
+			   , gtp_path_state_str(p->state), (long) (now - p->last_change)
+			   , p->recovery, p->restart, VTY_NEWLINE
+			   , p->nr_sessions, p->purged
+			   , list_empty(&p->purge) ? "" : " (purge in progress)"
+			   , VTY_NEWLINE
+			   , p->echo_tx, p->echo_rx, p->echo_lost
+			   , (p->echo_tx) ? p->echo_lost * 100 / p->echo_tx : 0
+			   , p->srtt, (p->echo_rx) ? p->rtt_min : 0, p->rtt_max
+			   , VTY_NEWLINE);
+		for (i = 0; i < GTP_PATH_RTT_BUCKETS; i++)
+			vty_out(vty, " %s:%ld", gtp_path_rtt_str[i], p->rtt[i]);
+		vty_out(vty, "%s", VTY_NEWLINE);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return 0;
+}
+
+int
+gtp_path_config_write(vty_t *vty)
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+
+	if (__test_bit(GTP_PATH_FL_DISABLED_BIT, &ctx->flags)) {
+		vty_out(vty, " no path-management%s", VTY_NEWLINE);
+		return 0;
+	}
+
+	if (ctx->interval != GTP_PATH_ECHO_INTERVAL ||
+	    ctx->t3_response != GTP_PATH_T3_RESPONSE ||
+	    ctx->n3_requests != GTP_PATH_N3_REQUESTS)
+		vty_out(vty, " path-management echo-interval %d t3-response %d n3-requests %d%s"
+			   , ctx->interval, ctx->t3_response, ctx->n3_requests
+			   , VTY_NEWLINE);
+	return 0;
+}
+
+
+/*
+ *	Path init
+ */
+int
+gtp_path_init(void)
+{
+	gtp_path_ctx_t *ctx;
+
+	PMALLOC(ctx);
+	if (!ctx)
+		return -1;
+	ctx->htab = (hlist_head_t *) MALLOC(sizeof(hlist_head_t) * GTP_PATH_HASHTAB_SIZE);
+	INIT_LIST_HEAD(&ctx->paths);
+	ctx->interval = GTP_PATH_ECHO_INTERVAL;
+	ctx->t3_response = GTP_PATH_T3_RESPONSE;
+	ctx->n3_requests = GTP_PATH_N3_REQUESTS;
+	pthread_mutex_init(&ctx->mutex, NULL);
+	pthread_cond_init(&ctx->cond, NULL);
+	gtp_path_ctx = ctx;
+
+	pthread_create(&ctx->task, NULL, gtp_path_task, ctx);
+	return 0;
+}
+
+int
+gtp_path_destroy(void)
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	gtp_path_t *p, *_p;
+
+	if (!ctx)
+		return -1;
+
+	pthread_mutex_lock(&ctx->mutex);
+	__set_bit(GTP_PATH_FL_STOP_BIT, &ctx->flags);
+	pthread_cond_signal(&ctx->cond);
+	pthread_mutex_unlock(&ctx->mutex);
+	pthread_join(ctx->task, NULL);
+
+	list_for_each_entry_safe(p, _p, &ctx->paths, next)
+		__gtp_path_free(ctx, p);
+
+	gtp_path_ctx = NULL;
+	pthread_mutex_destroy(&ctx->mutex);
+	pthread_cond_destroy(&ctx->cond);
+	if (ctx->echo)
+		FREE(ctx->echo);
+	FREE(ctx->htab);
+	FREE(ctx);
+	return 0;
+}
+
+
+/*
+ *	VTY command
+ */
+DEFUN(pdn_path_management,
+      pdn_path_management_cmd,
+      "path-management echo-interval <5-3600> t3-response <1-30> n3-requests <1-10>",
+      "GTP-C path management\n"
+      "Echo-Request interval\n"
+      "seconds\n"
+      "T3-RESPONSE timer\n"
+      "seconds\n"
+      "N3-REQUESTS counter\n"
+      "number\n")
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	int interval, t3, n3;
+
+	if (argc < 3) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("echo-interval", interval, argv[0], 5, 3600);
+	VTY_GET_INTEGER_RANGE("t3-response", t3, argv[1], 1, 30);
+	VTY_GET_INTEGER_RANGE("n3-requests", n3, argv[2], 1, 10);
+
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->interval = interval;
+	ctx->t3_response = t3;
+	ctx->n3_requests = n3;
+	__clear_bit(GTP_PATH_FL_DISABLED_BIT, &ctx->flags);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_pdn_path_management,
+      no_pdn_path_management_cmd,
+      "no path-management",
+      "GTP-C path management\n")
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	gtp_path_t *p;
+
+	/* Forget verdicts so scheduling is not biased anymore */
+	pthread_mutex_lock(&ctx->mutex);
+	__set_bit(GTP_PATH_FL_DISABLED_BIT, &ctx->flags);
+	list_for_each_entry(p, &ctx->paths, next) {
+		__clear_bit(GTP_PATH_FL_ECHO_PENDING_BIT, &p->flags);
+		p->state = GTP_PATH_UNKNOWN;
+		p->srtt = 0;
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(show_gtp_path,
+      show_gtp_path_cmd,
+      "show gtp path",
+      SHOW_STR
+      "GTP related informations\n"
+      "GTP-C path management\n")
+{
+	gtp_path_show(vty);
+	return CMD_SUCCESS;
+}
+
+DEFUN(clear_gtp_path,
+      clear_gtp_path_cmd,
+      "clear gtp path A.B.C.D",
+      "Clear GTP related\n"
+      "GTP related\n"
+      "GTP-C path sessions\n"
+      "Peer IPv4 Address\n")
+{
+	gtp_path_ctx_t *ctx = gtp_path_ctx;
+	struct sockaddr_in addr;
+	gtp_path_t *p;
+
+	memset(&addr, 0, sizeof(struct sockaddr_in));
+	if (inet_pton(AF_INET, argv[0], &addr.sin_addr) != 1) {
+		vty_out(vty, "%% malformed IP address %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	pthread_mutex_lock(&ctx->mutex);
+	p = __gtp_path_lookup(ctx, &addr);
+	if (!p) {
+		pthread_mutex_unlock(&ctx->mutex);
+		vty_out(vty, "%% unknown path %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	pthread_mutex_lock(&p->sessions_mutex);
+	vty_out(vty, "Purging %u sessions of path %s%s", p->nr_sessions, argv[0], VTY_NEWLINE);
+	list_splice_init(&p->sessions, &p->purge);
+	pthread_mutex_unlock(&p->sessions_mutex);
+	pthread_cond_signal(&ctx->cond);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return CMD_SUCCESS;
+}
+
+int
+gtp_path_vty_init(void)
+{
+	install_element(PDN_NODE, &pdn_path_management_cmd);
+	install_element(PDN_NODE, &no_pdn_path_management_cmd);
+	install_element(VIEW_NODE, &show_gtp_path_cmd);
+	install_element(ENABLE_NODE, &show_gtp_path_cmd);
+	install_element(ENABLE_NODE, &clear_gtp_path_cmd);
+
+	return 0;
+}
@@ -2867,7 +2867,7 @@ gtp_ppp_timer_init(gtp_pppoe_t *pppoe)
 	char pname[128];
 
 	snprintf(pname, 127, "ppp-timer-%s", pppoe->ifname);
-	timer_thread_init(&pppoe->ppp_timer, pname, NULL);
+	timer_thread_wheel_init(&pppoe->ppp_timer, pname, NULL, GTP_PPPOE_TIMER_SHARDS);
 	return 0;
 }
 
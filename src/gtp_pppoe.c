@@ -237,10 +237,26 @@ gtp_pppoe_update_tx_stats(gtp_pppoe_worker_t *w, pkt_t *pkt)
 	w->tx_bytes += pkt_buffer_len(pkt->pbuff);
 }
 
+static int
+gtp_pppoe_ring_send(gtp_pppoe_t *pppoe, gtp_pppoe_worker_t *w, pkt_t *pkt)
+{
+	bool flush;
+	int ret;
+
+	/* Worker flushes pending frames at the end of each RX block,
+	 * others are kicking immediately */
+	flush = !pthread_equal(w->task, pthread_self());
+	ret = pkt_ring_send(w->fd, &w->ring, pkt, flush);
+	pkt_queue_put(&pppoe->pkt_q, pkt);
+	return ret;
+}
+
 static int
 gtp_pppoe_send(gtp_pppoe_t *pppoe, gtp_pppoe_worker_t *w, pkt_t *pkt)
 {
 	gtp_pppoe_update_tx_stats(w, pkt);
+	if (__test_bit(PPPOE_FL_PACKET_RING_BIT, &pppoe->flags))
+		return gtp_pppoe_ring_send(pppoe, w, pkt);
 	return pkt_send(w->fd, &pppoe->pkt_q, pkt);
 }
 
@@ -323,6 +339,51 @@ gtp_pppoe_socket_init(gtp_pppoe_t *pppoe, uint16_t proto, int id)
 	return fd;
 }
 
+static int
+gtp_pppoe_ring_init(gtp_pppoe_t *pppoe, gtp_pppoe_worker_t *w)
+{
+	pkt_ring_t *r = &w->ring;
+
+	r->block_size = pppoe->ring_block_size;
+	r->block_nr = pppoe->ring_block_nr;
+	r->block_tmo = pppoe->ring_block_tmo;
+	if (pkt_ring_init(r, w->fd) < 0) {
+		log_message(LOG_INFO, "%s(): #%d : Error creating packet ring on interface %s (%m)"
+				    , __FUNCTION__, w->id
+				    , pppoe->ifname);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+gtp_pppoe_ring_loop(gtp_pppoe_t *pppoe, gtp_pppoe_worker_t *w)
+{
+	int ret;
+
+  shoot_again:
+	if (__test_bit(PPPOE_FL_STOPPING_BIT, &pppoe->flags))
+		return;
+
+	ret = pkt_ring_recv(w->fd, &w->ring, GTP_PPPOE_RECV_TIMER / 1000
+				 , gtp_pppoe_ingress, w);
+	if (ret < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			goto shoot_again;
+
+		log_message(LOG_INFO, "%s(): Error polling pppoe ring for interface %s (%m)"
+				    , __FUNCTION__
+				    , pppoe->ifname);
+		usleep(100000); /* 100ms delay before retry */
+		goto shoot_again;
+	}
+
+	/* TX batch: a single kick for all replies generated by this block */
+	pkt_ring_flush(w->fd, &w->ring);
+	goto shoot_again;
+}
+
 static void *
 gtp_pppoe_worker_task(void *arg)
 {
@@ -361,6 +422,14 @@ gtp_pppoe_worker_task(void *arg)
 	log_message(LOG_INFO, "%s(): Starting PPPoE Worker %s"
 			    , __FUNCTION__, pname);
 
+	/* PACKET_MMAP mode */
+	if (__test_bit(PPPOE_FL_PACKET_RING_BIT, &pppoe->flags)) {
+		if (gtp_pppoe_ring_init(pppoe, w) < 0)
+			goto end;
+		gtp_pppoe_ring_loop(pppoe, w);
+		goto end;
+	}
+
   shoot_again:
 	if (__test_bit(PPPOE_FL_STOPPING_BIT, &pppoe->flags))
 		goto end;
@@ -390,6 +459,7 @@ gtp_pppoe_worker_task(void *arg)
 			    , __FUNCTION__, pname);
 	if (bpf_obj)
 		bpf_object__close(bpf_obj);
+	pkt_ring_destroy(&w->ring);
 	close(w->fd);
 	return NULL;
 }
@@ -427,6 +497,7 @@ gtp_pppoe_worker_release(gtp_pppoe_worker_t *w)
 	sched_yield(); /* yield to handle the SIGUSR1 */
 	pthread_cancel(w->task); /* stop all the blocking syscalls, recvmmsg() */
 	pthread_join(w->task, NULL);
+	pkt_ring_destroy(&w->ring);
 	mpkt_destroy(&w->mpkt);
 	pkt_queue_destroy(&w->pkt_q);
 }
@@ -455,7 +526,8 @@ gtp_pppoe_timer_init(gtp_pppoe_t *pppoe)
 	char pname[128];
 
 	snprintf(pname, 127, "pppoe-timer-%s", pppoe->ifname);
-	timer_thread_init(&pppoe->session_timer, pname, pppoe_timeout);
+	timer_thread_wheel_init(&pppoe->session_timer, pname, pppoe_timeout,
+				GTP_PPPOE_TIMER_SHARDS);
 	return 0;
 }
 
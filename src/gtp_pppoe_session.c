@@ -46,7 +46,7 @@ extern thread_master_t *master;
 static struct hlist_head *
 spppoe_unique_hashkey(gtp_htab_t *h, uint32_t id)
 {
-	return h->htab + (jhash_1word(id, 0) & CONN_HASHTAB_MASK);
+	return h->htab + (gtp_hash_1word(GTP_HASH_PPPOE, id) & CONN_HASHTAB_MASK);
 }
 
 static spppoe_t *
@@ -146,7 +146,7 @@ spppoe_session_hashkey(gtp_htab_t *h, struct ether_addr *hw_addr, uint16_t id)
 	uint32_t hbits = *(uint32_t *) pkey;
 	uint32_t lbits = *(uint32_t *) (pkey + 4);
 
-	return h->htab + (jhash_3words(hbits, lbits, id, 0) & CONN_HASHTAB_MASK);
+	return h->htab + (gtp_hash_3words(GTP_HASH_PPPOE, hbits, lbits, id) & CONN_HASHTAB_MASK);
 }
 
 static spppoe_t *
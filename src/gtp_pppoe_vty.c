@@ -154,6 +154,68 @@ DEFUN(pppoe_interface,
 	return CMD_SUCCESS;
 }
 
+DEFUN(pppoe_packet_ring,
+      pppoe_packet_ring_cmd,
+      "packet-ring block-size INTEGER block-count <1-4096> block-timeout <1-1000>",
+      "PACKET_MMAP TPACKET_V3 RX/TX ring\n"
+      "Ring block size\n"
+      "Number of bytes (multiple of page size)\n"
+      "Ring block count\n"
+      "Number of blocks\n"
+      "RX block retire timeout\n"
+      "Number of milliseconds\n")
+{
+	gtp_pppoe_t *pppoe = vty->index;
+	unsigned int block_size, block_nr, block_tmo;
+
+	if (argc < 3) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (__test_bit(PPPOE_FL_RUNNING_BIT, &pppoe->flags)) {
+		vty_out(vty, "%% packet-ring MUST be configured before interface%s"
+			   , VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	block_size = strtoul(argv[0], NULL, 10);
+	if (!block_size || block_size % getpagesize() ||
+	    block_size < PKT_RING_FRAME_SIZE) {
+		vty_out(vty, "%% block-size MUST be a multiple of page size (%d)%s"
+			   , getpagesize(), VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("block-count", block_nr, argv[1], 1, 4096);
+	VTY_GET_INTEGER_RANGE("block-timeout", block_tmo, argv[2], 1, 1000);
+	pppoe->ring_block_size = block_size;
+	pppoe->ring_block_nr = block_nr;
+	pppoe->ring_block_tmo = block_tmo;
+	__set_bit(PPPOE_FL_PACKET_RING_BIT, &pppoe->flags);
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_pppoe_packet_ring,
+      no_pppoe_packet_ring_cmd,
+      "no packet-ring",
+      "Use plain socket RX/TX instead of PACKET_MMAP ring\n")
+{
+	gtp_pppoe_t *pppoe = vty->index;
+
+	if (__test_bit(PPPOE_FL_RUNNING_BIT, &pppoe->flags)) {
+		vty_out(vty, "%% packet-ring MUST be configured before interface%s"
+			   , VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	pppoe->ring_block_size = 0;
+	pppoe->ring_block_nr = 0;
+	pppoe->ring_block_tmo = 0;
+	__clear_bit(PPPOE_FL_PACKET_RING_BIT, &pppoe->flags);
+	return CMD_SUCCESS;
+}
+
 DEFUN(pppoe_monitor_vrrp,
       pppoe_monitor_vrrp_cmd,
       "monitor-vrrp <3-15>",
@@ -607,9 +669,15 @@ DEFUN(no_pppoe_bundle_ignore_ingress_ppp_brd,
 static int
 gtp_pppoe_worker_vty(vty_t *vty, gtp_pppoe_worker_t *w)
 {
+	pkt_ring_t *r = &w->ring;
+
 	vty_out(vty, "   #%.2d: rx_packets:%ld rx_bytes:%ld tx_packets:%ld tx_bytes:%ld%s"
 		   , w->id, w->rx_packets, w->rx_bytes, w->tx_packets, w->tx_bytes
 		   , VTY_NEWLINE);
+	if (r->map)
+		vty_out(vty, "        ring: rx_blocks:%ld tx_kicks:%ld tx_ring_full:%ld%s"
+			   , r->rx_blocks, r->tx_kicks, r->tx_full
+			   , VTY_NEWLINE);
 	return 0;
 }
 
@@ -634,6 +702,10 @@ gtp_pppoe_vty(vty_t *vty, gtp_pppoe_t *pppoe)
 	vty_out(vty, " PPPoE(%s): ifname %s (ifindex:%d) sessions:%d%s"
 		   , pppoe->name, pppoe->ifname, pppoe->ifindex, pppoe->session_count
 		   , VTY_NEWLINE);
+	if (__test_bit(PPPOE_FL_PACKET_RING_BIT, &pppoe->flags))
+		vty_out(vty, "  packet-ring: TPACKET_V3 block-size:%u block-count:%u block-timeout:%ums%s"
+			   , pppoe->ring_block_size, pppoe->ring_block_nr
+			   , pppoe->ring_block_tmo, VTY_NEWLINE);
 	gtp_pppoe_workers_vty(vty, "Discovery channel"
 				 , pppoe->worker_disc, pppoe->thread_cnt);
 	gtp_pppoe_workers_vty(vty, "Session channel"
@@ -678,6 +750,10 @@ gtp_config_pppoe_write(vty_t *vty)
 
 	list_for_each_entry(pppoe, l, next) {
 		vty_out(vty, "pppoe %s%s", pppoe->name, VTY_NEWLINE);
+		if (__test_bit(PPPOE_FL_PACKET_RING_BIT, &pppoe->flags))
+			vty_out(vty, " packet-ring block-size %u block-count %u block-timeout %u%s"
+				   , pppoe->ring_block_size, pppoe->ring_block_nr
+				   , pppoe->ring_block_tmo, VTY_NEWLINE);
 		vty_out(vty, " interface %s", pppoe->name);
 		if (pppoe->thread_cnt != GTP_PPPOE_RPS_SIZE)
 			vty_out(vty, " rps-bits %d", __builtin_ctz(pppoe->thread_cnt));
@@ -776,6 +852,8 @@ gtp_pppoe_vty_init(void)
 	install_element(CONFIG_NODE, &pppoe_cmd);
 	install_element(CONFIG_NODE, &no_pppoe_cmd);
 
+	install_element(PPPOE_NODE, &pppoe_packet_ring_cmd);
+	install_element(PPPOE_NODE, &no_pppoe_packet_ring_cmd);
 	install_element(PPPOE_NODE, &pppoe_interface_cmd);
 	install_element(PPPOE_NODE, &pppoe_monitor_vrrp_cmd);
 	install_element(PPPOE_NODE, &pppoe_ac_name_cmd);
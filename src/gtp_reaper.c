@@ -0,0 +1,566 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <errno.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/* Extern data */
+extern data_t *daemon_data;
+
+/* Local data */
+static gtp_reaper_t *gtp_reaper;
+static gtp_xdp_batch_t gtp_reaper_batch;
+static const char *gtp_reaper_job_str[] = {
+	[GTP_REAPER_JOB_SESSION]	= "session",
+	[GTP_REAPER_JOB_IMSI]		= "imsi",
+	[GTP_REAPER_JOB_APN]		= "apn",
+	[GTP_REAPER_JOB_PEER]		= "peer",
+	[GTP_REAPER_JOB_ALL]		= "all",
+};
+
+typedef struct _gtp_reaper_match {
+	int			type;
+	gtp_apn_t		*apn;
+	uint32_t		addr;
+	uint32_t		id;
+} gtp_reaper_match_t;
+
+
+/*
+ *	Reaper helpers
+ */
+static uint64_t
+gtp_reaper_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int
+gtp_reaper_item_add(gtp_reaper_job_t *job, uint64_t imsi, uint32_t id)
+{
+	gtp_reaper_item_t *item;
+
+	if (job->nr_item == job->max_item) {
+		item = REALLOC(job->item, (job->max_item + GTP_REAPER_ITEM_CHUNK) *
+					  sizeof(gtp_reaper_item_t));
+		if (!item)
+			return -1;
+		job->item = item;
+		job->max_item += GTP_REAPER_ITEM_CHUNK;
+	}
+
+	job->item[job->nr_item].imsi = imsi;
+	job->item[job->nr_item].id = id;
+	job->nr_item++;
+	return 0;
+}
+
+static gtp_reaper_job_t *
+__gtp_reaper_job_alloc(gtp_reaper_t *r, int type)
+{
+	gtp_reaper_job_t *new;
+
+	PMALLOC(new);
+	if (!new)
+		return NULL;
+	INIT_LIST_HEAD(&new->next);
+	new->type = type;
+	new->queued = time(NULL);
+
+	list_add_tail(&new->next, &r->jobs);
+	r->nr_jobs++;
+	return new;
+}
+
+static void
+__gtp_reaper_job_free(gtp_reaper_t *r, gtp_reaper_job_t *job)
+{
+	list_head_del(&job->next);
+	r->nr_jobs--;
+	if (job->item)
+		FREE(job->item);
+	FREE(job);
+}
+
+
+/*
+ *	Job submission
+ */
+int
+gtp_reaper_session_add(gtp_session_t *s)
+{
+	gtp_reaper_t *r = gtp_reaper;
+	gtp_reaper_job_t *job = NULL;
+	int err;
+
+	if (!r)
+		return -1;
+
+	/* Sessions are referenced by {IMSI, id} and resolved again
+	 * at reap time, they may be gone meanwhile */
+	pthread_mutex_lock(&r->mutex);
+	if (!list_empty(&r->jobs))
+		job = list_last_entry(&r->jobs, gtp_reaper_job_t, next);
+	if (!job || job->type != GTP_REAPER_JOB_SESSION)
+		job = __gtp_reaper_job_alloc(r, GTP_REAPER_JOB_SESSION);
+	err = (job) ? gtp_reaper_item_add(job, s->conn->imsi, s->id) : -1;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+
+	return err;
+}
+
+int
+gtp_reaper_job_add(int type, uint64_t imsi_min, uint64_t imsi_max, gtp_apn_t *apn, uint32_t addr)
+{
+	gtp_reaper_t *r = gtp_reaper;
+	gtp_reaper_job_t *job;
+
+	if (!r)
+		return -1;
+
+	pthread_mutex_lock(&r->mutex);
+	job = __gtp_reaper_job_alloc(r, type);
+	if (job) {
+		job->imsi_min = imsi_min;
+		job->imsi_max = imsi_max;
+		job->apn = apn;
+		job->addr = addr;
+	}
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+
+	return (job) ? 0 : -1;
+}
+
+
+/*
+ *	Job processing
+ */
+static int
+gtp_reaper_snapshot_iter(void *value, void *arg)
+{
+	gtp_reaper_job_t *job = arg;
+	gtp_conn_t *c = value;
+
+	if (job->type == GTP_REAPER_JOB_IMSI &&
+	    (c->imsi < job->imsi_min || c->imsi > job->imsi_max))
+		return 0;
+
+	return gtp_reaper_item_add(job, c->imsi, 0);
+}
+
+/* Reaper thread owns non-session jobs once started: snapshot is
+ * built without reaper lock held */
+static void
+gtp_reaper_snapshot(gtp_reaper_t *r, gtp_reaper_job_t *job)
+{
+	gtp_reaper_job_t tmp = { .type = job->type
+			       , .imsi_min = job->imsi_min
+			       , .imsi_max = job->imsi_max };
+
+	if (job->type == GTP_REAPER_JOB_IMSI && job->imsi_min == job->imsi_max)
+		gtp_reaper_item_add(&tmp, job->imsi_min, 0);
+	else
+		gtp_conn_iterate(gtp_reaper_snapshot_iter, &tmp);
+
+	pthread_mutex_lock(&r->mutex);
+	job->item = tmp.item;
+	job->nr_item = tmp.nr_item;
+	job->max_item = tmp.max_item;
+	pthread_mutex_unlock(&r->mutex);
+}
+
+static int
+gtp_reaper_match(gtp_session_t *s, void *arg)
+{
+	gtp_reaper_match_t *m = arg;
+
+	switch (m->type) {
+	case GTP_REAPER_JOB_SESSION:
+		return s->id == m->id;
+	case GTP_REAPER_JOB_APN:
+		return s->apn == m->apn;
+	case GTP_REAPER_JOB_PEER:
+		return s->path && s->path->addr.sin_addr.s_addr == m->addr;
+	}
+
+	return 1;
+}
+
+static int
+gtp_reaper_slice(gtp_reaper_t *r, int budget)
+{
+	gtp_reaper_item_t item[GTP_REAPER_ITEM_CHUNK];
+	uint64_t deadline = gtp_reaper_usec() + r->slice;
+	gtp_xdp_batch_t *batch = &gtp_reaper_batch;
+	int i, n, cnt, used = 0, reaped = 0;
+	gtp_reaper_match_t m;
+	gtp_reaper_job_t *job;
+	gtp_conn_t *c;
+
+	pthread_mutex_lock(&r->mutex);
+	job = list_first_entry(&r->jobs, gtp_reaper_job_t, next);
+	if (!job->started && job->type != GTP_REAPER_JOB_SESSION) {
+		job->started = true;
+		pthread_mutex_unlock(&r->mutex);
+		gtp_reaper_snapshot(r, job);
+		return 0;
+	}
+	job->started = true;
+
+	/* Work on a private copy: reaper lock nests inside path and
+	 * session locks, it must not be held while releasing */
+	n = job->nr_item - job->cur;
+	n = (n > budget) ? budget : n;
+	n = (n > GTP_REAPER_ITEM_CHUNK) ? GTP_REAPER_ITEM_CHUNK : n;
+	memcpy(item, job->item + job->cur, n * sizeof(gtp_reaper_item_t));
+	m.type = job->type;
+	m.apn = job->apn;
+	m.addr = job->addr;
+	pthread_mutex_unlock(&r->mutex);
+
+	/* Time and rate bounded, rate is accounted in sessions */
+	gtp_xdp_batch_begin(batch);
+	for (i = 0; i < n && used < budget; i++) {
+		if (i && !(i & 0xf) && gtp_reaper_usec() > deadline)
+			break;
+
+		c = gtp_conn_get_by_imsi(item[i].imsi);
+		if (!c) {
+			used++;
+			continue;
+		}
+
+		m.id = item[i].id;
+		cnt = gtp_sessions_reap(c, gtp_reaper_match, &m);
+		reaped += cnt;
+		used += (cnt) ? : 1;
+	}
+	gtp_xdp_batch_end();
+
+	pthread_mutex_lock(&r->mutex);
+	job->cur += i;
+	job->reaped += reaped;
+	r->reaped += reaped;
+	r->slices++;
+	r->xdp_deleted += batch->flushed;
+	r->xdp_syscalls += batch->syscalls;
+	if (job->cur == job->nr_item) {
+		log_message(LOG_INFO, "%s(): %s job done, %lu sessions released"
+				    , __FUNCTION__, gtp_reaper_job_str[job->type], job->reaped);
+		__gtp_reaper_job_free(r, job);
+		r->jobs_done++;
+	}
+	pthread_mutex_unlock(&r->mutex);
+
+	return used;
+}
+
+static void *
+gtp_reaper_task(void *arg)
+{
+	gtp_reaper_t *r = arg;
+	struct timespec timeout;
+	uint64_t last = 0, now;
+	int64_t credit = 0;
+
+	/* Our identity */
+	prctl(PR_SET_NAME, "gtp_reaper", 0, 0, 0, 0);
+
+	pthread_mutex_lock(&r->mutex);
+	while (!__test_bit(GTP_REAPER_FL_STOP_BIT, &r->flags)) {
+		if (list_empty(&r->jobs)) {
+			pthread_cond_wait(&r->cond, &r->mutex);
+			last = gtp_reaper_usec();
+			credit = 0;
+			continue;
+		}
+
+		/* Token bucket: at most 100ms worth of burst */
+		now = gtp_reaper_usec();
+		credit += (now - last) * r->rate / 1000000;
+		if (credit > r->rate / 10)
+			credit = (r->rate / 10) ? : 1;
+		last = now;
+
+		if (credit <= 0) {
+			clock_gettime(CLOCK_REALTIME, &timeout);
+			timeout.tv_nsec += GTP_REAPER_TIMER * 1000000;
+			if (timeout.tv_nsec >= 1000000000) {
+				timeout.tv_sec++;
+				timeout.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&r->cond, &r->mutex, &timeout);
+			continue;
+		}
+
+		pthread_mutex_unlock(&r->mutex);
+		credit -= gtp_reaper_slice(r, credit);
+		pthread_mutex_lock(&r->mutex);
+	}
+	pthread_mutex_unlock(&r->mutex);
+
+	return NULL;
+}
+
+
+/*
+ *	Reaper show
+ */
+static int
+gtp_reaper_show(vty_t *vty)
+{
+	gtp_reaper_t *r = gtp_reaper;
+	time_t now = time(NULL);
+	gtp_reaper_job_t *job;
+
+	pthread_mutex_lock(&r->mutex);
+	vty_out(vty, "Session reaper: rate:%u sessions/s slice:%uus, %d jobs pending%s"
+		     " released:%lu slices:%lu jobs-done:%lu xdp-deleted:%lu xdp-syscalls:%lu%s"
+		   , r->rate, r->slice, r->nr_jobs, VTY_NEWLINE
+		   , r->reaped, r->slices, r->jobs_done, r->xdp_deleted, r->xdp_syscalls
+		   , VTY_NEWLINE);
+	list_for_each_entry(job, &r->jobs, next) {
+		vty_out(vty, " %-7s", gtp_reaper_job_str[job->type]);
+		if (job->type == GTP_REAPER_JOB_IMSI)
+			vty_out(vty, " [%lu..%lu]", job->imsi_min, job->imsi_max);
+		else if (job->type == GTP_REAPER_JOB_APN)
+			vty_out(vty, " %s", job->apn->name);
+		else if (job->type == GTP_REAPER_JOB_PEER)
+			vty_out(vty, " %u.%u.%u.%u", NIPQUAD(job->addr));
+		if (!job->started && job->type != GTP_REAPER_JOB_SESSION)
+			vty_out(vty, " queued (%lds)%s", (long) (now - job->queued), VTY_NEWLINE);
+		else
+			vty_out(vty, " progress:%u/%u (%u%%) released:%lu (%lds)%s"
+				   , job->cur, job->nr_item
+				   , (job->nr_item) ? (uint32_t) ((uint64_t) job->cur * 100 / job->nr_item) : 0
+				   , job->reaped, (long) (now - job->queued), VTY_NEWLINE);
+	}
+	pthread_mutex_unlock(&r->mutex);
+
+	return 0;
+}
+
+int
+gtp_reaper_config_write(vty_t *vty)
+{
+	gtp_reaper_t *r = gtp_reaper;
+
+	if (r->rate != GTP_REAPER_RATE || r->slice != GTP_REAPER_SLICE)
+		vty_out(vty, " session-reaper rate %u slice %u%s"
+			   , r->rate, r->slice, VTY_NEWLINE);
+	return 0;
+}
+
+
+/*
+ *	Reaper init
+ */
+int
+gtp_reaper_init(void)
+{
+	gtp_reaper_t *r;
+
+	PMALLOC(r);
+	if (!r)
+		return -1;
+	INIT_LIST_HEAD(&r->jobs);
+	r->rate = GTP_REAPER_RATE;
+	r->slice = GTP_REAPER_SLICE;
+	pthread_mutex_init(&r->mutex, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	gtp_reaper = r;
+
+	pthread_create(&r->task, NULL, gtp_reaper_task, r);
+	return 0;
+}
+
+int
+gtp_reaper_destroy(void)
+{
+	gtp_reaper_t *r = gtp_reaper;
+	gtp_reaper_job_t *job, *_job;
+
+	if (!r)
+		return -1;
+
+	pthread_mutex_lock(&r->mutex);
+	__set_bit(GTP_REAPER_FL_STOP_BIT, &r->flags);
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+	pthread_join(r->task, NULL);
+
+	/* Pending jobs are dropped, remaining sessions are released
+	 * by conn tracking destroy */
+	list_for_each_entry_safe(job, _job, &r->jobs, next)
+		__gtp_reaper_job_free(r, job);
+
+	gtp_reaper = NULL;
+	pthread_mutex_destroy(&r->mutex);
+	pthread_cond_destroy(&r->cond);
+	FREE(r);
+	return 0;
+}
+
+
+/*
+ *	VTY command
+ */
+DEFUN(pdn_session_reaper,
+      pdn_session_reaper_cmd,
+      "session-reaper rate <100-1000000> slice <100-100000>",
+      "Background session release\n"
+      "Release rate\n"
+      "sessions per second\n"
+      "Max run time per slice\n"
+      "micro-seconds\n")
+{
+	gtp_reaper_t *r = gtp_reaper;
+	int rate, slice;
+
+	if (argc < 2) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("rate", rate, argv[0], 100, 1000000);
+	VTY_GET_INTEGER_RANGE("slice", slice, argv[1], 100, 100000);
+
+	pthread_mutex_lock(&r->mutex);
+	r->rate = rate;
+	r->slice = slice;
+	pthread_mutex_unlock(&r->mutex);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(clear_gtp_session_apn,
+      clear_gtp_session_apn_cmd,
+      "clear gtp session apn STRING",
+      "Clear GTP related\n"
+      "GTP related\n"
+      "GTP Session\n"
+      "Access-Point-Name\n"
+      "Name\n")
+{
+	gtp_apn_t *apn;
+
+	apn = gtp_apn_get(argv[0]);
+	if (!apn) {
+		vty_out(vty, "%% unknown access-point-name %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	gtp_reaper_job_add(GTP_REAPER_JOB_APN, 0, 0, apn, 0);
+	return CMD_SUCCESS;
+}
+
+DEFUN(clear_gtp_session_imsi_range,
+      clear_gtp_session_imsi_range_cmd,
+      "clear gtp session imsi-range INTEGER INTEGER",
+      "Clear GTP related\n"
+      "GTP related\n"
+      "GTP Session\n"
+      "IMSI range\n"
+      "First IMSI\n"
+      "Last IMSI\n")
+{
+	uint64_t imsi_min, imsi_max;
+
+	imsi_min = strtoull(argv[0], NULL, 10);
+	imsi_max = strtoull(argv[1], NULL, 10);
+	if (imsi_min > imsi_max) {
+		vty_out(vty, "%% invalid IMSI range%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	gtp_reaper_job_add(GTP_REAPER_JOB_IMSI, imsi_min, imsi_max, NULL, 0);
+	return CMD_SUCCESS;
+}
+
+DEFUN(clear_gtp_session_peer,
+      clear_gtp_session_peer_cmd,
+      "clear gtp session peer A.B.C.D",
+      "Clear GTP related\n"
+      "GTP related\n"
+      "GTP Session\n"
+      "sGW peer\n"
+      "IPv4 Address\n")
+{
+	uint32_t addr;
+
+	if (inet_pton(AF_INET, argv[0], &addr) != 1) {
+		vty_out(vty, "%% malformed IP address %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	gtp_reaper_job_add(GTP_REAPER_JOB_PEER, 0, 0, NULL, addr);
+	return CMD_SUCCESS;
+}
+
+DEFUN(clear_gtp_session_all,
+      clear_gtp_session_all_cmd,
+      "clear gtp session all",
+      "Clear GTP related\n"
+      "GTP related\n"
+      "GTP Session\n"
+      "All sessions\n")
+{
+	gtp_reaper_job_add(GTP_REAPER_JOB_ALL, 0, 0, NULL, 0);
+	return CMD_SUCCESS;
+}
+
+DEFUN(show_gtp_reaper,
+      show_gtp_reaper_cmd,
+      "show gtp reaper",
+      SHOW_STR
+      "GTP related informations\n"
+      "Background session release\n")
+{
+	gtp_reaper_show(vty);
+	return CMD_SUCCESS;
+}
+
+int
+gtp_reaper_vty_init(void)
+{
+	install_element(PDN_NODE, &pdn_session_reaper_cmd);
+	install_element(VIEW_NODE, &show_gtp_reaper_cmd);
+	install_element(ENABLE_NODE, &show_gtp_reaper_cmd);
+	install_element(ENABLE_NODE, &clear_gtp_session_apn_cmd);
+	install_element(ENABLE_NODE, &clear_gtp_session_imsi_range_cmd);
+	install_element(ENABLE_NODE, &clear_gtp_session_peer_cmd);
+	install_element(ENABLE_NODE, &clear_gtp_session_all_cmd);
+
+	return 0;
+}
@@ -0,0 +1,901 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/* Extern data */
+extern data_t *daemon_data;
+
+/* Local data */
+static gtp_repl_t *gtp_repl;
+
+/* Set on rx thread, changes applied from peer are not sent back */
+static __thread bool gtp_repl_applying;
+
+
+/*
+ *	Send queue
+ */
+static void
+gtp_repl_ring_write(gtp_repl_t *r, const void *data, uint32_t len)
+{
+	uint32_t off = r->tail % GTP_REPL_QUEUE_SIZE;
+	uint32_t n = (len < GTP_REPL_QUEUE_SIZE - off) ? len : GTP_REPL_QUEUE_SIZE - off;
+
+	memcpy(r->queue + off, data, n);
+	memcpy(r->queue, (const uint8_t *) data + n, len - n);
+	r->tail += len;
+}
+
+static void
+gtp_repl_ring_read(gtp_repl_t *r, uint8_t *data, uint32_t len)
+{
+	uint32_t off = r->head % GTP_REPL_QUEUE_SIZE;
+	uint32_t n = (len < GTP_REPL_QUEUE_SIZE - off) ? len : GTP_REPL_QUEUE_SIZE - off;
+
+	memcpy(data, r->queue + off, n);
+	memcpy(data + n, r->queue, len - n);
+	r->head += len;
+}
+
+/* Wait until queue is at most half full. Only resync waits, so live
+ * producers always have the other half to go. */
+static int
+gtp_repl_wait(gtp_repl_t *r, uint32_t need)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&r->mutex);
+	while (r->tail - r->head + need > GTP_REPL_QUEUE_SIZE / 2 &&
+	       __test_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags) &&
+	       !__test_bit(GTP_REPL_FL_STOP_BIT, &r->flags))
+		pthread_cond_wait(&r->space_cond, &r->mutex);
+
+	if (!__test_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags))
+		err = -1;
+	pthread_mutex_unlock(&r->mutex);
+	return err;
+}
+
+/* Queue one record. Producers never block: a full queue drops the
+ * record and asks for a resync. Resync waits for room beforehand so
+ * it never overflows. */
+static int
+gtp_repl_enqueue(gtp_repl_t *r, int type, void *data, uint32_t len, bool wait)
+{
+	uint32_t need = sizeof(gtp_ckpt_rec_t) + len;
+	gtp_ckpt_rec_t rec = { 0 };
+
+	if (wait && gtp_repl_wait(r, need) < 0)
+		return -1;
+
+	rec.type = type;
+	rec.len = len;
+	rec.crc = (len) ? adler_crc32(data, len) : 0;
+
+	pthread_mutex_lock(&r->mutex);
+	if (!__test_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags)) {
+		pthread_mutex_unlock(&r->mutex);
+		return -1;
+	}
+
+	if (r->tail - r->head + need > GTP_REPL_QUEUE_SIZE) {
+		r->tx_dropped++;
+		__set_bit(GTP_REPL_FL_RESYNC_BIT, &r->flags);
+		pthread_cond_signal(&r->sync_cond);
+		pthread_mutex_unlock(&r->mutex);
+		return -1;
+	}
+
+	gtp_repl_ring_write(r, &rec, sizeof(rec));
+	if (len)
+		gtp_repl_ring_write(r, data, len);
+	r->tx_records++;
+	pthread_cond_signal(&r->tx_cond);
+	pthread_mutex_unlock(&r->mutex);
+	return 0;
+}
+
+bool
+gtp_repl_running(void)
+{
+	gtp_repl_t *r = gtp_repl;
+
+	return r && __test_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags) &&
+	       !gtp_repl_applying;
+}
+
+int
+gtp_repl_send(int type, void *data, uint32_t len)
+{
+	if (!gtp_repl_running())
+		return -1;
+
+	return gtp_repl_enqueue(gtp_repl, type, data, len, false);
+}
+
+
+/*
+ *	Sender
+ */
+static int
+gtp_repl_connect(gtp_repl_t *r)
+{
+	struct timeval tv = { .tv_sec = GTP_REPL_SND_TIMEOUT };
+	int fd, on = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	/* Stalled peer turns into a send error, then a resync */
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	if (connect(fd, (struct sockaddr *) &r->peer_addr, sizeof(r->peer_addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int
+gtp_repl_write(gtp_repl_t *r, int fd, uint8_t *data, uint32_t len)
+{
+	uint32_t off = 0;
+	ssize_t ret;
+
+	while (off < len) {
+		ret = send(fd, data + off, len - off, MSG_NOSIGNAL);
+		r->tx_syscalls++;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		off += ret;
+	}
+
+	return 0;
+}
+
+/* Caller holds mutex */
+static void
+gtp_repl_disconnect(gtp_repl_t *r)
+{
+	__clear_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags);
+	close(r->tx_fd);
+	r->tx_fd = -1;
+	r->head = r->tail = 0;
+	pthread_cond_broadcast(&r->space_cond);
+}
+
+static void *
+gtp_repl_tx_task(void *arg)
+{
+	gtp_repl_t *r = arg;
+	struct timespec timeout;
+	uint8_t *batch;
+	uint32_t n;
+	int fd, err;
+
+	/* Our identity */
+	prctl(PR_SET_NAME, "gtp_repl_tx", 0, 0, 0, 0);
+
+	batch = MALLOC(GTP_REPL_BATCH);
+	if (!batch)
+		return NULL;
+
+	pthread_mutex_lock(&r->mutex);
+	while (!__test_bit(GTP_REPL_FL_STOP_BIT, &r->flags)) {
+		if (!__test_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags)) {
+			pthread_mutex_unlock(&r->mutex);
+			fd = gtp_repl_connect(r);
+			pthread_mutex_lock(&r->mutex);
+			if (fd < 0) {
+				clock_gettime(CLOCK_REALTIME, &timeout);
+				timeout.tv_sec += GTP_REPL_RETRY_TIMER;
+				pthread_cond_timedwait(&r->tx_cond, &r->mutex, &timeout);
+				continue;
+			}
+
+			if (__test_bit(GTP_REPL_FL_STOP_BIT, &r->flags)) {
+				close(fd);
+				break;
+			}
+
+			/* Peer state is unknown, start over from full image */
+			r->tx_fd = fd;
+			r->head = r->tail = 0;
+			r->connects++;
+			__set_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags);
+			__set_bit(GTP_REPL_FL_RESYNC_BIT, &r->flags);
+			pthread_cond_signal(&r->sync_cond);
+			log_message(LOG_INFO, "%s(): connected to peer %u.%u.%u.%u:%d"
+					    , __FUNCTION__
+					    , NIPQUAD(r->peer_addr.sin_addr.s_addr)
+					    , ntohs(r->peer_addr.sin_port));
+			continue;
+		}
+
+		if (r->head == r->tail) {
+			pthread_cond_wait(&r->tx_cond, &r->mutex);
+			continue;
+		}
+
+		/* Drain as much as possible per syscall */
+		n = (r->tail - r->head < GTP_REPL_BATCH) ? r->tail - r->head : GTP_REPL_BATCH;
+		gtp_repl_ring_read(r, batch, n);
+		pthread_cond_broadcast(&r->space_cond);
+		fd = r->tx_fd;
+		pthread_mutex_unlock(&r->mutex);
+
+		err = gtp_repl_write(r, fd, batch, n);
+
+		pthread_mutex_lock(&r->mutex);
+		if (err) {
+			log_message(LOG_INFO, "%s(): lost peer %u.%u.%u.%u:%d (%m)"
+					    , __FUNCTION__
+					    , NIPQUAD(r->peer_addr.sin_addr.s_addr)
+					    , ntohs(r->peer_addr.sin_port));
+			gtp_repl_disconnect(r);
+			continue;
+		}
+		r->tx_bytes += n;
+	}
+
+	if (__test_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags))
+		gtp_repl_disconnect(r);
+	pthread_mutex_unlock(&r->mutex);
+
+	FREE(batch);
+	return NULL;
+}
+
+
+/*
+ *	Full resync
+ */
+static int
+gtp_repl_sync_conn(gtp_repl_t *r, gtp_conn_t *c)
+{
+	gtp_session_t *s;
+	uint8_t *buffer;
+	int *len, nr = 0, i, err = 0;
+
+	/* Never sleep on queue room with conn locked, live updates
+	 * and packet path would stall behind a slow peer */
+	if (gtp_repl_wait(r, GTP_CKPT_IMAGE_MAX) < 0)
+		return -1;
+
+	/* Images are built under the same lock as live updates and
+	 * queued before releasing it: per conn ordering is kept */
+	pthread_mutex_lock(&c->session_mutex);
+	list_for_each_entry(s, &c->gtp_sessions, next)
+		nr += !__test_bit(GTP_SESSION_FL_REPLICA_BIT, &s->flags);
+	if (!nr) {
+		pthread_mutex_unlock(&c->session_mutex);
+		return 0;
+	}
+
+	buffer = MALLOC(nr * (GTP_CKPT_IMAGE_MAX + sizeof(int)));
+	if (!buffer) {
+		pthread_mutex_unlock(&c->session_mutex);
+		return -1;
+	}
+	len = (int *) (buffer + nr * GTP_CKPT_IMAGE_MAX);
+
+	nr = 0;
+	list_for_each_entry(s, &c->gtp_sessions, next) {
+		if (__test_bit(GTP_SESSION_FL_REPLICA_BIT, &s->flags))
+			continue;
+
+		len[nr] = gtp_ckpt_session_image(s, (gtp_ckpt_session_t *)
+						    (buffer + nr * GTP_CKPT_IMAGE_MAX));
+		nr += (len[nr] >= 0);
+	}
+
+	for (i = 0; i < nr && !err; i++)
+		err = gtp_repl_enqueue(r, GTP_CKPT_REC_SESSION
+					, buffer + i * GTP_CKPT_IMAGE_MAX, len[i], false);
+	pthread_mutex_unlock(&c->session_mutex);
+
+	FREE(buffer);
+	return err;
+}
+
+static int
+gtp_repl_sync(gtp_repl_t *r)
+{
+	gtp_ckpt_imsi_t list = { 0 };
+	gtp_conn_t *c;
+	uint32_t i;
+	int err = 0;
+
+	if (gtp_repl_enqueue(r, GTP_CKPT_REC_SYNC_BEGIN, NULL, 0, true) < 0)
+		return -1;
+
+	gtp_conn_iterate(gtp_ckpt_imsi_iter, &list);
+	for (i = 0; i < list.nr && !err; i++) {
+		if (__test_bit(GTP_REPL_FL_STOP_BIT, &r->flags))
+			break;
+
+		c = gtp_conn_get_by_imsi(list.imsi[i]);
+		if (!c)
+			continue;
+		err = gtp_repl_sync_conn(r, c);
+		gtp_conn_put(c);
+	}
+	if (list.imsi)
+		FREE(list.imsi);
+
+	if (i < list.nr || err)
+		return -1;
+
+	return gtp_repl_enqueue(r, GTP_CKPT_REC_SYNC_END, NULL, 0, true);
+}
+
+static void *
+gtp_repl_sync_task(void *arg)
+{
+	gtp_repl_t *r = arg;
+
+	/* Our identity */
+	prctl(PR_SET_NAME, "gtp_repl_sync", 0, 0, 0, 0);
+
+	pthread_mutex_lock(&r->mutex);
+	while (!__test_bit(GTP_REPL_FL_STOP_BIT, &r->flags)) {
+		if (!__test_bit(GTP_REPL_FL_RESYNC_BIT, &r->flags) ||
+		    !__test_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags)) {
+			pthread_cond_wait(&r->sync_cond, &r->mutex);
+			continue;
+		}
+
+		__clear_bit(GTP_REPL_FL_RESYNC_BIT, &r->flags);
+		r->resyncs++;
+		pthread_mutex_unlock(&r->mutex);
+		gtp_repl_sync(r);
+		pthread_mutex_lock(&r->mutex);
+	}
+	pthread_mutex_unlock(&r->mutex);
+
+	return NULL;
+}
+
+
+/*
+ *	Receiver
+ */
+static int
+gtp_repl_session_match(gtp_session_t *s, void *arg)
+{
+	uint32_t *id = arg;
+
+	return s->id == *id;
+}
+
+static int
+gtp_repl_session_release(gtp_ckpt_key_t *key)
+{
+	gtp_conn_t *c;
+
+	c = gtp_conn_get_by_imsi(key->imsi);
+	if (!c)
+		return 0;
+
+	return gtp_sessions_reap(c, gtp_repl_session_match, &key->id);
+}
+
+/* Locally owned session, ie: last updated by our own control plane */
+static bool
+gtp_repl_session_owned(gtp_ckpt_key_t *key)
+{
+	gtp_session_t *s;
+	gtp_conn_t *c;
+	bool owned = false;
+
+	c = gtp_conn_get_by_imsi(key->imsi);
+	if (!c)
+		return false;
+
+	pthread_mutex_lock(&c->session_mutex);
+	list_for_each_entry(s, &c->gtp_sessions, next) {
+		if (s->id == key->id) {
+			owned = !__test_bit(GTP_SESSION_FL_REPLICA_BIT, &s->flags);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&c->session_mutex);
+	gtp_conn_put(c);
+
+	return owned;
+}
+
+/* Replica refreshed by current peer resync */
+static void
+gtp_repl_session_stamp(gtp_ckpt_key_t *key, uint32_t gen)
+{
+	gtp_session_t *s;
+	gtp_conn_t *c;
+
+	c = gtp_conn_get_by_imsi(key->imsi);
+	if (!c)
+		return;
+
+	pthread_mutex_lock(&c->session_mutex);
+	list_for_each_entry(s, &c->gtp_sessions, next) {
+		if (s->id == key->id) {
+			s->repl_gen = gen;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&c->session_mutex);
+	gtp_conn_put(c);
+}
+
+static int
+gtp_repl_session_stale(gtp_session_t *s, void *arg)
+{
+	uint32_t *gen = arg;
+
+	return __test_bit(GTP_SESSION_FL_REPLICA_BIT, &s->flags) &&
+	       s->repl_gen != *gen;
+}
+
+/* Peer sent its full image: replicas it didn't refresh are gone
+ * on its side, release them now with their XDP rules and leases */
+static int
+gtp_repl_sweep(gtp_repl_t *r)
+{
+	gtp_ckpt_imsi_t list = { 0 };
+	gtp_conn_t *c;
+	uint32_t i;
+	int cnt = 0;
+
+	gtp_conn_iterate(gtp_ckpt_imsi_iter, &list);
+	for (i = 0; i < list.nr; i++) {
+		c = gtp_conn_get_by_imsi(list.imsi[i]);
+		if (!c)
+			continue;
+		cnt += gtp_sessions_reap(c, gtp_repl_session_stale, &r->rx_gen);
+	}
+	if (list.imsi)
+		FREE(list.imsi);
+
+	r->rx_swept += cnt;
+	return cnt;
+}
+
+static void
+gtp_repl_apply(gtp_repl_t *r, gtp_ckpt_rec_t *rec, uint8_t *data, bool *syncing)
+{
+	gtp_ckpt_session_t *img = (gtp_ckpt_session_t *) data;
+	time_t now;
+	int ret;
+
+	r->rx_records++;
+	if (rec->len && adler_crc32(data, rec->len) != rec->crc) {
+		r->rx_errors++;
+		return;
+	}
+
+	switch (rec->type) {
+	case GTP_CKPT_REC_SESSION:
+		if (rec->len < sizeof(*img) ||
+		    rec->len != sizeof(*img) + (img->nr_gtpc + img->nr_gtpu) * sizeof(gtp_ckpt_teid_t)) {
+			r->rx_errors++;
+			return;
+		}
+
+		/* Peer resync doesn't override sessions we took over.
+		 * Live updates do: peer control plane owns it again */
+		if (*syncing && gtp_repl_session_owned(&img->key))
+			return;
+
+		/* Refresh in place so that XDP rules and leases are
+		 * left untouched, rebuild only when layout changed */
+		now = time(NULL);
+		ret = gtp_ckpt_session_update(img, now, 1UL << GTP_SESSION_FL_REPLICA_BIT);
+		if (ret > 0) {
+			r->rx_updated++;
+			r->rx_applied++;
+		} else {
+			gtp_repl_session_release(&img->key);
+			ret = gtp_ckpt_session_restore(img, now, 1UL << GTP_SESSION_FL_REPLICA_BIT);
+			if (ret < 0) {
+				r->rx_errors++;
+				return;
+			}
+			r->rx_applied += ret;
+		}
+
+		if (*syncing && ret > 0)
+			gtp_repl_session_stamp(&img->key, r->rx_gen);
+		break;
+
+	case GTP_CKPT_REC_SESSION_DEL:
+		if (rec->len != sizeof(gtp_ckpt_key_t)) {
+			r->rx_errors++;
+			return;
+		}
+
+		r->rx_deleted += gtp_repl_session_release((gtp_ckpt_key_t *) data);
+		break;
+
+	case GTP_CKPT_REC_SYNC_BEGIN:
+		*syncing = true;
+		r->rx_gen++;
+		log_message(LOG_INFO, "%s(): peer resync started", __FUNCTION__);
+		break;
+
+	case GTP_CKPT_REC_SYNC_END:
+		if (!*syncing)
+			break;
+		*syncing = false;
+		ret = gtp_repl_sweep(r);
+		log_message(LOG_INFO, "%s(): peer resync completed (%lu sessions applied, %d stale released)"
+				    , __FUNCTION__, r->rx_applied, ret);
+		break;
+
+	default:
+		r->rx_errors++;
+		break;
+	}
+}
+
+static void
+gtp_repl_rx(gtp_repl_t *r, int fd, uint8_t *buffer)
+{
+	uint8_t data[GTP_CKPT_IMAGE_MAX];
+	gtp_ckpt_rec_t rec;
+	uint32_t fill = 0, off;
+	bool syncing = false;
+	ssize_t ret;
+
+	for (;;) {
+		ret = recv(fd, buffer + fill, GTP_REPL_RX_BUFFER - fill, 0);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return;
+
+		fill += ret;
+		r->rx_bytes += ret;
+
+		/* Apply every complete record, keep partial tail */
+		for (off = 0; fill - off >= sizeof(rec); off += sizeof(rec) + rec.len) {
+			memcpy(&rec, buffer + off, sizeof(rec));
+			if (rec.len > GTP_CKPT_IMAGE_MAX) {
+				log_message(LOG_INFO, "%s(): malformed record (len:%u)"
+						    , __FUNCTION__, rec.len);
+				r->rx_errors++;
+				return;
+			}
+
+			if (fill - off < sizeof(rec) + rec.len)
+				break;
+
+			memcpy(data, buffer + off + sizeof(rec), rec.len);
+			gtp_repl_apply(r, &rec, data, &syncing);
+		}
+
+		memmove(buffer, buffer + off, fill - off);
+		fill -= off;
+	}
+}
+
+static void *
+gtp_repl_rx_task(void *arg)
+{
+	gtp_repl_t *r = arg;
+	int fd, on = 1, idle = 5, intvl = 1, cnt = 3;
+	struct sockaddr_in addr;
+	socklen_t addrlen;
+	uint8_t *buffer;
+
+	/* Our identity */
+	prctl(PR_SET_NAME, "gtp_repl_rx", 0, 0, 0, 0);
+	gtp_repl_applying = true;
+
+	buffer = MALLOC(GTP_REPL_RX_BUFFER);
+	if (!buffer)
+		return NULL;
+
+	while (!__test_bit(GTP_REPL_FL_STOP_BIT, &r->flags)) {
+		addrlen = sizeof(addr);
+		fd = accept4(r->listen_fd, (struct sockaddr *) &addr, &addrlen, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (__test_bit(GTP_REPL_FL_STOP_BIT, &r->flags))
+				break;
+			if (errno != EINTR)
+				sleep(1);
+			continue;
+		}
+
+		/* Only configured peer may push sessions to us */
+		if (addr.sin_family != AF_INET ||
+		    addr.sin_addr.s_addr != r->peer_addr.sin_addr.s_addr) {
+			log_message(LOG_INFO, "%s(): rejecting connection from %u.%u.%u.%u"
+					    , __FUNCTION__, NIPQUAD(addr.sin_addr.s_addr));
+			close(fd);
+			continue;
+		}
+
+		/* Single peer, detect a dead one so next can get in */
+		setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl));
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt));
+
+		pthread_mutex_lock(&r->mutex);
+		if (__test_bit(GTP_REPL_FL_STOP_BIT, &r->flags)) {
+			pthread_mutex_unlock(&r->mutex);
+			close(fd);
+			break;
+		}
+		r->rx_fd = fd;
+		pthread_mutex_unlock(&r->mutex);
+
+		log_message(LOG_INFO, "%s(): peer connected", __FUNCTION__);
+		gtp_repl_rx(r, fd, buffer);
+		log_message(LOG_INFO, "%s(): peer disconnected", __FUNCTION__);
+
+		pthread_mutex_lock(&r->mutex);
+		r->rx_fd = -1;
+		pthread_mutex_unlock(&r->mutex);
+		close(fd);
+	}
+
+	FREE(buffer);
+	return NULL;
+}
+
+
+/*
+ *	Replication init
+ */
+static int
+gtp_repl_listen(gtp_repl_t *r)
+{
+	int fd, on = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, (struct sockaddr *) &r->listen_addr, sizeof(r->listen_addr)) < 0 ||
+	    listen(fd, 1) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int
+gtp_repl_start(void)
+{
+	gtp_repl_t *r = gtp_repl;
+
+	if (!__test_bit(GTP_REPL_FL_CONFIGURED_BIT, &r->flags))
+		return 0;
+
+	r->listen_fd = gtp_repl_listen(r);
+	if (r->listen_fd < 0) {
+		log_message(LOG_INFO, "%s(): unable to listen on %u.%u.%u.%u:%d (%m)"
+				    , __FUNCTION__
+				    , NIPQUAD(r->listen_addr.sin_addr.s_addr)
+				    , ntohs(r->listen_addr.sin_port));
+		return -1;
+	}
+
+	r->queue = MALLOC(GTP_REPL_QUEUE_SIZE);
+	if (!r->queue) {
+		close(r->listen_fd);
+		r->listen_fd = -1;
+		return -1;
+	}
+
+	__set_bit(GTP_REPL_FL_RUNNING_BIT, &r->flags);
+	pthread_create(&r->rx_task, NULL, gtp_repl_rx_task, r);
+	pthread_create(&r->sync_task, NULL, gtp_repl_sync_task, r);
+	pthread_create(&r->tx_task, NULL, gtp_repl_tx_task, r);
+	return 0;
+}
+
+int
+gtp_repl_init(void)
+{
+	gtp_repl_t *r;
+
+	PMALLOC(r);
+	if (!r)
+		return -1;
+	r->listen_fd = r->tx_fd = r->rx_fd = -1;
+	pthread_mutex_init(&r->mutex, NULL);
+	pthread_cond_init(&r->tx_cond, NULL);
+	pthread_cond_init(&r->space_cond, NULL);
+	pthread_cond_init(&r->sync_cond, NULL);
+	gtp_repl = r;
+	return 0;
+}
+
+int
+gtp_repl_destroy(void)
+{
+	gtp_repl_t *r = gtp_repl;
+
+	if (!r)
+		return -1;
+
+	if (__test_bit(GTP_REPL_FL_RUNNING_BIT, &r->flags)) {
+		/* Wake up everyone, blocking syscalls included */
+		pthread_mutex_lock(&r->mutex);
+		__set_bit(GTP_REPL_FL_STOP_BIT, &r->flags);
+		pthread_cond_broadcast(&r->tx_cond);
+		pthread_cond_broadcast(&r->space_cond);
+		pthread_cond_broadcast(&r->sync_cond);
+		shutdown(r->listen_fd, SHUT_RDWR);
+		if (r->rx_fd >= 0)
+			shutdown(r->rx_fd, SHUT_RDWR);
+		if (r->tx_fd >= 0)
+			shutdown(r->tx_fd, SHUT_RDWR);
+		pthread_mutex_unlock(&r->mutex);
+
+		pthread_join(r->tx_task, NULL);
+		pthread_join(r->sync_task, NULL);
+		pthread_join(r->rx_task, NULL);
+		close(r->listen_fd);
+		FREE(r->queue);
+	}
+
+	gtp_repl = NULL;
+	pthread_mutex_destroy(&r->mutex);
+	pthread_cond_destroy(&r->tx_cond);
+	pthread_cond_destroy(&r->space_cond);
+	pthread_cond_destroy(&r->sync_cond);
+	FREE(r);
+	return 0;
+}
+
+
+/*
+ *	VTY
+ */
+int
+gtp_repl_config_write(vty_t *vty)
+{
+	gtp_repl_t *r = gtp_repl;
+
+	if (!__test_bit(GTP_REPL_FL_CONFIGURED_BIT, &r->flags))
+		return 0;
+
+	vty_out(vty, " session-replication listen %u.%u.%u.%u port %d"
+		     " peer %u.%u.%u.%u port %d%s"
+		   , NIPQUAD(r->listen_addr.sin_addr.s_addr)
+		   , ntohs(r->listen_addr.sin_port)
+		   , NIPQUAD(r->peer_addr.sin_addr.s_addr)
+		   , ntohs(r->peer_addr.sin_port)
+		   , VTY_NEWLINE);
+	return 0;
+}
+
+DEFUN(pdn_session_replication,
+      pdn_session_replication_cmd,
+      "session-replication listen A.B.C.D port <1024-65535> peer A.B.C.D port <1024-65535>",
+      "Session state replication to standby peer\n"
+      "Local listening endpoint\n"
+      "IPv4 Address\n"
+      "listening TCP port\n"
+      "Number\n"
+      "Remote peer endpoint\n"
+      "IPv4 Address\n"
+      "remote TCP port\n"
+      "Number\n")
+{
+	gtp_repl_t *r = gtp_repl;
+	uint32_t laddr, paddr;
+	int lport, pport;
+
+	if (argc < 4) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (__test_bit(GTP_REPL_FL_RUNNING_BIT, &r->flags)) {
+		vty_out(vty, "%% session-replication already running%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (!inet_ston(argv[0], &laddr) || !inet_ston(argv[2], &paddr)) {
+		vty_out(vty, "%% malformed IPv4 address%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("listen port", lport, argv[1], 1024, 65535);
+	VTY_GET_INTEGER_RANGE("peer port", pport, argv[3], 1024, 65535);
+
+	r->listen_addr.sin_family = AF_INET;
+	r->listen_addr.sin_addr.s_addr = laddr;
+	r->listen_addr.sin_port = htons(lport);
+	r->peer_addr.sin_family = AF_INET;
+	r->peer_addr.sin_addr.s_addr = paddr;
+	r->peer_addr.sin_port = htons(pport);
+	__set_bit(GTP_REPL_FL_CONFIGURED_BIT, &r->flags);
+	return CMD_SUCCESS;
+}
+
+DEFUN(show_gtp_session_replication,
+      show_gtp_session_replication_cmd,
+      "show gtp session-replication",
+      SHOW_STR
+      "GTP related informations\n"
+      "Session state replication\n")
+{
+	gtp_repl_t *r = gtp_repl;
+
+	if (!__test_bit(GTP_REPL_FL_RUNNING_BIT, &r->flags)) {
+		vty_out(vty, "%% session-replication not running%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	pthread_mutex_lock(&r->mutex);
+	vty_out(vty, "Session replication: peer %u.%u.%u.%u:%d %s%s"
+		     " tx queued:%lu records sent:%lu bytes (%lu syscalls) dropped:%lu%s"
+		     " tx queue:%lu/%u bytes connects:%lu resyncs:%lu%s"
+		     " rx records:%lu (%lu bytes) applied:%lu (in place:%lu) deleted:%lu"
+		     " swept:%lu errors:%lu%s"
+		   , NIPQUAD(r->peer_addr.sin_addr.s_addr), ntohs(r->peer_addr.sin_port)
+		   , __test_bit(GTP_REPL_FL_CONNECTED_BIT, &r->flags) ? "connected" : "connecting"
+		   , VTY_NEWLINE
+		   , r->tx_records, r->tx_bytes, r->tx_syscalls, r->tx_dropped, VTY_NEWLINE
+		   , r->tail - r->head, GTP_REPL_QUEUE_SIZE, r->connects, r->resyncs
+		   , VTY_NEWLINE
+		   , r->rx_records, r->rx_bytes, r->rx_applied, r->rx_updated, r->rx_deleted
+		   , r->rx_swept, r->rx_errors
+		   , VTY_NEWLINE);
+	pthread_mutex_unlock(&r->mutex);
+
+	return CMD_SUCCESS;
+}
+
+int
+gtp_repl_vty_init(void)
+{
+	install_element(PDN_NODE, &pdn_session_replication_cmd);
+	install_element(VIEW_NODE, &show_gtp_session_replication_cmd);
+	install_element(ENABLE_NODE, &show_gtp_session_replication_cmd);
+
+	return 0;
+}
@@ -0,0 +1,363 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <inttypes.h>
+#include <errno.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/* Extern data */
+extern data_t *daemon_data;
+
+
+/*
+ *	Response replay cache
+ *
+ * Every GTP-C worker owns a bounded ring of responses keyed by the
+ * requesting peer transaction (address, port, version, request type,
+ * sequence number). A retransmitted request is answered straight from
+ * the cached bytes, before any IE parsing or TEID lookup, for as long
+ * as the peer may retransmit (T3-RESPONSE * N3-REQUESTS). In proxy mode
+ * the response comes back through any worker, so the receiving worker
+ * only books a pending slot that the forwarding worker completes.
+ */
+int
+gtp_replay_key_build(gtp_replay_key_t *key, pkt_buffer_t *pbuff, struct sockaddr_in *addr, bool response)
+{
+	gtp1_hdr_t *h1 = (gtp1_hdr_t *) pbuff->head;
+	gtp_hdr_t *h = (gtp_hdr_t *) pbuff->head;
+
+	if (pkt_buffer_len(pbuff) < sizeof(gtp1_hdr_t) || (response && !h->type))
+		return -1;
+
+	memset(key, 0, sizeof(gtp_replay_key_t));
+	key->addr = addr->sin_addr.s_addr;
+	key->port = addr->sin_port;
+	key->version = h->version;
+	key->type = (response) ? h->type - 1 : h->type;
+
+	switch (h->version) {
+	case 1:
+		if (!h1->seq)
+			return -1;
+		key->sqn = ntohs(h1->sqn);
+		return 0;
+	case 2:
+		key->sqn = ntohl((h->teid_presence) ? h->sqn : h->sqn_only) >> 8;
+		return 0;
+	}
+
+	return -1;
+}
+
+static hlist_head_t *
+gtp_replay_hash(gtp_replay_t *r, gtp_replay_key_t *key)
+{
+	uint32_t hkey = jhash_3words(key->addr
+				     , key->port << 16 | key->version << 8 | key->type
+				     , key->sqn, 0);
+	return r->htab + (hkey & GTP_REPLAY_HASHTAB_MASK);
+}
+
+static gtp_replay_entry_t *
+__gtp_replay_get(gtp_replay_t *r, gtp_replay_key_t *key, time_t now)
+{
+	hlist_head_t *head = gtp_replay_hash(r, key);
+	gtp_replay_entry_t *e;
+	hlist_node_t *n;
+
+	hlist_for_each_entry(e, n, head, hlist) {
+		if (!memcmp(&e->key, key, sizeof(gtp_replay_key_t)))
+			return (e->expire >= now) ? e : NULL;
+	}
+
+	return NULL;
+}
+
+static gtp_replay_entry_t *
+__gtp_replay_alloc(gtp_replay_t *r, gtp_replay_key_t *key, time_t now)
+{
+	gtp_replay_entry_t *e = &r->ring[r->next++ % r->nr_entries];
+
+	/* Oldest slot is recycled */
+	if (__test_and_clear_bit(GTP_REPLAY_FL_HASHED_BIT, &e->flags)) {
+		if (e->expire >= now)
+			r->stats.evict++;
+		hlist_del(&e->hlist);
+	}
+
+	e->key = *key;
+	e->len = 0;
+	e->flags = 0;
+	__set_bit(GTP_REPLAY_FL_HASHED_BIT, &e->flags);
+	hlist_add_head(&e->hlist, gtp_replay_hash(r, key));
+	return e;
+}
+
+static int
+__gtp_replay_fill(gtp_replay_t *r, gtp_replay_entry_t *e, pkt_buffer_t *pbuff, time_t now)
+{
+	size_t len = pkt_buffer_len(pbuff), size;
+
+	if (len > UINT16_MAX)
+		return -1;
+
+	if (len > e->size) {
+		size = (len < GTP_REPLAY_DATA_MIN) ? GTP_REPLAY_DATA_MIN : len;
+		if (e->data) {
+			r->mem -= e->size;
+			FREE(e->data);
+		}
+		e->size = 0;
+		e->data = MALLOC(size);
+		if (!e->data) {
+			/* Not cached: lookup misses, request is handled again */
+			e->len = 0;
+			__set_bit(GTP_REPLAY_FL_PENDING_BIT, &e->flags);
+			return -1;
+		}
+		e->size = size;
+		r->mem += size;
+	}
+
+	memcpy(e->data, pbuff->head, len);
+	e->len = len;
+	e->expire = now + GTP_REPLAY_TIMEOUT;
+	__clear_bit(GTP_REPLAY_FL_PENDING_BIT, &e->flags);
+	r->stats.store++;
+	return 0;
+}
+
+int
+gtp_replay_lookup(gtp_server_worker_t *w, gtp_replay_key_t *key, struct sockaddr_in *addr)
+{
+	gtp_replay_t *r = w->replay;
+	gtp_replay_entry_t *e;
+
+	if (!r)
+		return -1;
+
+	pthread_mutex_lock(&r->mutex);
+	r->stats.lookup++;
+	e = __gtp_replay_get(r, key, time(NULL));
+	if (!e || __test_bit(GTP_REPLAY_FL_PENDING_BIT, &e->flags)) {
+		pthread_mutex_unlock(&r->mutex);
+		return -1;
+	}
+
+	r->stats.hit++;
+	memcpy(w->pbuff->head, e->data, e->len);
+	pkt_buffer_set_end_pointer(w->pbuff, e->len);
+	pthread_mutex_unlock(&r->mutex);
+
+	gtp_server_send(w, w->fd, addr);
+	return 0;
+}
+
+int
+gtp_replay_pending(gtp_replay_t *r, gtp_replay_key_t *key)
+{
+	time_t now = time(NULL);
+	gtp_replay_entry_t *e;
+
+	if (!r)
+		return -1;
+
+	pthread_mutex_lock(&r->mutex);
+	e = __gtp_replay_get(r, key, now);
+	e = (e) ? : __gtp_replay_alloc(r, key, now);
+	__set_bit(GTP_REPLAY_FL_PENDING_BIT, &e->flags);
+	e->expire = now + GTP_REPLAY_TIMEOUT;
+	r->stats.pending++;
+	pthread_mutex_unlock(&r->mutex);
+
+	return 0;
+}
+
+int
+gtp_replay_store(gtp_replay_t *r, gtp_replay_key_t *key, pkt_buffer_t *pbuff)
+{
+	time_t now = time(NULL);
+	gtp_replay_entry_t *e;
+	int err;
+
+	if (!r)
+		return -1;
+
+	pthread_mutex_lock(&r->mutex);
+	e = __gtp_replay_get(r, key, now);
+	e = (e) ? : __gtp_replay_alloc(r, key, now);
+	err = __gtp_replay_fill(r, e, pbuff, now);
+	pthread_mutex_unlock(&r->mutex);
+
+	return err;
+}
+
+int
+gtp_replay_complete(gtp_server_t *srv, gtp_replay_key_t *key, pkt_buffer_t *pbuff)
+{
+	time_t now = time(NULL);
+	gtp_server_worker_t *w;
+	gtp_replay_entry_t *e;
+	int err = -1;
+
+	/* Workers list is immutable while server is running */
+	list_for_each_entry(w, &srv->workers, next) {
+		if (!w->replay)
+			continue;
+
+		pthread_mutex_lock(&w->replay->mutex);
+		e = __gtp_replay_get(w->replay, key, now);
+		if (e && __test_bit(GTP_REPLAY_FL_PENDING_BIT, &e->flags))
+			err = __gtp_replay_fill(w->replay, e, pbuff, now);
+		pthread_mutex_unlock(&w->replay->mutex);
+		if (e)
+			break;
+	}
+
+	return err;
+}
+
+gtp_replay_t *
+gtp_replay_alloc(uint32_t nr_entries)
+{
+	gtp_replay_t *new;
+
+	PMALLOC(new);
+	if (!new)
+		return NULL;
+	new->htab = (hlist_head_t *) MALLOC(sizeof(hlist_head_t) * GTP_REPLAY_HASHTAB_SIZE);
+	new->ring = (gtp_replay_entry_t *) MALLOC(sizeof(gtp_replay_entry_t) * nr_entries);
+	new->nr_entries = nr_entries;
+	new->mem = sizeof(gtp_replay_t) + sizeof(hlist_head_t) * GTP_REPLAY_HASHTAB_SIZE +
+		   sizeof(gtp_replay_entry_t) * nr_entries;
+	pthread_mutex_init(&new->mutex, NULL);
+	return new;
+}
+
+void
+gtp_replay_free(gtp_replay_t *r)
+{
+	uint32_t i;
+
+	if (!r)
+		return;
+
+	for (i = 0; i < r->nr_entries; i++) {
+		if (r->ring[i].data)
+			FREE(r->ring[i].data);
+	}
+	pthread_mutex_destroy(&r->mutex);
+	FREE(r->ring);
+	FREE(r->htab);
+	FREE(r);
+}
+
+
+/*
+ *	VTY command
+ */
+static int
+gtp_replay_worker_show(gtp_server_worker_t *w, void *arg)
+{
+	gtp_replay_t *r = w->replay;
+	gtp_replay_stats_t st;
+	time_t now = time(NULL);
+	vty_t *vty = arg;
+	uint32_t i, used = 0;
+	size_t mem;
+
+	if (!r)
+		return 0;
+
+	pthread_mutex_lock(&r->mutex);
+	for (i = 0; i < r->nr_entries; i++) {
+		if (__test_bit(GTP_REPLAY_FL_HASHED_BIT, &r->ring[i].flags) &&
+		    r->ring[i].expire >= now)
+			used++;
+	}
+	st = r->stats;
+	mem = r->mem;
+	pthread_mutex_unlock(&r->mutex);
+
+	vty_out(vty, "   %s worker:#%.2d entries:%u/%u lookup:%"PRIu64" hit:%"PRIu64
+		     " (%"PRIu64"%%) pending:%"PRIu64" store:%"PRIu64" evict:%"PRIu64
+		     " memory:%zuKB%s"
+		   , w->pname, w->id, used, r->nr_entries
+		   , st.lookup, st.hit, (st.lookup) ? st.hit * 100 / st.lookup : 0
+		   , st.pending, st.store, st.evict
+		   , mem >> 10, VTY_NEWLINE);
+	return 0;
+}
+
+static void
+gtp_replay_server_show(vty_t *vty, gtp_server_t *srv, const char *name)
+{
+	if (!__test_bit(GTP_FL_CTL_BIT, &srv->flags))
+		return;
+
+	vty_out(vty, "  %s: %s port %d%s"
+		   , name
+		   , inet_sockaddrtos(&srv->addr)
+		   , ntohs(inet_sockaddrport(&srv->addr))
+		   , VTY_NEWLINE);
+	gtp_server_for_each_worker(srv, gtp_replay_worker_show, vty);
+}
+
+DEFUN(show_gtp_replay_cache,
+      show_gtp_replay_cache_cmd,
+      "show gtp replay-cache",
+      SHOW_STR
+      "GTP related informations\n"
+      "GTP-C response replay cache\n")
+{
+	gtp_switch_t *sw;
+	gtp_router_t *rt;
+
+	list_for_each_entry(sw, &daemon_data->gtp_switch_ctx, next) {
+		vty_out(vty, "gtp-switch %s%s", sw->name, VTY_NEWLINE);
+		gtp_replay_server_show(vty, &sw->gtpc, "gtpc");
+		gtp_replay_server_show(vty, &sw->gtpc_egress, "gtpc-egress");
+	}
+
+	list_for_each_entry(rt, &daemon_data->gtp_router_ctx, next) {
+		vty_out(vty, "gtp-router %s%s", rt->name, VTY_NEWLINE);
+		gtp_replay_server_show(vty, &rt->gtpc, "gtpc");
+	}
+
+	return CMD_SUCCESS;
+}
+
+int
+gtp_replay_vty_init(void)
+{
+	install_element(VIEW_NODE, &show_gtp_replay_cache_cmd);
+	install_element(ENABLE_NODE, &show_gtp_replay_cache_cmd);
+
+	return 0;
+}
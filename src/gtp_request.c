@@ -40,15 +40,172 @@ extern thread_master_t *master;
 /*
  *	Handle request
  */
+static int gtp_request_out_append(gtp_req_session_t *, const void *, size_t);
+
+static gtp_conn_t *
+gtp_request_imsi_lookup(gtp_apn_t *apn, char *imsi_str)
+{
+	uint8_t imsi_swap[8];
+
+	memset(imsi_swap, 0, 8);
+	str_imsi_to_bcd_swap(imsi_str, strlen(imsi_str), imsi_swap);
+	gtp_imsi_rewrite(apn, imsi_swap);
+	return gtp_conn_get_by_imsi(bcd_to_int64(imsi_swap, 8));
+}
+
+static int
+gtp_request_imsi_info(gtp_req_session_t *s, gtp_apn_t *apn, char *imsi_str)
+{
+	gtp_conn_t *c;
+
+	c = gtp_request_imsi_lookup(apn, imsi_str);
+	if (!c) {
+		jsonw_string_field(s->jwriter, "Error", "Unknown IMSI");
+		return -1;
+	}
+
+	jsonw_string_field_fmt(s->jwriter, "sgw-ip-address", "%u.%u.%u.%u"
+					 , NIPQUAD(c->sgw_addr.sin_addr.s_addr));
+	gtp_conn_put(c);
+	return 0;
+}
+
+/* Subscriber found through a secondary index, report the session
+ * that matched */
+static int
+gtp_request_index_info(gtp_req_session_t *s, int idx, uint64_t key)
+{
+	gtp_session_t *sess;
+	gtp_conn_t *c;
+	int err = -1;
+
+	c = gtp_session_conn_get_by_index(idx, key);
+	if (!c) {
+		jsonw_string_field(s->jwriter, "Error", "Unknown subscriber");
+		return -1;
+	}
+
+	pthread_mutex_lock(&c->session_mutex);
+	list_for_each_entry(sess, &c->gtp_sessions, next) {
+		if (!gtp_session_index_match(sess, idx, key))
+			continue;
+
+		jsonw_string_field_fmt(s->jwriter, "imsi", "%lu", c->imsi);
+		jsonw_string_field_fmt(s->jwriter, "msisdn", "%lu", sess->msisdn);
+		jsonw_string_field_fmt(s->jwriter, "ue-ipv4", "%u.%u.%u.%u"
+						 , NIPQUAD(sess->ipv4));
+		jsonw_string_field(s->jwriter, "apn", sess->apn->name);
+		jsonw_string_field_fmt(s->jwriter, "sgw-ip-address", "%u.%u.%u.%u"
+						 , NIPQUAD(c->sgw_addr.sin_addr.s_addr));
+		err = 0;
+		break;
+	}
+	pthread_mutex_unlock(&c->session_mutex);
+	gtp_conn_put(c);
+
+	if (err)
+		jsonw_string_field(s->jwriter, "Error", "Unknown subscriber");
+	return err;
+}
+
+static int
+gtp_request_msisdn_info(gtp_req_session_t *s, gtp_apn_t *apn, char *msisdn_str)
+{
+	return gtp_request_index_info(s, GTP_SESSION_IDX_MSISDN
+				       , strtoull(msisdn_str, NULL, 10));
+}
+
+static int
+gtp_request_ipv4_info(gtp_req_session_t *s, gtp_apn_t *apn, char *ipv4_str)
+{
+	uint32_t addr;
+
+	if (!inet_ston(ipv4_str, &addr)) {
+		jsonw_string_field(s->jwriter, "Error", "Malformed IPv4 address");
+		return -1;
+	}
+
+	return gtp_request_index_info(s, GTP_SESSION_IDX_IPV4, addr);
+}
+
+typedef struct _gtp_request_cmd {
+	const char		*name;
+	const char		*key;		/* queried member */
+	const char		*label;
+	bool			apn;		/* APN scoped lookup */
+	int (*info) (gtp_req_session_t *, gtp_apn_t *, char *);
+} gtp_request_cmd_t;
+
+static const gtp_request_cmd_t gtp_request_cmds[] = {
+	{ "imsi_info",	 "imsi",   "IMSI",   true,  gtp_request_imsi_info },
+	{ "msisdn_info", "msisdn", "MSISDN", false, gtp_request_msisdn_info },
+	{ "ipv4_info",	 "ipv4",   "IPv4",   false, gtp_request_ipv4_info },
+	{ NULL }
+};
+
+/* Walk list from s->batch. Return 1 when suspended because too
+ * much output is pending, walk is then resumed once drained */
+static int
+gtp_request_info_batch_run(gtp_req_session_t *s)
+{
+	const gtp_request_cmd_t *cmd = s->cmd;
+	char addr_str[INET6_ADDRSTRLEN];
+	json_node_t *n;
+
+	for (n = s->batch; n; n = n->next) {
+		if (s->len_out - s->offset_sent >= GTP_REQUEST_OUT_HIGH) {
+			s->batch = n;
+			return 1;
+		}
+
+		if (n->tag != JSON_STRING)
+			continue;
+
+		s->batch_cnt++;
+		s->worker->lookups++;
+		jsonw_start_object(s->jwriter);
+		jsonw_string_field(s->jwriter, cmd->key, n->str_value);
+		s->batch_found += !(*cmd->info) (s, s->apn, n->str_value);
+		jsonw_end_object(s->jwriter);
+	}
+	jsonw_end_array(s->jwriter);
+	s->batch = NULL;
+
+	log_message(LOG_INFO, "%s(): %s:={%s:%d found:%d} with peer [%s]:%d"
+			    , __FUNCTION__
+			    , cmd->name, cmd->key, s->batch_cnt, s->batch_found
+			    , inet_sockaddrtos2(&s->addr, addr_str)
+			    , ntohs(inet_sockaddrport(&s->addr)));
+	return 0;
+}
+
+static int
+gtp_request_info_batch(gtp_req_session_t *s, const gtp_request_cmd_t *cmd,
+		       gtp_apn_t *apn, json_node_t *list)
+{
+	/* One array entry per key, in request order. Output is
+	 * streamed to peer while walking the list */
+	s->cmd = cmd;
+	s->apn = apn;
+	s->batch = json_first_child(list);
+	s->batch_cnt = s->batch_found = 0;
+	jsonw_name(s->jwriter, cmd->name);
+	jsonw_start_array(s->jwriter);
+	return gtp_request_info_batch_run(s);
+}
+
+/* Top level object is left open. Return 1 when a batch reply
+ * got suspended */
 static int
 gtp_request_json_parse_cmd(gtp_req_session_t *s, json_node_t *json)
 {
-	char *cmd_str = NULL, *apn_str = NULL, *imsi_str = NULL;
+	char *cmd_str = NULL, *apn_str = NULL;
 	char addr_str[INET6_ADDRSTRLEN];
-	gtp_apn_t *apn;
-	gtp_conn_t *c;
-	uint8_t imsi_swap[8];
-	uint64_t imsi;
+	char apn_ni[GTP_APN_MAX_LEN];
+	const gtp_request_cmd_t *cmd;
+	json_node_t *node;
+	gtp_apn_t *apn = NULL;
+	int err;
 
 	jsonw_start_object(s->jwriter);
 
@@ -57,59 +214,337 @@ gtp_request_json_parse_cmd(gtp_req_session_t *s, json_node_t *json)
 		goto end;
 	}
 
-	if (strncmp(cmd_str, "imsi_info", 9)) {
+	for (cmd = gtp_request_cmds; cmd->name; cmd++) {
+		if (!strcmp(cmd_str, cmd->name))
+			break;
+	}
+
+	if (!cmd->name) {
 		jsonw_string_field_fmt(s->jwriter, "Error", "Unknown command %s", cmd_str);
 		goto end;
 	}
 
-	if (!json_find_member_strvalue(json, "apn", &apn_str)) {
+	if (cmd->apn && !json_find_member_strvalue(json, "apn", &apn_str)) {
 		jsonw_string_field(s->jwriter, "Error", "No Access-Point-Name specified");
 		goto end;
 	}
 
-	if (!json_find_member_strvalue(json, "imsi", &imsi_str)) {
-		jsonw_string_field(s->jwriter, "Error", "No IMSI specified");
+	node = json_find_member(json, cmd->key);
+	if (!node || (node->tag != JSON_STRING && node->tag != JSON_ARRAY)) {
+		jsonw_string_field_fmt(s->jwriter, "Error", "No %s specified", cmd->label);
 		goto end;
 	}
 
-	gtp_apn_extract_ni(apn_str, strlen(apn_str), s->buffer_out, GTP_REQUEST_BUFFER_SIZE);
-	apn = gtp_apn_get(s->buffer_out);
-	if (!apn) {
-		jsonw_string_field(s->jwriter, "Error", "Unknown Access-Point-Name");
-		goto end;
+	if (cmd->apn) {
+		/* NI extraction doesn't bound nor terminate */
+		memset(apn_ni, 0, GTP_APN_MAX_LEN);
+		if (strlen(apn_str) < GTP_APN_MAX_LEN) {
+			gtp_apn_extract_ni(apn_str, strlen(apn_str), apn_ni, GTP_APN_MAX_LEN);
+			apn = gtp_apn_get(apn_ni);
+		}
+		if (!apn) {
+			jsonw_string_field(s->jwriter, "Error", "Unknown Access-Point-Name");
+			goto end;
+		}
 	}
 
-	memset(imsi_swap, 0, 8);
-	str_imsi_to_bcd_swap(imsi_str, strlen(imsi_str), imsi_swap);
-	gtp_imsi_rewrite(apn, imsi_swap);
-	imsi = bcd_to_int64(imsi_swap, 8);
-	c = gtp_conn_get_by_imsi(imsi);
-	if (!c) {
-		jsonw_string_field(s->jwriter, "Error", "Unknown IMSI");
-		goto end;
-	}
+	if (node->tag == JSON_ARRAY)
+		return gtp_request_info_batch(s, cmd, apn, node);
 
-	jsonw_string_field_fmt(s->jwriter, "sgw-ip-address", "%u.%u.%u.%u"
-					 , NIPQUAD(c->sgw_addr.sin_addr.s_addr));
+	s->worker->lookups++;
+	err = (*cmd->info) (s, apn, node->str_value);
 
-	log_message(LOG_INFO, "%s(): imsi_info:={imsi:%s sgw-ip-address:%u.%u.%u.%u} with peer [%s]:%d"
+	log_message(LOG_INFO, "%s(): %s:={%s:%s%s} with peer [%s]:%d"
 			    , __FUNCTION__
-			    , imsi_str
-			    ,  NIPQUAD(c->sgw_addr.sin_addr.s_addr)
+			    , cmd->name, cmd->key, node->str_value
+			    , (err) ? " unknown" : ""
 			    , inet_sockaddrtos2(&s->addr, addr_str)
 			    , ntohs(inet_sockaddrport(&s->addr)));
-
-	gtp_conn_put(c);
   end:
+	return 0;
+}
+
+static void
+gtp_request_json_reply_end(gtp_req_session_t *s)
+{
 	jsonw_end_object(s->jwriter);
+	jsonw_destroy(&s->jwriter);
+	if (__test_and_clear_bit(GTP_SESSION_FL_CHUNKED, &s->flags))
+		gtp_request_out_append(s, "0\r\n\r\n", 5);
+	json_destroy(s->json);
+	s->json = NULL;
+}
+
+/* Reply owns json. Return 1 while reply is suspended */
+static int
+gtp_request_json_reply(gtp_req_session_t *s, json_node_t *json)
+{
+	s->json = json;
+	s->jwriter = jsonw_new(s->fp);
+	jsonw_pretty(s->jwriter, true);
+	if (gtp_request_json_parse_cmd(s, json))
+		return 1;
+
+	gtp_request_json_reply_end(s);
 	return 0;
 }
 
 static int
-gtp_request_json_parse(gtp_req_session_t *s)
+gtp_request_json_reply_resume(gtp_req_session_t *s)
 {
+	if (gtp_request_info_batch_run(s))
+		return 1;
+
+	gtp_request_json_reply_end(s);
+	return 0;
+}
+
+/* Connection going away with a suspended batch: unwind writer
+ * with output discarded */
+static void
+gtp_request_json_reply_abort(gtp_req_session_t *s)
+{
+	if (!s->json)
+		return;
+
+	__set_bit(GTP_SESSION_FL_STOP, &s->flags);
+	jsonw_end_array(s->jwriter);
+	jsonw_end_object(s->jwriter);
+	jsonw_destroy(&s->jwriter);
+	json_destroy(s->json);
+	s->json = NULL;
+}
+
+
+/*
+ *	Output buffer
+ */
+static int
+gtp_request_out_append(gtp_req_session_t *s, const void *data, size_t size)
+{
+	size_t pending = s->len_out - s->offset_sent;
+	char *buffer;
+
+	/* Reclaim what is already sent */
+	if (s->offset_sent && s->len_out + size > s->size_out) {
+		memmove(s->buffer_out, s->buffer_out + s->offset_sent, pending);
+		s->len_out = pending;
+		s->offset_sent = 0;
+	}
+
+	if (s->len_out + size > s->size_out) {
+		buffer = REALLOC(s->buffer_out, (s->len_out + size) * 2);
+		if (!buffer)
+			return -1;
+		s->buffer_out = buffer;
+		s->size_out = (s->len_out + size) * 2;
+	}
+
+	memcpy(s->buffer_out + s->len_out, data, size);
+	s->len_out += size;
+	return 0;
+}
+
+static int
+gtp_request_out_printf(gtp_req_session_t *s, const char *fmt, ...)
+{
+	char buffer[512];
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+
+	return gtp_request_out_append(s, buffer, len);
+}
+
+static int
+gtp_request_session_send(gtp_req_session_t *s)
+{
+	ssize_t nbytes;
+
+	while (s->offset_sent < s->len_out) {
+		nbytes = send(s->fd, s->buffer_out + s->offset_sent
+				   , s->len_out - s->offset_sent, MSG_NOSIGNAL);
+		if (nbytes < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			__set_bit(GTP_SESSION_FL_STOP, &s->flags);
+			return -1;
+		}
+
+		s->offset_sent += nbytes;
+	}
+
+	s->len_out = s->offset_sent = 0;
+	return 0;
+}
+
+/* json_writer stream backend. Each stdio flush becomes one HTTP
+ * chunk, and large replies are pushed to peer while being built */
+static ssize_t
+gtp_request_stream_write(void *cookie, const char *buf, size_t size)
+{
+	gtp_req_session_t *s = cookie;
+	bool chunked = __test_bit(GTP_SESSION_FL_CHUNKED, &s->flags);
+	int err = 0;
+
+	if (!size || __test_bit(GTP_SESSION_FL_STOP, &s->flags))
+		return size;
+
+	if (chunked)
+		err = gtp_request_out_printf(s, "%zx\r\n", size);
+	err = (err) ? : gtp_request_out_append(s, buf, size);
+	if (chunked)
+		err = (err) ? : gtp_request_out_append(s, "\r\n", 2);
+	if (err)
+		return 0;
+
+	if (s->len_out - s->offset_sent >= GTP_REQUEST_OUT_HIGH)
+		gtp_request_session_send(s);
+	return size;
+}
+
+static cookie_io_functions_t gtp_request_stream_ops = {
+	.write = gtp_request_stream_write,
+};
+
+
+/*
+ *	HTTP/1.1
+ */
+static ssize_t
+gtp_request_http_error(gtp_req_session_t *s, int code, const char *reason)
+{
+	char addr_str[INET6_ADDRSTRLEN];
+
+	log_message(LOG_INFO, "%s(): %d %s with peer [%s]:%d"
+			    , __FUNCTION__, code, reason
+			    , inet_sockaddrtos2(&s->addr, addr_str)
+			    , ntohs(inet_sockaddrport(&s->addr)));
+
+	gtp_request_out_printf(s, "HTTP/1.1 %d %s\r\n"
+				  "Content-Length: 0\r\n"
+				  "Connection: close\r\n\r\n"
+				, code, reason);
+	__set_bit(GTP_SESSION_FL_COMPLETE, &s->flags);
+	return -1;
+}
+
+/* Return consumed bytes, 0 if request is not complete yet */
+static ssize_t
+gtp_request_http_handle(gtp_req_session_t *s)
+{
+	char hdr[GTP_REQUEST_HEADER_MAX + 1];
+	char *eoh, *line, *value, *method, *target, *version, *body, *end;
+	char *save, *lsave;
+	size_t hlen, clen = 0;
+	bool keepalive, http10, has_clen = false;
 	json_node_t *json;
+	char c;
+
+	eoh = memmem(s->buffer_in, s->len_in, "\r\n\r\n", 4);
+	if (!eoh) {
+		if (s->len_in >= GTP_REQUEST_HEADER_MAX)
+			return gtp_request_http_error(s, 431, "Request Header Fields Too Large");
+		return 0;
+	}
+
+	hlen = eoh - s->buffer_in;
+	if (hlen >= GTP_REQUEST_HEADER_MAX)
+		return gtp_request_http_error(s, 431, "Request Header Fields Too Large");
+	memcpy(hdr, s->buffer_in, hlen);
+	hdr[hlen] = '\0';
+	hlen += 4;
+
+	/* Request line */
+	line = strtok_r(hdr, "\r\n", &save);
+	method = (line) ? strtok_r(line, " ", &lsave) : NULL;
+	target = (method) ? strtok_r(NULL, " ", &lsave) : NULL;
+	version = (target) ? strtok_r(NULL, " ", &lsave) : NULL;
+	if (!version || strncmp(version, "HTTP/1.", 7))
+		return gtp_request_http_error(s, 400, "Bad Request");
+	keepalive = !strcmp(version, "HTTP/1.1");
+	http10 = !strcmp(version, "HTTP/1.0");
+
+	/* Headers */
+	while ((line = strtok_r(NULL, "\r\n", &save))) {
+		value = strchr(line, ':');
+		if (!value)
+			continue;
+		*value++ = '\0';
+		value += strspn(value, " \t");
+
+		if (!strcasecmp(line, "Content-Length")) {
+			clen = strtoul(value, &end, 10);
+			if (end == value)
+				return gtp_request_http_error(s, 400, "Bad Request");
+			has_clen = true;
+		} else if (!strcasecmp(line, "Connection")) {
+			if (strcasestr(value, "close"))
+				keepalive = false;
+			else if (strcasestr(value, "keep-alive"))
+				keepalive = true;
+		} else if (!strcasecmp(line, "Transfer-Encoding")) {
+			return gtp_request_http_error(s, 501, "Not Implemented");
+		}
+	}
 
+	if (strcmp(method, "POST"))
+		return gtp_request_http_error(s, 405, "Method Not Allowed");
+	if (!has_clen)
+		return gtp_request_http_error(s, 411, "Length Required");
+	if (clen > GTP_REQUEST_BUFFER_MAX - 1 - hlen)
+		return gtp_request_http_error(s, 413, "Payload Too Large");
+	if (s->len_in < hlen + clen)
+		return 0;
+
+	/* Input buffer always keeps one spare byte */
+	body = s->buffer_in + hlen;
+	c = body[clen];
+	body[clen] = '\0';
+	json = json_decode(body);
+	body[clen] = c;
+	if (!json)
+		return gtp_request_http_error(s, 400, "Bad Request");
+
+	/* HTTP/1.0 has no chunked coding and reply size is unknown
+	 * while streamed: body is delimited by connection close */
+	if (http10) {
+		keepalive = false;
+		gtp_request_out_printf(s, "HTTP/1.0 200 OK\r\n"
+					  "Content-Type: application/json\r\n"
+					  "Connection: close\r\n\r\n");
+	} else {
+		gtp_request_out_printf(s, "HTTP/1.1 200 OK\r\n"
+					  "Content-Type: application/json\r\n"
+					  "Transfer-Encoding: chunked\r\n"
+					  "%s\r\n"
+					, (keepalive) ? "" : "Connection: close\r\n");
+		__set_bit(GTP_SESSION_FL_CHUNKED, &s->flags);
+	}
+
+	if (!keepalive)
+		__set_bit(GTP_SESSION_FL_COMPLETE, &s->flags);
+	gtp_request_json_reply(s, json);
+	return hlen + clen;
+}
+
+/* Raw JSON terminated by CRLF, one request per connection */
+static ssize_t
+gtp_request_legacy_handle(gtp_req_session_t *s)
+{
+	json_node_t *json;
+
+	if (s->len_in < 2 || s->buffer_in[s->len_in - 2] != '\r' ||
+	    s->buffer_in[s->len_in - 1] != '\n')
+		return 0;
+
+	s->buffer_in[s->len_in] = '\0';
+	__set_bit(GTP_SESSION_FL_COMPLETE, &s->flags);
 	json = json_decode(s->buffer_in);
 	if (!json) {
 		log_message(LOG_INFO, "%s(): Error parsing JSON string : [%s]"
@@ -118,110 +553,202 @@ gtp_request_json_parse(gtp_req_session_t *s)
 		return -1;
 	}
 
-	gtp_request_json_parse_cmd(s, json);
-	json_destroy(json);
-	return 0;
+	gtp_request_json_reply(s, json);
+	return s->len_in;
 }
 
 
 /*
- *	Main TCP thread
+ *	Client session
  */
-static int
+static void gtp_request_session_read(thread_ref_t);
+static void gtp_request_session_write(thread_ref_t);
+
+static void
 gtp_request_session_close(gtp_req_session_t *s)
 {
-	jsonw_destroy(&s->jwriter);
-	fclose(s->fp);	/* Also close s->fd */
+	gtp_request_json_reply_abort(s);
+	list_head_del(&s->next);
+	fclose(s->fp);
+	close(s->fd);
+	FREE(s->buffer_in);
+	FREE(s->buffer_out);
 	FREE(s);
-	return 0;
 }
 
-int
-gtp_request_http_read(int sd, void *data, int size)
+static int
+gtp_request_session_recv(gtp_req_session_t *s)
 {
-	int nbytes, offset = 0;
-	char *buffer = (char *) data;
+	ssize_t nbytes;
+	char *buffer;
+
+	for (;;) {
+		/* Keep a spare byte for in-place body termination */
+		if (s->len_in + 1 >= s->size_in) {
+			if (s->size_in >= GTP_REQUEST_BUFFER_MAX)
+				return 0;
+
+			buffer = REALLOC(s->buffer_in, s->size_in * 2);
+			if (!buffer)
+				return -1;
+			s->buffer_in = buffer;
+			s->size_in *= 2;
+		}
+
+		nbytes = recv(s->fd, s->buffer_in + s->len_in
+				   , s->size_in - s->len_in - 1, 0);
+		if (nbytes < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			return -1;
+		}
+
+		if (!nbytes) {
+			__set_bit(GTP_SESSION_FL_EOF, &s->flags);
+			return 0;
+		}
+
+		s->len_in += nbytes;
+	}
+}
 
-	if (!size)
-		return 0;
+/* Handle pipelined requests in order. Return true when stopped
+ * because too much output is pending, a suspended batch reply is
+ * resumed first */
+static bool
+gtp_request_session_process(gtp_req_session_t *s)
+{
+	ssize_t ret;
 
-next_rcv:
-	if (__test_bit(GTP_FL_STOP_BIT, &daemon_data->flags))
-		return -1;
+	if (s->json && gtp_request_json_reply_resume(s))
+		return true;
 
-	nbytes = read(sd, data + offset, size - offset);
+	while (s->len_in && !__test_bit(GTP_SESSION_FL_COMPLETE, &s->flags)) {
+		if (s->len_out - s->offset_sent >= GTP_REQUEST_OUT_HIGH)
+			return true;
 
-	/* data are ready ? */
-	if (nbytes == -1 || nbytes == 0) {
-		if (nbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
-			goto next_rcv;
+		ret = (s->buffer_in[0] == '{') ? gtp_request_legacy_handle(s) :
+						 gtp_request_http_handle(s);
+		if (ret < 0)
+			break;
 
-		return -1;
-	}
+		/* Incomplete and unable to grow any further */
+		if (!ret) {
+			if (s->len_in + 1 >= GTP_REQUEST_BUFFER_MAX)
+				__set_bit(GTP_SESSION_FL_COMPLETE, &s->flags);
+			break;
+		}
 
-	/* Everything but the girl ! */
-	offset += nbytes;
+		s->worker->requests++;
+		memmove(s->buffer_in, s->buffer_in + ret, s->len_in - ret);
+		s->len_in -= ret;
 
-	if (buffer[offset-2] == '\r' && buffer[offset-1] == '\n')
-		return offset;
+		if (s->json)
+			return true;
+	}
 
-	if (offset < size)
-		goto next_rcv;
+	/* Peer is done sending */
+	if (__test_bit(GTP_SESSION_FL_EOF, &s->flags))
+		__set_bit(GTP_SESSION_FL_COMPLETE, &s->flags);
+	return false;
+}
 
-	return size;
+/* Drive session until it blocks on I/O. On entry, only read event
+ * can be registered on fd, and only if thread is provided. */
+static void
+gtp_request_session_run(gtp_req_session_t *s, thread_ref_t thread)
+{
+	thread_master_t *m = s->worker->master;
+	bool more;
+
+	do {
+		more = gtp_request_session_process(s);
+		if (gtp_request_session_send(s) < 0 ||
+		    __test_bit(GTP_SESSION_FL_STOP, &s->flags))
+			goto close;
+
+		if (s->offset_sent < s->len_out) {
+			thread_del_read(thread);
+			thread_add_write(m, gtp_request_session_write, s, s->fd
+					  , GTP_REQUEST_TCP_TIMEOUT, 0);
+			return;
+		}
+	} while (more);
+
+	if (__test_bit(GTP_SESSION_FL_COMPLETE, &s->flags))
+		goto close;
+
+	thread_add_read(m, gtp_request_session_read, s, s->fd
+			 , GTP_REQUEST_KEEPALIVE_TIMER, 0);
+	return;
+
+  close:
+	thread_del_read(thread);
+	gtp_request_session_close(s);
 }
 
-static int
-gtp_request_json_rcv(gtp_req_session_t *s)
+static void
+gtp_request_session_read(thread_ref_t thread)
 {
-	char *buffer = s->buffer_in;
-	int ret;
+	gtp_req_session_t *s = THREAD_ARG(thread);
 
-	memset(buffer, 0, GTP_REQUEST_BUFFER_SIZE);
-	ret = gtp_request_http_read(s->fd, buffer, GTP_REQUEST_BUFFER_SIZE);
-	if (ret < 0)
-		return -1;
+	/* Idle keep-alive or peer error */
+	if (thread->type == THREAD_READ_TIMEOUT || thread->type == THREAD_READ_ERROR ||
+	    gtp_request_session_recv(s) < 0) {
+		thread_del_read(thread);
+		gtp_request_session_close(s);
+		return;
+	}
 
-	return ret;
+	gtp_request_session_run(s, thread);
 }
 
-void *
-gtp_request_tcp_thread(void *arg)
+static void
+gtp_request_session_write(thread_ref_t thread)
 {
-	gtp_req_session_t *s = arg;
-	char identity[64];
-	int old_type, ret;
+	gtp_req_session_t *s = THREAD_ARG(thread);
 
-	/* Out identity */
-	snprintf(identity, 63, "%s", inet_sockaddrtos(&s->addr));
-	prctl(PR_SET_NAME, identity, 0, 0, 0, 0);
+	thread_del_write(thread);
 
-	/* Set Cancel type */
-	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &old_type);
+	if (thread->type == THREAD_WRITE_TIMEOUT || thread->type == THREAD_WRITE_ERROR) {
+		gtp_request_session_close(s);
+		return;
+	}
 
-	/* Set timeout on session fd */
-	s->fd = if_setsockopt_rcvtimeo(s->fd, 2000);
-	s->fd = if_setsockopt_sndtimeo(s->fd, 2000);
-	if (s->fd < 0)
-		goto end;
+	gtp_request_session_run(s, NULL);
+}
 
-	ret = gtp_request_json_rcv(s);
-	if (ret < 0)
-		goto end;
+static gtp_req_session_t *
+gtp_request_session_alloc(gtp_req_worker_t *w, int fd, struct sockaddr_storage *addr)
+{
+	gtp_req_session_t *s;
 
-	/* session handle */
-#if 0
-	dump_buffer("JSON : ", s->buffer_in, ret);
-	printf("---[%s]---\nlength:%d\n", s->buffer_in, ret);
-#endif
-	s->jwriter = jsonw_new(s->fp);
-	jsonw_pretty(s->jwriter, true);
-	gtp_request_json_parse(s);
-	jsonw_destroy(&s->jwriter);
+	PMALLOC(s);
+	if (!s)
+		return NULL;
+	s->fd = fd;
+	s->addr = *addr;
+	s->worker = w;
+	INIT_LIST_HEAD(&s->next);
+	s->buffer_in = MALLOC(GTP_REQUEST_BUFFER_SIZE);
+	s->size_in = GTP_REQUEST_BUFFER_SIZE;
+	s->buffer_out = MALLOC(GTP_REQUEST_BUFFER_SIZE);
+	s->size_out = GTP_REQUEST_BUFFER_SIZE;
+	s->fp = fopencookie(s, "w", gtp_request_stream_ops);
+	if (!s->buffer_in || !s->buffer_out || !s->fp) {
+		if (s->fp)
+			fclose(s->fp);
+		FREE(s->buffer_in);
+		FREE(s->buffer_out);
+		FREE(s);
+		return NULL;
+	}
+	setvbuf(s->fp, NULL, _IOFBF, GTP_REQUEST_STREAM_SIZE);
 
-  end:
-	gtp_request_session_close(s);
-	return NULL;
+	list_add_tail(&s->next, &w->sessions);
+	return s;
 }
 
 /*
@@ -234,7 +761,7 @@ gtp_request_tcp_accept(thread_ref_t thread)
         socklen_t addrlen = sizeof(addr);
 	gtp_req_worker_t *w;
         gtp_req_session_t *s;
-        int fd, accept_fd, ret;
+        int fd, accept_fd;
 
         /* Fetch thread elements */
         fd = THREAD_FD(thread);
@@ -249,7 +776,8 @@ gtp_request_tcp_accept(thread_ref_t thread)
                 goto next_accept;
 
         /* Accept incoming connection */
-        accept_fd = accept(fd, (struct sockaddr *) &addr, &addrlen);
+        accept_fd = accept4(fd, (struct sockaddr *) &addr, &addrlen,
+			    SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (accept_fd < 0) {
                 log_message(LOG_INFO, "%s(): #%d Error accepting connection from peer [%s]:%d (%m)"
                                     , __FUNCTION__
@@ -260,58 +788,23 @@ gtp_request_tcp_accept(thread_ref_t thread)
         }
 
         /* remote client session allocation */
-	PMALLOC(s);
-        s->fd = accept_fd;
-        s->addr = addr;
-        s->worker = w;
-	s->fp = fdopen(accept_fd, "w");
-	if (!s->fp) {
-		log_message(LOG_INFO, "%s(): #%d cant fdopen on accept socket with peer [%s]:%d (%m)"
+	s = gtp_request_session_alloc(w, accept_fd, &addr);
+	if (!s) {
+		log_message(LOG_INFO, "%s(): #%d cant allocate session for peer [%s]:%d"
 				    , __FUNCTION__
 				    , w->id
 				    , inet_sockaddrtos(&addr)
 				    , ntohs(inet_sockaddrport(&addr)));
-		gtp_request_session_close(s);
+		close(accept_fd);
 		goto next_accept;
 	}
+	w->accepted++;
 
-        /* Register reader on accept_sd */
+        /* Register reader on accept_sd. Sessions are handled by worker
+	 * I/O MUX, many requests per connection (keep-alive) */
         if_setsockopt_nodelay(s->fd, 1);
-	if_setsockopt_nolinger(s->fd, 1);
-
-	/* Spawn a dedicated pthread per client. Dont really need performance here,
-	 * simply handle requests synchronously */
-	ret = pthread_attr_init(&s->task_attr);
-	if (ret != 0) {
-		log_message(LOG_INFO, "%s(): #%d cant init pthread_attr for session with peer [%s]:%d (%m)"
-				    , __FUNCTION__
-				    , w->id
-				    , inet_sockaddrtos(&addr)
-				    , ntohs(inet_sockaddrport(&addr)));
-		gtp_request_session_close(s);
-		goto next_accept;
-	}
-
-	ret = pthread_attr_setdetachstate(&s->task_attr, PTHREAD_CREATE_DETACHED);
-	if (ret != 0) {
-		log_message(LOG_INFO, "%s(): #%d cant set pthread detached for session with peer [%s]:%d (%m)"
-				    , __FUNCTION__
-				    , w->id
-				    , inet_sockaddrtos(&addr)
-				    , ntohs(inet_sockaddrport(&addr)));
-		gtp_request_session_close(s);
-		goto next_accept;
-	}
-
-	ret = pthread_create(&s->task, &s->task_attr, gtp_request_tcp_thread, s);
-	if (ret != 0) {
-		log_message(LOG_INFO, "%s(): #%d cant create pthread for session with peer [%s]:%d (%m)"
-				    , __FUNCTION__
-				    , w->id
-				    , inet_sockaddrtos(&addr)
-				    , ntohs(inet_sockaddrport(&addr)));
-		gtp_request_session_close(s);
-	}
+	thread_add_read(thread->master, gtp_request_session_read, s, s->fd,
+			GTP_REQUEST_KEEPALIVE_TIMER, 0);
 
   next_accept:
         /* Register read thread on listen fd */
@@ -460,6 +953,7 @@ gtp_request_worker_alloc(gtp_req_channel_t *srv, int id)
 
 	PMALLOC(worker);
 	INIT_LIST_HEAD(&worker->next);
+	INIT_LIST_HEAD(&worker->sessions);
 	worker->channel = srv;
 	worker->id = id;
 
@@ -473,7 +967,11 @@ gtp_request_worker_alloc(gtp_req_channel_t *srv, int id)
 static int
 gtp_request_worker_release(gtp_req_worker_t *w)
 {
+	gtp_req_session_t *s, *_s;
+
 	thread_destroy_master(w->master);
+	list_for_each_entry_safe(s, _s, &w->sessions, next)
+		gtp_request_session_close(s);
 	close(w->fd);
 	return 0;
 }
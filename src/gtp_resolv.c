@@ -197,6 +197,14 @@ retry:
 	return ret;
 }
 
+static void
+gtp_resolv_ttl_update(gtp_resolv_ctx_t *ctx)
+{
+	/* Keep the smallest TTL seen over the whole resolution */
+	if (ns_rr_ttl(ctx->rr) < ctx->ttl)
+		ctx->ttl = ns_rr_ttl(ctx->rr);
+}
+
 static int
 gtp_pgw_set(gtp_pgw_t *pgw, const u_char *rdata, size_t rdlen)
 {
@@ -230,6 +238,8 @@ gtp_resolv_srv_a(gtp_resolv_ctx_t *ctx, gtp_pgw_t *pgw)
 		if (ns_rr_type(ctx->rr) != ns_t_a)
 			continue;
 
+		gtp_resolv_ttl_update(ctx);
+
 		gtp_pgw_set(pgw, ns_rr_rdata(ctx->rr), ns_rr_rdlen(ctx->rr));
         }
 
@@ -332,6 +342,8 @@ gtp_resolv_naptr_srv(gtp_resolv_ctx_t *ctx, gtp_naptr_t *naptr)
 		if (ns_rr_type(ctx->rr) != ns_t_srv)
 			continue;
 
+		gtp_resolv_ttl_update(ctx);
+
 		gtp_pgw_alloc(naptr, ns_rr_rdata(ctx->rr), ns_rr_rdlen(ctx->rr));
         }
 
@@ -444,6 +456,8 @@ gtp_resolv_naptr(gtp_resolv_ctx_t *ctx, list_head_t *l, const char *format, ...)
 		if (ns_rr_type(ctx->rr) != ns_t_naptr)
 			continue;
 
+		gtp_resolv_ttl_update(ctx);
+
 		gtp_naptr_alloc(l, ns_rr_rdata(ctx->rr), ns_rr_rdlen(ctx->rr));
         }
 
@@ -463,6 +477,7 @@ gtp_resolv_ctx_alloc(gtp_apn_t *apn)
 
 	ctx->apn = apn;
 	ctx->max_retry = apn->resolv_max_retry;
+	ctx->ttl = UINT32_MAX;
 	addr = (apn->nameserver.ss_family) ? &apn->nameserver : &daemon_data->nameserver;
 	if (!addr->ss_family) {
 		log_message(LOG_INFO, "%s(): No nameserver configured... Ignoring..."
@@ -630,14 +645,11 @@ gtp_naptr_get(gtp_apn_t *apn, const char *name)
 int
 gtp_resolv_init(void)
 {
-	return 0;
+	return gtp_resolv_cache_init();
 }
 
 int
 gtp_resolv_destroy(void)
 {
-
-	/* FIXME: release cache stuffs */
-
-	return 0;
+	return gtp_resolv_cache_destroy();
 }
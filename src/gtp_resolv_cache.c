@@ -0,0 +1,625 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <errno.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/* Local data */
+static gtp_resolv_cache_t *gtp_resolv_cache;
+
+
+/*
+ *	Cache data helpers
+ */
+static uint64_t
+gtp_resolv_cache_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static gtp_resolv_cache_data_t *
+gtp_resolv_cache_data_alloc(void)
+{
+	gtp_resolv_cache_data_t *new;
+
+	PMALLOC(new);
+	if (!new)
+		return NULL;
+	INIT_LIST_HEAD(&new->naptr);
+	new->refcnt = 1;
+
+	return new;
+}
+
+void
+gtp_resolv_cache_put(gtp_resolv_cache_data_t *data)
+{
+	if (!data)
+		return;
+
+	if (__sync_sub_and_fetch(&data->refcnt, 1))
+		return;
+
+	gtp_sched_index_free(data->sched);
+	gtp_naptr_destroy(&data->naptr);
+	FREE(data);
+}
+
+
+/*
+ *	Cache entry helpers
+ */
+static uint32_t
+gtp_resolv_cache_hash(gtp_apn_t *apn, const char *fqdn)
+{
+	return jhash_2words(jhash_oaat((ub1 *) fqdn, strlen(fqdn)),
+			    (uint32_t) (uintptr_t) apn, 0);
+}
+
+static void
+__gtp_resolv_cache_entry_put(gtp_resolv_cache_t *c, gtp_resolv_cache_entry_t *e)
+{
+	if (--e->refcnt)
+		return;
+
+	gtp_resolv_cache_put(e->data);
+	FREE(e);
+}
+
+static void
+__gtp_resolv_cache_unhash(gtp_resolv_cache_t *c, gtp_resolv_cache_entry_t *e)
+{
+	if (!__test_and_clear_bit(GTP_RESOLV_CACHE_FL_HASHED_BIT, &e->flags))
+		return;
+
+	hlist_del_init(&e->hlist);
+	c->nr_entries--;
+	__gtp_resolv_cache_entry_put(c, e);
+}
+
+static gtp_resolv_cache_entry_t *
+__gtp_resolv_cache_lookup(gtp_resolv_cache_t *c, gtp_apn_t *apn, const char *fqdn, uint32_t hash)
+{
+	hlist_head_t *head = &c->htab[hash & GTP_RESOLV_CACHE_HASHTAB_MASK];
+	gtp_resolv_cache_entry_t *e;
+	hlist_node_t *n;
+
+	hlist_for_each_entry(e, n, head, hlist) {
+		if (e->hash == hash && e->apn == apn && !strcmp(e->fqdn, fqdn))
+			return e;
+	}
+
+	return NULL;
+}
+
+static gtp_resolv_cache_entry_t *
+__gtp_resolv_cache_entry_alloc(gtp_resolv_cache_t *c, gtp_apn_t *apn, const char *fqdn, uint32_t hash)
+{
+	gtp_resolv_cache_entry_t *new;
+
+	if (c->nr_entries >= GTP_RESOLV_CACHE_MAX_ENTRIES)
+		return NULL;
+
+	PMALLOC(new);
+	if (!new)
+		return NULL;
+	INIT_LIST_HEAD(&new->next);
+	new->apn = apn;
+	bsd_strlcpy(new->fqdn, fqdn, GTP_DISPLAY_BUFFER_LEN);
+	new->hash = hash;
+	new->refcnt = 1;
+
+	hlist_add_head(&new->hlist, &c->htab[hash & GTP_RESOLV_CACHE_HASHTAB_MASK]);
+	__set_bit(GTP_RESOLV_CACHE_FL_HASHED_BIT, &new->flags);
+	c->nr_entries++;
+	return new;
+}
+
+static void
+__gtp_resolv_cache_queue(gtp_resolv_cache_t *c, gtp_resolv_cache_entry_t *e)
+{
+	/* In-flight deduplication: one pending resolution per entry */
+	if (__test_and_set_bit(GTP_RESOLV_CACHE_FL_INFLIGHT_BIT, &e->flags))
+		return;
+
+	e->refcnt++;
+	list_add_tail(&e->next, &c->queue);
+	pthread_cond_signal(&c->cond);
+}
+
+static void
+__gtp_resolv_cache_gc(gtp_resolv_cache_t *c)
+{
+	gtp_resolv_cache_entry_t *e;
+	hlist_node_t *n, *_n;
+	time_t now = time(NULL);
+	int i;
+
+	for (i = 0; i < GTP_RESOLV_CACHE_HASHTAB_SIZE; i++) {
+		hlist_for_each_entry_safe(e, n, _n, &c->htab[i], hlist) {
+			if (__test_bit(GTP_RESOLV_CACHE_FL_INFLIGHT_BIT, &e->flags) ||
+			    now < e->expire + GTP_RESOLV_CACHE_STALE)
+				continue;
+
+			__gtp_resolv_cache_unhash(c, e);
+		}
+	}
+}
+
+
+/*
+ *	Cache lookup
+ *
+ * Never blocks on DNS: a miss queues the resolution and fails fast,
+ * the peer retransmission will then hit the cache. Expired entries
+ * are still served for GTP_RESOLV_CACHE_STALE seconds while being
+ * refreshed in the background.
+ */
+gtp_resolv_cache_data_t *
+gtp_resolv_cache_get(gtp_apn_t *apn, const char *apn_name, const char *plmn)
+{
+	gtp_resolv_cache_t *c = gtp_resolv_cache;
+	gtp_resolv_cache_data_t *data = NULL;
+	gtp_resolv_cache_entry_t *e;
+	char fqdn[GTP_DISPLAY_BUFFER_LEN];
+	time_t now = time(NULL);
+	uint32_t hash;
+
+	if (!c)
+		return NULL;
+
+	snprintf(fqdn, GTP_DISPLAY_BUFFER_LEN, "%s.apn.epc.%s.3gppnetwork.org."
+					     , apn_name, plmn);
+	hash = gtp_resolv_cache_hash(apn, fqdn);
+
+	pthread_mutex_lock(&c->mutex);
+	e = __gtp_resolv_cache_lookup(c, apn, fqdn, hash);
+	if (!e) {
+		c->stats.miss++;
+		e = __gtp_resolv_cache_entry_alloc(c, apn, fqdn, hash);
+		if (e)
+			__gtp_resolv_cache_queue(c, e);
+		goto end;
+	}
+
+	/* Too old to be served, even stale */
+	if (e->data && now >= e->expire + GTP_RESOLV_CACHE_STALE) {
+		gtp_resolv_cache_put(e->data);
+		e->data = NULL;
+	}
+
+	if (!e->data) {
+		if (__test_bit(GTP_RESOLV_CACHE_FL_INFLIGHT_BIT, &e->flags)) {
+			c->stats.inflight++;
+		} else if (__test_bit(GTP_RESOLV_CACHE_FL_NEGATIVE_BIT, &e->flags) &&
+			   now < e->expire) {
+			c->stats.negative++;
+		} else {
+			c->stats.miss++;
+			__gtp_resolv_cache_queue(c, e);
+		}
+		goto end;
+	}
+
+	data = e->data;
+	__sync_add_and_fetch(&data->refcnt, 1);
+	e->hit++;
+	if (now < e->expire) {
+		c->stats.hit++;
+		goto end;
+	}
+
+	/* stale-while-revalidate */
+	c->stats.stale++;
+	if (now >= e->refresh)
+		__gtp_resolv_cache_queue(c, e);
+
+  end:
+	pthread_mutex_unlock(&c->mutex);
+	return data;
+}
+
+
+/*
+ *	Resolver workers
+ */
+static gtp_resolv_cache_data_t *
+gtp_resolv_cache_fetch(gtp_resolv_cache_entry_t *e, uint32_t *ttl)
+{
+	gtp_resolv_cache_data_t *data;
+	gtp_resolv_ctx_t *ctx;
+	int err;
+
+	ctx = gtp_resolv_ctx_alloc(e->apn);
+	if (!ctx)
+		return NULL;
+
+	data = gtp_resolv_cache_data_alloc();
+	if (!data) {
+		gtp_resolv_ctx_destroy(ctx);
+		return NULL;
+	}
+
+	err = gtp_resolv_naptr(ctx, &data->naptr, "%s", e->fqdn);
+	err = (err) ? : gtp_resolv_pgw(ctx, &data->naptr);
+	if (!err && !list_empty(&data->naptr)) {
+		/* Selection index is built here, out of the lookup path */
+		pthread_mutex_lock(&e->apn->mutex);
+		data->sched = gtp_sched_index_build(&data->naptr, &e->apn->service_selection);
+		pthread_mutex_unlock(&e->apn->mutex);
+	}
+
+	if (!data->sched) {
+		gtp_resolv_cache_put(data);
+		data = NULL;
+	}
+
+	*ttl = ctx->ttl;
+	gtp_resolv_ctx_destroy(ctx);
+	return data;
+}
+
+static void
+__gtp_resolv_cache_publish(gtp_resolv_cache_t *c, gtp_resolv_cache_entry_t *e,
+			   gtp_resolv_cache_data_t *data, uint32_t ttl, uint64_t lat)
+{
+	gtp_resolv_cache_data_t *old = data;
+	time_t now = time(NULL);
+	int i;
+
+	/* Latency histogram: 1ms, 4ms, 16ms, ... upper bounds */
+	for (i = 0; i < GTP_RESOLV_CACHE_LAT_BUCKETS - 1 && lat >= (1000ULL << (2*i)); i++) ;
+	c->stats.lat[i]++;
+	c->stats.lat_sum += lat;
+	if (lat > c->stats.lat_max)
+		c->stats.lat_max = lat;
+
+	if (!data) {
+		c->stats.failed++;
+		e->refresh = now + GTP_RESOLV_CACHE_NEGATIVE_TTL;
+		if (!e->data) {
+			__set_bit(GTP_RESOLV_CACHE_FL_NEGATIVE_BIT, &e->flags);
+			e->expire = now + GTP_RESOLV_CACHE_NEGATIVE_TTL;
+		}
+		log_message(LOG_INFO, "%s(): Unable to resolv '%s'%s"
+				    , __FUNCTION__, e->fqdn
+				    , (e->data) ? "... serving stale entry" : "");
+		goto end;
+	}
+
+	if (ttl < GTP_RESOLV_CACHE_TTL_MIN)
+		ttl = GTP_RESOLV_CACHE_TTL_MIN;
+	if (ttl > GTP_RESOLV_CACHE_TTL_MAX)
+		ttl = GTP_RESOLV_CACHE_TTL_MAX;
+
+	c->stats.resolved++;
+	old = e->data;
+	e->data = data;
+	e->ttl = ttl;
+	e->expire = now + ttl;
+	e->refresh = now;
+	e->last_update = now;
+	__clear_bit(GTP_RESOLV_CACHE_FL_NEGATIVE_BIT, &e->flags);
+
+  end:
+	__clear_bit(GTP_RESOLV_CACHE_FL_RUNNING_BIT, &e->flags);
+	__clear_bit(GTP_RESOLV_CACHE_FL_INFLIGHT_BIT, &e->flags);
+	pthread_cond_broadcast(&c->done);
+	__gtp_resolv_cache_entry_put(c, e);
+
+	/* Workers may still hold a reference on previous data */
+	gtp_resolv_cache_put(old);
+}
+
+static void *
+gtp_resolv_cache_task(void *arg)
+{
+	gtp_resolv_cache_t *c = arg;
+	gtp_resolv_cache_entry_t *e;
+	gtp_resolv_cache_data_t *data;
+	struct timespec timeout;
+	uint64_t start;
+	uint32_t ttl;
+
+	/* Our identity */
+	prctl(PR_SET_NAME, "resolv_worker", 0, 0, 0, 0);
+
+	pthread_mutex_lock(&c->mutex);
+	while (!__test_bit(GTP_RESOLV_CACHE_FL_STOP_BIT, &c->flags)) {
+		if (list_empty(&c->queue)) {
+			clock_gettime(CLOCK_REALTIME, &timeout);
+			timeout.tv_sec += GTP_RESOLV_CACHE_GC_TIMER;
+			if (pthread_cond_timedwait(&c->cond, &c->mutex, &timeout) == ETIMEDOUT)
+				__gtp_resolv_cache_gc(c);
+			continue;
+		}
+
+		e = list_first_entry(&c->queue, gtp_resolv_cache_entry_t, next);
+		list_del_init(&e->next);
+		__set_bit(GTP_RESOLV_CACHE_FL_RUNNING_BIT, &e->flags);
+		pthread_mutex_unlock(&c->mutex);
+
+		/* Blocking resolution, out of any lock */
+		ttl = UINT32_MAX;
+		start = gtp_resolv_cache_usec();
+		data = gtp_resolv_cache_fetch(e, &ttl);
+
+		pthread_mutex_lock(&c->mutex);
+		__gtp_resolv_cache_publish(c, e, data, ttl, gtp_resolv_cache_usec() - start);
+	}
+	pthread_mutex_unlock(&c->mutex);
+
+	return NULL;
+}
+
+
+/*
+ *	Cache flush
+ */
+static int
+__gtp_resolv_cache_flush(gtp_resolv_cache_t *c, gtp_apn_t *apn)
+{
+	gtp_resolv_cache_entry_t *e, *_e;
+	hlist_node_t *n, *_n;
+	int i;
+
+	/* Pending resolutions */
+	list_for_each_entry_safe(e, _e, &c->queue, next) {
+		if (apn && e->apn != apn)
+			continue;
+
+		list_del_init(&e->next);
+		__clear_bit(GTP_RESOLV_CACHE_FL_INFLIGHT_BIT, &e->flags);
+		__gtp_resolv_cache_entry_put(c, e);
+	}
+
+  retry:
+	for (i = 0; i < GTP_RESOLV_CACHE_HASHTAB_SIZE; i++) {
+		hlist_for_each_entry_safe(e, n, _n, &c->htab[i], hlist) {
+			if (apn && e->apn != apn)
+				continue;
+
+			/* APN is about to be released, running resolution
+			 * must complete before */
+			if (apn && __test_bit(GTP_RESOLV_CACHE_FL_RUNNING_BIT, &e->flags)) {
+				pthread_cond_wait(&c->done, &c->mutex);
+				goto retry;
+			}
+
+			__gtp_resolv_cache_unhash(c, e);
+		}
+	}
+
+	return 0;
+}
+
+int
+gtp_resolv_cache_apn_flush(gtp_apn_t *apn)
+{
+	gtp_resolv_cache_t *c = gtp_resolv_cache;
+
+	if (!c)
+		return -1;
+
+	pthread_mutex_lock(&c->mutex);
+	__gtp_resolv_cache_flush(c, apn);
+	pthread_mutex_unlock(&c->mutex);
+	return 0;
+}
+
+int
+gtp_resolv_cache_flush(void)
+{
+	return gtp_resolv_cache_apn_flush(NULL);
+}
+
+
+/*
+ *	Cache show
+ */
+int
+gtp_resolv_cache_stats(gtp_resolv_cache_stats_t *stats)
+{
+	gtp_resolv_cache_t *c = gtp_resolv_cache;
+
+	if (!c)
+		return -1;
+
+	pthread_mutex_lock(&c->mutex);
+	*stats = c->stats;
+	pthread_mutex_unlock(&c->mutex);
+	return 0;
+}
+
+static const char *
+gtp_resolv_cache_state(gtp_resolv_cache_entry_t *e, time_t now)
+{
+	if (e->data)
+		return (now < e->expire) ? "valid" : "stale";
+	if (__test_bit(GTP_RESOLV_CACHE_FL_NEGATIVE_BIT, &e->flags))
+		return "negative";
+	return "pending";
+}
+
+int
+gtp_resolv_cache_show(vty_t *vty)
+{
+	static const char *lat_str[GTP_RESOLV_CACHE_LAT_BUCKETS] = {
+		"<1ms", "<4ms", "<16ms", "<64ms", "<256ms", "<1s", "<4s", ">=4s"
+	};
+	gtp_resolv_cache_t *c = gtp_resolv_cache;
+	gtp_resolv_cache_stats_t *s;
+	gtp_resolv_cache_entry_t *e;
+	hlist_node_t *n;
+	time_t now = time(NULL);
+	uint64_t lookups, nr_resolv;
+	int i;
+
+	if (!c) {
+		vty_out(vty, "%% resolver cache not running (no nameserver configured)%s"
+			   , VTY_NEWLINE);
+		return -1;
+	}
+
+	pthread_mutex_lock(&c->mutex);
+	s = &c->stats;
+	lookups = s->hit + s->stale + s->negative + s->miss + s->inflight;
+	nr_resolv = s->resolved + s->failed;
+	vty_out(vty, "Resolver cache: %d entries, %d workers%s"
+		     " lookups:%ld hit:%ld stale:%ld negative:%ld miss:%ld inflight:%ld (hit-ratio:%ld%%)%s"
+		     " resolutions:%ld resolved:%ld failed:%ld latency avg:%ldus max:%ldus%s"
+		     " latency:"
+		   , c->nr_entries, GTP_RESOLV_CACHE_WORKERS, VTY_NEWLINE
+		   , lookups, s->hit, s->stale, s->negative, s->miss, s->inflight
+		   , (lookups) ? (s->hit + s->stale) * 100 / lookups : 0, VTY_NEWLINE
+		   , nr_resolv, s->resolved, s->failed
+		   , (nr_resolv) ? s->lat_sum / nr_resolv : 0, s->lat_max, VTY_NEWLINE);
+	for (i = 0; i < GTP_RESOLV_CACHE_LAT_BUCKETS; i++)
+		vty_out(vty, " %s:%ld", lat_str[i], s->lat[i]);
+	vty_out(vty, "%s", VTY_NEWLINE);
+
+	for (i = 0; i < GTP_RESOLV_CACHE_HASHTAB_SIZE; i++) {
+		hlist_for_each_entry(e, n, &c->htab[i], hlist) {
+			vty_out(vty, " %s (apn:%s)%s"
+				     "   state:%s%s ttl:%u expire:%lds hit:%ld%s"
+				   , e->fqdn, e->apn->name, VTY_NEWLINE
+				   , gtp_resolv_cache_state(e, now)
+				   , __test_bit(GTP_RESOLV_CACHE_FL_INFLIGHT_BIT, &e->flags) ?
+				     "+refresh" : ""
+				   , e->ttl, (long) (e->expire - now), e->hit, VTY_NEWLINE);
+		}
+	}
+	pthread_mutex_unlock(&c->mutex);
+
+	return 0;
+}
+
+
+/*
+ *	Resolver cache init
+ */
+int
+gtp_resolv_cache_init(void)
+{
+	gtp_resolv_cache_t *c;
+	int i;
+
+	/* Already running */
+	if (gtp_resolv_cache)
+		return 0;
+
+	PMALLOC(c);
+	if (!c)
+		return -1;
+	c->htab = (hlist_head_t *) MALLOC(sizeof(hlist_head_t) * GTP_RESOLV_CACHE_HASHTAB_SIZE);
+	if (!c->htab) {
+		FREE(c);
+		return -1;
+	}
+	INIT_LIST_HEAD(&c->queue);
+	pthread_mutex_init(&c->mutex, NULL);
+	pthread_cond_init(&c->cond, NULL);
+	pthread_cond_init(&c->done, NULL);
+
+	for (i = 0; i < GTP_RESOLV_CACHE_WORKERS; i++)
+		pthread_create(&c->task[i], NULL, gtp_resolv_cache_task, c);
+
+	gtp_resolv_cache = c;
+	return 0;
+}
+
+int
+gtp_resolv_cache_destroy(void)
+{
+	gtp_resolv_cache_t *c = gtp_resolv_cache;
+	int i;
+
+	if (!c)
+		return 0;
+
+	pthread_mutex_lock(&c->mutex);
+	__set_bit(GTP_RESOLV_CACHE_FL_STOP_BIT, &c->flags);
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->mutex);
+
+	for (i = 0; i < GTP_RESOLV_CACHE_WORKERS; i++)
+		pthread_join(c->task[i], NULL);
+
+	__gtp_resolv_cache_flush(c, NULL);
+	gtp_resolv_cache = NULL;
+	pthread_mutex_destroy(&c->mutex);
+	pthread_cond_destroy(&c->cond);
+	pthread_cond_destroy(&c->done);
+	FREE(c->htab);
+	FREE(c);
+	return 0;
+}
+
+
+/*
+ *	VTY command
+ */
+DEFUN(show_gtp_resolv_cache,
+      show_gtp_resolv_cache_cmd,
+      "show gtp resolv-cache",
+      SHOW_STR
+      "GTP related informations\n"
+      "Dynamic pGW resolver cache\n")
+{
+	gtp_resolv_cache_show(vty);
+	return CMD_SUCCESS;
+}
+
+DEFUN(clear_gtp_resolv_cache,
+      clear_gtp_resolv_cache_cmd,
+      "clear gtp resolv-cache",
+      "Clear GTP related\n"
+      "GTP related\n"
+      "Dynamic pGW resolver cache\n")
+{
+	if (gtp_resolv_cache_flush() < 0) {
+		vty_out(vty, "%% resolver cache not running%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
+int
+gtp_resolv_cache_vty_init(void)
+{
+	install_element(VIEW_NODE, &show_gtp_resolv_cache_cmd);
+	install_element(ENABLE_NODE, &show_gtp_resolv_cache_cmd);
+	install_element(ENABLE_NODE, &clear_gtp_resolv_cache_cmd);
+
+	return 0;
+}
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+/* system includes */
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+/* local includes */
+#include "gtp_guard.h"
+
+
+/*
+ *	Trie build
+ */
+static size_t
+gtp_rewrite_rule_nibbles(gtp_rewrite_rule_t *rule, int type)
+{
+	/* IMSI rule match_len is a digit count */
+	if (type == GTP_REWRITE_IMSI)
+		return rule->match_len;
+	return 2 * rule->match_len;
+}
+
+static void
+gtp_rewrite_trie_insert(gtp_rewrite_trie_t *t, gtp_rewrite_rule_t *rule,
+			size_t nibbles, int32_t idx)
+{
+	const uint8_t *key = (const uint8_t *) rule->match;
+	gtp_rewrite_node_t *node = &t->node[0];
+	uint32_t *child;
+	size_t i;
+
+	for (i = 0; i < nibbles; i++) {
+		child = &node->child[GTP_REWRITE_NIBBLE(key, i)];
+		if (!*child) {
+			*child = t->nr_node++;
+			t->node[*child].rule = -1;
+		}
+		node = &t->node[*child];
+	}
+
+	/* Shadowed duplicate prefix: first one wins */
+	if (node->rule < 0)
+		node->rule = idx;
+}
+
+gtp_rewrite_trie_t *
+gtp_rewrite_trie_build(list_head_t *l, int type)
+{
+	gtp_rewrite_rule_t *rule;
+	gtp_rewrite_trie_t *t;
+	size_t max_node = 1;
+	uint32_t i = 0;
+
+	PMALLOC(t);
+	list_for_each_entry(rule, l, next) {
+		max_node += gtp_rewrite_rule_nibbles(rule, type);
+		t->nr_rule++;
+	}
+
+	t->rule = MALLOC((t->nr_rule + 1) * sizeof(gtp_rewrite_rule_t *));
+	t->node = MALLOC(max_node * sizeof(gtp_rewrite_node_t));
+	if (!t->rule || !t->node) {
+		gtp_rewrite_trie_free(t);
+		return NULL;
+	}
+
+	t->node[0].rule = -1;
+	t->nr_node = 1;
+	list_for_each_entry(rule, l, next) {
+		t->rule[i] = rule;
+		gtp_rewrite_trie_insert(t, rule, gtp_rewrite_rule_nibbles(rule, type), i);
+		i++;
+	}
+
+	/* Prefixes are shared, give back what is left */
+	t->node = REALLOC(t->node, t->nr_node * sizeof(gtp_rewrite_node_t));
+	return t;
+}
+
+void
+gtp_rewrite_trie_free(gtp_rewrite_trie_t *t)
+{
+	if (!t)
+		return;
+
+	if (t->node)
+		FREE(t->node);
+	if (t->rule)
+		FREE(t->rule);
+	FREE(t);
+}
+
+/* First rule of the list whose match is a prefix of key */
+gtp_rewrite_rule_t *
+gtp_rewrite_trie_lookup(gtp_rewrite_trie_t *t, const uint8_t *key, size_t nibbles)
+{
+	gtp_rewrite_node_t *node = &t->node[0];
+	uint32_t best = node->rule, child;
+	size_t i;
+
+	for (i = 0; i < nibbles; i++) {
+		child = node->child[GTP_REWRITE_NIBBLE(key, i)];
+		if (!child)
+			break;
+
+		node = &t->node[child];
+		if ((uint32_t) node->rule < best)
+			best = node->rule;
+	}
+
+	return (best < t->nr_rule) ? t->rule[best] : NULL;
+}
+
+
+/*
+ *	Snapshot publishing
+ */
+static void
+gtp_rewrite_trie_release(grace_obj_t *obj)
+{
+	gtp_rewrite_trie_free(container_of(obj, gtp_rewrite_trie_t, gp));
+}
+
+static void
+__gtp_rewrite_trie_publish(gtp_apn_t *apn, int type, gtp_rewrite_trie_t *t)
+{
+	grace_ptr_publish(&apn->rewrite_trie[type], (t) ? &t->gp : NULL
+						  , gtp_rewrite_trie_release);
+}
+
+int
+gtp_rewrite_trie_rebuild(gtp_apn_t *apn, int type)
+{
+	list_head_t *l = (type == GTP_REWRITE_IMSI) ? &apn->imsi_match : &apn->oi_match;
+	gtp_rewrite_trie_t *t;
+
+	pthread_mutex_lock(&apn->mutex);
+	t = gtp_rewrite_trie_build(l, type);
+	if (t)
+		__gtp_rewrite_trie_publish(apn, type, t);
+	pthread_mutex_unlock(&apn->mutex);
+	return (t) ? 0 : -1;
+}
+
+int
+gtp_rewrite_trie_destroy(gtp_apn_t *apn)
+{
+	int type;
+
+	pthread_mutex_lock(&apn->mutex);
+	for (type = 0; type < GTP_REWRITE_MAX; type++)
+		__gtp_rewrite_trie_publish(apn, type, NULL);
+	pthread_mutex_unlock(&apn->mutex);
+	return 0;
+}
+
+gtp_rewrite_trie_t *
+gtp_rewrite_trie_get(gtp_apn_t *apn, int type)
+{
+	grace_obj_t *obj = grace_ptr_get(&apn->rewrite_trie[type]);
+
+	return (obj) ? container_of(obj, gtp_rewrite_trie_t, gp) : NULL;
+}
+
+void
+gtp_rewrite_trie_put(gtp_rewrite_trie_t *t)
+{
+	grace_ptr_put(&t->gp);
+}
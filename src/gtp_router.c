@@ -63,15 +63,32 @@ int
 gtp_router_ingress_process(gtp_server_worker_t *w, struct sockaddr_storage *addr_from)
 {
 	gtp_server_t *srv = w->srv;
-	int ret;
+	gtp_replay_key_t key;
+	int ret, err = -1;
 
-	ret = __test_bit(GTP_FL_UPF_BIT, &srv->flags) ? gtpu_router_handle(w, addr_from) :
-							gtpc_router_handle(w, addr_from);
+	if (__test_bit(GTP_FL_UPF_BIT, &srv->flags)) {
+		ret = gtpu_router_handle(w, addr_from);
+		goto end;
+	}
+
+	/* Retransmitted request already answered */
+	err = gtp_replay_key_build(&key, w->pbuff, (struct sockaddr_in *) addr_from, false);
+	if (!err && !gtp_replay_lookup(w, &key, (struct sockaddr_in *) addr_from))
+		return 0;
+
+	ret = gtpc_router_handle(w, addr_from);
+
+  end:
 	if (ret < 0)
 		return -1;
 
-	if (ret != GTP_ROUTER_DELAYED)
+	if (ret != GTP_ROUTER_DELAYED) {
+		gtp_overload_oci_append(w, (struct sockaddr_in *) addr_from
+					  , GTP_OVERLOAD_OCI_NODE);
 		gtp_server_send(w, w->fd, (struct sockaddr_in *) addr_from);
+		if (!err)
+			gtp_replay_store(w->replay, &key, w->pbuff);
+	}
 	return 0;
 }
 
@@ -523,17 +523,37 @@ gtpc_pkt_put_apn_restriction(pkt_buffer_t *pbuff, gtp_apn_t *apn)
 }
 
 static int
-gtpc_pkt_put_paa(pkt_buffer_t *pbuff, uint32_t addr)
+gtpc_pkt_put_paa(pkt_buffer_t *pbuff, gtp_session_t *s)
 {
 	gtp_ie_paa_t *paa;
+	uint8_t *cp;
+	int len;
+
+	if (IN6_IS_ADDR_UNSPECIFIED(&s->ipv6_prefix)) {
+		if (gtpc_pkt_put_ie(pbuff, GTP_IE_PAA_TYPE, sizeof(gtp_ie_paa_t)) < 0)
+			return 1;
+
+		paa = (gtp_ie_paa_t *) pbuff->data;
+		paa->type = GTP_PAA_IPV4_TYPE;
+		paa->addr = s->ipv4;
+		pkt_buffer_put_data(pbuff, sizeof(gtp_ie_paa_t));
+		return 0;
+	}
 
-	if (gtpc_pkt_put_ie(pbuff, GTP_IE_PAA_TYPE, sizeof(gtp_ie_paa_t)) < 0)
+	/* 3GPP TS 29.274 8.14: PDN type | prefix len | IPv6 prefix [| IPv4] */
+	len = sizeof(gtp_ie_t) + 1 + 1 + sizeof(struct in6_addr);
+	len += (s->ipv4) ? sizeof(uint32_t) : 0;
+	if (gtpc_pkt_put_ie(pbuff, GTP_IE_PAA_TYPE, len) < 0)
 		return 1;
 
-	paa = (gtp_ie_paa_t *) pbuff->data;
-	paa->type = GTP_PAA_IPV4_TYPE;
-	paa->addr = addr;
-	pkt_buffer_put_data(pbuff, sizeof(gtp_ie_paa_t));
+	cp = pbuff->data + sizeof(gtp_ie_t);
+	*cp++ = (s->ipv4) ? GTP_PAA_IPV4V6_TYPE : GTP_PAA_IPV6_TYPE;
+	*cp++ = GTP_PAA_IPV6_PLEN;
+	memcpy(cp, &s->ipv6_prefix, sizeof(struct in6_addr));
+	cp += sizeof(struct in6_addr);
+	if (s->ipv4)
+		memcpy(cp, &s->ipv4, sizeof(uint32_t));
+	pkt_buffer_put_data(pbuff, len);
 	return 0;
 }
 
@@ -600,6 +620,133 @@ gtpc_pkt_put_bearer_context(pkt_buffer_t *pbuff, gtp_session_t *s, gtp_teid_t *t
 	return 0;
 }
 
+/*
+ *	Per APN response template
+ */
+static int
+gtpc_pkt_put_tpl(pkt_buffer_t *pbuff, gtp_apn_tpl_t *tpl, uint16_t start, uint16_t end)
+{
+	gtp_hdr_t *h = (gtp_hdr_t *) pbuff->head;
+	uint16_t len = end - start;
+
+	if (!len)
+		return 0;
+
+	if (pkt_buffer_put_zero(pbuff, len) < 0)
+		return 1;
+
+	memcpy(pbuff->data, tpl->buffer + start, len);
+	pkt_buffer_put_data(pbuff, len);
+	h->length = htons(ntohs(h->length) + len);
+	return 0;
+}
+
+static int
+gtpc_pkt_put_tpl_recovery(pkt_buffer_t *pbuff, gtp_apn_tpl_t *tpl)
+{
+	gtp_ie_recovery_t *ie = (gtp_ie_recovery_t *) pbuff->data;
+
+	/* Recovery & Indication */
+	if (gtpc_pkt_put_tpl(pbuff, tpl, 0, tpl->pco_off))
+		return 1;
+
+	ie->recovery = daemon_data->restart_counter;
+	return 0;
+}
+
+static int
+gtpc_apn_tpl_build(gtp_apn_t *apn, gtp_apn_tpl_t *tpl)
+{
+	pkt_buffer_t *pbuff;
+	gtp_hdr_t *h;
+	int err = 0;
+
+	pbuff = pkt_buffer_alloc(GTP_BUFFER_SIZE);
+	if (!pbuff)
+		return -1;
+
+	/* Serialize using regular IE factory, then snapshot */
+	h = (gtp_hdr_t *) pbuff->head;
+	h->length = 0;
+	pkt_buffer_set_end_pointer(pbuff, sizeof(gtp_hdr_t));
+	pkt_buffer_set_data_pointer(pbuff, sizeof(gtp_hdr_t));
+
+	err = err ? : gtpc_pkt_put_recovery(pbuff);
+	err = err ? : gtpc_pkt_put_indication(pbuff, apn->indication_flags);
+	tpl->pco_off = pkt_buffer_len(pbuff) - sizeof(gtp_hdr_t);
+	err = err ? : gtpc_pkt_put_pco(pbuff, apn->pco, NULL);
+	tpl->restriction_off = pkt_buffer_len(pbuff) - sizeof(gtp_hdr_t);
+	err = err ? : gtpc_pkt_put_apn_restriction(pbuff, apn);
+	tpl->len = pkt_buffer_len(pbuff) - sizeof(gtp_hdr_t);
+
+	/* Template are raw IE bytes, header length must account
+	 * exactly for them */
+	if (err || tpl->len > GTP_APN_TPL_SIZE || ntohs(h->length) != tpl->len) {
+		pkt_buffer_free(pbuff);
+		return -1;
+	}
+
+	memcpy(tpl->buffer, pbuff->head + sizeof(gtp_hdr_t), tpl->len);
+	pkt_buffer_free(pbuff);
+	return 0;
+}
+
+static gtp_apn_tpl_t *
+gtpc_apn_tpl_get(gtp_apn_t *apn)
+{
+	uint32_t gen = __sync_add_and_fetch(&apn->tpl_gen, 0);
+	gtp_apn_tpl_t *tpl;
+	grace_obj_t *obj;
+
+	obj = grace_ptr_get(&apn->tpl);
+	if (obj) {
+		tpl = container_of(obj, gtp_apn_tpl_t, gp);
+		if (tpl->gen == gen && tpl->len)
+			return tpl;
+		grace_ptr_put(obj);
+		if (tpl->gen == gen)
+			return NULL;
+	}
+
+	/* Someone else is rebuilding, use regular factory meanwhile */
+	if (!__sync_bool_compare_and_swap(&apn->tpl_building, 0, 1))
+		return NULL;
+
+	/* Build a fresh one then publish, pinned ones are reaped
+	 * once released */
+	PMALLOC(tpl);
+	if (!tpl) {
+		__sync_lock_release(&apn->tpl_building);
+		return NULL;
+	}
+
+	if (gtpc_apn_tpl_build(apn, tpl) < 0) {
+		log_message(LOG_INFO, "%s(): APN:%s unable to build response template."
+				      " Falling back to regular IE factory"
+				    , __FUNCTION__, apn->name);
+		tpl->len = 0;
+	}
+	tpl->gen = gen;
+	gtp_apn_tpl_publish(apn, tpl);
+	__sync_lock_release(&apn->tpl_building);
+
+	obj = grace_ptr_get(&apn->tpl);
+	if (!obj)
+		return NULL;
+	tpl = container_of(obj, gtp_apn_tpl_t, gp);
+	if (tpl->len)
+		return tpl;
+	grace_ptr_put(obj);
+	return NULL;
+}
+
+static void
+gtpc_apn_tpl_put(gtp_apn_tpl_t *tpl)
+{
+	if (tpl)
+		grace_ptr_put(&tpl->gp);
+}
+
 static int
 gtpc_build_header(pkt_buffer_t *pbuff, gtp_teid_t *teid, uint8_t type)
 {
@@ -625,20 +772,30 @@ gtpc_build_create_session_response(pkt_buffer_t *pbuff, gtp_session_t *s, gtp_te
 {
 	gtp_hdr_t *h = (gtp_hdr_t *) pbuff->head;
 	gtp_apn_t *apn = s->apn;
+	gtp_apn_tpl_t *tpl;
 	int err = 0;
 
 	/* Header update */
 	gtpc_build_header(pbuff, teid, GTP_CREATE_SESSION_RESPONSE_TYPE);
 
 	/* Put IE */
+	tpl = gtpc_apn_tpl_get(apn);
 	err = err ? : gtpc_pkt_put_cause(pbuff, GTP_CAUSE_REQUEST_ACCEPTED, teid);
-	err = err ? : gtpc_pkt_put_recovery(pbuff);
-	err = err ? : gtpc_pkt_put_indication(pbuff, apn->indication_flags);
-	err = err ? : gtpc_pkt_put_pco(pbuff, apn->pco, ipcp);
+	if (tpl) {
+		err = err ? : gtpc_pkt_put_tpl_recovery(pbuff, tpl);
+		err = err ? : (ipcp) ? gtpc_pkt_put_pco(pbuff, apn->pco, ipcp) :
+				       gtpc_pkt_put_tpl(pbuff, tpl, tpl->pco_off, tpl->restriction_off);
+	} else {
+		err = err ? : gtpc_pkt_put_recovery(pbuff);
+		err = err ? : gtpc_pkt_put_indication(pbuff, apn->indication_flags);
+		err = err ? : gtpc_pkt_put_pco(pbuff, apn->pco, ipcp);
+	}
 	err = err ? : gtpc_pkt_put_f_teid(pbuff, teid->peer_teid, 1, GTP_TEID_INTERFACE_TYPE_SGW_GTPC);
-	err = err ? : gtpc_pkt_put_apn_restriction(pbuff, apn);
-	err = err ? : gtpc_pkt_put_paa(pbuff, s->ipv4);
+	err = err ? : (tpl) ? gtpc_pkt_put_tpl(pbuff, tpl, tpl->restriction_off, tpl->len) :
+			      gtpc_pkt_put_apn_restriction(pbuff, apn);
+	err = err ? : gtpc_pkt_put_paa(pbuff, s);
 	err = err ? : gtpc_pkt_put_bearer_context(pbuff, s, teid->peer_teid);
+	gtpc_apn_tpl_put(tpl);
 	if (err) {
 		log_message(LOG_INFO, "%s(): Error building PKT !?"
 				    , __FUNCTION__);
@@ -829,7 +986,7 @@ gtpc_pppoe_create_session_response(sppp_t *sp)
 	/* Build and send response */
 	pbuff = pkt_buffer_alloc(GTP_BUFFER_SIZE);
 
-	s_gtp->ipv4 = htonl(sp->ipcp.req_myaddr);
+	gtp_session_set_ipv4(s_gtp, htonl(sp->ipcp.req_myaddr));
 	ret = gtpc_build_create_session_response(pbuff, s_gtp, teid, &sp->ipcp);
 	if (ret < 0) {
 		gtpc_build_errmsg(pbuff, teid, GTP_CREATE_SESSION_RESPONSE_TYPE
@@ -880,6 +1037,7 @@ gtpc_echo_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *addr)
 	cp = gtp_get_ie(GTP_IE_RECOVERY_TYPE, w->pbuff);
 	if (cp) {
 		rec = (gtp_ie_recovery_t *) cp;
+		gtp_path_recovery_update((struct sockaddr_in *) addr, &rec->recovery);
 		rec->recovery = daemon_data->restart_counter;
 	}
 
@@ -891,6 +1049,17 @@ gtpc_echo_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *addr)
 	return 0;
 }
 
+static int
+gtpc_echo_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage *addr)
+{
+	gtp_hdr_t *h = (gtp_hdr_t *) w->pbuff->head;
+
+	/* Only relevant to path management, nothing to reply */
+	gtp_path_echo_response((struct sockaddr_in *) addr, 2, ntohl(h->sqn_only) >> 8
+			       , gtp_get_ie(GTP_IE_RECOVERY_TYPE, w->pbuff));
+	return -1;
+}
+
 static int
 gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *addr)
 {
@@ -910,9 +1079,8 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	int ret, rc = -1;
 	bool retransmit = false;
 
-	msg = gtp_msg_alloc(w->pbuff);
-	if (!msg)
-		return -1;
+	msg = w->msg;
+	gtp_msg_parse(msg, w->pbuff);
 
 	/* At least F-TEID present for create session */
 	msg_ie = gtp_msg_ie_get(msg, GTP_IE_F_TEID_TYPE);
@@ -1004,9 +1172,19 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	s->ptype = *ptype;
 	s->w = w;
 
-	/* Allocate IP Address from APN pool if configured */
-	s->ipv4 = gtp_ip_pool_get(apn);
-	if (apn->ip_pool && !s->ipv4) {
+	/* Allocate IP Address and/or IPv6 prefix from APN pools
+	 * if configured, according to requested PDN type */
+	ret = gtp_session_ip_pool_get(s);
+	if (ret == GTP_SESSION_POOL_PTYPE_UNSUPPORTED) {
+		log_message(LOG_INFO, "%s(): APN:%s PDN type:%d not supported"
+				    , __FUNCTION__
+				    , apn_str, *ptype & 0x07);
+		rc = gtpc_build_errmsg(w->pbuff, teid, GTP_CREATE_SESSION_RESPONSE_TYPE
+						     , GTP_CAUSE_PREFERRED_PDN_TYPE_NOT_SUPPORTED);
+		goto end;
+	}
+
+	if (ret < 0) {
 		log_message(LOG_INFO, "%s(): APN:%s All IP Address occupied"
 				    , __FUNCTION__
 				    , apn_str);
@@ -1021,7 +1199,7 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 				    , __FUNCTION__);
 		rc = gtpc_build_errmsg(w->pbuff, teid, GTP_CREATE_SESSION_RESPONSE_TYPE
 						     , GTP_CAUSE_REQUEST_REJECTED);
-		gtp_ip_pool_put(apn, s->ipv4);
+		gtp_session_ip_pool_put(s);
 		goto end;
 	}
 
@@ -1037,7 +1215,7 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	/* MSISDN */
 	msg_ie = gtp_msg_ie_get(msg, GTP_IE_MSISDN_TYPE);
 	if (msg_ie)
-		s->msisdn = bcd_to_int64(msg_ie->data, ntohs(msg_ie->h->length));
+		gtp_session_set_msisdn(s, bcd_to_int64(msg_ie->data, ntohs(msg_ie->h->length)));
 
 	/* ULI */
 	msg_ie = gtp_msg_ie_get(msg, GTP_IE_ULI_TYPE);
@@ -1052,6 +1230,13 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	/* Update last sGW visited */
 	gtp_teid_update_sgw(teid, addr);
 
+	/* sGW restart detection, before anchoring this session */
+	msg_ie = gtp_msg_ie_get(msg, GTP_IE_RECOVERY_TYPE);
+	if (msg_ie)
+		gtp_path_recovery_update((struct sockaddr_in *) addr
+					 , &((gtp_ie_recovery_t *) msg_ie->h)->recovery);
+	gtp_path_session_register(w->srv, (struct sockaddr_in *) addr, 2, GTP_PATH_FL_SGW_BIT, s);
+
 	/* Generate Charging-ID */
 	s->charging_id = poor_prng(&w->seed) ^ c->sgw_addr.sin_addr.s_addr;
 
@@ -1090,8 +1275,8 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	}
 
 	rc = gtpc_build_create_session_response(w->pbuff, s, teid, NULL);
+	gtp_ckpt_session_put(s);
   end:
-	gtp_msg_destroy(msg);
 	return rc;
 }
 
@@ -1107,9 +1292,8 @@ gtpc_delete_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	uint8_t *ie_buffer;
 	int rc = -1;
 
-	msg = gtp_msg_alloc(w->pbuff);
-	if (!msg)
-		return -1;
+	msg = w->msg;
+	gtp_msg_parse(msg, w->pbuff);
 
 	teid = _gtpc_teid_get(h->teid, inet_sockaddrip4(&srv->addr));
 	if (!teid) {
@@ -1162,7 +1346,6 @@ gtpc_delete_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	else
 		gtp_session_destroy(teid->session);
   end:
-	gtp_msg_destroy(msg);
 	return rc;
 }
 
@@ -1177,9 +1360,8 @@ gtpc_modify_bearer_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *
 	gtp_msg_t *msg;
 	int rc = -1;
 
-	msg = gtp_msg_alloc(w->pbuff);
-	if (!msg)
-		return -1;
+	msg = w->msg;
+	gtp_msg_parse(msg, w->pbuff);
 
 	teid = _gtpc_teid_get(h->teid, inet_sockaddrip4(&srv->addr));
 	if (!teid) {
@@ -1224,12 +1406,12 @@ gtpc_modify_bearer_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *
 	vrf = (s->apn) ? s->apn->vrf : NULL;
 	if (vrf && __test_bit(IP_VRF_FL_PPPOE_BIT, &vrf->flags))
 		gtp_session_gtpu_teid_xdp_add(s);
+	gtp_ckpt_session_put(s);
 
   accept:
 	rc = gtpc_build_errmsg(w->pbuff, teid->peer_teid, GTP_MODIFY_BEARER_RESPONSE_TYPE
 							, GTP_CAUSE_REQUEST_ACCEPTED);
   end:
-	gtp_msg_destroy(msg);
 	return rc;
 }
 
@@ -1242,9 +1424,8 @@ gtpc_change_notification_request_hdl(gtp_server_worker_t *w, struct sockaddr_sto
 	gtp_msg_t *msg;
 	int rc = -1;
 
-	msg = gtp_msg_alloc(w->pbuff);
-	if (!msg)
-		return -1;
+	msg = w->msg;
+	gtp_msg_parse(msg, w->pbuff);
 
 	teid = _gtpc_teid_get(h->teid, inet_sockaddrip4(&srv->addr));
 	if (!teid) {
@@ -1262,7 +1443,6 @@ gtpc_change_notification_request_hdl(gtp_server_worker_t *w, struct sockaddr_sto
 
 	rc = gtpc_build_change_notification_response(w->pbuff, teid->session, teid->peer_teid);
   end:
-	gtp_msg_destroy(msg);
 	return rc;
 }
 
@@ -1274,6 +1454,7 @@ static const struct {
 	int (*hdl) (gtp_server_worker_t *, struct sockaddr_storage *);
 } gtpc_msg_hdl[0xff + 1] = {
 	[GTP_ECHO_REQUEST_TYPE]			= { gtpc_echo_request_hdl },
+	[GTP_ECHO_RESPONSE_TYPE]		= { gtpc_echo_response_hdl },
 	[GTP_CREATE_SESSION_REQUEST_TYPE]	= { gtpc_create_session_request_hdl },
 	[GTP_DELETE_SESSION_REQUEST_TYPE]	= { gtpc_delete_session_request_hdl },
 	[GTP_MODIFY_BEARER_REQUEST_TYPE]	= { gtpc_modify_bearer_request_hdl },
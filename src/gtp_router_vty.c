@@ -141,6 +141,136 @@ DEFUN(gtpc_router_tunnel_endpoint,
 	return CMD_SUCCESS;
 }
 
+DEFUN(gtpc_router_admission_control,
+      gtpc_router_admission_control_cmd,
+      "gtpc-admission-control rate <1-1000000> burst <1-1000000>",
+      "GTP-C per peer initial attach admission control\n"
+      "Rate\n"
+      "messages per second\n"
+      "Burst\n"
+      "number of messages\n")
+{
+	gtp_router_t *ctx = vty->index;
+	gtp_server_t *srv;
+	int rate, burst;
+
+	if (argc < 2) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("Rate", rate, argv[0], 1, 1000000);
+	VTY_GET_INTEGER_RANGE("Burst", burst, argv[1], 1, 1000000);
+
+	srv = &ctx->gtpc;
+	srv->overload.rate = rate;
+	srv->overload.burst = burst;
+	__set_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &srv->overload.flags);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_gtpc_router_admission_control,
+      no_gtpc_router_admission_control_cmd,
+      "no gtpc-admission-control",
+      "GTP-C per peer initial attach admission control\n")
+{
+	gtp_router_t *ctx = vty->index;
+
+	__clear_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &ctx->gtpc.overload.flags);
+	return CMD_SUCCESS;
+}
+
+DEFUN(gtpc_router_overload_control,
+      gtpc_router_overload_control_cmd,
+      "gtpc-overload-control threshold <10-99> latency <10-1000000> validity <2-600>",
+      "GTP-C overload control\n"
+      "Load threshold entering overload\n"
+      "percent\n"
+      "Per message service time target\n"
+      "micro-seconds\n"
+      "Overload Control Information Period-of-Validity\n"
+      "seconds\n")
+{
+	gtp_router_t *ctx = vty->index;
+	gtp_server_t *srv;
+	int threshold, latency, validity;
+
+	if (argc < 3) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("Threshold", threshold, argv[0], 10, 99);
+	VTY_GET_INTEGER_RANGE("Latency", latency, argv[1], 10, 1000000);
+	VTY_GET_INTEGER_RANGE("Validity", validity, argv[2], 2, 600);
+
+	srv = &ctx->gtpc;
+	srv->overload.threshold = threshold;
+	srv->overload.latency = latency;
+	srv->overload.validity = validity;
+	__set_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &srv->overload.flags);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_gtpc_router_overload_control,
+      no_gtpc_router_overload_control_cmd,
+      "no gtpc-overload-control",
+      "GTP-C overload control\n")
+{
+	gtp_router_t *ctx = vty->index;
+
+	__clear_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &ctx->gtpc.overload.flags);
+	return CMD_SUCCESS;
+}
+
+DEFUN(gtpc_router_overload_control_peer,
+      gtpc_router_overload_control_peer_cmd,
+      "gtpc-overload-control peer A.B.C.D",
+      "GTP-C overload control\n"
+      "Peer supporting overload control\n"
+      "IPv4 Address\n")
+{
+	gtp_router_t *ctx = vty->index;
+	uint32_t addr;
+
+	if (inet_pton(AF_INET, argv[0], &addr) != 1) {
+		vty_out(vty, "%% malformed IP address %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (gtp_overload_oci_peer_add(&ctx->gtpc.overload, addr) < 0) {
+		vty_out(vty, "%% no more than %d peers%s", GTP_OVERLOAD_OCI_PEER_MAX, VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_gtpc_router_overload_control_peer,
+      no_gtpc_router_overload_control_peer_cmd,
+      "no gtpc-overload-control peer A.B.C.D",
+      "GTP-C overload control\n"
+      "Peer supporting overload control\n"
+      "IPv4 Address\n")
+{
+	gtp_router_t *ctx = vty->index;
+	uint32_t addr;
+
+	if (inet_pton(AF_INET, argv[0], &addr) != 1) {
+		vty_out(vty, "%% malformed IP address %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (gtp_overload_oci_peer_del(&ctx->gtpc.overload, addr) < 0) {
+		vty_out(vty, "%% unknown peer %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(gtpu_router_tunnel_endpoint,
       gtpu_router_tunnel_endpoint_cmd,
       "gtpu-tunnel-endpoint (A.B.C.D|X:X:X:X) port <1024-65535> [listener-count [INTEGER]]",
@@ -208,6 +338,7 @@ gtp_config_write(vty_t *vty)
 					   , srv->thread_cnt);
 			vty_out(vty, "%s", VTY_NEWLINE);
 		}
+		gtp_overload_config_write(vty, &ctx->gtpc.overload);
 		srv = &ctx->gtpu;
 		if (__test_bit(GTP_FL_UPF_BIT, &srv->flags)) {
 			vty_out(vty, " gtpu-tunnel-endpoint %s port %d"
@@ -243,6 +374,7 @@ vty_server_worker(gtp_server_worker_t *w, void *arg)
 		     "    flags:%s%s"
 		     "    seed:%d pbuff:%p (len:%d size:%d bytes)%s"
 		     "    rx:%"PRIu64"bytes %"PRIu64"pkts | tx:%"PRIu64"bytes %"PRIu64"pkts%s"
+		     "    ie-dropped:%"PRIu64"%s"
 		   , w->pname
 		   , w->id
 		   , w->task
@@ -255,6 +387,8 @@ vty_server_worker(gtp_server_worker_t *w, void *arg)
 		   , VTY_NEWLINE
 		   , w->rx_bytes, w->rx_pkts
 		   , w->tx_bytes, w->tx_pkts
+		   , VTY_NEWLINE
+		   , (w->msg) ? w->msg->ie_dropped_total : 0
 		   , VTY_NEWLINE);
 
 	vty_out(vty, "    RX:%s", VTY_NEWLINE);
@@ -395,6 +529,12 @@ gtp_router_vty_init(void)
 	install_default(GTP_ROUTER_NODE);
 	install_element(GTP_ROUTER_NODE, &gtpc_router_tunnel_endpoint_cmd);
 	install_element(GTP_ROUTER_NODE, &gtpu_router_tunnel_endpoint_cmd);
+	install_element(GTP_ROUTER_NODE, &gtpc_router_admission_control_cmd);
+	install_element(GTP_ROUTER_NODE, &no_gtpc_router_admission_control_cmd);
+	install_element(GTP_ROUTER_NODE, &gtpc_router_overload_control_cmd);
+	install_element(GTP_ROUTER_NODE, &no_gtpc_router_overload_control_cmd);
+	install_element(GTP_ROUTER_NODE, &gtpc_router_overload_control_peer_cmd);
+	install_element(GTP_ROUTER_NODE, &no_gtpc_router_overload_control_peer_cmd);
 
 	install_element(VIEW_NODE, &show_workers_gtp_router_cmd);
 	install_element(ENABLE_NODE, &show_workers_gtp_router_cmd);
@@ -27,110 +27,327 @@
 
 
 /*
- *	Scheduling decision
+ *	Selection index
+ *
+ * Flattened view of a NAPTR list, built when the resolv cache is
+ * refreshed:
+ *   service (by prio) -> NAPTR (by order) -> priority group -> pGW
+ * Quiesced pGW (weight=0) are pruned at build time. Each pGW is bound
+ * to its GTP-C path so selection can skip dead peers and weight by
+ * measured latency. Once published the
+ * index is immutable, only pGW counters are atomically updated, so that
+ * selection runs without holding apn->mutex.
  */
-static gtp_pgw_t *
-gtp_sched_pgw_wlc(gtp_naptr_t *naptr, struct sockaddr_in *addr_skip)
+static int
+gtp_sched_naptr_count(gtp_naptr_t *naptr, uint32_t *nr_pgw)
 {
-	uint64_t loh = 0, doh;
-	gtp_pgw_t *pgw, *least = NULL;
-	struct sockaddr_in *paddr;
-	uint16_t priority = 0;
+	gtp_pgw_t *pgw;
+	int nr_group = 0, priority = -1;
 
-	/* Second stage: wlc over lower priority */
+	/* pgw list is sorted by priority */
 	list_for_each_entry(pgw, &naptr->pgw, next) {
-		paddr = (struct sockaddr_in *) &pgw->addr;
-		if (paddr->sin_addr.s_addr == addr_skip->sin_addr.s_addr)
+		if (!pgw->weight)
 			continue;
 
-		/* first least priority init */
-		if (!priority)
-			priority = pgw->priority;
+		if (pgw->priority != priority)
+			nr_group++;
+		priority = pgw->priority;
+		(*nr_pgw)++;
+	}
+
+	return nr_group;
+}
 
-		/* weight=0 is quiesced and will not receive any connections */
+static void
+gtp_sched_naptr_fill(gtp_sched_index_t *idx, gtp_naptr_t *naptr)
+{
+	gtp_sched_naptr_t *n = &idx->naptr[idx->nr_naptr++];
+	gtp_sched_group_t *g = NULL;
+	gtp_sched_pgw_t *p;
+	gtp_pgw_t *pgw;
+
+	n->order = naptr->order;
+	n->first = idx->nr_group;
+	list_for_each_entry(pgw, &naptr->pgw, next) {
 		if (!pgw->weight)
 			continue;
 
-		/* Switching to next priority */
-		if (!least && pgw->priority != priority)
-			priority = pgw->priority;
+		if (!g || g->priority != pgw->priority) {
+			g = &idx->group[idx->nr_group++];
+			g->priority = pgw->priority;
+			g->first = idx->nr_pgw;
+			n->nr++;
+		}
 
-		if (pgw->priority != priority)
+		p = &idx->pgw[idx->nr_pgw++];
+		p->addr = *(struct sockaddr_in *) &pgw->addr;
+		p->priority = pgw->priority;
+		p->weight = pgw->weight;
+		p->path = gtp_path_get(&p->addr, GTP_PATH_FL_PGW_BIT);
+		g->nr++;
+	}
+}
+
+static void
+gtp_sched_service_fill(gtp_sched_index_t *idx, gtp_naptr_t **naptr, const char *service)
+{
+	gtp_sched_service_t *s = &idx->service[idx->nr_service++];
+	uint32_t i, j, tmp;
+
+	s->first = idx->nr_sel;
+	for (i = 0; i < idx->nr_naptr; i++) {
+		if (!strstr(naptr[i]->service, service))
 			continue;
 
-		doh = __sync_add_and_fetch(&pgw->cnt, 0);
-		if (!doh) {
-			least = pgw;
-			break;
+		/* Stable insertion by order, only a few NAPTR per service */
+		for (j = idx->nr_sel++; j > s->first; j--) {
+			tmp = idx->sel[j - 1];
+			if (idx->naptr[tmp].order <= idx->naptr[i].order)
+				break;
+			idx->sel[j] = tmp;
 		}
+		idx->sel[j] = i;
+		s->nr++;
+	}
+}
 
-		/* The comparison of h1*w2 > h2*w1 is equivalent to that of
-		 * h1/w1 > h2/w2 */
-		if (!least || doh*least->weight < loh*pgw->weight) {
-			least = pgw;
-			loh = doh;
-		}
+gtp_sched_index_t *
+gtp_sched_index_build(list_head_t *naptr_list, list_head_t *service_list)
+{
+	uint32_t nr_naptr = 0, nr_group = 0, nr_pgw = 0, nr_service = 0, i;
+	gtp_sched_index_t *idx;
+	gtp_naptr_t *naptr, **naptrs;
+	gtp_service_t *service;
+
+	/* First stage: sizing */
+	list_for_each_entry(naptr, naptr_list, next) {
+		nr_group += gtp_sched_naptr_count(naptr, &nr_pgw);
+		nr_naptr++;
 	}
+	list_for_each_entry(service, service_list, next)
+		nr_service++;
 
-	if (!least)
+	PMALLOC(idx);
+	if (!idx)
 		return NULL;
+	idx->service = MALLOC(sizeof(gtp_sched_service_t) * (nr_service + 1));
+	idx->sel = MALLOC(sizeof(uint32_t) * (nr_service * nr_naptr + 1));
+	idx->naptr = MALLOC(sizeof(gtp_sched_naptr_t) * (nr_naptr + 1));
+	idx->group = MALLOC(sizeof(gtp_sched_group_t) * (nr_group + 1));
+	idx->pgw = MALLOC(sizeof(gtp_sched_pgw_t) * (nr_pgw + 1));
+	naptrs = MALLOC(sizeof(gtp_naptr_t *) * (nr_naptr + 1));
+	if (!idx->service || !idx->sel || !idx->naptr || !idx->group ||
+	    !idx->pgw || !naptrs) {
+		if (naptrs)
+			FREE(naptrs);
+		gtp_sched_index_free(idx);
+		return NULL;
+	}
 
-	__sync_add_and_fetch(&least->cnt, 1);
-	return least;
+	/* Second stage: NAPTR buckets, priority groups and pGW */
+	i = 0;
+	list_for_each_entry(naptr, naptr_list, next) {
+		naptrs[i++] = naptr;
+		gtp_sched_naptr_fill(idx, naptr);
+	}
+
+	/* Third stage: service selection list is already sorted by prio */
+	list_for_each_entry(service, service_list, next)
+		gtp_sched_service_fill(idx, naptrs, service->str);
+
+	FREE(naptrs);
+	return idx;
 }
 
-static gtp_pgw_t *
-gtp_sched_naptr(list_head_t *l, const char *service, struct sockaddr_in *addr_skip)
+void
+gtp_sched_index_free(gtp_sched_index_t *idx)
 {
-	gtp_naptr_t *naptr, *least = NULL;
-	gtp_pgw_t *pgw = NULL;
+	if (!idx)
+		return;
+
+	if (idx->service)
+		FREE(idx->service);
+	if (idx->sel)
+		FREE(idx->sel);
+	if (idx->naptr)
+		FREE(idx->naptr);
+	if (idx->group)
+		FREE(idx->group);
+	if (idx->pgw)
+		FREE(idx->pgw);
+	FREE(idx);
+}
 
-	/* First stage: Reset previous scheduling flags */
-	list_for_each_entry(naptr, l, next)
-		naptr->fl = 0;
 
-	/* Second stage : Schedule by order until pgw election */
-  shoot_again:
-	list_for_each_entry(naptr, l, next) {
-		if (!strstr(naptr->service, service) ||
-		    __test_bit(GTP_SCHEDULE_FL_SKIP, &naptr->fl))
-			continue;
+/*
+ *	Index publication
+ *
+ * Readers pin the published index with a refcount taken inside a grace
+ * period read-side section, see lib/grace.h.
+ */
+static void
+gtp_sched_index_release(grace_obj_t *obj)
+{
+	gtp_sched_index_free(container_of(obj, gtp_sched_index_t, gp));
+}
+
+static void
+__gtp_sched_index_publish(gtp_apn_t *apn, gtp_sched_index_t *idx)
+{
+	grace_ptr_publish(&apn->sched_index, (idx) ? &idx->gp : NULL
+					   , gtp_sched_index_release);
+}
+
+/* Must be called under apn->mutex */
+int
+__gtp_sched_index_rebuild(gtp_apn_t *apn)
+{
+	gtp_sched_index_t *idx;
+
+	idx = gtp_sched_index_build(&apn->naptr, &apn->service_selection);
+	if (!idx)
+		return -1;
+
+	__gtp_sched_index_publish(apn, idx);
+	return 0;
+}
+
+int
+gtp_sched_index_destroy(gtp_apn_t *apn)
+{
+	pthread_mutex_lock(&apn->mutex);
+	__gtp_sched_index_publish(apn, NULL);
+	pthread_mutex_unlock(&apn->mutex);
+	return 0;
+}
+
+static gtp_sched_index_t *
+gtp_sched_index_get(gtp_apn_t *apn)
+{
+	grace_obj_t *obj = grace_ptr_get(&apn->sched_index);
+
+	return (obj) ? container_of(obj, gtp_sched_index_t, gp) : NULL;
+}
+
+static void
+gtp_sched_index_put(gtp_sched_index_t *idx)
+{
+	grace_ptr_put(&idx->gp);
+}
+
+
+/*
+ *	Scheduling decision
+ */
+static uint32_t
+gtp_sched_rand(void)
+{
+	static __thread uint32_t seed;
 
-		if (!least || naptr->order < least->order)
-			least = naptr;
+	if (!seed)
+		seed = ((uint32_t) (uintptr_t) &seed ^ (uint32_t) time(NULL)) | 1;
+
+	/* xorshift32 */
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static inline bool
+gtp_sched_pgw_skip(gtp_sched_pgw_t *pgw, struct sockaddr_in *addr_skip, bool alive)
+{
+	if (alive && !gtp_path_is_alive(pgw->path))
+		return true;
+	return pgw->addr.sin_addr.s_addr == addr_skip->sin_addr.s_addr;
+}
+
+static inline uint64_t
+gtp_sched_pgw_weight(gtp_sched_pgw_t *pgw)
+{
+	return gtp_path_weight(pgw->path, pgw->weight);
+}
+
+static gtp_sched_pgw_t *
+gtp_sched_pgw_wlc(gtp_sched_index_t *idx, gtp_sched_group_t *g, struct sockaddr_in *addr_skip,
+		  bool alive)
+{
+	gtp_sched_pgw_t *pgw = &idx->pgw[g->first], *least = NULL, *a, *b;
+	uint64_t loh = 0, lw = 0, doh, w;
+	uint32_t i;
+
+	/* Power of two choices on large groups, fall back to full scan
+	 * if both candidates are to be skipped */
+	if (g->nr > GTP_SCHED_WLC_SCAN_MAX) {
+		a = &pgw[gtp_sched_rand() % g->nr];
+		b = &pgw[gtp_sched_rand() % g->nr];
+		if (gtp_sched_pgw_skip(a, addr_skip, alive))
+			a = b;
+		if (gtp_sched_pgw_skip(b, addr_skip, alive))
+			b = a;
+		if (!gtp_sched_pgw_skip(a, addr_skip, alive)) {
+			least = (__sync_add_and_fetch(&a->cnt, 0) * gtp_sched_pgw_weight(b) <=
+				 __sync_add_and_fetch(&b->cnt, 0) * gtp_sched_pgw_weight(a)) ? a : b;
+			goto end;
+		}
 	}
 
-	if (!least)
-		return NULL;
+	for (i = 0; i < g->nr; i++) {
+		if (gtp_sched_pgw_skip(&pgw[i], addr_skip, alive))
+			continue;
 
-	pgw = gtp_sched_pgw_wlc(least, addr_skip);
-	if (!pgw) {
-		__set_bit(GTP_SCHEDULE_FL_SKIP, &least->fl);
-		least = NULL;
-		/* Same player */
-		goto shoot_again;
+		doh = __sync_add_and_fetch(&pgw[i].cnt, 0);
+		if (!doh) {
+			least = &pgw[i];
+			break;
+		}
+
+		/* The comparison of h1*w2 > h2*w1 is equivalent to that of
+		 * h1/w1 > h2/w2 */
+		w = gtp_sched_pgw_weight(&pgw[i]);
+		if (!least || doh*lw < loh*w) {
+			least = &pgw[i];
+			loh = doh;
+			lw = w;
+		}
 	}
 
-	return pgw;
+  end:
+	if (least)
+		__sync_add_and_fetch(&least->cnt, 1);
+	return least;
 }
 
-static int
-gtp_sched_generic(gtp_apn_t *apn, list_head_t *l, struct sockaddr_in *addr, struct sockaddr_in *addr_skip)
+int
+gtp_sched_index_select(gtp_sched_index_t *idx, struct sockaddr_in *addr, struct sockaddr_in *addr_skip)
 {
-	gtp_service_t *service;
-	gtp_pgw_t *pgw = NULL;
+	gtp_sched_service_t *s;
+	gtp_sched_naptr_t *n;
+	gtp_sched_pgw_t *pgw;
+	uint32_t i, j, k;
+	int alive;
 
-	/* Service selection list is already sorted by prio */
-	pthread_mutex_lock(&apn->mutex);
-	list_for_each_entry(service, &apn->service_selection, next) {
-		pgw = gtp_sched_naptr(l, service->str, addr_skip);
-		if (pgw) {
-			*addr = *(struct sockaddr_in *) &pgw->addr;
-			pthread_mutex_unlock(&apn->mutex);
-			return 0;
+	if (!idx)
+		return -1;
+
+	/* First service, lowest NAPTR order and lowest pGW priority
+	 * holding an eligible pGW. Peers declared dead by path management
+	 * are only considered if nothing else is left */
+	for (alive = 1; alive >= 0; alive--) {
+		for (i = 0; i < idx->nr_service; i++) {
+			s = &idx->service[i];
+			for (j = s->first; j < s->first + s->nr; j++) {
+				n = &idx->naptr[idx->sel[j]];
+				for (k = n->first; k < n->first + n->nr; k++) {
+					pgw = gtp_sched_pgw_wlc(idx, &idx->group[k], addr_skip, alive);
+					if (pgw) {
+						*addr = pgw->addr;
+						return 0;
+					}
+				}
+			}
 		}
 	}
-	pthread_mutex_unlock(&apn->mutex);
 
 	return -1;
 }
@@ -138,39 +355,31 @@ gtp_sched_generic(gtp_apn_t *apn, list_head_t *l, struct sockaddr_in *addr, stru
 int
 gtp_sched(gtp_apn_t *apn, struct sockaddr_in *addr, struct sockaddr_in *addr_skip)
 {
-	return gtp_sched_generic(apn, &apn->naptr, addr, addr_skip);
+	gtp_sched_index_t *idx;
+	int err;
+
+	idx = gtp_sched_index_get(apn);
+	if (!idx)
+		return -1;
+
+	err = gtp_sched_index_select(idx, addr, addr_skip);
+	gtp_sched_index_put(idx);
+	return err;
 }
 
 int
 gtp_sched_dynamic(gtp_apn_t *apn, const char *apn_name, const char *plmn, struct sockaddr_in *addr, struct sockaddr_in *addr_skip)
 {
-	gtp_resolv_ctx_t *ctx;
-	list_head_t l;
-	int err = 0;
+	gtp_resolv_cache_data_t *data;
+	int err;
 
-	ctx = gtp_resolv_ctx_alloc(apn);
-	if (!ctx)
+	/* Resolution is performed asynchronously by resolver cache
+	 * workers, a miss is not waiting for it */
+	data = gtp_resolv_cache_get(apn, apn_name, plmn);
+	if (!data)
 		return -1;
 
-	INIT_LIST_HEAD(&l);
-	err = gtp_resolv_naptr(ctx, &l, "%s.apn.epc.%s.3gppnetwork.org.", apn_name, plmn);
-	if (err) {
-		log_message(LOG_INFO, "%s(): Unable to resolv apn:'%s.apn.epc.%s.3gppnetwork.org.'"
-				    , __FUNCTION__, apn_name, plmn);
-		goto end;
-	}
-
-	err = gtp_resolv_pgw(ctx, &l);
-	if (err) {
-		log_message(LOG_INFO, "%s(): Unable resolv pgw for apn:'%s.apn.epc.%s.3gppnetwork.org.'"
-				    , __FUNCTION__, apn_name, plmn);
-		goto end;
-	}
-
-	err = gtp_sched_generic(apn, &l, addr, addr_skip);
-
-  end:
-	gtp_resolv_ctx_destroy(ctx);
-	gtp_naptr_destroy(&l);
+	err = gtp_sched_index_select(data->sched, addr, addr_skip);
+	gtp_resolv_cache_put(data);
 	return err;
-}
\ No newline at end of file
+}
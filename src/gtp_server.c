@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <libbpf.h>
 
 /* local includes */
 #include "gtp_guard.h"
@@ -72,6 +73,129 @@ gtp_server_send(gtp_server_worker_t *w, int fd, struct sockaddr_in *addr)
 	return nbytes;
 }
 
+/*
+ *	SO_REUSEPORT steering eBPF related
+ */
+static int
+gtp_server_reuseport_load(gtp_server_t *srv)
+{
+	gtp_bpf_opts_t *bpf_opts = &daemon_data->bpf_gtpc_reuseport;
+	struct bpf_object *bpf_obj;
+	struct bpf_map *bpf_map;
+	struct reuseport_opts opts;
+	char errmsg[GTP_XDP_STRERR_BUFSIZE];
+	int err, key = 0;
+
+	if (!srv->teid_shard_bits) {
+		log_message(LOG_INFO, "%s(): listener-count:%d out of steering range. Ignoring"
+				    , __FUNCTION__, srv->thread_cnt);
+		return -1;
+	}
+
+	bpf_obj = bpf_object__open(bpf_opts->filename);
+	if (!bpf_obj) {
+		libbpf_strerror(errno, errmsg, GTP_XDP_STRERR_BUFSIZE);
+		log_message(LOG_INFO, "eBPF: error opening bpf file err:%d (%s)\n"
+				    , errno, errmsg);
+		return -1;
+	}
+
+	err = bpf_object__load(bpf_obj);
+	if (err) {
+		libbpf_strerror(err, errmsg, GTP_XDP_STRERR_BUFSIZE);
+		log_message(LOG_INFO, "eBPF: error loading bpf_object err:%d (%s)\n"
+				    , err, errmsg);
+		goto err;
+	}
+
+	srv->bpf_socks = bpf_object__find_map_by_name(bpf_obj, "reuseport_socks");
+	bpf_map = bpf_object__find_map_by_name(bpf_obj, "reuseport_opts");
+	if (!srv->bpf_socks || !bpf_map) {
+		log_message(LOG_INFO, "eBPF: error mapping:%s\n"
+				    , (!bpf_map) ? "reuseport_opts" : "reuseport_socks");
+		goto err;
+	}
+
+	memset(&opts, 0, sizeof(struct reuseport_opts));
+	opts.max_id = srv->thread_cnt;
+	opts.shard_bits = srv->teid_shard_bits;
+	err = bpf_map__update_elem(bpf_map, &key, sizeof(int)
+					  , &opts, sizeof(struct reuseport_opts)
+					  , BPF_ANY);
+	if (err) {
+		libbpf_strerror(err, errmsg, GTP_XDP_STRERR_BUFSIZE);
+		log_message(LOG_INFO, "eBPF: error setting option in map:%s (%s)\n"
+				    , "reuseport_opts", errmsg);
+		goto err;
+	}
+
+	srv->bpf_obj = bpf_obj;
+	return 0;
+
+  err:
+	srv->bpf_socks = NULL;
+	bpf_object__close(bpf_obj);
+	return -1;
+}
+
+static int
+gtp_server_reuseport_attach(gtp_server_t *srv, int fd)
+{
+	struct bpf_program *bpf_prog;
+
+	if (fd < 0)
+		return fd;
+
+	bpf_prog = bpf_object__next_program(srv->bpf_obj, NULL);
+	if (!bpf_prog) {
+		log_message(LOG_INFO, "eBPF: no program found in file:%s\n"
+				    , daemon_data->bpf_gtpc_reuseport.filename);
+		close(fd);
+		return -1;
+	}
+
+	/* Program is shared by the whole reuseport group, attaching
+	 * again from every worker is harmless and makes us independent
+	 * of worker startup ordering */
+	return if_setsockopt_attach_reuseport_bpf(fd, bpf_program__fd(bpf_prog));
+}
+
+static int
+gtp_server_reuseport_register(gtp_server_worker_t *w)
+{
+	gtp_server_t *srv = w->srv;
+	char errmsg[GTP_XDP_STRERR_BUFSIZE];
+	__u32 key = w->id;
+	__u64 value = w->fd;
+	int err;
+
+	err = bpf_map__update_elem(srv->bpf_socks, &key, sizeof(__u32)
+					      , &value, sizeof(__u64)
+					      , BPF_ANY);
+	if (err) {
+		libbpf_strerror(err, errmsg, GTP_XDP_STRERR_BUFSIZE);
+		log_message(LOG_INFO, "%s(): %s: error registering socket (%s)"
+				    , __FUNCTION__, w->pname, errmsg);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+gtp_server_teid_shard_init(gtp_server_t *srv)
+{
+	int bits;
+
+	/* Worker id lives in VTEID high-bits. Keep at least 24bits
+	 * of randomness for allocation */
+	bits = (srv->thread_cnt > 1) ? 32 - __builtin_clz(srv->thread_cnt - 1) : 0;
+	if (srv->thread_cnt > GTP_REUSEPORT_MAX_WORKERS)
+		bits = 0;
+
+	srv->teid_shard_bits = bits;
+}
+
 static int
 gtp_server_udp_init(gtp_server_t *srv)
 {
@@ -106,6 +230,10 @@ gtp_server_udp_init(gtp_server_t *srv)
 		return -1;
 	}
 
+	/* Steering is enabled as soon as the socket is in the group */
+	if (srv->bpf_obj)
+		fd = gtp_server_reuseport_attach(srv, fd);
+
 	return fd;
 }
 
@@ -117,6 +245,7 @@ gtp_server_worker_task(void *arg)
 	struct sockaddr_storage *addr = &srv->addr;
 	struct sockaddr_storage addr_from;
 	socklen_t addrlen = sizeof(addr_from);
+	uint64_t start;
 	ssize_t nbytes;
 	int fd;
 
@@ -136,6 +265,8 @@ gtp_server_worker_task(void *arg)
 
 	/* So far so good */
 	w->fd = fd;
+	if (srv->bpf_obj)
+		gtp_server_reuseport_register(w);
 	__set_bit(GTP_FL_RUNNING_BIT, &w->flags);
 
 	/* Infinita tristessa */
@@ -152,8 +283,19 @@ gtp_server_worker_task(void *arg)
 		}
 		pkt_buffer_set_end_pointer(w->pbuff, nbytes);
 
+		/* Admission & overload control */
+		start = 0;
+		if (w->overload && srv->overload.flags) {
+			start = gtp_overload_usec();
+			if (gtp_overload_admit(w, &addr_from, start) < 0)
+				continue;
+		}
+
 		/* Process incoming buffer */
 		(*srv->process) (w, &addr_from);
+
+		if (start)
+			gtp_overload_account(w, start);
 	}
 
   end:
@@ -191,6 +333,11 @@ gtp_server_worker_alloc(gtp_server_t *srv, int id)
 	worker->seed = time(NULL);
 	srand(worker->seed);
 	worker->pbuff = pkt_buffer_alloc(GTP_BUFFER_SIZE);
+	worker->msg = gtp_msg_alloc(NULL);
+	if (__test_bit(GTP_FL_CTL_BIT, &srv->flags)) {
+		worker->replay = gtp_replay_alloc(GTP_REPLAY_ENTRIES);
+		worker->overload = gtp_overload_worker_alloc();
+	}
 
 	pthread_mutex_lock(&srv->workers_mutex);
 	list_add_tail(&worker->next, &srv->workers);
@@ -204,6 +351,9 @@ gtp_server_worker_destroy(gtp_server_worker_t *w)
 {
 	list_head_del(&w->next);
 	pkt_buffer_free(w->pbuff);
+	gtp_msg_destroy(w->msg);
+	gtp_replay_free(w->replay);
+	gtp_overload_worker_free(w->overload);
 	FREE(w);
 	return 0;
 }
@@ -229,6 +379,10 @@ gtp_server_start(gtp_server_t *srv)
 	if (!__test_bit(GTP_FL_RUNNING_BIT, &srv->flags))
 	    return -1;
 
+	if (__test_bit(GTP_FL_CTL_BIT, &srv->flags) &&
+	    __test_bit(GTP_FL_GTPC_REUSEPORT_LOADED_BIT, &daemon_data->flags))
+		gtp_server_reuseport_load(srv);
+
 	gtp_server_worker_launch(srv);
 
 	return 0;
@@ -246,6 +400,9 @@ gtp_server_init(gtp_server_t *srv, void *ctx
 	srv->ctx = ctx;
 	srv->init = init;
 	srv->process = process;
+	gtp_server_teid_shard_init(srv);
+	if (__test_bit(GTP_FL_CTL_BIT, &srv->flags))
+		gtp_overload_init(&srv->overload);
 	for (i = 0; i < srv->thread_cnt; i++)
 		gtp_server_worker_alloc(srv, i);
 
@@ -269,6 +426,12 @@ gtp_server_destroy(gtp_server_t *srv)
 		gtp_server_worker_destroy(w);
 	}
 	pthread_mutex_unlock(&srv->workers_mutex);
+	gtp_overload_destroy(&srv->overload);
+
+	if (srv->bpf_obj)
+		bpf_object__close(srv->bpf_obj);
+	srv->bpf_obj = NULL;
+	srv->bpf_socks = NULL;
 
 	return 0;
 }
@@ -38,7 +38,11 @@ extern thread_master_t *master;
 
 /* Local data */
 static uint32_t gtp_session_id;
+static int gtp_session_count;
 static timer_thread_t gtp_session_timer;
+static gtp_oatab_t gtp_session_index[GTP_SESSION_IDX_MAX];
+static gtp_oatab_t gtp_session_index_prev[GTP_SESSION_IDX_MAX];
+static uint64_t gtp_session_index_conflict[GTP_SESSION_IDX_MAX];
 
 
 /*
@@ -206,23 +210,35 @@ gtp_session_alloc(gtp_conn_t *c, gtp_apn_t *apn,
 	INIT_LIST_HEAD(&new->gtpc_teid);
 	INIT_LIST_HEAD(&new->gtpu_teid);
 	INIT_LIST_HEAD(&new->next);
+	INIT_LIST_HEAD(&new->path_next);
 	timer_node_init(&new->t_node, NULL, new);
 	new->apn = apn;
 	new->conn = c;
 	new->gtpc_teid_destroy = gtpc_destroy;
 	new->gtpu_teid_destroy = gtpu_destroy;
-	time_now_to_calendar(&new->creation_time);
+	new->creation_time = time_now.tv_sec;
 	/* This is a local session id, simply monotonically incremented */
 	__sync_add_and_fetch(&gtp_session_id, 1);
 	new->id = gtp_session_id;
 
 	gtp_session_add(c, new);
 	gtp_session_add_timer(new);
+	__sync_add_and_fetch(&gtp_session_count, 1);
 
 	return new;
 }
 
 
+/* Restored sessions keep their id, new ones are numbered above */
+void
+gtp_session_id_update(uint32_t id)
+{
+	uint32_t cur = gtp_session_id;
+
+	while (cur < id && !__sync_bool_compare_and_swap(&gtp_session_id, cur, id))
+		cur = gtp_session_id;
+}
+
 static int
 __gtp_session_gtpc_teid_destroy(gtp_teid_t *teid)
 {
@@ -324,13 +340,205 @@ __gtp_session_send_delete_bearer(gtp_session_t *s)
 	return 0;
 }
 
-static int
-__gtp_session_destroy(gtp_session_t *s)
+/*
+ *	Secondary indexes
+ *
+ * Index value is owner IMSI, not a session pointer: lookups are
+ * lock-free while sessions are released under conn lock. Resolving
+ * through conn refcounting keeps lookups safe, session is then
+ * matched under session_mutex. Sessions of a conn sharing the same
+ * key share one entry. A key showing up on another conn overrides
+ * previous owner (MSISDN recycling, overlapping APN pools). Displaced
+ * owner is kept aside and restored when the new one releases the key.
+ * Only last displaced owner is remembered, and it may be stale by
+ * then: lookups match sessions anyway, a stale owner is just a miss.
+ */
+static uint64_t
+gtp_session_index_key(gtp_session_t *s, int idx)
+{
+	return (idx == GTP_SESSION_IDX_MSISDN) ? s->msisdn : s->ipv4;
+}
+
+/* Caller holds session_mutex */
+static void
+__gtp_session_index_del(gtp_session_t *s, int idx)
+{
+	uint64_t key = gtp_session_index_key(s, idx);
+	gtp_conn_t *c = s->conn;
+	void *imsi = (void *) (uintptr_t) c->imsi;
+	gtp_session_t *_s;
+	void *prev;
+
+	if (!key)
+		return;
+
+	list_for_each_entry(_s, &c->gtp_sessions, next) {
+		if (_s != s && gtp_session_index_key(_s, idx) == key)
+			return;
+	}
+
+	/* Not owner anymore, just leave displaced list */
+	if (gtp_oatab_del(&gtp_session_index[idx], key, imsi) < 0) {
+		gtp_oatab_del(&gtp_session_index_prev[idx], key, imsi);
+		return;
+	}
+
+	/* Give key back to displaced owner, unless someone else took
+	 * it meanwhile */
+	prev = gtp_oatab_get(&gtp_session_index_prev[idx], key);
+	if (prev && !gtp_oatab_del(&gtp_session_index_prev[idx], key, prev))
+		gtp_oatab_add(&gtp_session_index[idx], key, prev);
+}
+
+/* Caller holds session_mutex */
+static void
+__gtp_session_index_add(gtp_session_t *s, int idx)
+{
+	uint64_t key = gtp_session_index_key(s, idx);
+	void *imsi = (void *) (uintptr_t) s->conn->imsi;
+	gtp_oatab_t *t = &gtp_session_index[idx];
+	void *owner;
+
+	if (!key)
+		return;
+
+	if (gtp_oatab_get(t, key) == imsi)
+		return;
+
+	/* Conns are only serialized by their own session_mutex: take
+	 * the key over atomically */
+	if (gtp_oatab_replace(t, key, imsi, &owner) < 0)
+		return;
+	if (!owner || owner == imsi)
+		return;
+
+	__sync_add_and_fetch(&gtp_session_index_conflict[idx], 1);
+	gtp_oatab_replace(&gtp_session_index_prev[idx], key, owner, &owner);
+}
+
+/* Caller holds session_mutex */
+static void
+__gtp_session_index_set(gtp_session_t *s, int idx, uint64_t key)
+{
+	if (gtp_session_index_key(s, idx) == key)
+		return;
+
+	__gtp_session_index_del(s, idx);
+	if (idx == GTP_SESSION_IDX_MSISDN)
+		s->msisdn = key;
+	else
+		s->ipv4 = key;
+	__gtp_session_index_add(s, idx);
+}
+
+static void
+gtp_session_index_set(gtp_session_t *s, int idx, uint64_t key)
 {
 	gtp_conn_t *c = s->conn;
 
 	pthread_mutex_lock(&c->session_mutex);
+	__gtp_session_index_set(s, idx, key);
+	pthread_mutex_unlock(&c->session_mutex);
+}
+
+void
+__gtp_session_set_msisdn(gtp_session_t *s, uint64_t msisdn)
+{
+	__gtp_session_index_set(s, GTP_SESSION_IDX_MSISDN, msisdn);
+}
+
+void
+gtp_session_set_msisdn(gtp_session_t *s, uint64_t msisdn)
+{
+	gtp_session_index_set(s, GTP_SESSION_IDX_MSISDN, msisdn);
+}
+
+void
+__gtp_session_set_ipv4(gtp_session_t *s, uint32_t ipv4)
+{
+	__gtp_session_index_set(s, GTP_SESSION_IDX_IPV4, ipv4);
+}
+
+void
+gtp_session_set_ipv4(gtp_session_t *s, uint32_t ipv4)
+{
+	gtp_session_index_set(s, GTP_SESSION_IDX_IPV4, ipv4);
+}
+
+/* Return conn with a ref held, caller looks for matching sessions
+ * under session_mutex then releases conn */
+gtp_conn_t *
+gtp_session_conn_get_by_index(int idx, uint64_t key)
+{
+	void *imsi;
+
+	if (!key || idx >= GTP_SESSION_IDX_MAX)
+		return NULL;
 
+	imsi = gtp_oatab_get(&gtp_session_index[idx], key);
+	if (!imsi)
+		return NULL;
+
+	return gtp_conn_get_by_imsi((uintptr_t) imsi);
+}
+
+bool
+gtp_session_index_match(gtp_session_t *s, int idx, uint64_t key)
+{
+	return gtp_session_index_key(s, idx) == key;
+}
+
+
+/*
+ *	APN pool leases
+ */
+int
+gtp_session_ip_pool_get(gtp_session_t *s)
+{
+	gtp_apn_t *apn = s->apn;
+	int shard = (s->w) ? s->w->id : 0;
+	uint8_t ptype = s->ptype & 0x07;
+
+	/* Single stack request on an APN only offering the other
+	 * family. Dual stack one gets whichever is offered */
+	if ((ptype == GTP_PAA_IPV4_TYPE && !apn->ip_pool && apn->ip6_pool) ||
+	    (ptype == GTP_PAA_IPV6_TYPE && !apn->ip6_pool && apn->ip_pool))
+		return GTP_SESSION_POOL_PTYPE_UNSUPPORTED;
+
+	if (apn->ip_pool && ptype != GTP_PAA_IPV6_TYPE) {
+		s->ipv4_lease = gtp_ip_pool_get(apn, shard);
+		if (!s->ipv4_lease)
+			return GTP_SESSION_POOL_EXHAUSTED;
+		gtp_session_set_ipv4(s, s->ipv4_lease);
+	}
+
+	if (apn->ip6_pool && ptype != GTP_PAA_IPV4_TYPE) {
+		if (gtp_ip6_pool_get(apn, shard, &s->ipv6_prefix) < 0) {
+			gtp_session_ip_pool_put(s);
+			return GTP_SESSION_POOL_EXHAUSTED;
+		}
+	}
+
+	return 0;
+}
+
+int
+gtp_session_ip_pool_put(gtp_session_t *s)
+{
+	gtp_apn_t *apn = s->apn;
+	int shard = (s->w) ? s->w->id : 0;
+
+	gtp_ip_pool_put(apn, shard, s->ipv4_lease);
+	gtp_ip6_pool_put(apn, shard, &s->ipv6_prefix);
+	s->ipv4_lease = 0;
+	memset(&s->ipv6_prefix, 0, sizeof(struct in6_addr));
+	return 0;
+}
+
+/* Caller holds session_mutex, conn refcnt is left to caller */
+static void
+__gtp_session_release(gtp_session_t *s)
+{
 	/* Send Delete-Bearer-Request if needed */
 	if (s->action == GTP_ACTION_SEND_DELETE_BEARER_REQUEST)
 		__gtp_session_send_delete_bearer(s);
@@ -341,20 +549,49 @@ __gtp_session_destroy(gtp_session_t *s)
 	/* Release PPPoE related */
 	__spppoe_destroy(s->s_pppoe);
 
+	/* Release APN pool leases */
+	gtp_session_ip_pool_put(s);
+
+	/* Release peer tracking. Expiration may have been requested
+	 * meanwhile by path purge */
+	gtp_path_session_unregister(s);
+	timer_node_del(&gtp_session_timer, &s->t_node);
+
+	/* Drop checkpoint image */
+	gtp_ckpt_session_del(s);
+
+	/* Drop secondary indexes */
+	__gtp_session_index_del(s, GTP_SESSION_IDX_MSISDN);
+	__gtp_session_index_del(s, GTP_SESSION_IDX_IPV4);
+
 	/* Release session */
 	list_head_del(&s->next);
 	FREE(s);
+	__sync_sub_and_fetch(&gtp_session_count, 1);
+}
 
-	pthread_mutex_unlock(&c->session_mutex);
-
+static void
+gtp_session_conn_release(gtp_conn_t *c, int cnt)
+{
 	/* Release connection if no more sessions */
-	if (__sync_sub_and_fetch(&c->refcnt, 1) == 0) {
+	if (__sync_sub_and_fetch(&c->refcnt, cnt) == 0) {
 		gtp_conn_unhash(c);
 		log_message(LOG_INFO, "IMSI:%ld - no more sessions - Releasing tracking"
 				    , c->imsi);
-		FREE(c);
+		gtp_conn_free(c);
 	}
+}
+
+static int
+__gtp_session_destroy(gtp_session_t *s)
+{
+	gtp_conn_t *c = s->conn;
 
+	pthread_mutex_lock(&c->session_mutex);
+	__gtp_session_release(s);
+	pthread_mutex_unlock(&c->session_mutex);
+
+	gtp_session_conn_release(c, 1);
 	return 0;
 }
 
@@ -441,6 +678,12 @@ gtp_session_destroy_teid(gtp_teid_t *teid)
 int
 gtp_session_expire_now(gtp_session_t *s)
 {
+	/* Session without lifetime are not queued yet */
+	if (!timer_node_pending(&s->t_node)) {
+		timer_node_add(&gtp_session_timer, &s->t_node, 0);
+		return 0;
+	}
+
 	timer_node_expire_now(&gtp_session_timer, &s->t_node);
 	return 0;
 }
@@ -456,20 +699,32 @@ __gtp_session_expire(void *arg)
 	return 0;
 }
 
-static int
-gtp_sessions_release(gtp_conn_t *c)
+/* Release sessions selected by match(), caller reference on conn
+ * is consumed. Sessions whose expiration is already running are
+ * left to session timer. */
+int
+gtp_sessions_reap(gtp_conn_t *c, int (*match) (gtp_session_t *, void *), void *arg)
 {
 	list_head_t *l = &c->gtp_sessions;
 	gtp_session_t *s, *_s;
+	int cnt = 0;
 
-	/* Release sessions */
 	pthread_mutex_lock(&c->session_mutex);
 	list_for_each_entry_safe(s, _s, l, next) {
-		gtp_session_expire_now(s);
+		if (match && !(*match) (s, arg))
+			continue;
+
+		if (timer_node_del(&gtp_session_timer, &s->t_node) < 0 &&
+		    s->apn->session_lifetime)
+			continue;
+
+		__gtp_session_release(s);
+		cnt++;
 	}
 	pthread_mutex_unlock(&c->session_mutex);
 
-	return 0;
+	gtp_session_conn_release(c, cnt + 1);
+	return cnt;
 }
 
 int
@@ -483,6 +738,7 @@ gtp_sessions_free(gtp_conn_t *c)
 		__gtp_session_teid_destroy(s);
 		list_head_del(&s->next);
 		FREE(s);
+		__sync_sub_and_fetch(&gtp_session_count, 1);
 	}
 	pthread_mutex_unlock(&c->session_mutex);
 
@@ -490,20 +746,43 @@ gtp_sessions_free(gtp_conn_t *c)
 }
 
 
+int
+gtp_sessions_count(void)
+{
+	return gtp_session_count;
+}
+
+
 /*
  *	Session tracking init
  */
 int
 gtp_sessions_init(void)
 {
-	timer_thread_init(&gtp_session_timer, "gtp-session-timer", __gtp_session_expire);
+	int i;
+
+	timer_thread_wheel_init(&gtp_session_timer, "gtp-session-timer",
+				__gtp_session_expire, GTP_SESSION_TIMER_SHARDS);
+
+	/* MSISDN and IMSI are both 15 digits integers, share conn
+	 * hash function setting */
+	for (i = 0; i < GTP_SESSION_IDX_MAX; i++) {
+		gtp_oatab_init(&gtp_session_index[i], CONN_HASHTAB_SIZE, GTP_HASH_CONN);
+		gtp_oatab_init(&gtp_session_index_prev[i], 0, GTP_HASH_CONN);
+	}
 	return 0;
 }
 
 int
 gtp_sessions_destroy(void)
 {
+	int i;
+
 	timer_thread_destroy(&gtp_session_timer);
+	for (i = 0; i < GTP_SESSION_IDX_MAX; i++) {
+		gtp_oatab_destroy(&gtp_session_index[i]);
+		gtp_oatab_destroy(&gtp_session_index_prev[i]);
+	}
 	return 0;
 }
 
@@ -560,31 +839,40 @@ __gtp_session_teid_up_vty(vty_t *vty, list_head_t *l)
 	return 0;
 }
 
+static const char *
+gtp_session_expire_str(gtp_session_t *s, char *dst, size_t dsize)
+{
+	if (!timerisset(&s->t_node.sands))
+		return "never";
+
+	snprintf(dst, dsize, "%ld secs", s->t_node.sands.tv_sec - time_now.tv_sec);
+	return dst;
+}
+
 int
 gtp_session_vty(vty_t *vty, gtp_conn_t *c)
 {
 	list_head_t *l = &c->gtp_sessions;
-	time_t timeout = 0;
+	char expire_str[64];
 	gtp_session_t *s;
-	struct tm *t;
+	struct tm tm, *t = &tm;
 
 	/* Walk the line */
 	pthread_mutex_lock(&c->session_mutex);
 	list_for_each_entry(s, l, next) {
-		if (timerisset(&s->t_node.sands)) {
-			timeout = s->t_node.sands.tv_sec - time_now.tv_sec;
-			snprintf(s->tmp_str, 63, "%ld secs", timeout);
-		}
-
-		t = &s->creation_time;
-		vty_out(vty, " session-id:0x%.8x apn:%s imsi:%ld creation:%.2d/%.2d/%.2d-%.2d:%.2d:%.2d expire:%s pppoe cnt:%d%s"
+		localtime_r(&s->creation_time, t);
+		vty_out(vty, " session-id:0x%.8x apn:%s imsi:%ld creation:%.2d/%.2d/%.2d-%.2d:%.2d:%.2d expire:%s pppoe cnt:%d%s%s"
 			   , s->id, s->apn->name
 			   , c->imsi
 			   , t->tm_mday, t->tm_mon+1, t->tm_year+1900
 			   , t->tm_hour, t->tm_min, t->tm_sec
-			   , timerisset(&s->t_node.sands) ? s->tmp_str : "never"
+			   , gtp_session_expire_str(s, expire_str, sizeof(expire_str))
 			   , c->pppoe_cnt
+			   , __test_bit(GTP_SESSION_FL_REPLICA_BIT, &s->flags) ? " (replica)" : ""
 			   , VTY_NEWLINE);
+		if (s->msisdn || s->ipv4)
+			vty_out(vty, "  msisdn:%lu ue-ipv4:%u.%u.%u.%u%s"
+				   , s->msisdn, NIPQUAD(s->ipv4), VTY_NEWLINE);
 		if (s->s_pppoe)
 			vty_out(vty, "  pppuser:%s%s" , s->s_pppoe->gtp_username , VTY_NEWLINE);
 		__gtp_session_teid_cp_vty(vty, &s->gtpc_teid);
@@ -598,22 +886,17 @@ int
 gtp_session_summary_vty(vty_t *vty, gtp_conn_t *c)
 {
 	list_head_t *l = &c->gtp_sessions;
-	time_t timeout = 0;
+	char expire_str[64];
 	gtp_session_t *s;
 	gtp_apn_t *apn = NULL;
 
 	/* Walk the line */
 	pthread_mutex_lock(&c->session_mutex);
 	list_for_each_entry(s, l, next) {
-		if (timerisset(&s->t_node.sands)) {
-			timeout = s->t_node.sands.tv_sec - time_now.tv_sec;
-			snprintf(s->tmp_str, 63, "%ld secs", timeout);
-		}
-
 		if (!apn) {
 			vty_out(vty, "| %.15ld | %10s |  session-id:0x%.8x #teid:%.2d expiration:%11s |%s"
 				   , c->imsi, s->apn->name, s->id, s->refcnt
-				   , timerisset(&s->t_node.sands) ? s->tmp_str : "never"
+				   , gtp_session_expire_str(s, expire_str, sizeof(expire_str))
 				   , VTY_NEWLINE);
 			apn = s->apn;
 			continue;
@@ -622,7 +905,7 @@ gtp_session_summary_vty(vty_t *vty, gtp_conn_t *c)
 		vty_out(vty, "|                 | %10s |  session-id:0x%.8x #teid:%.2d expiration:%11s |%s"
 			   , (apn == s->apn) ? "" : s->apn->name
 			   , s->id, s->refcnt
-			   , timerisset(&s->t_node.sands) ? s->tmp_str : "never"
+			   , gtp_session_expire_str(s, expire_str, sizeof(expire_str))
 			   , VTY_NEWLINE);
 		apn = s->apn;
 	}
@@ -656,6 +939,90 @@ DEFUN(show_gtp_session,
 		     "+-----------------+------------+--------------------------------------------------------+%s"
 		   , VTY_NEWLINE, VTY_NEWLINE, VTY_NEWLINE);
 	gtp_conn_vty(vty, gtp_session_summary_vty, 0);
+	gtp_conn_tab_vty(vty);
+	return CMD_SUCCESS;
+}
+
+static int
+gtp_session_index_vty(vty_t *vty, int idx, uint64_t key)
+{
+	gtp_conn_t *c;
+
+	c = gtp_session_conn_get_by_index(idx, key);
+	if (!c) {
+		vty_out(vty, "%% no session found%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	gtp_session_vty(vty, c);
+	gtp_conn_put(c);
+	return CMD_SUCCESS;
+}
+
+DEFUN(show_gtp_session_msisdn,
+      show_gtp_session_msisdn_cmd,
+      "show gtp session msisdn INTEGER",
+      SHOW_STR
+      "GTP related informations\n"
+      "GTP Session tracking\n"
+      "Lookup by MSISDN\n"
+      "MSISDN to look for\n")
+{
+	return gtp_session_index_vty(vty, GTP_SESSION_IDX_MSISDN
+					, strtoull(argv[0], NULL, 10));
+}
+
+DEFUN(show_gtp_session_ipv4,
+      show_gtp_session_ipv4_cmd,
+      "show gtp session ipv4 A.B.C.D",
+      SHOW_STR
+      "GTP related informations\n"
+      "GTP Session tracking\n"
+      "Lookup by UE IPv4 Address\n"
+      "IPv4 Address\n")
+{
+	uint32_t addr;
+
+	if (!inet_ston(argv[0], &addr)) {
+		vty_out(vty, "%% malformed IPv4 address %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return gtp_session_index_vty(vty, GTP_SESSION_IDX_IPV4, addr);
+}
+
+DEFUN(show_gtp_memory,
+      show_gtp_memory_cmd,
+      "show gtp memory",
+      SHOW_STR
+      "GTP related informations\n"
+      "Per object memory accounting\n")
+{
+	int nr_session = gtp_sessions_count();
+	int nr_teid = gtp_teid_count();
+	int nr_conn = gtp_conn_count();
+
+	vty_out(vty, " %-14s %6s %10s %14s%s"
+		   , "object", "size", "count", "bytes", VTY_NEWLINE);
+	vty_out(vty, " %-14s %6zu %10d %14zu%s"
+		   , "gtp_conn_t", sizeof(gtp_conn_t), nr_conn
+		   , nr_conn * sizeof(gtp_conn_t), VTY_NEWLINE);
+	vty_out(vty, " %-14s %6zu %10d %14zu%s"
+		   , "gtp_session_t", sizeof(gtp_session_t), nr_session
+		   , nr_session * sizeof(gtp_session_t), VTY_NEWLINE);
+	vty_out(vty, " %-14s %6zu %10d %14zu (unused:%d)%s"
+		   , "gtp_teid_t", sizeof(gtp_teid_t), nr_teid
+		   , nr_teid * sizeof(gtp_teid_t)
+		   , gtp_teid_unuse_queue_size(), VTY_NEWLINE);
+	gtp_conn_tab_vty(vty);
+	vty_out(vty, "MSISDN index: %u entries, %zu bytes, %lu conflicts%s"
+		     "UE IPv4 index: %u entries, %zu bytes, %lu conflicts%s"
+		   , gtp_oatab_count(&gtp_session_index[GTP_SESSION_IDX_MSISDN])
+		   , gtp_oatab_memory(&gtp_session_index[GTP_SESSION_IDX_MSISDN])
+		   , gtp_session_index_conflict[GTP_SESSION_IDX_MSISDN], VTY_NEWLINE
+		   , gtp_oatab_count(&gtp_session_index[GTP_SESSION_IDX_IPV4])
+		   , gtp_oatab_memory(&gtp_session_index[GTP_SESSION_IDX_IPV4])
+		   , gtp_session_index_conflict[GTP_SESSION_IDX_IPV4], VTY_NEWLINE);
 	return CMD_SUCCESS;
 }
 
@@ -682,8 +1049,10 @@ DEFUN(clear_gtp_session,
 		return CMD_WARNING;
 	}
 
-	gtp_sessions_release(c);
 	gtp_conn_put(c);
+
+	/* Released in background */
+	gtp_reaper_job_add(GTP_REAPER_JOB_IMSI, imsi, imsi, NULL, 0);
 	return CMD_SUCCESS;
 }
 
@@ -697,6 +1066,12 @@ gtp_sessions_vty_init(void)
 	/* Install show commands */
 	install_element(VIEW_NODE, &show_gtp_session_cmd);
 	install_element(ENABLE_NODE, &show_gtp_session_cmd);
+	install_element(VIEW_NODE, &show_gtp_session_msisdn_cmd);
+	install_element(ENABLE_NODE, &show_gtp_session_msisdn_cmd);
+	install_element(VIEW_NODE, &show_gtp_session_ipv4_cmd);
+	install_element(ENABLE_NODE, &show_gtp_session_ipv4_cmd);
+	install_element(VIEW_NODE, &show_gtp_memory_cmd);
+	install_element(ENABLE_NODE, &show_gtp_memory_cmd);
 	install_element(ENABLE_NODE, &clear_gtp_session_cmd);
 
 	return 0;
@@ -39,7 +39,7 @@
 static struct hlist_head *
 gtp_sqn_hashkey(gtp_htab_t *h, uint32_t id)
 {
-	return h->htab + (jhash_1word(id, 0) & CONN_HASHTAB_MASK);
+	return h->htab + (gtp_hash_1word(GTP_HASH_SQN, id) & CONN_HASHTAB_MASK);
 }
 
 static gtp_teid_t *
@@ -125,24 +125,26 @@ gtp_vsqn_alloc(gtp_server_worker_t *w, gtp_teid_t *teid, bool set_msb)
 	gtp_hdr_t *gtph = (gtp_hdr_t *) w->pbuff->head;
 	gtp_server_t *srv = w->srv;
 	gtp_switch_t *ctx = srv->ctx;
-	uint32_t *sqn = &ctx->seqnum;
-	uint32_t sqn_max = ~(1 << 31) >> 8; /* MSB is reserved */
-	uint32_t vsqn;
+	uint32_t sqn, vsqn;
 
-	/* nbytes counter circle */
-	if (!*sqn || *sqn >= sqn_max)
-		*sqn = 0x0f;
-	__sync_add_and_fetch(sqn, 1);
+	/* Previous one goes back to pool */
+	if (__test_bit(GTP_TEID_FL_VSQN_HASHED, &teid->flags))
+		gtp_switch_vsqn_release(ctx, teid);
+
+	/* Counter circle, skipping values still in use */
+	if (gtp_idpool_get(ctx->vsqn_pool, &sqn) < 0) {
+		log_message(LOG_INFO, "%s(): VSQN pool exhausted for TEID:0x%.8x"
+				    , __FUNCTION__, ntohl(teid->id));
+		return -1;
+	}
 
 	/* In GTPv2 simply shift 8bit for spare field */
-	vsqn = (gtph->version == 2) ? *sqn << 8 : *sqn;
+	vsqn = (gtph->version == 2) ? sqn << 8 : sqn;
 
 	if (set_msb)
 		vsqn |= 1 << 31;
 
 	/* Hash it */
-	if (__test_bit(GTP_TEID_FL_VSQN_HASHED, &teid->flags))
-		gtp_vsqn_unhash(&ctx->vsqn_tab, teid);
 	gtp_vsqn_hash(&ctx->vsqn_tab, teid, vsqn);
 
 	return 0;
@@ -40,6 +40,19 @@ extern thread_master_t *master;
 /*
  *	Helpers
  */
+static void
+gtp_switch_vteid_release(gtp_switch_t *ctx, gtp_teid_t *teid)
+{
+	int id = 0;
+
+	if (gtp_vteid_unhash(&ctx->vteid_tab, teid) < 0)
+		return;
+
+	if (ctx->vteid_pool_bits)
+		id = teid->vid >> (32 - ctx->vteid_pool_bits);
+	gtp_idpool_put(gtp_switch_vteid_pool(ctx, id), teid->vid);
+}
+
 int
 gtp_switch_gtpc_teid_destroy(gtp_teid_t *teid)
 {
@@ -47,9 +60,9 @@ gtp_switch_gtpc_teid_destroy(gtp_teid_t *teid)
 	gtp_server_t *w_srv = s->w->srv;
 	gtp_switch_t *ctx = w_srv->ctx;
 
-	gtp_vteid_unhash(&ctx->vteid_tab, teid);
+	gtp_switch_vteid_release(ctx, teid);
 	gtp_teid_unhash(&ctx->gtpc_teid_tab, teid);
-	gtp_vsqn_unhash(&ctx->vsqn_tab, teid);
+	gtp_switch_vsqn_release(ctx, teid);
 	return 0;
 }
 
@@ -60,11 +73,109 @@ gtp_switch_gtpu_teid_destroy(gtp_teid_t *teid)
 	gtp_server_t *w_srv = s->w->srv;
 	gtp_switch_t *ctx = w_srv->ctx;
 
-	gtp_vteid_unhash(&ctx->vteid_tab, teid);
+	gtp_switch_vteid_release(ctx, teid);
 	gtp_teid_unhash(&ctx->gtpu_teid_tab, teid);
 	return 0;
 }
 
+
+/*
+ *	VTEID & VSQN pools
+ */
+gtp_idpool_t *
+gtp_switch_vteid_pool(gtp_switch_t *ctx, int id)
+{
+	if (id < 0 || id >= ctx->vteid_pool_cnt)
+		return NULL;
+	return ctx->vteid_pool[id];
+}
+
+int
+gtp_switch_vsqn_release(gtp_switch_t *ctx, gtp_teid_t *teid)
+{
+	uint32_t vsqn = teid->vsqn;
+
+	if (gtp_vsqn_unhash(&ctx->vsqn_tab, teid) < 0)
+		return -1;
+
+	/* Back to raw counter value */
+	if (teid->version == 2)
+		vsqn = (vsqn & ~(1U << 31)) >> 8;
+	return gtp_idpool_put(ctx->vsqn_pool, vsqn);
+}
+
+int
+gtp_switch_vsqn_reserve(gtp_switch_t *ctx, gtp_teid_t *teid, uint32_t vsqn)
+{
+	uint32_t sqn = vsqn;
+
+	if (teid->version == 2)
+		sqn = (sqn & ~(1U << 31)) >> 8;
+	if (gtp_idpool_reserve(ctx->vsqn_pool, sqn) < 0)
+		return -1;
+
+	gtp_vsqn_hash(&ctx->vsqn_tab, teid, vsqn);
+	return 0;
+}
+
+int
+gtp_switch_idpool_init(gtp_server_t *srv)
+{
+	gtp_switch_t *ctx = srv->ctx;
+	int i, bits = srv->teid_shard_bits;
+	uint32_t sqn;
+
+	/* Ingress & egress share listener-count and thus pools */
+	if (ctx->vteid_pool)
+		return 0;
+
+	ctx->vteid_pool = MALLOC(sizeof(gtp_idpool_t *) * srv->thread_cnt);
+	ctx->vteid_pool_cnt = srv->thread_cnt;
+	ctx->vteid_pool_bits = bits;
+	for (i = 0; i < srv->thread_cnt; i++) {
+		ctx->vteid_pool[i] = gtp_idpool_alloc((bits) ? (uint32_t) i << (32 - bits) : 0
+						      , 32 - bits, GTP_IDPOOL_MAX_SIZE, true);
+		gtp_idpool_reserve(ctx->vteid_pool[i], 0);
+	}
+
+	/* VSQN are sequential counter values, lowest are left out
+	 * as they have always been */
+	ctx->vsqn_pool = gtp_idpool_alloc(0, GTP_VSQN_BITS, GTP_VSQN_SIZE, false);
+	for (sqn = 0; sqn <= GTP_VSQN_MIN; sqn++)
+		gtp_idpool_reserve(ctx->vsqn_pool, sqn);
+	return 0;
+}
+
+static void
+gtp_switch_idpool_destroy(gtp_switch_t *ctx)
+{
+	int i;
+
+	for (i = 0; i < ctx->vteid_pool_cnt; i++)
+		gtp_idpool_free(ctx->vteid_pool[i]);
+	if (ctx->vteid_pool)
+		FREE(ctx->vteid_pool);
+	gtp_idpool_free(ctx->vsqn_pool);
+	ctx->vteid_pool = NULL;
+	ctx->vteid_pool_cnt = 0;
+	ctx->vsqn_pool = NULL;
+}
+
+int
+gtp_switch_idpool_vty(vty_t *vty, gtp_switch_t *ctx)
+{
+	char label[GTP_NAME_MAX_LEN];
+	int i;
+
+	vty_out(vty, "gtp-switch %s%s", ctx->name, VTY_NEWLINE);
+	for (i = 0; i < ctx->vteid_pool_cnt; i++) {
+		snprintf(label, sizeof(label), "vteid#%d", i);
+		gtp_idpool_vty(vty, label, ctx->vteid_pool[i]);
+	}
+	gtp_idpool_vty(vty, "vsqn", ctx->vsqn_pool);
+	return 0;
+}
+
 static void
 gtp_switch_fwd_addr_get(gtp_teid_t *teid, struct sockaddr_storage *from, struct sockaddr_in *to)
 {
@@ -99,6 +210,42 @@ gtp_switch_ingress_init(gtp_server_worker_t *w)
 	return 0;
 }
 
+static gtp_server_t *
+gtp_switch_replay_server(gtp_switch_t *ctx, gtp_server_t *srv)
+{
+	/* Requests answered by this server were received by the peer one */
+	if (!__test_bit(GTP_FL_CTL_BIT, &ctx->gtpc_egress.flags))
+		return srv;
+	return (srv == &ctx->gtpc) ? &ctx->gtpc_egress : &ctx->gtpc;
+}
+
+static void
+gtp_switch_replay_update(gtp_server_worker_t *w, gtp_teid_t *teid, gtp_replay_key_t *key,
+			 int err, struct sockaddr_in *addr_to)
+{
+	gtp_server_t *srv = w->srv;
+	gtp_replay_key_t rkey;
+
+	/* Locally answered request */
+	if (TEID_IS_DUMMY(teid)) {
+		if (!err)
+			gtp_replay_store(w->replay, key, w->pbuff);
+		return;
+	}
+
+	/* Forwarded request, book a slot for its response */
+	if (teid->family == GTP_INIT) {
+		if (!err)
+			gtp_replay_pending(w->replay, key);
+		return;
+	}
+
+	/* Forwarded response, complete requester booking */
+	if (gtp_replay_key_build(&rkey, w->pbuff, addr_to, true) < 0)
+		return;
+	gtp_replay_complete(gtp_switch_replay_server(srv->ctx, srv), &rkey, w->pbuff);
+}
+
 int
 gtp_switch_ingress_process(gtp_server_worker_t *w, struct sockaddr_storage *addr_from)
 {
@@ -107,8 +254,9 @@ gtp_switch_ingress_process(gtp_server_worker_t *w, struct sockaddr_storage *addr
 	gtp_server_t *srv_egress = &ctx->gtpc_egress;
 	socket_pair_t *spair = ctx->gtpc_socket_pair;
 	struct sockaddr_in addr_to;
+	gtp_replay_key_t key;
 	gtp_teid_t *teid;
-	int fd = w->fd;
+	int fd = w->fd, err;
 
 	/* GTP-U handling */
 	if (__test_bit(GTP_FL_UPF_BIT, &srv->flags)) {
@@ -120,6 +268,11 @@ gtp_switch_ingress_process(gtp_server_worker_t *w, struct sockaddr_storage *addr
 		return 0;
 	}
 
+	/* Retransmitted request already answered */
+	err = gtp_replay_key_build(&key, w->pbuff, (struct sockaddr_in *) addr_from, false);
+	if (!err && !gtp_replay_lookup(w, &key, (struct sockaddr_in *) addr_from))
+		return 0;
+
 	/* GTP-C handling */
 	teid = gtpc_switch_handle(w, addr_from);
 	if (!teid)
@@ -137,8 +290,11 @@ gtp_switch_ingress_process(gtp_server_worker_t *w, struct sockaddr_storage *addr
 
 	/* Set destination address */
 	gtp_switch_fwd_addr_get(teid, addr_from, &addr_to);
+	if (!TEID_IS_DUMMY(teid) && teid->family == GTP_TRIG)
+		gtp_overload_oci_append(w, &addr_to, GTP_OVERLOAD_OCI_RELAY);
 	gtp_server_send(w, TEID_IS_DUMMY(teid) ? w->fd : fd
 			 , TEID_IS_DUMMY(teid) ? (struct sockaddr_in *) addr_from : &addr_to);
+	gtp_switch_replay_update(w, teid, &key, err, &addr_to);
 	gtpc_switch_handle_post(w, teid);
 
 	return 0;
@@ -162,6 +318,15 @@ gtp_switch_get(const char *name)
 	return NULL;
 }
 
+gtp_server_t *
+gtp_switch_pgw_server(gtp_switch_t *ctx)
+{
+	/* pGW are reached through egress channel when configured */
+	if (__test_bit(GTP_FL_CTL_BIT, &ctx->gtpc_egress.flags))
+		return &ctx->gtpc_egress;
+	return &ctx->gtpc;
+}
+
 gtp_switch_t *
 gtp_switch_init(const char *name)
 {
@@ -224,6 +389,7 @@ gtp_switch_ctx_destroy(gtp_switch_t *ctx)
 	gtp_htab_destroy(&ctx->gtpu_teid_tab);
 	gtp_htab_destroy(&ctx->vteid_tab);
 	gtp_htab_destroy(&ctx->vsqn_tab);
+	gtp_switch_idpool_destroy(ctx);
 	if (ctx->gtpc_socket_pair)
 		FREE(ctx->gtpc_socket_pair);
 	list_head_del(&ctx->next);
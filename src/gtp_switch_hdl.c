@@ -56,7 +56,7 @@ gtpc_retransmit_detected(gtp_server_worker_t *w)
 	uint8_t *cp;
 
 	if (gtph->version == 2) {
-		cp = gtp_get_ie(GTP_IE_F_TEID_TYPE, w->pbuff);
+		cp = gtp_msg_ie_buffer(w->msg, GTP_IE_F_TEID_TYPE);
 		if (!cp)
 			return NULL;
 		f_teid.teid_grekey = (uint32_t *) (cp + offsetof(gtp_ie_f_teid_t, teid_grekey));
@@ -75,11 +75,11 @@ gtpc_retransmit_detected(gtp_server_worker_t *w)
 		return s;
 	}
 
-	cp = gtp1_get_ie(GTP1_IE_TEID_CONTROL_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_TEID_CONTROL_TYPE);
 	if (!cp)
 		return NULL;
 	f_teid.teid_grekey = (uint32_t *) (cp + offsetof(gtp1_ie_teid_t, id));
-	cp = gtp1_get_ie(GTP1_IE_GSN_ADDRESS_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_GSN_ADDRESS_TYPE);
 	if (!cp)
 		return NULL;
 	f_teid.ipv4 = (uint32_t *) (cp + sizeof(gtp1_ie_t));
@@ -111,8 +111,14 @@ gtpc_switch_handle(gtp_server_worker_t *w, struct sockaddr_storage *addr)
 	gtp_hdr_t *gtph = (gtp_hdr_t *) w->pbuff->head;
 
 	/* Only support GTPv1 & GTPv2 */
-	if (*(gtpc_msg_hdl[gtph->version].hdl))
+	if (*(gtpc_msg_hdl[gtph->version].hdl)) {
+		/* Single pass IE indexing consumed by every handlers */
+		if (gtph->version == 2)
+			gtp_msg_parse(w->msg, w->pbuff);
+		else
+			gtp1_msg_parse(w->msg, w->pbuff);
 		return (*(gtpc_msg_hdl[gtph->version].hdl)) (w, addr);
+	}
 
 	log_message(LOG_INFO, "%s(): GTP Version %d not supported."
 			      " Ignoring ingress datagram from [%s]:%d"
@@ -139,6 +145,7 @@ gtpc_switch_handle_post(gtp_server_worker_t *w, gtp_teid_t *teid)
 		return 0;
 	}
 
+	gtp_ckpt_session_put(s);
 	gtp_teid_put(teid);
 	return 0;
 }
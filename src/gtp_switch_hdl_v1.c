@@ -73,7 +73,7 @@ gtp1_create_teid(uint8_t type, int direction, gtp_server_worker_t *w, gtp_htab_t
 	teid->type = type;
 	__set_bit(direction ? GTP_TEID_FL_EGRESS : GTP_TEID_FL_INGRESS, &teid->flags);
 	teid->session = s;
-	gtp_vteid_alloc(vh, teid, &w->seed);
+	gtp_vteid_alloc(vh, teid, gtp_switch_vteid_pool(ctx, w->id), &w->seed);
 
 	/* Add to list */
 	if (type == GTP_TEID_C)
@@ -104,7 +104,7 @@ gtp1_session_xlat_recovery(gtp_server_worker_t *w)
 	gtp1_ie_recovery_t *rec;
 	uint8_t *cp;
 
-	cp = gtp1_get_ie(GTP1_IE_RECOVERY_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_RECOVERY_TYPE);
 	if (cp) {
 		rec = (gtp1_ie_recovery_t *) cp;
 		rec->recovery = daemon_data->restart_counter;
@@ -121,20 +121,20 @@ gtp1_session_xlat(gtp_server_worker_t *w, gtp_session_t *s, int direction)
 	gtp_f_teid_t f_teid_c, f_teid_u;
 	gtp1_ie_teid_t *teid_c = NULL, *teid_u = NULL;
 	uint32_t *gsn_address_c = NULL, *gsn_address_u = NULL;
-	gtp1_ie_t *ie;
+	gtp_msg_ie_t *msg_ie;
 	uint8_t *cp;
 
 	gtp1_session_xlat_recovery(w);
 
 	/* Control & Data Plane IE */
-	cp = gtp1_get_ie(GTP1_IE_TEID_CONTROL_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_TEID_CONTROL_TYPE);
 	if (cp) {
 		teid_c = (gtp1_ie_teid_t *) cp;
 		f_teid_c.version = 1;
 		f_teid_c.teid_grekey = (uint32_t *) (cp + offsetof(gtp1_ie_teid_t, id));
 	}
 
-	cp = gtp1_get_ie(GTP1_IE_TEID_DATA_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_TEID_DATA_TYPE);
 	if (cp) {
 		teid_u = (gtp1_ie_teid_t *) cp;
 		f_teid_u.version = 1;
@@ -142,15 +142,11 @@ gtp1_session_xlat(gtp_server_worker_t *w, gtp_session_t *s, int direction)
 	}
 
 	/* GSN Address for Control-Plane & Data-Plane */
-	cp = gtp1_get_ie(GTP1_IE_GSN_ADDRESS_TYPE, w->pbuff);
-	if (cp) {
-		gsn_address_c = (uint32_t *) (cp + sizeof(gtp1_ie_t));
-		ie = (gtp1_ie_t *) cp;
-		cp = gtp1_get_ie_offset(GTP1_IE_GSN_ADDRESS_TYPE, cp+sizeof(gtp1_ie_t)+ntohs(ie->length)
-								, pkt_buffer_end(w->pbuff));
-		if (cp) {
-			gsn_address_u = (uint32_t *) (cp + sizeof(gtp1_ie_t));
-		}
+	msg_ie = gtp_msg_ie_get(w->msg, GTP1_IE_GSN_ADDRESS_TYPE);
+	if (msg_ie) {
+		gsn_address_c = (uint32_t *) msg_ie->data;
+		if (msg_ie->next)
+			gsn_address_u = (uint32_t *) msg_ie->next->data;
 	}
 
 	/* Control-Plane */
@@ -219,7 +215,7 @@ gtp1_create_pdp_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *add
 		retransmit = true;
 
 	/* At least TEID CONTROL for creation */
-	cp = gtp1_get_ie(GTP1_IE_TEID_CONTROL_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_TEID_CONTROL_TYPE);
 	if (!cp) {
 		log_message(LOG_INFO, "%s(): no TEID-Control IE present. ignoring..."
 				    , __FUNCTION__);
@@ -227,7 +223,7 @@ gtp1_create_pdp_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *add
 	}
 
 	/* At least GSN Address for Control-Plane */
-	cp = gtp1_get_ie(GTP1_IE_GSN_ADDRESS_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_GSN_ADDRESS_TYPE);
 	if (!cp) {
 		log_message(LOG_INFO, "%s(): no C-Plane GSN-Address present. ignoring..."
 				    , __FUNCTION__);
@@ -235,7 +231,7 @@ gtp1_create_pdp_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *add
 	}
 
 	/* APN selection */
-	cp = gtp1_get_ie(GTP1_IE_APN_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_APN_TYPE);
 	if (!cp) {
 		log_message(LOG_INFO, "%s(): no APN IE present. ignoring..."
 				    , __FUNCTION__);
@@ -258,7 +254,7 @@ gtp1_create_pdp_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *add
 	}
 
 	/* IMSI */
-	cp = gtp1_get_ie(GTP1_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_IMSI_TYPE);
 	if (!cp) {
 		log_message(LOG_INFO, "%s(): no IMSI IE present. ignoring..."
 				    , __FUNCTION__);
@@ -307,10 +303,12 @@ gtp1_create_pdp_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *add
 
 	/* Update last sGW visited */
 	c->sgw_addr = *((struct sockaddr_in *) addr);
+	gtp_path_session_register(w->srv, &c->sgw_addr, 1, GTP_PATH_FL_SGW_BIT, s);
 
 	/* pGW selection */
 	if (__test_bit(GTP_FL_FORCE_PGW_BIT, &ctx->flags)) {
 		teid->pgw_addr = *(struct sockaddr_in *) &ctx->pgw_addr;
+		gtp_path_register(gtp_switch_pgw_server(ctx), &teid->pgw_addr, 1, GTP_PATH_FL_PGW_BIT);
 		goto end;
 	}
 
@@ -319,8 +317,11 @@ gtp1_create_pdp_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *add
 		log_message(LOG_INFO, "%s(): Unable to schedule pGW for apn:%s"
 				    , __FUNCTION__
 				    , apn->name);
+		goto end;
 	}
 
+	gtp_path_register(gtp_switch_pgw_server(ctx), &teid->pgw_addr, 1, GTP_PATH_FL_PGW_BIT);
+
   end:
 	gtp_conn_put(c);
 	return teid;
@@ -406,7 +407,7 @@ gtp1_create_pdp_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage *ad
 
 	/* Test cause code, destroy if <> success.
 	 * 3GPP.TS.129.060 7.7.1 */
-	cp = gtp1_get_ie(GTP1_IE_CAUSE_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_CAUSE_TYPE);
 	if (cp) {
 		ie_cause = (gtp1_ie_cause_t *) cp;
 		if (!(ie_cause->value >= GTP1_CAUSE_REQUEST_ACCEPTED &&
@@ -460,7 +461,7 @@ gtp1_update_pdp_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *add
 			    , mobility ? " (4G Mobility)" : "");
 
 	/* IMSI rewrite if needed */
-	cp = gtp1_get_ie(GTP1_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_IMSI_TYPE);
 	if (cp) {
 		ie_imsi = (gtp1_ie_imsi_t *) cp;
 		gtp_imsi_rewrite(teid->session->apn, ie_imsi->imsi);
@@ -486,7 +487,7 @@ gtp1_update_pdp_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *add
 	t = gtp1_session_xlat(w, s, GTP_INGRESS);
 	if (!t) {
 		/* No GTP-C IE, if related GSN Address present then xlat it */
-		cp = gtp1_get_ie(GTP1_IE_GSN_ADDRESS_TYPE, w->pbuff);
+		cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_GSN_ADDRESS_TYPE);
 		if (cp) {
 			gsn_address_c = (uint32_t *) (cp + sizeof(gtp1_ie_t));
 			*gsn_address_c = ((struct sockaddr_in *) &srv->addr)->sin_addr.s_addr;
@@ -567,7 +568,7 @@ gtp1_update_pdp_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage *ad
 	t = gtp1_session_xlat(w, teid->session, GTP_EGRESS);
 	if (!t) {
 		/* No GTP-C IE, if related GSN Address present then xlat it */
-		cp = gtp1_get_ie(GTP1_IE_GSN_ADDRESS_TYPE, w->pbuff);
+		cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_GSN_ADDRESS_TYPE);
 		if (cp) {
 			gsn_address_c = (uint32_t *) (cp + sizeof(gtp1_ie_t));
 			*gsn_address_c = ((struct sockaddr_in *) &srv->addr)->sin_addr.s_addr;
@@ -580,7 +581,7 @@ gtp1_update_pdp_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage *ad
 
 	/* Test cause code, destroy if <> success.
 	 * 3GPP.TS.29.274 8.4 */
-	cp = gtp1_get_ie(GTP1_IE_CAUSE_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_CAUSE_TYPE);
 	if (!cp)
 		return teid;
 
@@ -704,7 +705,7 @@ gtp1_delete_pdp_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage *ad
 
 	/* Test cause code, destroy if == success.
 	 * 3GPP.TS.129.060 7.7.1 */
-	cp = gtp1_get_ie(GTP1_IE_CAUSE_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP1_IE_CAUSE_TYPE);
 	if (cp) {
 		ie_cause = (gtp1_ie_cause_t *) cp;
 		if (ie_cause->value >= GTP1_CAUSE_REQUEST_ACCEPTED &&
@@ -739,9 +740,13 @@ gtpc_switch_handle_v1(gtp_server_worker_t *w, struct sockaddr_storage *addr)
 	gtp_hdr_t *gtph = (gtp_hdr_t *) w->pbuff->head;
 	gtp_teid_t *teid;
 
-	/* Ignore echo-response messages */
-	if (gtph->type == GTP_ECHO_RESPONSE_TYPE)
+	/* Echo-response are only relevant to path management */
+	if (gtph->type == GTP_ECHO_RESPONSE_TYPE) {
+		gtp_path_echo_response((struct sockaddr_in *) addr, 1
+				       , ntohs(((gtp1_hdr_t *) gtph)->sqn)
+				       , gtp_msg_ie_buffer(w->msg, GTP1_IE_RECOVERY_TYPE));
 		return NULL;
+	}
 
 	if (*(gtpc_msg_hdl[gtph->type].hdl)) {
 		teid = (*(gtpc_msg_hdl[gtph->type].hdl)) (w, addr);
@@ -89,7 +89,7 @@ gtp_create_teid(uint8_t type, int direction, gtp_server_worker_t *w, gtp_htab_t
 	__set_bit(direction ? GTP_TEID_FL_EGRESS : GTP_TEID_FL_INGRESS, &teid->flags);
 	teid->session = s;
 	__set_bit(GTP_TEID_FL_FWD, &teid->flags);
-	gtp_vteid_alloc(vh, teid, &w->seed);
+	gtp_vteid_alloc(vh, teid, gtp_switch_vteid_pool(ctx, w->id), &w->seed);
 
 	/* Add to list */
 	if (type == GTP_TEID_C)
@@ -141,7 +141,7 @@ gtpc_session_xlat_recovery(gtp_server_worker_t *w)
 	gtp_ie_recovery_t *rec;
 	uint8_t *cp;
 
-	cp = gtp_get_ie(GTP_IE_RECOVERY_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_RECOVERY_TYPE);
 	if (cp) {
 		rec = (gtp_ie_recovery_t *) cp;
 		rec->recovery = daemon_data->restart_counter;
@@ -156,14 +156,13 @@ gtpc_session_xlat(gtp_server_worker_t *w, gtp_session_t *s, int direction)
 	gtp_switch_t *ctx = srv->ctx;
 	gtp_f_teid_t f_teid;
 	gtp_teid_t *teid = NULL;
-	uint8_t *cp, *cp_bid, *end;
+	gtp_msg_ie_t *bearer_ctx, *msg_ie;
 	gtp_ie_eps_bearer_id_t *bearer_id = NULL;
-	gtp_ie_t *ie;
-	size_t size;
+	uint8_t *cp;
 
 	gtpc_session_xlat_recovery(w);
 
-	cp = gtp_get_ie(GTP_IE_F_TEID_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_F_TEID_TYPE);
 	if (cp) {
 		f_teid.version = 2;
 		f_teid.teid_grekey = (uint32_t *) (cp + offsetof(gtp_ie_f_teid_t, teid_grekey));
@@ -175,17 +174,16 @@ gtpc_session_xlat(gtp_server_worker_t *w, gtp_session_t *s, int direction)
 	}
 
 	/* Bearer Context handling */
-	cp = gtp_get_ie(GTP_IE_BEARER_CONTEXT_TYPE, w->pbuff);
-	if (!cp)
+	bearer_ctx = gtp_msg_ie_get(w->msg, GTP_IE_BEARER_CONTEXT_TYPE);
+	if (!bearer_ctx)
 		return teid;
 
-	size = pkt_buffer_size(w->pbuff) - (cp - w->pbuff->head);
-	cp_bid = gtp_get_ie_offset(GTP_IE_EPS_BEARER_ID_TYPE, cp, size, sizeof(gtp_ie_t));
-	bearer_id = (cp_bid) ? (gtp_ie_eps_bearer_id_t *) cp_bid : NULL;
-	ie = (gtp_ie_t *) cp;
-	end = cp + sizeof(gtp_ie_t) + ntohs(ie->length);
-	gtp_foreach_ie(GTP_IE_F_TEID_TYPE, cp, sizeof(gtp_ie_t), end,
-		       w, s, direction, bearer_id, gtp_append_gtpu);
+	msg_ie = gtp_msg_ie_child_get(bearer_ctx, GTP_IE_EPS_BEARER_ID_TYPE);
+	bearer_id = (msg_ie) ? (gtp_ie_eps_bearer_id_t *) msg_ie->h : NULL;
+	gtp_msg_ie_for_each_child(bearer_ctx, msg_ie) {
+		if (msg_ie->type == GTP_IE_F_TEID_TYPE)
+			gtp_append_gtpu(w, s, direction, bearer_id, (uint8_t *) msg_ie->h);
+	}
 
 	return teid;
 }
@@ -200,9 +198,10 @@ gtpc_echo_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *addr, int
 	gtp_ie_recovery_t *rec;
 	uint8_t *cp;
 
-	cp = gtp_get_ie(GTP_IE_RECOVERY_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_RECOVERY_TYPE);
 	if (cp) {
 		rec = (gtp_ie_recovery_t *) cp;
+		gtp_path_recovery_update((struct sockaddr_in *) addr, &rec->recovery);
 		rec->recovery = daemon_data->restart_counter;
 	}
 
@@ -214,6 +213,7 @@ gtpc_echo_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *addr, int
 static gtp_teid_t *
 gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *addr, int direction)
 {
+	gtp_ie_t *ie;
 	gtp_ie_imsi_t *ie_imsi;
 	gtp_ie_apn_t *ie_apn;
 	gtp_server_t *srv = w->srv;
@@ -242,7 +242,7 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 		retransmit = true;
 
 	/* At least F-TEID present for create session */
-	cp = gtp_get_ie(GTP_IE_F_TEID_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_F_TEID_TYPE);
 	if (!cp) {
 		log_message(LOG_INFO, "%s(): no F_TEID IE present. ignoring..."
 				    , __FUNCTION__);
@@ -250,7 +250,7 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	}
 
 	/* APN selection */
-	cp = gtp_get_ie(GTP_IE_APN_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_APN_TYPE);
 	if (!cp) {
 		log_message(LOG_INFO, "%s(): no Access-Point-Name IE present. ignoring..."
 				    , __FUNCTION__);
@@ -276,9 +276,7 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	/* Rewrite APN if needed */
 	gtp_ie_apn_rewrite(apn, ie_apn, strlen(apn_str));
 
-	/* TODO: Maybe optimize this stuff by creating a mapping offset table
-	 * to avoid a global walking from the buffer begining */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (!cp) {
 		log_message(LOG_INFO, "%s(): no IMSI IE present. ignoring..."
 				    , __FUNCTION__);
@@ -325,12 +323,22 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	/* Set addr tunnel endpoint */
 	gtp_teid_update_sgw(teid, addr);
 
+	/* MSISDN */
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_MSISDN_TYPE);
+	if (cp) {
+		ie = (gtp_ie_t *) cp;
+		gtp_session_set_msisdn(s, bcd_to_int64(cp + sizeof(gtp_ie_t)
+							 , ntohs(ie->length)));
+	}
+
 	/* Update last sGW visited */
 	c->sgw_addr = *((struct sockaddr_in *) addr);
+	gtp_path_session_register(srv, &c->sgw_addr, 2, GTP_PATH_FL_SGW_BIT, s);
 
 	/* pGW selection */
 	if (__test_bit(GTP_FL_FORCE_PGW_BIT, &ctx->flags)) {
 		teid->pgw_addr = *(struct sockaddr_in *) &ctx->pgw_addr;
+		gtp_path_register(gtp_switch_pgw_server(ctx), &teid->pgw_addr, 2, GTP_PATH_FL_PGW_BIT);
 		goto end;
 	}
 
@@ -347,8 +355,10 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 			gtp_teid_put(teid);
 			gtp_session_destroy(s);
 			teid = NULL;
+			goto end;
 		}
 
+		gtp_path_register(gtp_switch_pgw_server(ctx), &teid->pgw_addr, 2, GTP_PATH_FL_PGW_BIT);
 		goto end;
 	}
 
@@ -357,8 +367,11 @@ gtpc_create_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 		log_message(LOG_INFO, "%s(): Unable to schedule pGW for apn:%s"
 				    , __FUNCTION__
 				    , apn->name);
+		goto end;
 	}
 
+	gtp_path_register(gtp_switch_pgw_server(ctx), &teid->pgw_addr, 2, GTP_PATH_FL_PGW_BIT);
+
   end:
 	gtp_conn_put(c);
 	return teid;
@@ -387,7 +400,7 @@ gtpc_create_session_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 		}
 
 		/* IMSI rewrite if needed */
-		cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+		cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 		if (cp) {
 			gtp_ie_imsi_rewrite(t->session->apn, cp);
 		}
@@ -405,7 +418,7 @@ gtpc_create_session_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	}
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(t->session->apn, cp);
 	}
@@ -449,7 +462,7 @@ gtpc_create_session_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 
 	/* Test cause code, destroy if <> success.
 	 * 3GPP.TS.29.274 8.4 */
-	cp = gtp_get_ie(GTP_IE_CAUSE_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_CAUSE_TYPE);
 	if (cp) {
 		ie_cause = (gtp_ie_cause_t *) cp;
 		if (!(ie_cause->value >= 16 && ie_cause->value <= 63)) {
@@ -483,7 +496,7 @@ gtpc_delete_session_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	log_message(LOG_INFO, "Delete-Session-Req:={F-TEID:0x%.8x}", ntohl(teid->id));
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -536,7 +549,7 @@ gtpc_delete_session_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 		}
 
 		/* IMSI rewrite if needed */
-		cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+		cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 		if (cp) {
 			gtp_ie_imsi_rewrite(teid->session->apn, cp);
 		}
@@ -554,7 +567,7 @@ gtpc_delete_session_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	}
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -570,7 +583,7 @@ gtpc_delete_session_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 
 	/* Test cause code, destroy if == success.
 	 * 3GPP.TS.29.274 8.4 */
-	cp = gtp_get_ie(GTP_IE_CAUSE_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_CAUSE_TYPE);
 	if (cp) {
 		ie_cause = (gtp_ie_cause_t *) cp;
 		if ((ie_cause->value >= GTP_CAUSE_REQUEST_ACCEPTED &&
@@ -613,7 +626,7 @@ gtpc_modify_bearer_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *
 			    , mobility ? " (3G Mobility)" : "");
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -686,7 +699,7 @@ gtpc_modify_bearer_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 		}
 
 		/* IMSI rewrite if needed */
-		cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+		cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 		if (cp) {
 			gtp_ie_imsi_rewrite(teid->session->apn, cp);
 		}
@@ -701,7 +714,7 @@ gtpc_modify_bearer_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 	}
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -718,7 +731,7 @@ gtpc_modify_bearer_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 
 	/* Test cause code, destroy if <> success.
 	 * 3GPP.TS.29.274 8.4 */
-	cp = gtp_get_ie(GTP_IE_CAUSE_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_CAUSE_TYPE);
 	if (!cp)
 		return teid;
 
@@ -774,7 +787,7 @@ gtpc_delete_bearer_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *
 	log_message(LOG_INFO, "Delete-Bearer-Req:={F-TEID:0x%.8x}", ntohl(teid->id));
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -795,7 +808,7 @@ gtpc_delete_bearer_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *
 	gtp_teid_update_pgw(teid, addr);
 	gtp_teid_update_pgw(teid->peer_teid, addr);
 
-	cp = gtp_get_ie(GTP_IE_EPS_BEARER_ID_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_EPS_BEARER_ID_TYPE);
 	if (!cp)
 		return teid;
 
@@ -844,7 +857,7 @@ gtpc_delete_bearer_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage
 
 	/* Test cause code, destroy if == success.
 	 * 3GPP.TS.29.274 8.4 */
-	cp = gtp_get_ie(GTP_IE_CAUSE_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_CAUSE_TYPE);
 	if (cp) {
 		ie_cause = (gtp_ie_cause_t *) cp;
 		if (ie_cause->value >= GTP_CAUSE_REQUEST_ACCEPTED &&
@@ -911,7 +924,7 @@ gtpc_generic_xlat_request_hdl(gtp_server_worker_t *w, struct sockaddr_storage *a
 	}
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -968,7 +981,7 @@ gtpc_generic_xlat_command_hdl(gtp_server_worker_t *w, struct sockaddr_storage *a
 	}
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -1023,7 +1036,7 @@ gtpc_generic_xlat_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage *
 		}
 
 		/* IMSI rewrite if needed */
-		cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+		cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 		if (cp) {
 			gtp_ie_imsi_rewrite(teid->session->apn, cp);
 		}
@@ -1035,7 +1048,7 @@ gtpc_generic_xlat_response_hdl(gtp_server_worker_t *w, struct sockaddr_storage *
 	}
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -1077,7 +1090,7 @@ gtpc_generic_xlat_hdl(gtp_server_worker_t *w, struct sockaddr_storage *addr, int
 	}
 
 	/* IMSI rewrite if needed */
-	cp = gtp_get_ie(GTP_IE_IMSI_TYPE, w->pbuff);
+	cp = gtp_msg_ie_buffer(w->msg, GTP_IE_IMSI_TYPE);
 	if (cp) {
 		gtp_ie_imsi_rewrite(teid->session->apn, cp);
 	}
@@ -1143,9 +1156,12 @@ gtpc_switch_handle_v2(gtp_server_worker_t *w, struct sockaddr_storage *addr)
 	gtp_hdr_t *gtph = (gtp_hdr_t *) w->pbuff->head;
 	gtp_teid_t *teid;
 
-	/* Ignore echo-response messages */
-	if (gtph->type == GTP_ECHO_RESPONSE_TYPE)
+	/* Echo-response are only relevant to path management */
+	if (gtph->type == GTP_ECHO_RESPONSE_TYPE) {
+		gtp_path_echo_response((struct sockaddr_in *) addr, 2, ntohl(gtph->sqn_only) >> 8
+				       , gtp_msg_ie_buffer(w->msg, GTP_IE_RECOVERY_TYPE));
 		return NULL;
+	}
 
 	/* Special care to create and delete session */
 	if (*(gtpc_msg_hdl[gtph->type].hdl)) {
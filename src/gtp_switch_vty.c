@@ -178,6 +178,7 @@ DEFUN(gtpc_switch_tunnel_endpoint,
 	__set_bit(GTP_FL_CTL_BIT, &srv->flags);
 	__set_bit(GTP_FL_GTPC_INGRESS_BIT, &srv->flags);
 	gtp_server_init(srv, ctx, gtp_switch_ingress_init, gtp_switch_ingress_process);
+	gtp_switch_idpool_init(srv);
 	gtp_server_start(srv);
 	gtp_switch_gtpc_socketpair_init(srv);
 
@@ -235,12 +236,158 @@ DEFUN(gtpc_switch_egress_tunnel_endpoint,
 	__set_bit(GTP_FL_CTL_BIT, &srv->flags);
 	__set_bit(GTP_FL_GTPC_EGRESS_BIT, &srv->flags);
 	gtp_server_init(srv, ctx, gtp_switch_ingress_init, gtp_switch_ingress_process);
+	gtp_switch_idpool_init(srv);
 	gtp_server_start(srv);
 	gtp_switch_gtpc_socketpair_init(srv);
 
 	return CMD_SUCCESS;
 }
 
+DEFUN(gtpc_switch_admission_control,
+      gtpc_switch_admission_control_cmd,
+      "gtpc-admission-control rate <1-1000000> burst <1-1000000>",
+      "GTP-C per peer initial attach admission control\n"
+      "Rate\n"
+      "messages per second\n"
+      "Burst\n"
+      "number of messages\n")
+{
+	gtp_switch_t *ctx = vty->index;
+	gtp_server_t *srv;
+	int rate, burst;
+
+	if (argc < 2) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("Rate", rate, argv[0], 1, 1000000);
+	VTY_GET_INTEGER_RANGE("Burst", burst, argv[1], 1, 1000000);
+
+	srv = &ctx->gtpc;
+	srv->overload.rate = rate;
+	srv->overload.burst = burst;
+	__set_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &srv->overload.flags);
+
+	srv = &ctx->gtpc_egress;
+	srv->overload.rate = rate;
+	srv->overload.burst = burst;
+	__set_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &srv->overload.flags);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_gtpc_switch_admission_control,
+      no_gtpc_switch_admission_control_cmd,
+      "no gtpc-admission-control",
+      "GTP-C per peer initial attach admission control\n")
+{
+	gtp_switch_t *ctx = vty->index;
+
+	__clear_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &ctx->gtpc.overload.flags);
+	__clear_bit(GTP_OVERLOAD_FL_ADMISSION_BIT, &ctx->gtpc_egress.overload.flags);
+	return CMD_SUCCESS;
+}
+
+DEFUN(gtpc_switch_overload_control,
+      gtpc_switch_overload_control_cmd,
+      "gtpc-overload-control threshold <10-99> latency <10-1000000> validity <2-600>",
+      "GTP-C overload control\n"
+      "Load threshold entering overload\n"
+      "percent\n"
+      "Per message service time target\n"
+      "micro-seconds\n"
+      "Overload Control Information Period-of-Validity\n"
+      "seconds\n")
+{
+	gtp_switch_t *ctx = vty->index;
+	gtp_server_t *srv;
+	int threshold, latency, validity;
+
+	if (argc < 3) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	VTY_GET_INTEGER_RANGE("Threshold", threshold, argv[0], 10, 99);
+	VTY_GET_INTEGER_RANGE("Latency", latency, argv[1], 10, 1000000);
+	VTY_GET_INTEGER_RANGE("Validity", validity, argv[2], 2, 600);
+
+	srv = &ctx->gtpc;
+	srv->overload.threshold = threshold;
+	srv->overload.latency = latency;
+	srv->overload.validity = validity;
+	__set_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &srv->overload.flags);
+
+	srv = &ctx->gtpc_egress;
+	srv->overload.threshold = threshold;
+	srv->overload.latency = latency;
+	srv->overload.validity = validity;
+	__set_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &srv->overload.flags);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_gtpc_switch_overload_control,
+      no_gtpc_switch_overload_control_cmd,
+      "no gtpc-overload-control",
+      "GTP-C overload control\n")
+{
+	gtp_switch_t *ctx = vty->index;
+
+	__clear_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &ctx->gtpc.overload.flags);
+	__clear_bit(GTP_OVERLOAD_FL_CONTROL_BIT, &ctx->gtpc_egress.overload.flags);
+	return CMD_SUCCESS;
+}
+
+DEFUN(gtpc_switch_overload_control_peer,
+      gtpc_switch_overload_control_peer_cmd,
+      "gtpc-overload-control peer A.B.C.D",
+      "GTP-C overload control\n"
+      "Peer supporting overload control\n"
+      "IPv4 Address\n")
+{
+	gtp_switch_t *ctx = vty->index;
+	uint32_t addr;
+
+	if (inet_pton(AF_INET, argv[0], &addr) != 1) {
+		vty_out(vty, "%% malformed IP address %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (gtp_overload_oci_peer_add(&ctx->gtpc.overload, addr) < 0 ||
+	    gtp_overload_oci_peer_add(&ctx->gtpc_egress.overload, addr) < 0) {
+		vty_out(vty, "%% no more than %d peers%s", GTP_OVERLOAD_OCI_PEER_MAX, VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_gtpc_switch_overload_control_peer,
+      no_gtpc_switch_overload_control_peer_cmd,
+      "no gtpc-overload-control peer A.B.C.D",
+      "GTP-C overload control\n"
+      "Peer supporting overload control\n"
+      "IPv4 Address\n")
+{
+	gtp_switch_t *ctx = vty->index;
+	uint32_t addr;
+
+	if (inet_pton(AF_INET, argv[0], &addr) != 1) {
+		vty_out(vty, "%% malformed IP address %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	gtp_overload_oci_peer_del(&ctx->gtpc_egress.overload, addr);
+	if (gtp_overload_oci_peer_del(&ctx->gtpc.overload, addr) < 0) {
+		vty_out(vty, "%% unknown peer %s%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(gtpu_switch_tunnel_endpoint,
       gtpu_switch_tunnel_endpoint_cmd,
       "gtpu-tunnel-endpoint (A.B.C.D|X:X:X:X) port <1024-65535> [listener-count [INTEGER]]",
@@ -641,6 +788,23 @@ DEFUN(gtpu_ipip_decap_tag_vlan,
 }
 
 
+/*
+ *	Show commands
+ */
+DEFUN(show_gtp_id_pool,
+      show_gtp_id_pool_cmd,
+      "show gtp id-pool",
+      SHOW_STR
+      "GTP related informations\n"
+      "VTEID & VSQN allocation pools\n")
+{
+	gtp_switch_t *ctx;
+
+	list_for_each_entry(ctx, &daemon_data->gtp_switch_ctx, next)
+		gtp_switch_idpool_vty(vty, ctx);
+
+	return CMD_SUCCESS;
+}
 
 
 /* Configuration writer */
@@ -699,6 +863,7 @@ gtp_config_write(vty_t *vty)
 					   , srv->thread_cnt);
 			vty_out(vty, "%s", VTY_NEWLINE);
 		}
+		gtp_overload_config_write(vty, &ctx->gtpc.overload);
 		if (__test_bit(GTP_FL_FORCE_PGW_BIT, &ctx->flags))
 			vty_out(vty, " pgw-force-selection %s%s"
 	                           , inet_sockaddrtos(&ctx->pgw_addr)
@@ -755,6 +920,12 @@ gtp_switch_vty_init(void)
 	install_element(GTP_SWITCH_NODE, &gtpu_switch_tunnel_endpoint_cmd);
 	install_element(GTP_SWITCH_NODE, &gtpu_switch_egress_tunnel_endpoint_cmd);
 	install_element(GTP_SWITCH_NODE, &gtpc_force_pgw_selection_cmd);
+	install_element(GTP_SWITCH_NODE, &gtpc_switch_admission_control_cmd);
+	install_element(GTP_SWITCH_NODE, &no_gtpc_switch_admission_control_cmd);
+	install_element(GTP_SWITCH_NODE, &gtpc_switch_overload_control_cmd);
+	install_element(GTP_SWITCH_NODE, &no_gtpc_switch_overload_control_cmd);
+	install_element(GTP_SWITCH_NODE, &gtpc_switch_overload_control_peer_cmd);
+	install_element(GTP_SWITCH_NODE, &no_gtpc_switch_overload_control_peer_cmd);
 	install_element(GTP_SWITCH_NODE, &gtpu_ipip_cmd);
 	install_element(GTP_SWITCH_NODE, &gtpu_ipip_dead_peer_detection_cmd);
 	install_element(GTP_SWITCH_NODE, &gtpu_ipip_transparent_ingress_encap_cmd);
@@ -765,6 +936,8 @@ gtp_switch_vty_init(void)
 	/* Install show commands */
 //	install_element(VIEW_NODE, &show_gtp_cmd);
 //	install_element(ENABLE_NODE, &show_gtp_cmd);
+	install_element(VIEW_NODE, &show_gtp_id_pool_cmd);
+	install_element(ENABLE_NODE, &show_gtp_id_pool_cmd);
 
 
 	return 0;
@@ -38,6 +38,7 @@
 static list_head_t gtp_teid_unuse;
 pthread_mutex_t gtp_teid_unuse_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int gtp_teid_unuse_count;
+static int gtp_teid_alloc_count;
 static gtp_htab_t gtpc_teid_tab;
 static gtp_htab_t gtpu_teid_tab;
 
@@ -50,6 +51,7 @@ gtp_teid_unuse_destroy(void)
 	list_for_each_entry_safe(t, _t, &gtp_teid_unuse, next) {
 		list_head_del(&t->next);
 		FREE(t);
+		__sync_sub_and_fetch(&gtp_teid_alloc_count, 1);
 	}
 	INIT_LIST_HEAD(&gtp_teid_unuse);
 	pthread_mutex_unlock(&gtp_teid_unuse_mutex);
@@ -63,6 +65,12 @@ gtp_teid_unuse_queue_size(void)
 	return gtp_teid_unuse_count;
 }
 
+int
+gtp_teid_count(void)
+{
+	return gtp_teid_alloc_count;
+}
+
 static gtp_teid_t *
 gtp_teid_unuse_trim_head(void)
 {
@@ -90,8 +98,12 @@ gtp_teid_malloc(void)
 	gtp_teid_t *t;
 
 	t = gtp_teid_unuse_trim_head();
-	if (!t)
-		PMALLOC(t);
+	if (t)
+		return t;
+
+	PMALLOC(t);
+	if (t)
+		__sync_add_and_fetch(&gtp_teid_alloc_count, 1);
 
 	return t;
 }
@@ -115,7 +127,7 @@ gtp_teid_free(gtp_teid_t *t)
 static struct hlist_head *
 gtp_teid_hashkey(gtp_htab_t *h, uint32_t id, uint32_t ipv4)
 {
-	return h->htab + (jhash_2words(id, ipv4, 0) & CONN_HASHTAB_MASK);
+	return h->htab + (gtp_hash_2words(GTP_HASH_TEID, id, ipv4) & CONN_HASHTAB_MASK);
 }
 
 static gtp_teid_t *
@@ -448,15 +460,29 @@ gtp_vteid_unhash(gtp_htab_t *h, gtp_teid_t *t)
 }
 
 int
-gtp_vteid_alloc(gtp_htab_t *h, gtp_teid_t *teid, unsigned int *seed)
+gtp_vteid_alloc(gtp_htab_t *h, gtp_teid_t *teid, gtp_idpool_t *pool, unsigned int *seed)
 {
 	uint32_t vid;
 	gtp_teid_t *t;
 
+	/* Pool ids are unique by construction, no probing */
+	if (!gtp_idpool_get(pool, &vid)) {
+		dlock_lock_id(h->dlock, vid, 0);
+		__gtp_vteid_hash(h, teid, vid);
+		dlock_unlock_id(h->dlock, vid, 0);
+		return 0;
+	}
+
+	/* Pool exhausted: probe randomly in pool shard, out of
+	 * pool range */
   shoot_again:
 	vid = poor_prng(seed);
 	/* Add some kind of enthropy to workaround rand() crappiness */
 	vid ^= teid->id;
+	if (pool)
+		vid = pool->base | (vid & pool->mask);
+	if (!vid || gtp_idpool_owns(pool, vid))
+		goto shoot_again;
 
 	dlock_lock_id(h->dlock, vid, 0);
 	t = __gtp_vteid_get(h, vid);
@@ -472,6 +498,28 @@ gtp_vteid_alloc(gtp_htab_t *h, gtp_teid_t *teid, unsigned int *seed)
 	return 0;
 }
 
+/* Re-hash a VTEID known from a previous run, keeping pool in sync */
+int
+gtp_vteid_reserve(gtp_htab_t *h, gtp_teid_t *teid, gtp_idpool_t *pool, uint32_t vid)
+{
+	gtp_teid_t *t;
+
+	if (pool && gtp_idpool_owns(pool, vid) && gtp_idpool_reserve(pool, vid) < 0)
+		return -1;
+
+	dlock_lock_id(h->dlock, vid, 0);
+	t = __gtp_vteid_get(h, vid);
+	if (t) {
+		dlock_unlock_id(h->dlock, vid, 0);
+		__sync_sub_and_fetch(&t->refcnt, 1);
+		return -1;
+	}
+
+	__gtp_vteid_hash(h, teid, vid);
+	dlock_unlock_id(h->dlock, vid, 0);
+	return 0;
+}
+
 /*
  *	Tunnel ID tracking init
  */
@@ -72,6 +72,12 @@ static const struct {
 };
 
 
+size_t
+gtp1_ie_tv_len(uint8_t type)
+{
+	return (type < 0x80) ? gtp1_ie_len[type].len : 0;
+}
+
 size_t
 gtp1_get_header_len(gtp1_hdr_t *h)
 {
@@ -275,27 +281,17 @@ gtp_ifid_from_ether_build(struct ether_addr *eth, struct in6_addr *ifid)
 int
 gtp_imsi_rewrite(gtp_apn_t *apn, uint8_t *imsi)
 {
-	list_head_t *l = &apn->imsi_match;
-	gtp_rewrite_rule_t *rule, *rule_match = NULL;
+	gtp_rewrite_rule_t *rule_match;
+	gtp_rewrite_trie_t *t;
 	int len;
 
-	if (list_empty(l))
+	t = gtp_rewrite_trie_get(apn, GTP_REWRITE_IMSI);
+	if (!t)
 		return -1;
 
-	list_for_each_entry(rule, l, next) {
-		if (memcmp(rule->match, imsi, rule->match_len / 2) == 0) {
-			if (!!(rule->match_len % 2)) {
-				if ((imsi[rule->match_len / 2] & 0x0f) == (rule->match[rule->match_len / 2] & 0x0f)) {
-					rule_match = rule;
-					break;
-				}
-			} else {
-				rule_match = rule;
-				break;
-			}
-		}
-	}
-
+	/* TBCD IMSI: 15 digits + filler */
+	rule_match = gtp_rewrite_trie_lookup(t, imsi, 2 * 8);
+	gtp_rewrite_trie_put(t);
 	if (!rule_match)
 		return -1;
 
@@ -430,24 +426,24 @@ gtp_ie_apn_rewrite_oi(gtp_ie_apn_t *apn, size_t offset, char *buffer)
 int
 gtp_ie_apn_rewrite(gtp_apn_t *apn, gtp_ie_apn_t *ie_apn, size_t offset_ni)
 {
-	list_head_t *l = &apn->oi_match;
 	gtp_rewrite_rule_t *rule;
+	gtp_rewrite_trie_t *t;
 	char apn_oi[32];
 
-	if (list_empty(l))
+	t = gtp_rewrite_trie_get(apn, GTP_REWRITE_OI);
+	if (!t)
 		return -1;
 
 	memset(apn_oi, 0, 32);
 	gtp_ie_apn_extract_oi(ie_apn, apn_oi, 32);
 
-        list_for_each_entry(rule, l, next) {
-		if (strncmp(rule->match, apn_oi, rule->match_len) == 0) {
-			gtp_ie_apn_rewrite_oi(ie_apn, offset_ni, rule->rewrite);
-			return 0;
-		}
-	}
+	rule = gtp_rewrite_trie_lookup(t, (uint8_t *) apn_oi, 2 * strlen(apn_oi));
+	gtp_rewrite_trie_put(t);
+	if (!rule)
+		return -1;
 
-	return -1;
+	gtp_ie_apn_rewrite_oi(ie_apn, offset_ni, rule->rewrite);
+	return 0;
 }
 
 gtp_id_ecgi_t *
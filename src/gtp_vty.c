@@ -302,6 +302,50 @@ DEFUN(no_pdn_bpf_ppp_rps,
 	return CMD_SUCCESS;
 }
 
+DEFUN(pdn_bpf_gtpc_reuseport,
+      pdn_bpf_gtpc_reuseport_cmd,
+      "bpf-gtpc-reuseport STRING",
+      "GTP-C SO_REUSEPORT steering BPF program\n"
+      "path to BPF file\n")
+{
+	gtp_bpf_opts_t *opts = &daemon_data->bpf_gtpc_reuseport;
+
+	if (__test_bit(GTP_FL_GTPC_REUSEPORT_LOADED_BIT, &daemon_data->flags)) {
+		vty_out(vty, "%% GTP-C reuseport program already loaded.%s"
+			   , VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (argc < 1) {
+		vty_out(vty, "%% missing arguments%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	bsd_strlcpy(opts->filename, argv[0], GTP_STR_MAX_LEN-1);
+	__set_bit(GTP_FL_GTPC_REUSEPORT_LOADED_BIT, &daemon_data->flags);
+	return CMD_SUCCESS;
+}
+
+DEFUN(no_pdn_bpf_gtpc_reuseport,
+      no_pdn_bpf_gtpc_reuseport_cmd,
+      "no bpf-gtpc-reuseport",
+      "GTP-C SO_REUSEPORT steering BPF program\n")
+{
+	gtp_bpf_opts_t *opts = &daemon_data->bpf_gtpc_reuseport;
+
+	if (!__test_bit(GTP_FL_GTPC_REUSEPORT_LOADED_BIT, &daemon_data->flags)) {
+		vty_out(vty, "%% No GTP-C reuseport BPF program is currently configured. Ignoring%s"
+			   , VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	/* Already running GTP-C servers keep their steering until
+	 * restarted */
+	memset(opts, 0, sizeof(gtp_bpf_opts_t));
+	__clear_bit(GTP_FL_GTPC_REUSEPORT_LOADED_BIT, &daemon_data->flags);
+	return CMD_SUCCESS;
+}
+
 static int
 pdn_mirror_prepare(int argc, const char **argv, vty_t *vty,
 		   struct sockaddr_storage *addr, uint8_t *protocol, int *ifindex)
@@ -818,11 +862,14 @@ vty_request_worker(gtp_req_worker_t *w, void *arg)
 
 	vty_out(vty, "  Worker:#%.2d task:0x%lx fd:%d(%s)%s"
 		       "    flags:%s%s"
+		       "    accepted:%lu requests:%lu lookups:%lu%s"
 		     , w->id
 		     , w->task
 		     , w->fd, (w->fd < 0) ? "none" : fd2str(w->fd, fdpath, PATH_MAX)
 		     , VTY_NEWLINE
 		     , gtp_flags2str(flags2str, sizeof(flags2str), w->flags)
+		     , VTY_NEWLINE
+		     , w->accepted, w->requests, w->lookups
 		     , VTY_NEWLINE);
 	return 0;
 }
@@ -873,11 +920,19 @@ pdn_config_write(vty_t *vty)
 		gtp_bpf_opts_config_write(vty, " xdp-gtp-forward", &daemon_data->xdp_gtp_forward);
 	if (__test_bit(GTP_FL_MIRROR_LOADED_BIT, &daemon_data->flags))
 		gtp_bpf_opts_config_write(vty, " xdp-mirror", &daemon_data->xdp_mirror);
+	if (__test_bit(GTP_FL_GTPC_REUSEPORT_LOADED_BIT, &daemon_data->flags))
+		vty_out(vty, " bpf-gtpc-reuseport %s%s"
+			     , daemon_data->bpf_gtpc_reuseport.filename
+			     , VTY_NEWLINE);
 	if (__test_bit(GTP_FL_RESTART_COUNTER_LOADED_BIT, &daemon_data->flags)) {
 		vty_out(vty, " restart-counter-file %s%s"
 			     , daemon_data->restart_counter_filename
 			     , VTY_NEWLINE);
 	}
+	gtp_path_config_write(vty);
+	gtp_reaper_config_write(vty);
+	gtp_ckpt_config_write(vty);
+	gtp_repl_config_write(vty);
 	vty_out(vty, "!%s", VTY_NEWLINE);
 
 	return CMD_SUCCESS;
@@ -906,6 +961,8 @@ gtp_vty_init(void)
 	install_element(PDN_NODE, &no_pdn_xdp_mirror_cmd);
 	install_element(PDN_NODE, &pdn_bpf_ppp_rps_cmd);
 	install_element(PDN_NODE, &no_pdn_bpf_ppp_rps_cmd);
+	install_element(PDN_NODE, &pdn_bpf_gtpc_reuseport_cmd);
+	install_element(PDN_NODE, &no_pdn_bpf_gtpc_reuseport_cmd);
 	install_element(PDN_NODE, &pdn_mirror_cmd);
 	install_element(PDN_NODE, &no_pdn_mirror_cmd);
 	install_element(PDN_NODE, &restart_counter_file_cmd);
@@ -940,6 +997,14 @@ gtp_vty_init(void)
 	gtp_switch_vty_init();
 	gtp_router_vty_init();
 	gtp_sessions_vty_init();
+	gtp_resolv_cache_vty_init();
+	gtp_path_vty_init();
+	gtp_reaper_vty_init();
+	gtp_ckpt_vty_init();
+	gtp_repl_vty_init();
+	gtp_replay_vty_init();
+	gtp_overload_vty_init();
+	gtp_hash_vty_init();
 
 	return 0;
 }
@@ -43,6 +43,97 @@ extern data_t *daemon_data;
 
 /* Local data */
 static const char *pin_basedir = "/sys/fs/bpf";
+static __thread gtp_xdp_batch_t *gtp_xdp_batch;
+
+
+/*
+ *	Batched map deletion
+ */
+static void
+gtp_xdp_batch_flush(gtp_xdp_batch_t *b, gtp_xdp_batch_map_t *m)
+{
+	char errmsg[GTP_XDP_STRERR_BUFSIZE];
+	uint32_t count = m->cnt, i;
+	int err;
+
+	if (!m->cnt)
+		return;
+
+	err = bpf_map_delete_batch(bpf_map__fd(m->map), m->keys, &count, NULL);
+	b->syscalls++;
+	b->flushed += m->cnt;
+	if (!err)
+		goto end;
+
+	/* Batch stops on first missing key: finish one by one,
+	 * missing entries are not an error here */
+	for (i = count; i < m->cnt; i++) {
+		err = bpf_map__delete_elem(m->map, m->keys + i * m->key_sz, m->key_sz, 0);
+		b->syscalls++;
+		if (err && err != -ENOENT) {
+			libbpf_strerror(err, errmsg, GTP_XDP_STRERR_BUFSIZE);
+			log_message(LOG_INFO, "%s(): Cant delete entry from map:%s (%s)"
+					    , __FUNCTION__, bpf_map__name(m->map), errmsg);
+		}
+	}
+
+  end:
+	m->cnt = 0;
+}
+
+/* Stats are per batch, caller accumulates them after batch_end() */
+void
+gtp_xdp_batch_begin(gtp_xdp_batch_t *b)
+{
+	memset(b->map, 0, sizeof(b->map));
+	b->flushed = b->syscalls = 0;
+	gtp_xdp_batch = b;
+}
+
+void
+gtp_xdp_batch_end(void)
+{
+	gtp_xdp_batch_t *b = gtp_xdp_batch;
+	int i;
+
+	if (!b)
+		return;
+
+	for (i = 0; i < GTP_XDP_BATCH_MAP; i++)
+		gtp_xdp_batch_flush(b, &b->map[i]);
+	gtp_xdp_batch = NULL;
+}
+
+int
+gtp_xdp_map_delete(struct bpf_map *map, const void *key, uint32_t key_sz)
+{
+	gtp_xdp_batch_t *b = gtp_xdp_batch;
+	gtp_xdp_batch_map_t *m = NULL;
+	int i;
+
+	if (!b || key_sz > GTP_XDP_BATCH_KEYSZ)
+		return bpf_map__delete_elem(map, key, key_sz, 0);
+
+	for (i = 0; i < GTP_XDP_BATCH_MAP; i++) {
+		if (b->map[i].map == map || !b->map[i].map) {
+			m = &b->map[i];
+			break;
+		}
+	}
+
+	/* No slot left, recycle first one */
+	if (!m) {
+		m = &b->map[0];
+		gtp_xdp_batch_flush(b, m);
+	}
+
+	m->map = map;
+	m->key_sz = key_sz;
+	memcpy(m->keys + m->cnt * key_sz, key, key_sz);
+	if (++m->cnt == GTP_XDP_BATCH_SIZE)
+		gtp_xdp_batch_flush(b, m);
+	return 0;
+}
 
 
 /*
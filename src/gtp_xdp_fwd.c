@@ -155,7 +155,7 @@ gtp_xdp_teid_action(struct bpf_map *map, int action, gtp_teid_t *t)
 		gtp_xdp_teid_rule_set(new, t);
 		err = bpf_map__update_elem(map, &key, sizeof(uint32_t), new, sz, BPF_NOEXIST);
 	} else if (action == RULE_DEL)
-		err = bpf_map__delete_elem(map, &key, sizeof(uint32_t), 0);
+		err = gtp_xdp_map_delete(map, &key, sizeof(uint32_t));
 	else
 		return -1;
 	if (err) {
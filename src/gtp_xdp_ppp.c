@@ -148,9 +148,9 @@ gtp_xdp_ppp_map_action(struct bpf_map *map, int action, gtp_teid_t *t, int ifind
 						   new, sz, BPF_NOEXIST);
 	} else if (action == RULE_DEL) {
 		if (__test_bit(GTP_TEID_FL_EGRESS, &t->flags))
-			err = bpf_map__delete_elem(map, &rt_k, sizeof(struct ip_rt_key), 0);
+			err = gtp_xdp_map_delete(map, &rt_k, sizeof(struct ip_rt_key));
 		else
-			err = bpf_map__delete_elem(map, &ppp_k, sizeof(struct ppp_key), 0);
+			err = gtp_xdp_map_delete(map, &ppp_k, sizeof(struct ppp_key));
 	} else
 		return -1;
 	if (err) {
@@ -198,7 +198,7 @@ gtp_xdp_rt_action(struct bpf_map *map, int action, gtp_teid_t *t, int ifindex)
 		gtp_xdp_rt_rule_set(new, t);
 		err = bpf_map__update_elem(map, &rt_key, sizeof(struct ip_rt_key), new, sz, BPF_NOEXIST);
 	} else if (action == RULE_DEL)
-		err = bpf_map__delete_elem(map, &rt_key, sizeof(struct ip_rt_key), 0);
+		err = gtp_xdp_map_delete(map, &rt_key, sizeof(struct ip_rt_key));
 	else
 		return -1;
 	if (err) {
@@ -97,6 +97,7 @@ enum gtp_flags {
 #define GTP_CAUSE_REQUEST_ACCEPTED			16
 #define GTP_CAUSE_CONTEXT_NOT_FOUND			64
 #define GTP_CAUSE_MISSING_OR_UNKNOWN_APN		78
+#define GTP_CAUSE_PREFERRED_PDN_TYPE_NOT_SUPPORTED	83
 #define GTP_CAUSE_ALL_DYNAMIC_ADDRESS_OCCUPIED		84
 #define GTP_CAUSE_USER_AUTH_FAILED			92
 #define GTP_CAUSE_APN_ACCESS_DENIED			93
@@ -336,6 +337,9 @@ typedef struct _gtp_ie_paa {
 	uint32_t	addr;
 } __attribute__((packed)) gtp_ie_paa_t;
 #define GTP_PAA_IPV4_TYPE	1
+#define GTP_PAA_IPV6_TYPE	2
+#define GTP_PAA_IPV4V6_TYPE	3
+#define GTP_PAA_IPV6_PLEN	64
 
 #define GTP_IE_ULI_TYPE			86
 typedef struct _gtp_ie_uli {
@@ -413,6 +417,41 @@ typedef struct _gtp_ie_apn_restriction {
 	uint8_t		value;
 } __attribute__((packed)) gtp_ie_apn_restriction_t;
 
+#define GTP_IE_EPC_TIMER_TYPE				156
+#define GTP_EPC_TIMER_UNIT_2S				0
+#define GTP_EPC_TIMER_UNIT_1M				1
+#define GTP_EPC_TIMER_UNIT_10M				2
+typedef struct _gtp_ie_epc_timer {
+	gtp_ie_t	h;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	uint8_t		value:5;
+	uint8_t		unit:3;
+#elif __BYTE_ORDER == __BIG_ENDIAN
+	uint8_t		unit:3;
+	uint8_t		value:5;
+#else
+# error "Please fix <bits/endian.h>"
+#endif
+} __attribute__((packed)) gtp_ie_epc_timer_t;
+
+#define GTP_IE_OVERLOAD_CONTROL_INFO_TYPE		180
+typedef struct _gtp_ie_overload_control_info {
+	gtp_ie_t	h;
+	/* Grouped IE here */
+} __attribute__((packed)) gtp_ie_overload_control_info_t;
+
+#define GTP_IE_METRIC_TYPE				182
+typedef struct _gtp_ie_metric {
+	gtp_ie_t	h;
+	uint8_t		value;
+} __attribute__((packed)) gtp_ie_metric_t;
+
+#define GTP_IE_SEQUENCE_NUMBER_TYPE			183
+typedef struct _gtp_ie_sequence_number {
+	gtp_ie_t	h;
+	uint32_t	sqn;
+} __attribute__((packed)) gtp_ie_sequence_number_t;
+
 
 
 
@@ -29,6 +29,7 @@
 #define GTP_DISPLAY_BUFFER_LEN	512
 #define GTP_DISPLAY_SRV_LEN	256
 #define GTP_MATCH_MAX_LEN	256
+#define GTP_APN_TPL_SIZE	512
 
 /* flags */
 enum gtp_apn_flags {
@@ -61,13 +62,21 @@ typedef struct _gtp_pco {
 	unsigned long		flags;
 } gtp_pco_t;
 
-typedef struct _gtp_ip_pool {
-	uint32_t		network;
-	uint32_t		netmask;
-	bool			*lease;
-	int			next_lease_idx;
-} gtp_ip_pool_t;
 
+/* Pre-built Create Session Response IEs:
+ *   Recovery | Indication | PCO | APN Restriction
+ * Recovery is patched at emission time. PCO is skipped when session
+ * specific IPCP values are in use (PPPoE). Templates are immutable
+ * once published, a rebuild publishes a new one */
+typedef struct _gtp_apn_tpl {
+	uint8_t			buffer[GTP_APN_TPL_SIZE];
+	uint16_t		pco_off;
+	uint16_t		restriction_off;
+	uint16_t		len;
+	uint32_t		gen;
+
+	grace_obj_t		gp;		/* published snapshot */
+} gtp_apn_tpl_t;
 
 /* Rewriting rule */
 typedef struct _gtp_rewrite_rule {
@@ -94,12 +103,19 @@ typedef struct _gtp_apn {
 	unsigned long		indication_flags;
 	gtp_pco_t		*pco;
 	gtp_ip_pool_t		*ip_pool;
+	gtp_ip_pool_t		*ip6_pool;
 	ip_vrf_t		*vrf;
 
+	grace_ptr_t		tpl;		/* published, lock-free */
+	uint32_t		tpl_gen;
+	int			tpl_building;
+
 	list_head_t		naptr;
 	list_head_t		service_selection;
+	grace_ptr_t		sched_index;	/* published, lock-free */
 	list_head_t		imsi_match;
 	list_head_t		oi_match;
+	grace_ptr_t		rewrite_trie[2];	/* published, lock-free */
 	pthread_mutex_t		mutex;
 
 	pthread_t		cache_task;
@@ -114,9 +130,15 @@ typedef struct _gtp_apn {
 
 
 /* Prototypes */
-extern uint32_t gtp_ip_pool_get(gtp_apn_t *);
-extern int gtp_ip_pool_put(gtp_apn_t *, uint32_t);
+extern uint32_t gtp_ip_pool_get(gtp_apn_t *, int);
+extern int gtp_ip_pool_put(gtp_apn_t *, int, uint32_t);
+extern int gtp_ip_pool_restore(gtp_apn_t *, uint32_t);
+extern int gtp_ip6_pool_get(gtp_apn_t *, int, struct in6_addr *);
+extern int gtp_ip6_pool_put(gtp_apn_t *, int, struct in6_addr *);
+extern int gtp_ip6_pool_restore(gtp_apn_t *, struct in6_addr *);
 extern gtp_apn_t *gtp_apn_get(const char *);
+extern void gtp_apn_tpl_invalidate(gtp_apn_t *);
+extern void gtp_apn_tpl_publish(gtp_apn_t *, gtp_apn_tpl_t *);
 extern int gtp_apn_destroy(void);
 extern int gtp_apn_vty_init(void);
 
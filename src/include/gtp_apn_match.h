@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_APN_MATCH_H
+#define _GTP_APN_MATCH_H
+
+/* Defines */
+#define GTP_APN_MATCH_META	"*?[]\\"
+
+/* Compiled APN matcher: immutable snapshot of APN list.
+ *
+ * Exact names live in a hashtab. Wildcard patterns are indexed in
+ * a label trie by the complete labels of their literal suffix (the
+ * part after the last glob meta), walked right to left. Candidates
+ * are confirmed via fnmatch(), and the lowest config index wins, so
+ * result is the same as a first-match list walk. */
+typedef struct _gtp_apn_match_exact {
+	const char			*name;
+	uint32_t			idx;
+	struct _gtp_apn_match_exact	*next;
+} gtp_apn_match_exact_t;
+
+typedef struct _gtp_apn_match_node {
+	char				*label;
+	uint32_t			*pattern;	/* apn[] index, ascending */
+	uint32_t			nr_pattern;
+	struct _gtp_apn_match_node	*child;
+	struct _gtp_apn_match_node	*sibling;
+} gtp_apn_match_node_t;
+
+typedef struct _gtp_apn_match {
+	gtp_apn_t			**apn;		/* config order */
+	uint32_t			nr_apn;
+	gtp_apn_match_exact_t		**exact;
+	gtp_apn_match_exact_t		*exact_entry;
+	uint32_t			exact_mask;
+	uint32_t			nr_exact;
+	gtp_apn_match_node_t		*root;
+	uint32_t			nr_pattern;
+
+	grace_obj_t			gp;		/* published snapshot */
+} gtp_apn_match_t;
+
+
+/* Prototypes */
+extern gtp_apn_match_t *gtp_apn_match_build(list_head_t *);
+extern void gtp_apn_match_free(gtp_apn_match_t *);
+extern gtp_apn_t *gtp_apn_match_lookup(gtp_apn_match_t *, const char *);
+
+#endif
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_CKPT_H
+#define _GTP_CKPT_H
+
+/* Defines */
+#define GTP_CKPT_MAGIC			0x47435054	/* "GCPT" */
+#define GTP_CKPT_VERSION		1
+#define GTP_CKPT_HDR_SIZE		4096
+#define GTP_CKPT_SIZE			256	/* MBytes, default */
+#define GTP_CKPT_SYNC_TIMER		1	/* sec */
+#define GTP_CKPT_COMPACT_RATIO		50	/* % of log in use */
+#define GTP_CKPT_MAX_AGE		300	/* sec, older log is not restored */
+#define GTP_CKPT_TEID_MAX		32	/* per session image */
+#define GTP_CKPT_NONE			0xffff
+#define GTP_CKPT_IMAGE_MAX		(sizeof(gtp_ckpt_session_t) + \
+					 GTP_CKPT_TEID_MAX * sizeof(gtp_ckpt_teid_t))
+
+/* Record type */
+enum gtp_ckpt_rec_type {
+	GTP_CKPT_REC_SESSION = 1,	/* full session image */
+	GTP_CKPT_REC_SESSION_DEL,
+	GTP_CKPT_REC_SYNC_BEGIN,	/* replication resync */
+	GTP_CKPT_REC_SYNC_END,
+};
+
+/* Server owning session */
+enum gtp_ckpt_srv {
+	GTP_CKPT_SRV_SWITCH = 0,
+	GTP_CKPT_SRV_SWITCH_EGRESS,
+	GTP_CKPT_SRV_ROUTER,
+};
+
+/* On-disk header flags, fixed width */
+#define GTP_CKPT_HDR_FL_COMPLETE	(1ULL << 0)	/* compaction done */
+#define GTP_CKPT_HDR_FL_OVERFLOW	(1ULL << 1)	/* records lost, not restorable */
+
+enum gtp_ckpt_flags {
+	GTP_CKPT_FL_CONFIGURED_BIT,
+	GTP_CKPT_FL_RUNNING_BIT,
+	GTP_CKPT_FL_STOP_BIT,
+};
+
+/* On-disk layout: one header page followed by records appended
+ * back to back. A record becomes visible once its type is set,
+ * written last: replay stops at first unset or corrupted record. */
+typedef struct _gtp_ckpt_hdr {
+	uint32_t		magic;
+	uint16_t		version;
+	uint8_t			restart_counter;
+	uint8_t			pad;
+	uint64_t		size;
+	uint64_t		tail;
+	uint64_t		generation;
+	int64_t			sync_time;
+	uint64_t		flags;
+} gtp_ckpt_hdr_t;
+
+typedef struct _gtp_ckpt_rec {
+	uint16_t		type;
+	uint16_t		pad;
+	uint32_t		len;		/* payload length */
+	uint32_t		crc;		/* payload checksum */
+	uint32_t		pad2;
+} gtp_ckpt_rec_t;
+
+typedef struct _gtp_ckpt_key {
+	uint64_t		imsi;
+	uint32_t		id;
+	uint32_t		pad;
+} gtp_ckpt_key_t;
+
+typedef struct _gtp_ckpt_teid {
+	uint32_t		id;
+	uint32_t		vid;
+	uint32_t		ipv4;
+	uint32_t		sqn;
+	uint32_t		vsqn;
+	uint32_t		flags;
+	uint8_t			version;
+	uint8_t			type;
+	uint8_t			bearer_id;
+	uint8_t			family;
+	uint16_t		peer;		/* image index or NONE */
+	uint16_t		bearer;
+	uint32_t		sgw_addr;
+	uint32_t		pgw_addr;
+	uint16_t		sgw_port;
+	uint16_t		pgw_port;
+} gtp_ckpt_teid_t;
+
+typedef struct _gtp_ckpt_session {
+	gtp_ckpt_key_t		key;
+	char			ctx[GTP_NAME_MAX_LEN];
+	char			apn[GTP_APN_MAX_LEN];
+	uint8_t			srv;
+	uint8_t			worker;
+	uint8_t			ptype;
+	uint8_t			path_version;
+	uint8_t			path_recovery;
+	uint8_t			path_has_recovery;
+	uint8_t			nr_gtpc;
+	uint8_t			nr_gtpu;
+	uint32_t		ipv4;
+	uint32_t		ipv4_lease;
+	uint32_t		charging_id;
+	uint32_t		path_addr;
+	uint16_t		path_port;
+	uint16_t		pad;
+	uint32_t		sgw_addr;	/* conn last sGW visited */
+	uint16_t		sgw_port;
+	uint16_t		pad2;
+	uint64_t		mei;
+	uint64_t		msisdn;
+	struct in6_addr		ipv6_prefix;
+	int64_t			creation_time;
+	int64_t			expire;		/* wall clock, 0: no lifetime */
+	gtp_ckpt_teid_t		teid[];
+} gtp_ckpt_session_t;
+
+/* Mapped log file */
+typedef struct _gtp_ckpt_log {
+	char			path[GTP_STR_MAX_LEN];
+	int			fd;
+	uint64_t		size;
+	gtp_ckpt_hdr_t		*hdr;
+	uint8_t			*base;
+} gtp_ckpt_log_t;
+
+/* Conn IMSI snapshot, sessions are walked outside of conn table lock */
+typedef struct _gtp_ckpt_imsi {
+	uint64_t		*imsi;
+	uint32_t		nr;
+	uint32_t		max;
+} gtp_ckpt_imsi_t;
+
+typedef struct _gtp_ckpt {
+	char			path[GTP_STR_MAX_LEN];
+	uint64_t		size;		/* bytes */
+	pthread_mutex_t		mutex;		/* append */
+	gtp_ckpt_log_t		*log;		/* active log */
+	gtp_ckpt_log_t		*next;		/* compaction target */
+	pthread_t		task;
+	pthread_mutex_t		task_mutex;
+	pthread_cond_t		cond;
+
+	/* stats */
+	uint64_t		appended;
+	uint64_t		appended_bytes;
+	uint64_t		overflow;
+	uint64_t		compactions;
+	uint64_t		restored;
+	uint64_t		restore_errors;
+	uint64_t		restore_usec;
+	time_t			last_compaction;
+
+	unsigned long		flags;
+} gtp_ckpt_t;
+
+
+/* Prototypes */
+extern int gtp_ckpt_session_image(gtp_session_t *, gtp_ckpt_session_t *);
+extern int gtp_ckpt_session_restore(gtp_ckpt_session_t *, time_t, unsigned long);
+extern int gtp_ckpt_session_update(gtp_ckpt_session_t *, time_t, unsigned long);
+extern int gtp_ckpt_imsi_iter(void *, void *);
+extern int gtp_ckpt_session_put(gtp_session_t *);
+extern int gtp_ckpt_session_del(gtp_session_t *);
+extern int gtp_ckpt_start(void);
+extern int gtp_ckpt_config_write(vty_t *);
+extern int gtp_ckpt_init(void);
+extern int gtp_ckpt_destroy(void);
+extern int gtp_ckpt_vty_init(void);
+
+#endif
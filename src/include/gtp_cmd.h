@@ -48,6 +48,7 @@ typedef struct _gtp_cmd_args {
 } gtp_cmd_args_t;
 
 /* Prototypes */
+extern int gtp_cmd_echo_build(gtp_cmd_args_t *);
 extern int gtp_cmd_echo_request(gtp_cmd_args_t *);
 
 #endif
@@ -26,6 +26,7 @@
 #define CONN_HASHTAB_BITS  20
 #define CONN_HASHTAB_SIZE  (1 << CONN_HASHTAB_BITS)
 #define CONN_HASHTAB_MASK  (CONN_HASHTAB_SIZE - 1)
+#define GTP_CONN_HASH_RETRY	8
 
 /* Connection flags */
 enum conn_flags {
@@ -44,8 +45,8 @@ typedef struct _gtp_conn {
 	pthread_mutex_t		session_mutex;
 	time_t			ts;
 
-	/* hash stuff */
-        struct hlist_node       hlist;
+	list_head_t		next;		/* release list */
+	grace_obj_t		gp;		/* deferred release */
 
 	unsigned long		flags;
 	int			refcnt;
@@ -56,10 +57,14 @@ typedef struct _gtp_conn {
 extern int gtp_conn_get(gtp_conn_t *);
 extern int gtp_conn_put(gtp_conn_t *);
 extern gtp_conn_t *gtp_conn_alloc(uint64_t);
+extern void gtp_conn_free(gtp_conn_t *);
 extern gtp_conn_t *gtp_conn_get_by_imsi(uint64_t);
 extern int gtp_conn_hash(gtp_conn_t *);
 extern int gtp_conn_unhash(gtp_conn_t *);
 extern int gtp_conn_vty(vty_t *, int (*vty_conn) (vty_t *, gtp_conn_t *), uint64_t);
+extern int gtp_conn_tab_vty(vty_t *);
+extern int gtp_conn_iterate(int (*) (void *, void *), void *);
+extern int gtp_conn_count(void);
 extern int gtp_conn_init(void);
 extern int gtp_conn_destroy(void);
 
@@ -39,6 +39,7 @@ enum daemon_flags {
 	GTP_FL_MIRROR_LOADED_BIT,
 	GTP_FL_PPP_RPS_LOADED_BIT,
 	GTP_FL_RESTART_COUNTER_LOADED_BIT,
+	GTP_FL_GTPC_REUSEPORT_LOADED_BIT,
 };
 
 /* Main control block */
@@ -76,6 +77,7 @@ typedef struct _data {
 	gtp_bpf_opts_t		xdp_gtp_forward;
 	gtp_bpf_opts_t		xdp_mirror;
 	gtp_bpf_opts_t		bpf_ppp_rps;
+	gtp_bpf_opts_t		bpf_gtpc_reuseport;
 	char			restart_counter_filename[GTP_STR_MAX_LEN];
 	uint8_t			restart_counter;
 
@@ -43,16 +43,22 @@
 #include "json_reader.h"
 #include "json_writer.h"
 #include "pkt_buffer.h"
+#include "grace.h"
 #include "jhash.h"
 #include "gtp.h"
 #include "gtp_if.h"
 #include "gtp_request.h"
 #include "gtp_data.h"
+#include "gtp_hash.h"
 #include "gtp_htab.h"
+#include "gtp_idpool.h"
 #include "gtp_teid.h"
 #include "gtp_iptnl.h"
+#include "gtp_oatab.h"
 #include "gtp_conn.h"
+#include "gtp_overload.h"
 #include "gtp_server.h"
+#include "gtp_replay.h"
 #include "gtp_pppoe.h"
 #include "gtp_pppoe_session.h"
 #include "gtp_pppoe_proto.h"
@@ -61,10 +67,18 @@
 #include "gtp_ppp.h"
 #include "gtp_ppp_session.h"
 #include "gtp_vrf.h"
+#include "gtp_ip_pool.h"
 #include "gtp_apn.h"
+#include "gtp_apn_match.h"
+#include "gtp_rewrite.h"
 #include "gtp_session.h"
 #include "gtp_dpd.h"
+#include "gtp_path.h"
+#include "gtp_reaper.h"
+#include "gtp_ckpt.h"
+#include "gtp_repl.h"
 #include "gtp_resolv.h"
+#include "gtp_resolv_cache.h"
 #include "gtp_sched.h"
 #include "gtp_switch.h"
 #include "gtp_switch_hdl.h"
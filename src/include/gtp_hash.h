@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_HASH_H
+#define _GTP_HASH_H
+
+/* Hash algorithms */
+enum gtp_hash_algo {
+	GTP_HASH_JHASH = 0,
+	GTP_HASH_CRC32C,
+	GTP_HASH_XXH3,
+	GTP_HASH_ALGO_MAX,
+};
+
+/* Hashed tables */
+enum gtp_hash_id {
+	GTP_HASH_TEID = 0,
+	GTP_HASH_SQN,
+	GTP_HASH_CONN,
+	GTP_HASH_PPPOE,
+	GTP_HASH_DLOCK,
+	GTP_HASH_ID_MAX,
+};
+
+/* Build time default, runtime override via --hash */
+#ifndef GTP_HASH_DEFAULT
+#define GTP_HASH_DEFAULT	GTP_HASH_JHASH
+#endif
+
+#define GTP_HASH_PRIME64_1	0x9e3779b185ebca87ULL
+#define GTP_HASH_RRMXMX		0x9fb21c651e98df25ULL
+
+extern uint8_t gtp_hash_algo[GTP_HASH_ID_MAX];
+extern uint64_t gtp_hash_secret[2];
+
+/* Prototypes */
+extern uint32_t gtp_hash_crc32c_1word(uint32_t);
+extern uint32_t gtp_hash_crc32c_2words(uint32_t, uint32_t);
+extern uint32_t gtp_hash_crc32c_3words(uint32_t, uint32_t, uint32_t);
+extern const char *gtp_hash_algo_name(int);
+extern const char *gtp_hash_id_name(int);
+extern int gtp_hash_parse(const char *);
+extern int gtp_hash_init(void);
+extern int gtp_hash_vty_init(void);
+
+
+/*
+ *	Keyed XXH3 short input paths (4..16 bytes)
+ */
+static inline uint64_t
+gtp_hash_rotl64(uint64_t v, int r)
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+static inline uint32_t
+gtp_hash_xxh3_8(uint64_t v, uint64_t len)
+{
+	uint64_t h = v ^ gtp_hash_secret[0];
+
+	/* rrmxmx */
+	h ^= gtp_hash_rotl64(h, 49) ^ gtp_hash_rotl64(h, 24);
+	h *= GTP_HASH_RRMXMX;
+	h ^= (h >> 35) + len;
+	h *= GTP_HASH_RRMXMX;
+	return h ^ (h >> 28);
+}
+
+static inline uint32_t
+gtp_hash_xxh3_16(uint64_t lo, uint64_t hi, uint64_t len)
+{
+	__uint128_t m;
+	uint64_t h;
+
+	lo ^= gtp_hash_secret[0];
+	hi ^= gtp_hash_secret[1];
+	m = (__uint128_t) lo * hi;
+	h = len + __builtin_bswap64(lo) + hi + ((uint64_t) m ^ (uint64_t) (m >> 64));
+
+	/* avalanche */
+	h ^= h >> 37;
+	h *= 0x165667919e3779f9ULL;
+	return h ^ (h >> 32);
+}
+
+
+/*
+ *	Table hash helpers
+ */
+static inline uint32_t
+gtp_hash_1word(int id, uint32_t a)
+{
+	switch (gtp_hash_algo[id]) {
+	case GTP_HASH_CRC32C:
+		return gtp_hash_crc32c_1word(a);
+	case GTP_HASH_XXH3:
+		return gtp_hash_xxh3_8(a, 4);
+	}
+
+	return jhash_1word(a, 0);
+}
+
+static inline uint32_t
+gtp_hash_2words(int id, uint32_t a, uint32_t b)
+{
+	switch (gtp_hash_algo[id]) {
+	case GTP_HASH_CRC32C:
+		return gtp_hash_crc32c_2words(a, b);
+	case GTP_HASH_XXH3:
+		return gtp_hash_xxh3_8(((uint64_t) b << 32) | a, 8);
+	}
+
+	return jhash_2words(a, b, 0);
+}
+
+static inline uint32_t
+gtp_hash_3words(int id, uint32_t a, uint32_t b, uint32_t c)
+{
+	switch (gtp_hash_algo[id]) {
+	case GTP_HASH_CRC32C:
+		return gtp_hash_crc32c_3words(a, b, c);
+	case GTP_HASH_XXH3:
+		return gtp_hash_xxh3_16(((uint64_t) b << 32) | a, c, 12);
+	}
+
+	return jhash_3words(a, b, c, 0);
+}
+
+#endif
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_IDPOOL_H
+#define _GTP_IDPOOL_H
+
+/* defines */
+#define GTP_IDPOOL_MAX_BITS		22	/* per pool, 4M ids */
+#define GTP_IDPOOL_MAX_SIZE		(1 << GTP_IDPOOL_MAX_BITS)
+#define GTP_IDPOOL_WORD_BITS		64
+
+/* flags */
+enum gtp_idpool_flags {
+	GTP_IDPOOL_FL_PERMUTE_BIT,
+};
+
+/* Identifier pool.
+ *
+ * Index space is a bitmap of 64bit words. Words having free bits
+ * are queued into a ring. Allocation sweeps head word from a cursor
+ * and moves it to tail once swept, release queues a word at tail
+ * as soon as it turns from full to not-full. This is a counter
+ * skipping ids in use: O(1) as long as pool is not close to full,
+ * and released ids are reused as late as possible. Optionally
+ * indexes are mapped into id space through a keyed bijection so
+ * that handed out ids are not predictable. */
+typedef struct _gtp_idpool {
+	uint32_t		base;		/* constant id high-bits */
+	uint32_t		mask;		/* id variable bits */
+	uint32_t		size;		/* number of indexes */
+	uint8_t			shift;
+	uint32_t		key[3];
+	uint32_t		key_inv[2];
+
+	uint64_t		*bitmap;
+	uint32_t		*ring;
+	uint32_t		ring_head;
+	uint32_t		ring_cnt;
+	uint32_t		cursor;		/* bit in head word */
+	uint32_t		used;
+
+	uint64_t		alloc;
+	uint64_t		release;
+	uint64_t		exhausted;
+
+	pthread_mutex_t		mutex;
+	unsigned long		flags;
+} gtp_idpool_t;
+
+
+/* Prototypes */
+extern int gtp_idpool_get(gtp_idpool_t *, uint32_t *);
+extern int gtp_idpool_put(gtp_idpool_t *, uint32_t);
+extern int gtp_idpool_reserve(gtp_idpool_t *, uint32_t);
+extern bool gtp_idpool_owns(gtp_idpool_t *, uint32_t);
+extern int gtp_idpool_vty(vty_t *, const char *, gtp_idpool_t *);
+extern gtp_idpool_t *gtp_idpool_alloc(uint32_t, int, uint32_t, bool);
+extern void gtp_idpool_free(gtp_idpool_t *);
+
+#endif
@@ -43,6 +43,7 @@ extern int if_setsockopt_hdrincl(int);
 extern int if_setsockopt_broadcast(int);
 extern int if_setsockopt_promisc(int, int, bool);
 extern int if_setsockopt_attach_bpf(int, int);
+extern int if_setsockopt_attach_reuseport_bpf(int, int);
 extern int if_setsockopt_no_receive(int *);
 extern int if_setsockopt_rcvbuf(int *, int);
 extern int if_setsockopt_bindtodevice(int *, const char *);
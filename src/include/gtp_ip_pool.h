@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_IP_POOL_H
+#define _GTP_IP_POOL_H
+
+/* Defines */
+#define GTP_IP_POOL_SHARDS		16	/* lease caches, by worker id */
+#define GTP_IP_POOL_SHARDS_MASK		(GTP_IP_POOL_SHARDS - 1)
+#define GTP_IP_POOL_CACHE_SIZE		32
+#define GTP_IP_POOL_CACHE_BATCH		(GTP_IP_POOL_CACHE_SIZE / 2)
+#define GTP_IP_POOL_V4_RESERVED		10	/* head & tail of IPv4 pool */
+#define GTP_IP_POOL_V6_MIN_PLEN		40	/* at most 2^24 /64 */
+
+/* Lease cache. Worker allocates and releases from its own cache,
+ * refilled or flushed by batch from the shared bitmap. */
+typedef struct _gtp_ip_pool_cache {
+	uint32_t		lock;
+	uint32_t		cnt;
+	uint64_t		idx[GTP_IP_POOL_CACHE_SIZE];
+} __attribute__ ((__aligned__(64))) gtp_ip_pool_cache_t;
+
+/* Address or /64 prefix pool. Two levels bitmap: one bit per lease
+ * unit (1: free) and one summary bit per 64bits bitmap word having
+ * at least one free unit. A free unit may also sit in a lease cache,
+ * so leased ones are tracked apart (1: leased) to catch double
+ * release. */
+typedef struct _gtp_ip_pool {
+	int			family;
+	uint32_t		network;
+	uint32_t		netmask;
+	struct in6_addr		prefix;
+	uint8_t			prefix_len;
+
+	uint64_t		size;		/* lease units */
+	uint64_t		first;		/* usable [first, last) */
+	uint64_t		last;
+	uint64_t		*bitmap;
+	uint64_t		*summary;
+	uint64_t		*leased;	/* atomic, no lock */
+	uint32_t		nr_word;
+	uint32_t		nr_summary;
+	uint32_t		hint;		/* summary word cursor */
+	uint32_t		lock;
+
+	gtp_ip_pool_cache_t	cache[GTP_IP_POOL_SHARDS];
+
+	/* stats */
+	uint64_t		used;
+	uint64_t		cached;
+	uint64_t		alloc;
+	uint64_t		release;
+	uint64_t		exhausted;
+	uint64_t		invalid;	/* release of a free unit */
+} gtp_ip_pool_t;
+
+
+/* Prototypes */
+extern gtp_ip_pool_t *gtp_ip_pool_alloc(uint32_t, uint32_t);
+extern gtp_ip_pool_t *gtp_ip6_pool_alloc(struct in6_addr *, uint8_t);
+extern void gtp_ip_pool_destroy(gtp_ip_pool_t *);
+extern int gtp_ip_pool_lease(gtp_ip_pool_t *, int, uint64_t *);
+extern int gtp_ip_pool_release(gtp_ip_pool_t *, int, uint64_t);
+extern int gtp_ip_pool_reserve(gtp_ip_pool_t *, uint64_t);
+extern uint32_t gtp_ip_pool_addr(gtp_ip_pool_t *, uint64_t);
+extern int gtp_ip_pool_addr_idx(gtp_ip_pool_t *, uint32_t, uint64_t *);
+extern void gtp_ip6_pool_prefix(gtp_ip_pool_t *, uint64_t, struct in6_addr *);
+extern int gtp_ip6_pool_prefix_idx(gtp_ip_pool_t *, struct in6_addr *, uint64_t *);
+extern void gtp_ip_pool_vty(vty_t *, gtp_ip_pool_t *);
+
+#endif
@@ -24,25 +24,55 @@
 
 /*
  *	GTPv2 Message
+ *
+ * Flat IE index: IEs are stored in message order into a fixed array and
+ * chained per IE type through a direct-indexed table. Same type IEs
+ * (multiple instances or duplicates) are chained in message order. The
+ * index is meant to be owned by a worker and re-used for each message
+ * so parsing doesn't allocate anything.
+ *
+ * Grouped IEs (Bearer Context) children are stored right after their
+ * parent into the IE array and are not part of the type table.
+ *
+ * GTPv1 messages can be indexed the same way: only h->type is then
+ * meaningful, gtp_msg_ie_buffer() returns raw IE pointer for both.
  */
+#define GTP_MSG_IE_MAX		128
+#define GTP_MSG_IE_TYPE_MAX	256
+
 typedef struct _gtp_msg_ie {
 	gtp_ie_t		*h;
 	void const		*data;
+	uint8_t			type;		/* h may be stale on reset */
+	uint8_t			nr_child;	/* grouped IE */
 
-	rb_node_t		n;
+	struct _gtp_msg_ie	*next;		/* same type chaining */
 } gtp_msg_ie_t;
 
 typedef struct _gtp_msg {
 	gtp_hdr_t		*h;
 
-	rb_root_cached_t	ie;
+	gtp_msg_ie_t		*type[GTP_MSG_IE_TYPE_MAX];
+	gtp_msg_ie_t		ie[GTP_MSG_IE_MAX];
+	int			ie_cnt;
+	int			ie_dropped;	/* beyond GTP_MSG_IE_MAX */
+	uint64_t		ie_dropped_total;	/* not reset, for stats */
 } gtp_msg_t;
 
+#define gtp_msg_ie_for_each_child(parent, child)		\
+	for (child = (parent) + 1; child <= (parent) + (parent)->nr_child; child++)
+
 
 /* Prototypes */
 extern size_t gtp_msg_hlen(gtp_hdr_t *);
 extern void gtp_msg_ie_dump(const gtp_msg_ie_t *);
 extern gtp_msg_ie_t *gtp_msg_ie_get(gtp_msg_t *, uint8_t);
+extern gtp_msg_ie_t *gtp_msg_ie_get_instance(gtp_msg_t *, uint8_t, uint8_t);
+extern gtp_msg_ie_t *gtp_msg_ie_child_get(gtp_msg_ie_t *, uint8_t);
+extern uint8_t *gtp_msg_ie_buffer(gtp_msg_t *, uint8_t);
+extern void gtp_msg_reset(gtp_msg_t *);
+extern int gtp_msg_parse(gtp_msg_t *, const pkt_buffer_t *);
+extern int gtp1_msg_parse(gtp_msg_t *, const pkt_buffer_t *);
 extern gtp_msg_t *gtp_msg_alloc(const pkt_buffer_t *);
 extern void gtp_msg_destroy(gtp_msg_t *);
 extern void gtp_msg_dump(gtp_msg_t *);
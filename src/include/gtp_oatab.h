@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_OATAB_H
+#define _GTP_OATAB_H
+
+/* defines */
+#define GTP_OATAB_GROUP_SLOTS	16
+#define GTP_OATAB_MIN_GROUPS	1024
+#define GTP_OATAB_CTRL_EMPTY	0x80
+#define GTP_OATAB_CTRL_DELETED	0xfe
+#define GTP_OATAB_ADD_LOCKS	256
+
+/* Open addressing hashtab: uint64_t key to object pointer.
+ *
+ * SwissTable layout: slots are grouped by 16, each group carrying
+ * a control byte per slot holding 7bits of key hash (or EMPTY /
+ * DELETED). A lookup matches the 16 control bytes at once (SSE2)
+ * and only touches candidate slots, probing groups quadratically
+ * until one having an EMPTY slot.
+ *
+ * Readers are lock-free: each group carries a sequence counter
+ * bumped by writers around updates, readers retry a group when it
+ * moved under them. Writers serialize per group via a spinlock.
+ * Growth rehashes into a new table under every group lock, then
+ * publishes it. Readers of previous table then retry on new one.
+ * Readers and writers access tables within a grace read section,
+ * previous table is released once a grace period went by, without
+ * blocking resize.
+ *
+ * Adders of a same key serialize on a key hash striped lock, taken
+ * before any group lock, so duplicate check and insert are atomic.
+ * Replace takes the same lock: ownership of a key moves in a single
+ * step, value being swapped in place under group lock. */
+typedef struct _gtp_oatab_slot {
+	uint64_t		key;
+	void			*value;
+} gtp_oatab_slot_t;
+
+typedef struct _gtp_oatab_group {
+	uint8_t			ctrl[GTP_OATAB_GROUP_SLOTS];
+	uint32_t		seq;
+	uint32_t		lock;
+	gtp_oatab_slot_t	slot[GTP_OATAB_GROUP_SLOTS];
+} __attribute__ ((__aligned__(64))) gtp_oatab_group_t;
+
+typedef struct _gtp_oatab_table {
+	gtp_oatab_group_t	*group;
+	uint32_t		mask;		/* nr_groups - 1 */
+	uint32_t		live;
+	uint32_t		used;		/* live + deleted */
+	int			retired;
+	struct _gtp_oatab	*owner;
+	grace_obj_t		gp;		/* deferred release */
+} gtp_oatab_table_t;
+
+typedef struct _gtp_oatab {
+	gtp_oatab_table_t	*tab;
+	grace_t			gp;
+	grace_defer_t		retired;
+	size_t			retired_size;
+	pthread_mutex_t		resize_mutex;
+	uint32_t		add_lock[GTP_OATAB_ADD_LOCKS];
+	uint32_t		seed;
+	int			hash;		/* gtp_hash table id */
+	uint64_t		resize;
+} gtp_oatab_t;
+
+
+/* Read section, for lookups pinning what they found */
+static inline int
+gtp_oatab_read_lock(gtp_oatab_t *t)
+{
+	return grace_read_lock(&t->gp);
+}
+
+static inline void
+gtp_oatab_read_unlock(gtp_oatab_t *t, int cookie)
+{
+	grace_read_unlock(&t->gp, cookie);
+}
+
+
+/* Prototypes */
+extern void *__gtp_oatab_get(gtp_oatab_t *, uint64_t);
+extern void *gtp_oatab_get(gtp_oatab_t *, uint64_t);
+extern int gtp_oatab_add(gtp_oatab_t *, uint64_t, void *);
+extern int gtp_oatab_replace(gtp_oatab_t *, uint64_t, void *, void **);
+extern int gtp_oatab_del(gtp_oatab_t *, uint64_t, void *);
+extern int gtp_oatab_iterate(gtp_oatab_t *, int (*cb) (void *, void *), void *);
+extern uint32_t gtp_oatab_count(gtp_oatab_t *);
+extern size_t gtp_oatab_memory(gtp_oatab_t *);
+extern int gtp_oatab_init(gtp_oatab_t *, uint32_t, int);
+extern void gtp_oatab_destroy(gtp_oatab_t *);
+
+#endif
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_OVERLOAD_H
+#define _GTP_OVERLOAD_H
+
+/* defines */
+#define GTP_OVERLOAD_PEER_BITS		10
+#define GTP_OVERLOAD_PEER_SIZE		(1 << GTP_OVERLOAD_PEER_BITS)
+#define GTP_OVERLOAD_PEER_MASK		(GTP_OVERLOAD_PEER_SIZE - 1)
+#define GTP_OVERLOAD_SAMPLE		16	/* backlog sampling period, in pkts */
+#define GTP_OVERLOAD_HYSTERESIS		10	/* % */
+#define GTP_OVERLOAD_SATURATED		95	/* % */
+#define GTP_OVERLOAD_THRESHOLD		80	/* % */
+#define GTP_OVERLOAD_LATENCY		1000	/* usec */
+#define GTP_OVERLOAD_VALIDITY		30	/* sec */
+#define GTP_OVERLOAD_OCI_PEER_MAX	32
+
+/* OCI instance in Create/Modify/Delete Session Response */
+enum gtp_overload_oci_instance {
+	GTP_OVERLOAD_OCI_NODE = 0,	/* sender: PGW's OCI */
+	GTP_OVERLOAD_OCI_RELAY,		/* relaying node: SGW's OCI */
+};
+
+/* Message priority, lowest is shed first */
+enum gtp_overload_prio {
+	GTP_OVERLOAD_PRIO_LOW = 0,	/* initial attach */
+	GTP_OVERLOAD_PRIO_NORMAL,
+	GTP_OVERLOAD_PRIO_HIGH,		/* path mgt, deletion & responses */
+	GTP_OVERLOAD_PRIO_MAX,
+};
+
+/* flags */
+enum gtp_overload_flags {
+	GTP_OVERLOAD_FL_ADMISSION_BIT,
+	GTP_OVERLOAD_FL_CONTROL_BIT,
+	GTP_OVERLOAD_FL_OVERLOADED_BIT,
+};
+
+/* Per peer admission, GCRA form of token bucket. Shared by all workers
+ * of a server so a single CAS updates it. */
+typedef struct _gtp_overload_bucket {
+	uint64_t		tat;		/* nsec, theoretical arrival time */
+} gtp_overload_bucket_t;
+
+/* Configuration, per GTP-C server */
+typedef struct _gtp_overload {
+	uint32_t		rate;		/* initial msg/s per peer */
+	uint32_t		burst;
+	int			threshold;	/* % load entering overload */
+	uint32_t		latency;	/* usec, per msg service time target */
+	int			validity;	/* OCI Period-of-Validity, sec */
+	gtp_overload_bucket_t	*bucket;	/* per peer, shared by workers */
+	uint32_t		oci_peer[GTP_OVERLOAD_OCI_PEER_MAX];
+	int			nr_oci_peer;	/* supporting overload control */
+
+	unsigned long		flags;
+} gtp_overload_t;
+
+/* Per worker state */
+typedef struct _gtp_overload_stats {
+	uint64_t		admitted;
+	uint64_t		rate_limited;
+	uint64_t		shed[GTP_OVERLOAD_PRIO_MAX];
+	uint64_t		oci;
+	uint64_t		overload;	/* entering overload */
+} gtp_overload_stats_t;
+
+typedef struct _gtp_overload_worker {
+	uint32_t		sample;
+	int			backlog;	/* % of receive buffer */
+	uint32_t		service;	/* EWMA usec */
+	int			load;		/* % */
+	uint8_t			metric;		/* OCI reduction metric */
+	uint32_t		oci_sqn;
+	time_t			oci_expire;
+
+	gtp_overload_stats_t	stats;
+
+	unsigned long		flags;
+} gtp_overload_worker_t;
+
+
+/* Prototypes */
+struct _gtp_server_worker;
+extern int gtp_overload_admit(struct _gtp_server_worker *, struct sockaddr_storage *, uint64_t);
+extern void gtp_overload_account(struct _gtp_server_worker *, uint64_t);
+extern int gtp_overload_oci_append(struct _gtp_server_worker *, struct sockaddr_in *, int);
+extern int gtp_overload_oci_peer_add(gtp_overload_t *, uint32_t);
+extern int gtp_overload_oci_peer_del(gtp_overload_t *, uint32_t);
+extern uint64_t gtp_overload_usec(void);
+extern gtp_overload_worker_t *gtp_overload_worker_alloc(void);
+extern void gtp_overload_worker_free(gtp_overload_worker_t *);
+extern int gtp_overload_init(gtp_overload_t *);
+extern void gtp_overload_destroy(gtp_overload_t *);
+extern int gtp_overload_config_write(vty_t *, gtp_overload_t *);
+extern int gtp_overload_vty_init(void);
+
+#endif
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_PATH_H
+#define _GTP_PATH_H
+
+/* defines */
+#define GTP_PATH_HASHTAB_BITS		10
+#define GTP_PATH_HASHTAB_SIZE		(1 << GTP_PATH_HASHTAB_BITS)
+#define GTP_PATH_HASHTAB_MASK		(GTP_PATH_HASHTAB_SIZE - 1)
+#define GTP_PATH_MAX			4096
+#define GTP_PATH_TIMER			500	/* msec */
+#define GTP_PATH_ECHO_INTERVAL		60	/* 3GPP.TS.29.274 7.1 : not more often than 60s */
+#define GTP_PATH_T3_RESPONSE		3
+#define GTP_PATH_N3_REQUESTS		3
+#define GTP_PATH_RTT_BUCKETS		10
+#define GTP_PATH_RTT_REF		10000	/* usec, latency halving scheduling weight */
+#define GTP_PATH_PURGE_TIMER		10	/* msec, while purge is pending */
+#define GTP_PATH_PURGE_BATCH		1024	/* sessions per purge run */
+#define GTP_PATH_GC_IDLE		600	/* secs without session before release */
+#define GTP_PATH_ECHO_CHUNK		64	/* echo batch growth */
+#define GTP_PATH_ECHO_SIZE		32
+
+/* Path state */
+enum gtp_path_state {
+	GTP_PATH_UNKNOWN = 0,
+	GTP_PATH_UP,
+	GTP_PATH_DOWN,
+};
+
+/* flags */
+enum gtp_path_flags {
+	GTP_PATH_FL_PGW_BIT,
+	GTP_PATH_FL_SGW_BIT,
+	GTP_PATH_FL_RECOVERY_BIT,
+	GTP_PATH_FL_ECHO_PENDING_BIT,
+	GTP_PATH_FL_PINNED_BIT,
+};
+
+enum gtp_path_global_flags {
+	GTP_PATH_FL_DISABLED_BIT,
+	GTP_PATH_FL_STOP_BIT,
+};
+
+typedef struct _gtp_path {
+	struct sockaddr_in	addr;
+	uint8_t			version;
+	uint8_t			recovery;
+	int			state;
+	gtp_server_t		*srv;		/* echo source */
+
+	/* Echo tracking */
+	uint32_t		seq;
+	uint64_t		echo_sent;	/* usec, outstanding request */
+	int			retry;
+	time_t			echo_next;
+
+	/* Stats */
+	uint64_t		echo_tx;
+	uint64_t		echo_rx;
+	uint64_t		echo_lost;
+	uint32_t		restart;
+	uint32_t		srtt;		/* usec */
+	uint32_t		rtt_min;
+	uint32_t		rtt_max;
+	uint64_t		rtt[GTP_PATH_RTT_BUCKETS];
+	time_t			last_change;
+
+	/* Sessions anchored on this peer. On peer restart, current
+	 * sessions are moved to purge list and released by batch
+	 * from path task. */
+	pthread_mutex_t		sessions_mutex;
+	list_head_t		sessions;
+	list_head_t		purge;
+	uint32_t		nr_sessions;
+	uint64_t		purged;
+	int			refcnt;
+	time_t			idle_since;
+
+	hlist_node_t		hlist;
+	list_head_t		next;
+
+	unsigned long		flags;
+} gtp_path_t;
+
+/* Echo-Request built under ctx lock, sent once released */
+typedef struct _gtp_path_echo {
+	int			fd;
+	struct sockaddr_in	addr;
+	size_t			len;
+	char			buffer[GTP_PATH_ECHO_SIZE];
+} gtp_path_echo_t;
+
+typedef struct _gtp_path_ctx {
+	hlist_head_t		*htab;
+	list_head_t		paths;
+	int			nr_paths;
+	gtp_server_t		*srv;		/* default echo source */
+	int			interval;
+	int			t3_response;
+	int			n3_requests;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	pthread_t		task;
+
+	/* path task private */
+	gtp_path_echo_t		*echo;
+	int			nr_echo;
+	int			max_echo;
+
+	unsigned long		flags;
+} gtp_path_ctx_t;
+
+
+/* Prototypes */
+extern gtp_path_t *gtp_path_get(struct sockaddr_in *, int);
+extern gtp_path_t *gtp_path_register(gtp_server_t *, struct sockaddr_in *, uint8_t, int);
+extern gtp_path_t *gtp_path_session_register(gtp_server_t *, struct sockaddr_in *, uint8_t, int,
+					      gtp_session_t *);
+extern int gtp_path_session_unregister(gtp_session_t *);
+extern int gtp_path_echo_response(struct sockaddr_in *, uint8_t, uint32_t, uint8_t *);
+extern int gtp_path_recovery_update(struct sockaddr_in *, uint8_t *);
+extern bool gtp_path_is_alive(gtp_path_t *);
+extern uint64_t gtp_path_weight(gtp_path_t *, uint16_t);
+extern int gtp_path_config_write(vty_t *);
+extern int gtp_path_init(void);
+extern int gtp_path_destroy(void);
+extern int gtp_path_vty_init(void);
+
+#endif
@@ -107,6 +107,7 @@ typedef struct _pppoe_vendor_tag {
 
 /* Receive channel */
 #define GTP_PPPOE_RECV_TIMER	(3 * TIMER_HZ)
+#define GTP_PPPOE_TIMER_SHARDS	4
 #define GTP_PPPOE_RPS_BITS	3
 #define GTP_PPPOE_RPS_SIZE	(1 << GTP_PPPOE_RPS_BITS)
 #define GTP_PPPOE_RPS_MASK	(GTP_PPPOE_RPS_SIZE - 1)
@@ -132,6 +133,7 @@ enum pppoe_flags {
 	PPPOE_FL_LCP_MAX_CONFIGURE_BIT,
 	PPPOE_FL_LCP_MAX_FAILURE_BIT,
 	PPPOE_FL_IGNORE_INGRESS_PPP_BRD_BIT,
+	PPPOE_FL_PACKET_RING_BIT,
 };
 
 struct rps_opts {
@@ -151,6 +153,7 @@ typedef struct _gtp_pppoe_worker {
 	pthread_mutex_t		mutex;
 
 	mpkt_t			mpkt;
+	pkt_ring_t		ring;		/* PACKET_MMAP mode */
 	pkt_queue_t		pkt_q;
 
 	/* Stats */
@@ -186,6 +189,9 @@ typedef struct _gtp_pppoe {
 	int			lcp_max_terminate;
 	int			lcp_max_configure;
 	int			lcp_max_failure;
+	unsigned int		ring_block_size;
+	unsigned int		ring_block_nr;
+	unsigned int		ring_block_tmo;
 	int			thread_cnt;
 	int			refcnt;
 	unsigned int		seed;
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_REAPER_H
+#define _GTP_REAPER_H
+
+/* Defines */
+#define GTP_REAPER_RATE			20000	/* sessions per second */
+#define GTP_REAPER_SLICE		2000	/* usec, max run per slice */
+#define GTP_REAPER_TIMER		10	/* msec between slices */
+#define GTP_REAPER_ITEM_CHUNK		1024
+
+/* Job type */
+enum gtp_reaper_job_type {
+	GTP_REAPER_JOB_SESSION = 0,	/* explicit {imsi, session-id} list */
+	GTP_REAPER_JOB_IMSI,
+	GTP_REAPER_JOB_APN,
+	GTP_REAPER_JOB_PEER,
+	GTP_REAPER_JOB_ALL,
+};
+
+enum gtp_reaper_flags {
+	GTP_REAPER_FL_STOP_BIT,
+};
+
+typedef struct _gtp_reaper_item {
+	uint64_t		imsi;
+	uint32_t		id;		/* 0: any session matching job */
+} gtp_reaper_item_t;
+
+typedef struct _gtp_reaper_job {
+	int			type;
+	uint64_t		imsi_min;
+	uint64_t		imsi_max;
+	gtp_apn_t		*apn;
+	uint32_t		addr;
+
+	/* IMSI snapshot, taken when job starts */
+	gtp_reaper_item_t	*item;
+	uint32_t		nr_item;
+	uint32_t		max_item;
+	uint32_t		cur;
+	bool			started;
+
+	uint64_t		reaped;
+	time_t			queued;
+	list_head_t		next;
+} gtp_reaper_job_t;
+
+typedef struct _gtp_reaper {
+	list_head_t		jobs;
+	int			nr_jobs;
+	uint32_t		rate;		/* sessions per second */
+	uint32_t		slice;		/* usec */
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	pthread_t		task;
+
+	/* stats */
+	uint64_t		reaped;
+	uint64_t		slices;
+	uint64_t		jobs_done;
+	uint64_t		xdp_deleted;
+	uint64_t		xdp_syscalls;
+
+	unsigned long		flags;
+} gtp_reaper_t;
+
+
+/* Prototypes */
+extern int gtp_reaper_session_add(gtp_session_t *);
+extern int gtp_reaper_job_add(int, uint64_t, uint64_t, gtp_apn_t *, uint32_t);
+extern int gtp_reaper_config_write(vty_t *);
+extern int gtp_reaper_init(void);
+extern int gtp_reaper_destroy(void);
+extern int gtp_reaper_vty_init(void);
+
+#endif
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_REPL_H
+#define _GTP_REPL_H
+
+/* Defines */
+#define GTP_REPL_QUEUE_SIZE		(32 << 20)	/* tx queue bytes */
+#define GTP_REPL_BATCH			(64 << 10)	/* bytes per send() */
+#define GTP_REPL_RX_BUFFER		(256 << 10)
+#define GTP_REPL_RETRY_TIMER		1		/* sec, peer connect */
+#define GTP_REPL_SND_TIMEOUT		3		/* sec, stalled peer */
+
+enum gtp_repl_flags {
+	GTP_REPL_FL_CONFIGURED_BIT,
+	GTP_REPL_FL_RUNNING_BIT,
+	GTP_REPL_FL_CONNECTED_BIT,
+	GTP_REPL_FL_RESYNC_BIT,
+	GTP_REPL_FL_STOP_BIT,
+};
+
+/* Replication channel: session images and tombstones, framed as
+ * checkpoint records, streamed to peer over TCP. Each node sends
+ * sessions it owns and applies the ones received as replicas. */
+typedef struct _gtp_repl {
+	struct sockaddr_in	listen_addr;
+	struct sockaddr_in	peer_addr;
+	int			listen_fd;
+	int			tx_fd;
+	int			rx_fd;
+
+	/* tx queue, byte ring with free running offsets */
+	pthread_mutex_t		mutex;
+	pthread_cond_t		tx_cond;	/* data queued */
+	pthread_cond_t		space_cond;	/* data sent */
+	pthread_cond_t		sync_cond;	/* resync requested */
+	uint8_t			*queue;
+	uint64_t		head;
+	uint64_t		tail;
+
+	pthread_t		tx_task;
+	pthread_t		rx_task;
+	pthread_t		sync_task;
+	uint32_t		rx_gen;		/* peer resync generation */
+
+	/* stats */
+	uint64_t		tx_records;
+	uint64_t		tx_bytes;
+	uint64_t		tx_syscalls;
+	uint64_t		tx_dropped;
+	uint64_t		connects;
+	uint64_t		resyncs;
+	uint64_t		rx_records;
+	uint64_t		rx_bytes;
+	uint64_t		rx_applied;
+	uint64_t		rx_updated;	/* applied in place */
+	uint64_t		rx_deleted;
+	uint64_t		rx_swept;	/* stale after resync */
+	uint64_t		rx_errors;
+
+	unsigned long		flags;
+} gtp_repl_t;
+
+
+/* Prototypes */
+extern bool gtp_repl_running(void);
+extern int gtp_repl_send(int, void *, uint32_t);
+extern int gtp_repl_start(void);
+extern int gtp_repl_config_write(vty_t *);
+extern int gtp_repl_init(void);
+extern int gtp_repl_destroy(void);
+extern int gtp_repl_vty_init(void);
+
+#endif
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_REPLAY_H
+#define _GTP_REPLAY_H
+
+/* defines */
+#define GTP_REPLAY_HASHTAB_BITS		10
+#define GTP_REPLAY_HASHTAB_SIZE		(1 << GTP_REPLAY_HASHTAB_BITS)
+#define GTP_REPLAY_HASHTAB_MASK		(GTP_REPLAY_HASHTAB_SIZE - 1)
+#define GTP_REPLAY_ENTRIES		4096
+#define GTP_REPLAY_DATA_MIN		256
+#define GTP_REPLAY_TIMEOUT		(GTP_PATH_T3_RESPONSE * GTP_PATH_N3_REQUESTS)
+
+/* flags */
+enum gtp_replay_flags {
+	GTP_REPLAY_FL_HASHED_BIT,
+	GTP_REPLAY_FL_PENDING_BIT,
+};
+
+/* Response cache keyed by requesting peer transaction */
+typedef struct _gtp_replay_key {
+	uint32_t		addr;
+	uint16_t		port;
+	uint8_t			version;
+	uint8_t			type;		/* request message type */
+	uint32_t		sqn;
+} gtp_replay_key_t;
+
+typedef struct _gtp_replay_entry {
+	gtp_replay_key_t	key;
+	time_t			expire;
+	uint16_t		len;
+	uint16_t		size;
+	uint8_t			*data;
+
+	hlist_node_t		hlist;
+
+	unsigned long		flags;
+} gtp_replay_entry_t;
+
+typedef struct _gtp_replay_stats {
+	uint64_t		lookup;
+	uint64_t		hit;
+	uint64_t		pending;
+	uint64_t		store;
+	uint64_t		evict;		/* reused before expiration */
+} gtp_replay_stats_t;
+
+typedef struct _gtp_replay {
+	hlist_head_t		*htab;
+	gtp_replay_entry_t	*ring;
+	uint32_t		nr_entries;
+	uint32_t		next;
+	size_t			mem;
+	pthread_mutex_t		mutex;
+
+	gtp_replay_stats_t	stats;
+} gtp_replay_t;
+
+
+/* Prototypes */
+extern int gtp_replay_key_build(gtp_replay_key_t *, pkt_buffer_t *, struct sockaddr_in *, bool);
+extern int gtp_replay_lookup(gtp_server_worker_t *, gtp_replay_key_t *, struct sockaddr_in *);
+extern int gtp_replay_pending(gtp_replay_t *, gtp_replay_key_t *);
+extern int gtp_replay_store(gtp_replay_t *, gtp_replay_key_t *, pkt_buffer_t *);
+extern int gtp_replay_complete(gtp_server_t *, gtp_replay_key_t *, pkt_buffer_t *);
+extern gtp_replay_t *gtp_replay_alloc(uint32_t);
+extern void gtp_replay_free(gtp_replay_t *);
+extern int gtp_replay_vty_init(void);
+
+#endif
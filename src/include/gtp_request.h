@@ -25,11 +25,16 @@
 /* Default values */
 #define GTP_REQUEST_THREAD_CNT_DEFAULT	5
 #define GTP_REQUEST_BUFFER_SIZE		4096
+#define GTP_REQUEST_BUFFER_MAX		(1 << 20)	/* request header + body */
+#define GTP_REQUEST_HEADER_MAX		8192
+#define GTP_REQUEST_STREAM_SIZE		16384		/* json_writer stdio buffer */
+#define GTP_REQUEST_OUT_HIGH		(256 << 10)	/* stop pipelining above */
 
 /* Channel definition */
 #define GTP_REQUEST_TCP_TIMEOUT        (3 * TIMER_HZ)
 #define GTP_REQUEST_TCP_LISTENER_TIMER (3 * TIMER_HZ)
 #define GTP_REQUEST_TCP_TIMER          (3 * TIMER_HZ)
+#define GTP_REQUEST_KEEPALIVE_TIMER    (15 * TIMER_HZ)
 
 /* Defines */
 #define GTP_REQUEST_TIMER		(3 * TIMER_HZ)
@@ -46,6 +51,9 @@ enum session_flags {
 	GTP_SESSION_FL_DONTSEND,
 	GTP_SESSION_FL_COMPLETE,
 	GTP_SESSION_FL_ASYNCSEND,
+	GTP_SESSION_FL_HTTP,
+	GTP_SESSION_FL_CHUNKED,
+	GTP_SESSION_FL_EOF,
 };
 
 /* Resquest channel */
@@ -58,6 +66,12 @@ typedef struct _gtp_req_worker {
 	/* I/O MUX related */
 	thread_master_t		*master;
 	thread_ref_t		r_thread;
+	list_head_t		sessions;
+
+	/* stats */
+	uint64_t		accepted;
+	uint64_t		requests;
+	uint64_t		lookups;
 
 	list_head_t		next;
 
@@ -74,24 +88,34 @@ typedef struct _gtp_req_channel {
 	unsigned long		flags;
 } gtp_req_channel_t;
 
+/* Client connection, driven by worker I/O MUX */
 typedef struct _gtp_req_session {
-	pthread_t		task;
-	pthread_attr_t		task_attr;
 	struct sockaddr_storage	addr;
 	int                     fd;
-	FILE			*fp;
+	FILE			*fp;		/* json_writer stream */
 	uint32_t                id;
 
 	gtp_req_worker_t	*worker;
 
 	json_writer_t		*jwriter;
 
-	off_t			offset_read;
-	off_t			offset_sent;
-	char			buffer_in[GTP_REQUEST_BUFFER_SIZE];
-	char			buffer_out[GTP_REQUEST_BUFFER_SIZE];
-	off_t			buffer_size;
-	off_t			offset_header;
+	char			*buffer_in;
+	size_t			size_in;
+	size_t			len_in;
+	char			*buffer_out;
+	size_t			size_out;
+	size_t			len_out;
+	size_t			offset_sent;
+
+	/* Reply being produced, batch suspended while output drains */
+	json_node_t		*json;
+	json_node_t		*batch;		/* next list entry */
+	const struct _gtp_request_cmd *cmd;
+	struct _gtp_apn		*apn;
+	int			batch_cnt;
+	int			batch_found;
+
+	list_head_t		next;
 
 	unsigned long		flags;
 } gtp_req_session_t;
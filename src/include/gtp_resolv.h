@@ -29,11 +29,6 @@
 #define GTP_DISPLAY_SRV_LEN	256
 #define GTP_MATCH_MAX_LEN	256
 
-/* flags */
-enum gtp_schedule_flags {
-	GTP_SCHEDULE_FL_SKIP,
-};
-
 /* GTP Resolv */
 typedef struct _gtp_pgw {
 	uint16_t		priority;
@@ -59,8 +54,6 @@ typedef struct _gtp_naptr {
 	list_head_t		pgw;
 
 	list_head_t		next;
-
-	unsigned long		fl;
 } gtp_naptr_t;
 
 typedef struct _gtp_service {
@@ -77,6 +70,7 @@ typedef struct _gtp_resolv_ctx {
 	ns_msg			msg;
 	ns_rr			rr;
 	int			max_retry;
+	uint32_t		ttl;	/* lowest TTL seen */
 	u_char			nsbuffer[GTP_RESOLV_BUFFER_LEN];
 	char			nsdisp[GTP_DISPLAY_BUFFER_LEN];
 } gtp_resolv_ctx_t;
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_RESOLV_CACHE_H
+#define _GTP_RESOLV_CACHE_H
+
+/* defines */
+#define GTP_RESOLV_CACHE_HASHTAB_BITS	10
+#define GTP_RESOLV_CACHE_HASHTAB_SIZE	(1 << GTP_RESOLV_CACHE_HASHTAB_BITS)
+#define GTP_RESOLV_CACHE_HASHTAB_MASK	(GTP_RESOLV_CACHE_HASHTAB_SIZE - 1)
+#define GTP_RESOLV_CACHE_MAX_ENTRIES	(64 * 1024)
+#define GTP_RESOLV_CACHE_WORKERS	4
+#define GTP_RESOLV_CACHE_TTL_MIN	5
+#define GTP_RESOLV_CACHE_TTL_MAX	86400
+#define GTP_RESOLV_CACHE_NEGATIVE_TTL	30
+#define GTP_RESOLV_CACHE_STALE		300
+#define GTP_RESOLV_CACHE_GC_TIMER	60
+#define GTP_RESOLV_CACHE_LAT_BUCKETS	8
+
+/* flags */
+enum gtp_resolv_cache_flags {
+	GTP_RESOLV_CACHE_FL_INFLIGHT_BIT,
+	GTP_RESOLV_CACHE_FL_RUNNING_BIT,
+	GTP_RESOLV_CACHE_FL_NEGATIVE_BIT,
+	GTP_RESOLV_CACHE_FL_HASHED_BIT,
+	GTP_RESOLV_CACHE_FL_STOP_BIT,
+};
+
+/* Resolved NAPTR/PGW set. Immutable once published, refcounted so
+ * that a worker can keep scheduling over it while a refresh is
+ * swapping in a new one. */
+typedef struct _gtp_resolv_cache_data {
+	list_head_t		naptr;
+	struct _gtp_sched_index	*sched;
+	int			refcnt;
+} gtp_resolv_cache_data_t;
+
+typedef struct _gtp_resolv_cache_entry {
+	gtp_apn_t		*apn;		/* Back-pointer */
+	char			fqdn[GTP_DISPLAY_BUFFER_LEN];
+	uint32_t		hash;
+	gtp_resolv_cache_data_t	*data;
+	uint32_t		ttl;
+	time_t			expire;
+	time_t			refresh;	/* next refresh allowed */
+	time_t			last_update;
+	uint64_t		hit;
+	int			refcnt;
+
+	hlist_node_t		hlist;
+	list_head_t		next;		/* resolver queue */
+
+	unsigned long		flags;
+} gtp_resolv_cache_entry_t;
+
+typedef struct _gtp_resolv_cache_stats {
+	uint64_t		hit;
+	uint64_t		stale;
+	uint64_t		negative;
+	uint64_t		miss;
+	uint64_t		inflight;	/* miss deduplicated */
+	uint64_t		resolved;
+	uint64_t		failed;
+	uint64_t		lat_sum;	/* usec */
+	uint64_t		lat_max;	/* usec */
+	uint64_t		lat[GTP_RESOLV_CACHE_LAT_BUCKETS];
+} gtp_resolv_cache_stats_t;
+
+typedef struct _gtp_resolv_cache {
+	hlist_head_t		*htab;
+	int			nr_entries;
+	list_head_t		queue;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	pthread_cond_t		done;
+	pthread_t		task[GTP_RESOLV_CACHE_WORKERS];
+	gtp_resolv_cache_stats_t stats;
+
+	unsigned long		flags;
+} gtp_resolv_cache_t;
+
+
+/* Prototypes */
+extern gtp_resolv_cache_data_t *gtp_resolv_cache_get(gtp_apn_t *, const char *, const char *);
+extern void gtp_resolv_cache_put(gtp_resolv_cache_data_t *);
+extern int gtp_resolv_cache_apn_flush(gtp_apn_t *);
+extern int gtp_resolv_cache_flush(void);
+extern int gtp_resolv_cache_stats(gtp_resolv_cache_stats_t *);
+extern int gtp_resolv_cache_show(vty_t *);
+extern int gtp_resolv_cache_init(void);
+extern int gtp_resolv_cache_destroy(void);
+extern int gtp_resolv_cache_vty_init(void);
+
+#endif
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#ifndef _GTP_REWRITE_H
+#define _GTP_REWRITE_H
+
+/* Rule sets */
+enum gtp_rewrite_type {
+	GTP_REWRITE_IMSI = 0,
+	GTP_REWRITE_OI,
+	GTP_REWRITE_MAX,
+};
+
+#define GTP_REWRITE_NIBBLE(K, I)	(((I) & 1) ? (K)[(I) >> 1] >> 4 : (K)[(I) >> 1] & 0x0f)
+
+/* Nibble trie compiled from rewrite rule list. IMSI rules are keyed
+ * by TBCD digits, OI rules by the nibbles of their chars. Each node
+ * keeps lowest config index of rules ending there, so lookup returns
+ * first matching rule of the list in O(prefix length). */
+typedef struct _gtp_rewrite_node {
+	uint32_t		child[16];	/* 0: none, root is never a child */
+	int32_t			rule;		/* rule[] index, -1: none */
+} gtp_rewrite_node_t;
+
+typedef struct _gtp_rewrite_trie {
+	gtp_rewrite_node_t	*node;
+	uint32_t		nr_node;
+	gtp_rewrite_rule_t	**rule;		/* config order */
+	uint32_t		nr_rule;
+
+	grace_obj_t		gp;		/* published snapshot */
+} gtp_rewrite_trie_t;
+
+
+/* Prototypes */
+extern gtp_rewrite_trie_t *gtp_rewrite_trie_build(list_head_t *, int);
+extern void gtp_rewrite_trie_free(gtp_rewrite_trie_t *);
+extern gtp_rewrite_rule_t *gtp_rewrite_trie_lookup(gtp_rewrite_trie_t *, const uint8_t *, size_t);
+extern gtp_rewrite_trie_t *gtp_rewrite_trie_get(gtp_apn_t *, int);
+extern void gtp_rewrite_trie_put(gtp_rewrite_trie_t *);
+extern int gtp_rewrite_trie_rebuild(gtp_apn_t *, int);
+extern int gtp_rewrite_trie_destroy(gtp_apn_t *);
+
+#endif
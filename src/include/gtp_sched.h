@@ -22,7 +22,57 @@
 #ifndef _GTP_SCHED_H
 #define _GTP_SCHED_H
 
+/* defines */
+#define GTP_SCHED_WLC_SCAN_MAX	8	/* larger groups use power-of-two-choices */
+
+/* pGW selection index */
+typedef struct _gtp_sched_pgw {
+	struct sockaddr_in	addr;
+	uint16_t		priority;
+	uint16_t		weight;
+	uint64_t		cnt;
+	struct _gtp_path	*path;		/* liveness & latency feedback */
+} gtp_sched_pgw_t;
+
+typedef struct _gtp_sched_group {
+	uint16_t		priority;
+	uint32_t		first;		/* into pgw[] */
+	uint32_t		nr;
+} gtp_sched_group_t;
+
+typedef struct _gtp_sched_naptr {
+	uint16_t		order;
+	uint32_t		first;		/* into group[] */
+	uint32_t		nr;
+} gtp_sched_naptr_t;
+
+typedef struct _gtp_sched_service {
+	uint32_t		first;		/* into sel[] */
+	uint32_t		nr;
+} gtp_sched_service_t;
+
+typedef struct _gtp_sched_index {
+	gtp_sched_service_t	*service;
+	uint32_t		*sel;		/* naptr[] index, by order */
+	gtp_sched_naptr_t	*naptr;
+	gtp_sched_group_t	*group;
+	gtp_sched_pgw_t		*pgw;
+	uint32_t		nr_service;
+	uint32_t		nr_sel;
+	uint32_t		nr_naptr;
+	uint32_t		nr_group;
+	uint32_t		nr_pgw;
+
+	grace_obj_t		gp;		/* published snapshot */
+} gtp_sched_index_t;
+
+
 /* Prototypes */
+extern gtp_sched_index_t *gtp_sched_index_build(list_head_t *, list_head_t *);
+extern void gtp_sched_index_free(gtp_sched_index_t *);
+extern int gtp_sched_index_select(gtp_sched_index_t *, struct sockaddr_in *, struct sockaddr_in *);
+extern int __gtp_sched_index_rebuild(gtp_apn_t *);
+extern int gtp_sched_index_destroy(gtp_apn_t *);
 extern int gtp_sched(gtp_apn_t *, struct sockaddr_in *, struct sockaddr_in *);
 extern int gtp_sched_dynamic(gtp_apn_t *, const char *, const char *, struct sockaddr_in *, struct sockaddr_in *);
 
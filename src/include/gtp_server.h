@@ -33,6 +33,13 @@ typedef struct _gtp_server_stats {
 	gtp_stats_t		tx[0xff];
 } gtp_server_stats_t;
 
+/* GTP-C SO_REUSEPORT steering, mirror of eBPF definition */
+#define GTP_REUSEPORT_MAX_WORKERS	256
+struct reuseport_opts {
+	__u16	max_id;
+	__u8	shard_bits;
+} __attribute__ ((__aligned__(8)));
+
 /* GTP Switching context */
 typedef struct _gtp_server_worker {
 	char			pname[GTP_PNAME];
@@ -41,6 +48,9 @@ typedef struct _gtp_server_worker {
 	int			fd;
 	struct _gtp_server	*srv;		/* backpointer */
 	pkt_buffer_t		*pbuff;
+	struct _gtp_msg		*msg;		/* GTPv2 IE index */
+	struct _gtp_replay	*replay;	/* GTP-C response cache */
+	gtp_overload_worker_t	*overload;	/* GTP-C admission state */
 	unsigned int		seed;
 
 	/* stats */
@@ -60,6 +70,10 @@ typedef struct _gtp_server {
 	struct sockaddr_storage	addr;
 	int			thread_cnt;
 	void			*ctx;		/* backpointer */
+	gtp_overload_t		overload;
+	uint8_t			teid_shard_bits;	/* worker id in VTEID high-bits */
+	struct bpf_object	*bpf_obj;	/* SO_REUSEPORT steering */
+	struct bpf_map		*bpf_socks;
 
 	pthread_mutex_t		workers_mutex;
 	list_head_t		workers;
@@ -22,6 +22,8 @@
 #ifndef _GTP_SESSION_H
 #define _GTP_SESSION_H
 
+/* Defines */
+#define GTP_SESSION_TIMER_SHARDS	4
 
 /* Tunnel Actions */
 enum {
@@ -30,37 +32,62 @@ enum {
 	GTP_ACTION_SEND_DELETE_BEARER_REQUEST,
 };
 
-/* GTP session */
+/* APN pool lease errors */
+enum {
+	GTP_SESSION_POOL_EXHAUSTED = -1,
+	GTP_SESSION_POOL_PTYPE_UNSUPPORTED = -2,
+};
+
+/* Secondary indexes */
+enum gtp_session_index {
+	GTP_SESSION_IDX_MSISDN,
+	GTP_SESSION_IDX_IPV4,
+	GTP_SESSION_IDX_MAX,
+};
+
+/* Session flags */
+enum gtp_session_flags {
+	GTP_SESSION_FL_REPLICA_BIT,	/* owned by replication peer */
+};
+
+/* GTP session. Fields are ordered by use: lookup and signalling
+ * ones first, then the ones mostly set on session setup and read
+ * on expiration, checkpoint and VTY dump. */
 typedef struct _gtp_session {
 	uint32_t		id;
-	uint32_t		charging_id;
-	uint32_t		ipv4;
-	uint64_t		mei;
-	uint64_t		msisdn;
-	uint8_t			ptype;
-
+	int			refcnt;
+	gtp_conn_t		*conn;		/* backpointer */
 	gtp_apn_t		*apn;
 	list_head_t		gtpc_teid;
 	list_head_t		gtpu_teid;
+	uint32_t		ipv4;
+	uint8_t			ptype;
+	uint8_t			action;
+
+	gtp_server_worker_t	*w;		/* Server worker used */
+	spppoe_t		*s_pppoe;	/* PPPoE session peer */
+	list_head_t		next;
 
 	/* local method */
 	int (*gtpc_teid_destroy) (gtp_teid_t *);
 	int (*gtpu_teid_destroy) (gtp_teid_t *);
 
-	gtp_conn_t		*conn;		/* backpointer */
-	spppoe_t		*s_pppoe;	/* PPPoE session peer */
-	gtp_server_worker_t	*w;		/* Server worker used */
-
-	uint8_t			action;
-
 	/* Expiration handling */
-	char			tmp_str[64];
-	struct tm		creation_time;
 	timer_node_t		t_node;
 
-	list_head_t		next;
+	/* Peer tracking */
+	struct _gtp_path	*path;		/* sGW peer */
+	list_head_t		path_next;
 
-	int			refcnt;
+	/* setup, checkpoint & dump */
+	uint32_t		charging_id;
+	uint32_t		ipv4_lease;	/* from APN pool */
+	uint64_t		mei;
+	uint64_t		msisdn;
+	struct in6_addr		ipv6_prefix;	/* /64 from APN pool */
+	time_t			creation_time;	/* formatted on VTY dump */
+	uint32_t		repl_gen;	/* last peer resync refreshing replica */
+	unsigned long		flags;
 } gtp_session_t;
 
 
@@ -75,16 +102,27 @@ extern void gtp_session_mod_timer(gtp_session_t *, int);
 extern gtp_session_t *gtp_session_alloc(gtp_conn_t *, gtp_apn_t *,
 					int (*gtpc_destroy) (gtp_teid_t *),
 					int (*gtpu_destroy) (gtp_teid_t *));
+extern void gtp_session_id_update(uint32_t);
+extern void __gtp_session_set_msisdn(gtp_session_t *, uint64_t);
+extern void gtp_session_set_msisdn(gtp_session_t *, uint64_t);
+extern void __gtp_session_set_ipv4(gtp_session_t *, uint32_t);
+extern void gtp_session_set_ipv4(gtp_session_t *, uint32_t);
+extern gtp_conn_t *gtp_session_conn_get_by_index(int, uint64_t);
+extern bool gtp_session_index_match(gtp_session_t *, int, uint64_t);
 extern int gtp_session_gtpu_teid_destroy(gtp_teid_t *);
 extern int gtp_session_gtpc_teid_destroy(gtp_teid_t *);
+extern int gtp_session_ip_pool_get(gtp_session_t *);
+extern int gtp_session_ip_pool_put(gtp_session_t *);
 extern int gtp_session_destroy(gtp_session_t *);
 extern int gtp_session_set_delete_bearer(gtp_session_t *, gtp_ie_eps_bearer_id_t *);
 extern int gtp_session_destroy_bearer(gtp_session_t *);
 extern int gtp_session_destroy_teid(gtp_teid_t *);
 extern int gtp_session_expire_now(gtp_session_t *);
+extern int gtp_sessions_reap(gtp_conn_t *, int (*) (gtp_session_t *, void *), void *);
 extern int gtp_sessions_free(gtp_conn_t *);
 extern int gtp_sessions_init(void);
 extern int gtp_sessions_destroy(void);
+extern int gtp_sessions_count(void);
 extern int gtp_sessions_vty_init(void);
 
 #endif
@@ -22,8 +22,14 @@
 #ifndef _GTP_SQN_H
 #define _GTP_SQN_H
 
+/* defines */
+#define GTP_VSQN_BITS		23	/* MSB reserved, GTPv2 spare byte */
+#define GTP_VSQN_SIZE		(1 << GTP_VSQN_BITS)
+#define GTP_VSQN_MIN		0x0f
+
 /* Prototypes */
 extern gtp_teid_t *gtp_vsqn_get(gtp_htab_t *, uint32_t);
+extern int gtp_vsqn_hash(gtp_htab_t *, gtp_teid_t *, uint32_t);
 extern int gtp_vsqn_unhash(gtp_htab_t *, gtp_teid_t *);
 extern int gtp_vsqn_alloc(gtp_server_worker_t *, gtp_teid_t *, bool);
 extern int gtp_sqn_update(gtp_server_worker_t *, gtp_teid_t *);
@@ -41,7 +41,10 @@ typedef struct _gtp_switch {
 	gtp_htab_t		gtpu_teid_tab;	/* GTP-U teid hashtab */
 	gtp_htab_t		vteid_tab;	/* virtual teid hashtab */
 	gtp_htab_t		vsqn_tab;	/* virtual Seqnum hashtab */
-	uint32_t		seqnum;		/* Global context Seqnum */
+	gtp_idpool_t		**vteid_pool;	/* per worker VTEID shard */
+	int			vteid_pool_cnt;
+	uint8_t			vteid_pool_bits;
+	gtp_idpool_t		*vsqn_pool;	/* context Seqnum */
 
 	gtp_naptr_t		*pgw;
 	struct sockaddr_storage	pgw_addr;
@@ -58,9 +61,15 @@ typedef struct _gtp_switch {
 /* Prototypes */
 extern int gtp_switch_gtpc_teid_destroy(gtp_teid_t *);
 extern int gtp_switch_gtpu_teid_destroy(gtp_teid_t *);
+extern gtp_idpool_t *gtp_switch_vteid_pool(gtp_switch_t *, int);
+extern int gtp_switch_vsqn_release(gtp_switch_t *, gtp_teid_t *);
+extern int gtp_switch_vsqn_reserve(gtp_switch_t *, gtp_teid_t *, uint32_t);
+extern int gtp_switch_idpool_init(gtp_server_t *);
+extern int gtp_switch_idpool_vty(vty_t *, gtp_switch_t *);
 extern int gtp_switch_ingress_init(gtp_server_worker_t *);
 extern int gtp_switch_ingress_process(gtp_server_worker_t *, struct sockaddr_storage *);
 extern gtp_switch_t *gtp_switch_get(const char *);
+extern gtp_server_t *gtp_switch_pgw_server(gtp_switch_t *);
 extern gtp_switch_t *gtp_switch_init(const char *);
 extern int gtp_switch_gtpc_socketpair_init(gtp_server_t *);
 extern int gtp_switch_ctx_server_destroy(gtp_switch_t *);
@@ -45,34 +45,32 @@ enum gtp_teid_flags {
 /* Defines */
 #define TEID_IS_DUMMY(X)	((X)->type == 0xff)
 
-/* GTP Connection tracking */
+/* GTP Connection tracking. Hash chaining, keys, refcnt and session
+ * backpointer come first, linking and remote endpoints after. */
 typedef struct _gtp_teid {
-	uint8_t			version;	/* GTPv1 or GTPv2 */
-	uint8_t			type;		/* User or Contrlo plane */
+	struct hlist_node	hlist_teid;
+	struct hlist_node	hlist_vteid;
 	uint32_t		id;		/* Remote TEID */
 	uint32_t		vid;		/* Local Virtual TEID */
 	uint32_t		ipv4;		/* Remote IPv4 */
+	uint8_t			version;	/* GTPv1 or GTPv2 */
+	uint8_t			type;		/* User or Contrlo plane */
 	uint8_t			bearer_id;	/* Bearer we belong to */
-	struct sockaddr_in	sgw_addr;	/* Remote sGW endpoint */
-	struct sockaddr_in	pgw_addr;	/* Remote pGW endpoint */
-	uint8_t			family;
-
+	uint8_t			action;
+	int			refcnt;
 	uint32_t		sqn;		/* Local Seqnum */
-	uint32_t		vsqn;		/* Local Virtual Seqnum */
-
 	struct _gtp_session	*session;	/* backpointer */
+
+	unsigned long		flags;
 	struct _gtp_teid	*peer_teid;	/* Linked TEID */
 	struct _gtp_teid	*old_teid;	/* Old Linked TEID */
 	struct _gtp_teid	*bearer_teid;	/* GTP-C Bearer TEID */
-
-	uint8_t			action;
-	struct hlist_node	hlist_teid;
-	struct hlist_node	hlist_vteid;
+	uint32_t		vsqn;		/* Local Virtual Seqnum */
+	uint8_t			family;
 	struct hlist_node	hlist_vsqn;
 	list_head_t		next;
-
-	unsigned long		flags;
-	int			refcnt;
+	struct sockaddr_in	sgw_addr;	/* Remote sGW endpoint */
+	struct sockaddr_in	pgw_addr;	/* Remote pGW endpoint */
 } gtp_teid_t;
 
 typedef struct _gtp_f_teid {
@@ -90,6 +88,7 @@ extern int gtp_teid_init(void);
 extern int gtp_teid_destroy(void);
 extern void gtp_teid_free(gtp_teid_t *);
 extern int gtp_teid_unuse_queue_size(void);
+extern int gtp_teid_count(void);
 extern int gtp_teid_put(gtp_teid_t *);
 extern gtp_teid_t *gtp_teid_get(gtp_htab_t *, gtp_f_teid_t *);
 extern gtp_teid_t *gtpc_teid_get(gtp_f_teid_t *);
@@ -112,7 +111,8 @@ extern int gtp_teid_restore(gtp_teid_t *, gtp_f_teid_t *);
 extern int gtp_teid_update_sgw(gtp_teid_t *, struct sockaddr_storage *);
 extern int gtp_teid_update_pgw(gtp_teid_t *, struct sockaddr_storage *);
 extern void gtp_teid_dump(gtp_teid_t *);
-extern int gtp_vteid_alloc(gtp_htab_t *, gtp_teid_t *, unsigned int *);
+extern int gtp_vteid_alloc(gtp_htab_t *, gtp_teid_t *, gtp_idpool_t *, unsigned int *);
+extern int gtp_vteid_reserve(gtp_htab_t *, gtp_teid_t *, gtp_idpool_t *, uint32_t);
 extern int gtp_vteid_unhash(gtp_htab_t *, gtp_teid_t *);
 extern gtp_teid_t *gtp_vteid_get(gtp_htab_t *, uint32_t);
 
@@ -33,6 +33,24 @@ enum {
 #define XDP_PATH_MAX 128
 #define GTP_INGRESS	0
 #define GTP_EGRESS	1
+#define GTP_XDP_BATCH_MAP	4	/* maps per batch context */
+#define GTP_XDP_BATCH_SIZE	256	/* keys per map */
+#define GTP_XDP_BATCH_KEYSZ	16	/* largest key we batch */
+
+/* Deferred map deletions, per thread. While a batch is open,
+ * gtp_xdp_map_delete() only queues the key. */
+typedef struct _gtp_xdp_batch_map {
+	struct bpf_map		*map;
+	uint32_t		key_sz;
+	uint32_t		cnt;
+	uint8_t			keys[GTP_XDP_BATCH_SIZE * GTP_XDP_BATCH_KEYSZ];
+} gtp_xdp_batch_map_t;
+
+typedef struct _gtp_xdp_batch {
+	gtp_xdp_batch_map_t	map[GTP_XDP_BATCH_MAP];
+	uint64_t		flushed;
+	uint64_t		syscalls;
+} gtp_xdp_batch_t;
 
 typedef struct _xdp_exported_maps {
 	struct bpf_map	*map;
@@ -40,6 +58,9 @@ typedef struct _xdp_exported_maps {
 
 
 /* Prototypes */
+extern void gtp_xdp_batch_begin(gtp_xdp_batch_t *);
+extern void gtp_xdp_batch_end(void);
+extern int gtp_xdp_map_delete(struct bpf_map *, const void *, uint32_t);
 extern int gtp_xdp_mac_learning_vty(vty_t *, struct bpf_map *);
 extern struct bpf_map *gtp_bpf_load_map(struct bpf_object *, const char *);
 extern struct bpf_program *gtp_xdp_load_prog(gtp_bpf_opts_t *);
@@ -71,6 +71,7 @@ start_gtp(void)
 
 	/* Configuration file parsing */
 	daemon_data = alloc_daemon_data();
+	gtp_hash_init();
 
 	cmd_init();
 	vty_init();
@@ -80,11 +81,21 @@ start_gtp(void)
 	gtp_conn_init();
 	gtp_teid_init();
 	gtp_sessions_init();
+	gtp_path_init();
+	gtp_reaper_init();
+	gtp_ckpt_init();
+	gtp_repl_init();
 
 	ret = vty_read_config(conf_file, default_conf_file);
 	if (ret < 0) {
 		stop_gtp();
 	}
+
+	/* Warm restart from session checkpoint */
+	gtp_ckpt_start();
+
+	/* Session replication to standby peer */
+	gtp_repl_start();
 }
 
 /* Terminate handler */
@@ -131,9 +142,11 @@ usage(const char *prog)
 		"  %s --log-console        -l    Log message to stderr.\n"
 		"  %s --log-detail         -D    Detailed log messages.\n"
 		"  %s --log-facility       -S    0-7 Set syslog facility to LOG_LOCAL[0-7]. (default=LOG_DAEMON)\n"
+		"  %s --hash               -H    <table|all>=<jhash|crc32c|xxh3>[,...] Select tables hash function.\n"
+		"                                Tables: teid, sqn, conn, pppoe, dlock.\n"
 		"  %s --help               -h    Display this short inlined help screen.\n"
 		"  %s --version            -v    Display the version number\n",
-		prog, prog, prog, prog, prog, prog, prog, prog, prog);
+		prog, prog, prog, prog, prog, prog, prog, prog, prog, prog);
 }
 
 /* Command line parser */
@@ -151,13 +164,14 @@ parse_cmdline(int argc, char **argv)
 		{"dump-conf",		no_argument,		NULL, 'd'},
 		{"enable-bpf-debug",	no_argument,		NULL, 'b'},
 		{"use-file",		required_argument,	NULL, 'f'},
+		{"hash",		required_argument,	NULL, 'H'},
 		{"version",		no_argument,		NULL, 'v'},
 		{"help",		no_argument,		NULL, 'h'},
 		{NULL,			0,			NULL,  0 }
 	};
 
 	curind = optind;
-	while (longindex = -1, (c = getopt_long(argc, argv, ":vhlndDbf:S:"
+	while (longindex = -1, (c = getopt_long(argc, argv, ":vhlndDbf:S:H:"
 						, long_options, &longindex)) != -1) {
 		if (longindex >= 0 && long_options[longindex].has_arg == required_argument &&
 		    optarg && !optarg[0]) {
@@ -197,6 +211,12 @@ parse_cmdline(int argc, char **argv)
 		case 'f':
 			conf_file = optarg;
 			break;
+		case 'H':
+			if (gtp_hash_parse(optarg) < 0) {
+				fprintf(stderr, "Invalid hash selection %s\n", optarg);
+				bad_option = true;
+			}
+			break;
 		case '?':
 			if (optopt && argv[curind][1] != '-')
 				fprintf(stderr, "Unknown option -%c\n", optopt);
@@ -0,0 +1,309 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "gtp_guard.h"
+
+/* Local data */
+data_t *daemon_data;
+thread_master_t *master = NULL;
+
+#define BENCH_IMSI_BASE		208010000000000ULL
+#define BENCH_CHURN_ROUNDS	1024
+#define BENCH_CHURN_WINDOW	8192
+
+/* Slim conn: bench measures tables, not gtp_conn_t footprint */
+typedef struct _bench_conn {
+	uint64_t		imsi;
+	struct hlist_node	hlist;
+} bench_conn_t;
+
+static unsigned long count = 1000000;
+static bench_conn_t *conns;
+static uint64_t *order;
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+bench_report(const char *table, const char *op, double elapsed)
+{
+	printf("%-8s %-12s %10lu ops %8.1f ns/op %8.2f Mops/s\n"
+	       , table, op, count, elapsed * 1e9 / count, count / elapsed / 1e6);
+}
+
+
+/*
+ *	Baseline: hlist buckets + dlock, as gtp_conn.c used to
+ */
+static struct hlist_head *hlist_tab;
+static dlock_mutex_t *hlist_lock;
+
+static struct hlist_head *
+bench_hlist_hashkey(uint64_t id)
+{
+	return hlist_tab + (jhash_2words((uint32_t)id, (uint32_t) (id >> 32), 0) & CONN_HASHTAB_MASK);
+}
+
+static bench_conn_t *
+bench_hlist_get(uint64_t imsi)
+{
+	struct hlist_head *head = bench_hlist_hashkey(imsi);
+	struct hlist_node *n;
+	bench_conn_t *c;
+
+	dlock_lock_id(hlist_lock, (uint32_t)imsi, (uint32_t) (imsi >> 32));
+	hlist_for_each_entry(c, n, head, hlist) {
+		if (c->imsi == imsi) {
+			dlock_unlock_id(hlist_lock, (uint32_t)imsi, (uint32_t) (imsi >> 32));
+			return c;
+		}
+	}
+	dlock_unlock_id(hlist_lock, (uint32_t)imsi, (uint32_t) (imsi >> 32));
+	return NULL;
+}
+
+static void
+bench_hlist_add(bench_conn_t *c)
+{
+	dlock_lock_id(hlist_lock, (uint32_t)c->imsi, (uint32_t) (c->imsi >> 32));
+	hlist_add_head(&c->hlist, bench_hlist_hashkey(c->imsi));
+	dlock_unlock_id(hlist_lock, (uint32_t)c->imsi, (uint32_t) (c->imsi >> 32));
+}
+
+static void
+bench_hlist_del(bench_conn_t *c)
+{
+	dlock_lock_id(hlist_lock, (uint32_t)c->imsi, (uint32_t) (c->imsi >> 32));
+	hlist_del(&c->hlist);
+	dlock_unlock_id(hlist_lock, (uint32_t)c->imsi, (uint32_t) (c->imsi >> 32));
+}
+
+static void
+bench_hlist(void)
+{
+	unsigned long i, found = 0;
+	double t;
+
+	hlist_tab = calloc(CONN_HASHTAB_SIZE, sizeof(struct hlist_head));
+	hlist_lock = dlock_init();
+
+	t = bench_now();
+	for (i = 0; i < count; i++)
+		bench_hlist_add(&conns[order[i]]);
+	bench_report("hlist", "insert", bench_now() - t);
+
+	t = bench_now();
+	for (i = 0; i < count; i++)
+		found += !!bench_hlist_get(conns[order[count - 1 - i]].imsi);
+	bench_report("hlist", "lookup-hit", bench_now() - t);
+
+	t = bench_now();
+	for (i = 0; i < count; i++)
+		found += !!bench_hlist_get(conns[order[i]].imsi + count);
+	bench_report("hlist", "lookup-miss", bench_now() - t);
+
+	t = bench_now();
+	for (i = 0; i < count; i++)
+		bench_hlist_del(&conns[order[i]]);
+	bench_report("hlist", "delete", bench_now() - t);
+
+	if (found != count)
+		fprintf(stderr, "hlist: found %lu/%lu\n", found, count);
+	free(hlist_tab);
+	free(hlist_lock);
+}
+
+
+/*
+ *	Open addressing
+ */
+static void
+bench_oatab(bool presize)
+{
+	unsigned long i, found = 0;
+	const char *name = (presize) ? "oatab" : "oatab-g";
+	gtp_oatab_t tab;
+	double t;
+
+	/* Growing variant starts from CONN_HASHTAB_SIZE as gtp_conn does */
+	gtp_oatab_init(&tab, (presize) ? count : CONN_HASHTAB_SIZE, GTP_HASH_CONN);
+
+	t = bench_now();
+	for (i = 0; i < count; i++)
+		gtp_oatab_add(&tab, conns[order[i]].imsi, &conns[order[i]]);
+	bench_report(name, "insert", bench_now() - t);
+
+	t = bench_now();
+	for (i = 0; i < count; i++)
+		found += !!gtp_oatab_get(&tab, conns[order[count - 1 - i]].imsi);
+	bench_report(name, "lookup-hit", bench_now() - t);
+
+	t = bench_now();
+	for (i = 0; i < count; i++)
+		found += !!gtp_oatab_get(&tab, conns[order[i]].imsi + count);
+	bench_report(name, "lookup-miss", bench_now() - t);
+
+	printf("%-8s %u entries, %zu MB, %lu resize\n", name
+	       , gtp_oatab_count(&tab), gtp_oatab_memory(&tab) >> 20, tab.resize);
+
+	t = bench_now();
+	for (i = 0; i < count; i++)
+		gtp_oatab_del(&tab, conns[order[i]].imsi, &conns[order[i]]);
+	bench_report(name, "delete", bench_now() - t);
+
+	if (found != count || gtp_oatab_count(&tab))
+		fprintf(stderr, "%s: found %lu/%lu, %u left\n", name
+			, found, count, gtp_oatab_count(&tab));
+	gtp_oatab_destroy(&tab);
+}
+
+
+/*
+ *	Churn: a sliding window of IMSIs, live count stays put while
+ *	DELETED marks pile up, so table keeps being rehashed in place.
+ *	Retired tables must be released meanwhile.
+ */
+static int
+bench_churn(void)
+{
+	unsigned long i, round, window;
+	uint64_t base = 0;
+	size_t mem, first = 0, max = 0;
+	gtp_oatab_t tab;
+	int err;
+
+	/* Sliding window just below half load: live count stays put
+	 * while DELETED marks pile up, rehash purges but never grows */
+	window = (count < BENCH_CHURN_WINDOW) ? count : BENCH_CHURN_WINDOW;
+	gtp_oatab_init(&tab, window, GTP_HASH_CONN);
+	window = (tab.tab->mask + 1) * GTP_OATAB_GROUP_SLOTS * 15 / 32;
+	if (window > count) {
+		printf("%-8s needs at least %lu entries: SKIPPED\n", "churn", window);
+		gtp_oatab_destroy(&tab);
+		return 0;
+	}
+	for (i = 0; i < window; i++)
+		gtp_oatab_add(&tab, conns[order[i]].imsi, &conns[order[i]]);
+
+	for (round = 0; round < BENCH_CHURN_ROUNDS; round++) {
+		for (i = 0; i < window; i++) {
+			gtp_oatab_add(&tab, conns[order[i]].imsi + base + count * 7
+				      , &conns[order[i]]);
+			gtp_oatab_del(&tab, conns[order[i]].imsi + base, &conns[order[i]]);
+		}
+		base += count * 7;
+
+		mem = gtp_oatab_memory(&tab);
+		first = (first) ? : mem;
+		max = (mem > max) ? mem : max;
+	}
+
+	/* Many purges, memory bounded by current table plus at most
+	 * two batches waiting for readers */
+	err = (tab.resize < 4 || max > first * 3 || gtp_oatab_count(&tab) != window);
+	printf("%-8s %d rounds, %lu resize, memory %zu KB first, %zu KB max: %s\n"
+	       , "churn", BENCH_CHURN_ROUNDS, tab.resize, first >> 10, max >> 10
+	       , (err) ? "FAILED" : "PASSED");
+	gtp_oatab_destroy(&tab);
+	return err;
+}
+
+
+/*
+ *	Main
+ */
+static void
+usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-n imsi_count] [-t hlist|oatab|oatab-g|churn|all]\n", prog);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *table = "all";
+	unsigned int seed = 1;
+	unsigned long i, j;
+	uint64_t tmp;
+	int opt, err = 0;
+
+	while ((opt = getopt(argc, argv, "n:t:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			table = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	conns = calloc(count, sizeof(*conns));
+	order = malloc(count * sizeof(*order));
+	if (!conns || !order) {
+		fprintf(stderr, "Cant allocate %lu entries\n", count);
+		exit(1);
+	}
+
+	/* Sparse IMSIs visited in random order */
+	for (i = 0; i < count; i++) {
+		conns[i].imsi = BENCH_IMSI_BASE + i * 7;
+		order[i] = i;
+	}
+	for (i = count - 1; i > 0; i--) {
+		j = ((uint64_t) poor_prng(&seed) << 16 ^ poor_prng(&seed)) % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	if (!strcmp(table, "hlist") || !strcmp(table, "all"))
+		bench_hlist();
+	if (!strcmp(table, "oatab") || !strcmp(table, "all"))
+		bench_oatab(true);
+	if (!strcmp(table, "oatab-g") || !strcmp(table, "all"))
+		bench_oatab(false);
+	if (!strcmp(table, "churn") || !strcmp(table, "all"))
+		err = bench_churn();
+
+	free(conns);
+	free(order);
+	exit(err);
+}
@@ -0,0 +1,305 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "gtp_guard.h"
+
+/* Local data */
+data_t *daemon_data;
+thread_master_t *master = NULL;
+
+#define BENCH_MSG_MAX	16
+static pkt_buffer_t *bench_msg[BENCH_MSG_MAX];
+static int bench_msg_cnt;
+static unsigned long iterations = 1000000;
+
+/* S11 Create Session Request, 20 top-level IEs including one grouped
+ * Bearer Context and two F-TEID instances */
+static const uint8_t csr_default[] = {
+	0x48, 0x20, 0x01, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x12, 0x34, 0x00,
+	0x01, 0x00, 0x08, 0x00, 0x02, 0x08, 0x91, 0x00, 0x00, 0x00, 0x00, 0x10,
+	0x4c, 0x00, 0x06, 0x00, 0x33, 0x06, 0x12, 0x34, 0x56, 0x7f, 0x4b, 0x00,
+	0x08, 0x00, 0x53, 0x02, 0x40, 0x12, 0x34, 0x56, 0x78, 0x90, 0x56, 0x00,
+	0x0d, 0x00, 0x18, 0x02, 0xf8, 0x10, 0x00, 0x01, 0x02, 0xf8, 0x10, 0x00,
+	0x01, 0x23, 0x45, 0x53, 0x00, 0x03, 0x00, 0x02, 0xf8, 0x10, 0x52, 0x00,
+	0x01, 0x00, 0x06, 0x4d, 0x00, 0x04, 0x00, 0x00, 0x08, 0x00, 0x00, 0x57,
+	0x00, 0x09, 0x00, 0x8a, 0x10, 0x00, 0xab, 0xcd, 0x0a, 0x00, 0x00, 0x01,
+	0x57, 0x00, 0x09, 0x01, 0x87, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00,
+	0x02, 0x47, 0x00, 0x1c, 0x00, 0x08, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x6e,
+	0x65, 0x74, 0x06, 0x6d, 0x6e, 0x63, 0x30, 0x30, 0x31, 0x06, 0x6d, 0x63,
+	0x63, 0x32, 0x30, 0x38, 0x04, 0x67, 0x70, 0x72, 0x73, 0x80, 0x00, 0x01,
+	0x00, 0x00, 0x63, 0x00, 0x01, 0x00, 0x01, 0x4f, 0x00, 0x05, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x7f, 0x00, 0x01, 0x00, 0x00, 0x48, 0x00, 0x08,
+	0x00, 0x00, 0x00, 0xc3, 0x50, 0x00, 0x00, 0xc3, 0x50, 0x4e, 0x00, 0x20,
+	0x00, 0x80, 0x80, 0x21, 0x10, 0x01, 0x00, 0x00, 0x10, 0x81, 0x06, 0x00,
+	0x00, 0x00, 0x00, 0x83, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0d, 0x00,
+	0x00, 0x0a, 0x00, 0x00, 0x05, 0x00, 0x00, 0x10, 0x00, 0x5d, 0x00, 0x2c,
+	0x00, 0x49, 0x00, 0x01, 0x00, 0x05, 0x57, 0x00, 0x09, 0x00, 0x84, 0x10,
+	0x00, 0x0a, 0xbc, 0x0a, 0x00, 0x00, 0x03, 0x50, 0x00, 0x15, 0x00, 0x49,
+	0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x01,
+	0x00, 0x0a, 0x72, 0x00, 0x02, 0x00, 0x40, 0x00, 0x5f, 0x00, 0x02, 0x00,
+	0x08, 0x00,
+};
+
+/* IEs looked up by router Create Session Request handler */
+static const uint8_t lookup_types[] = {
+	GTP_IE_F_TEID_TYPE, GTP_IE_IMSI_TYPE, GTP_IE_APN_TYPE, GTP_IE_PDN_TYPE,
+	GTP_IE_MEI_TYPE, GTP_IE_MSISDN_TYPE, GTP_IE_ULI_TYPE, GTP_IE_AMBR_TYPE,
+	GTP_IE_BEARER_CONTEXT_TYPE,
+};
+
+
+/*
+ *	Reference: previous rbtree + per IE allocation decoder
+ */
+typedef struct _rb_msg_ie {
+	gtp_ie_t		*h;
+	void const		*data;
+	rb_node_t		n;
+} rb_msg_ie_t;
+
+typedef struct _rb_msg {
+	gtp_hdr_t		*h;
+	rb_root_cached_t	ie;
+} rb_msg_t;
+
+static inline bool
+rb_msg_ie_less(rb_node_t *a, const rb_node_t *b)
+{
+	const rb_msg_ie_t *r1 = rb_entry_const(a, rb_msg_ie_t, n);
+	const rb_msg_ie_t *r2 = rb_entry_const(b, rb_msg_ie_t, n);
+
+	return r1->h->type < r2->h->type;
+}
+
+static int
+rb_msg_ie_cmp(const void *type, const struct rb_node *a)
+{
+	return less_equal_greater_than(*((uint8_t *) type), rb_entry_const(a, rb_msg_ie_t, n)->h->type);
+}
+
+static rb_msg_ie_t *
+rb_msg_ie_get(rb_msg_t *msg, uint8_t type)
+{
+	rb_node_t *node;
+
+	node = rb_find(&type, &msg->ie.rb_root, rb_msg_ie_cmp);
+	return (node) ? rb_entry(node, rb_msg_ie_t, n) : NULL;
+}
+
+static rb_msg_t *
+rb_msg_alloc(const pkt_buffer_t *pbuff)
+{
+	rb_msg_ie_t *msg_ie;
+	const uint8_t *cp;
+	size_t offset;
+	rb_msg_t *msg;
+	gtp_ie_t *ie;
+
+	msg = calloc(1, sizeof(*msg));
+	msg->h = (gtp_hdr_t *) pbuff->head;
+	msg->ie = RB_ROOT_CACHED;
+	offset = gtp_msg_hlen(msg->h);
+
+	for (cp = pbuff->head + offset; cp < pbuff->end; cp += offset) {
+		ie = (gtp_ie_t *) cp;
+		offset = sizeof(gtp_ie_t) + ntohs(ie->length);
+		if (cp + offset > pbuff->end)
+			continue;
+
+		msg_ie = calloc(1, sizeof(*msg_ie));
+		msg_ie->h = ie;
+		msg_ie->data = cp + sizeof(gtp_ie_t);
+		rb_add_cached(&msg_ie->n, &msg->ie, rb_msg_ie_less);
+	}
+
+	return msg;
+}
+
+static void
+rb_msg_destroy(rb_msg_t *msg)
+{
+	rb_msg_ie_t *msg_ie, *_msg_ie;
+
+	rb_for_each_entry_safe_cached(msg_ie, _msg_ie, &msg->ie, n) {
+		rb_erase_cached(&msg_ie->n, &msg->ie);
+		free(msg_ie);
+	}
+	free(msg);
+}
+
+
+/*
+ *	Bench
+ */
+static uint64_t
+bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bench_report(const char *name, uint64_t ns, unsigned long found)
+{
+	printf("  %-28s: %8.1f ns/msg  %8.2f Mmsg/s  (found:%lu)\n"
+	       , name, (double) ns / iterations
+	       , (double) iterations * 1000.0 / ns, found);
+}
+
+static void
+bench_run(void)
+{
+	unsigned long i, found = 0;
+	uint64_t start;
+	gtp_msg_t *msg;
+	rb_msg_t *rb_msg;
+	pkt_buffer_t *pbuff;
+	unsigned int j;
+
+	printf("Decoding %lu messages (%d distinct)\n", iterations, bench_msg_cnt);
+
+	start = bench_ns();
+	for (i = 0; i < iterations; i++) {
+		pbuff = bench_msg[i % bench_msg_cnt];
+		rb_msg = rb_msg_alloc(pbuff);
+		for (j = 0; j < sizeof(lookup_types); j++)
+			found += !!rb_msg_ie_get(rb_msg, lookup_types[j]);
+		rb_msg_destroy(rb_msg);
+	}
+	bench_report("rbtree + per-IE malloc", bench_ns() - start, found);
+
+	found = 0;
+	msg = gtp_msg_alloc(NULL);
+	start = bench_ns();
+	for (i = 0; i < iterations; i++) {
+		pbuff = bench_msg[i % bench_msg_cnt];
+		gtp_msg_parse(msg, pbuff);
+		for (j = 0; j < sizeof(lookup_types); j++)
+			found += !!gtp_msg_ie_get(msg, lookup_types[j]);
+	}
+	bench_report("flat index (re-used)", bench_ns() - start, found);
+	gtp_msg_destroy(msg);
+}
+
+static int
+bench_msg_add(const uint8_t *data, size_t len)
+{
+	pkt_buffer_t *pbuff;
+
+	if (bench_msg_cnt >= BENCH_MSG_MAX || len > GTP_BUFFER_SIZE)
+		return -1;
+
+	pbuff = pkt_buffer_alloc(GTP_BUFFER_SIZE);
+	memcpy(pbuff->head, data, len);
+	pkt_buffer_set_end_pointer(pbuff, len);
+	bench_msg[bench_msg_cnt++] = pbuff;
+	return 0;
+}
+
+/* Raw GTPv2-C message as captured (UDP payload, ie: wireshark
+ * 'Export Packet Bytes' on GTPv2 layer) */
+static int
+bench_msg_load(const char *path)
+{
+	uint8_t buffer[GTP_BUFFER_SIZE];
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s (%m)\n", path);
+		return -1;
+	}
+
+	len = read(fd, buffer, sizeof(buffer));
+	close(fd);
+	if (len < GTPV2C_HEADER_LEN) {
+		fprintf(stderr, "%s: too short to be a GTPv2-C message\n", path);
+		return -1;
+	}
+
+	return bench_msg_add(buffer, len);
+}
+
+
+/*
+ *	Usage function
+ */
+static void
+usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [OPTION...]\n", prog);
+	fprintf(stderr, "  -f, --file                   Raw GTPv2-C message file (up to %d)\n", BENCH_MSG_MAX);
+	fprintf(stderr, "  -n, --iterations             Number of messages to decode\n");
+	fprintf(stderr, "  -h, --help                   Display this help message\n");
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	struct option long_options[] = {
+		{"file",		required_argument,	NULL, 'f'},
+		{"iterations",		required_argument,	NULL, 'n'},
+		{"help",                no_argument,		NULL, 'h'},
+		{NULL,                  0,			NULL,  0 }
+	};
+
+	while ((c = getopt_long(argc, argv, "hf:n:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'f':
+			if (bench_msg_load(optarg) < 0)
+				exit(-1);
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
+
+	if (!iterations) {
+		usage(argv[0]);
+		exit(-1);
+	}
+
+	if (!bench_msg_cnt)
+		bench_msg_add(csr_default, sizeof(csr_default));
+
+	bench_run();
+	exit(0);
+}
@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "gtp_guard.h"
+
+/* Local data */
+data_t *daemon_data;
+thread_master_t *master = NULL;
+
+#define BENCH_ID	GTP_HASH_TEID
+#define BENCH_ROUNDS	20
+
+static unsigned long count = 1000000;
+static uint32_t *bucket;
+
+/* Key sets modelled after what tables really see */
+enum {
+	KEY_TEID_SEQ,		/* sequential TEIDs from 4 sGW */
+	KEY_TEID_SHARD,		/* worker prefix + sequential, VTEID like */
+	KEY_SQN,		/* sequential seqnum */
+	KEY_IMSI,		/* 3 PLMN, sequential MSIN */
+	KEY_IMSI_RANDOM,	/* 1 PLMN, random MSIN */
+	KEY_MAX,
+};
+
+static const char *key_name[KEY_MAX] = {
+	[KEY_TEID_SEQ]		= "teid-seq",
+	[KEY_TEID_SHARD]	= "teid-shard",
+	[KEY_SQN]		= "sqn",
+	[KEY_IMSI]		= "imsi",
+	[KEY_IMSI_RANDOM]	= "imsi-random",
+};
+
+static uint32_t (*key_w)[2];
+static int key_words[KEY_MAX] = { 2, 2, 1, 2, 2 };
+
+static void
+bench_keys(int set)
+{
+	static const uint64_t plmn[3] = { 208010000000000ULL, 208100000000000ULL
+					, 208200000000000ULL };
+	unsigned int seed = 1;
+	unsigned long i;
+	uint64_t imsi;
+
+	for (i = 0; i < count; i++) {
+		switch (set) {
+		case KEY_TEID_SEQ:
+			key_w[i][0] = htonl(i / 4 + 1);
+			key_w[i][1] = htonl(0xc0a80a01 + (i & 3));
+			break;
+		case KEY_TEID_SHARD:
+			key_w[i][0] = (i & 7) << 29 | (i >> 3);
+			key_w[i][1] = 0;
+			break;
+		case KEY_SQN:
+			key_w[i][0] = i + 0x10;
+			key_w[i][1] = 0;
+			break;
+		case KEY_IMSI:
+			imsi = plmn[i % 3] + i / 3;
+			key_w[i][0] = (uint32_t) imsi;
+			key_w[i][1] = imsi >> 32;
+			break;
+		case KEY_IMSI_RANDOM:
+			imsi = plmn[0] + ((uint64_t) poor_prng(&seed) << 8 ^ poor_prng(&seed)) % 10000000000ULL;
+			key_w[i][0] = (uint32_t) imsi;
+			key_w[i][1] = imsi >> 32;
+			break;
+		}
+	}
+}
+
+static inline uint32_t
+bench_hash(int words, uint32_t *w)
+{
+	return (words == 1) ? gtp_hash_1word(BENCH_ID, w[0]) :
+			      gtp_hash_2words(BENCH_ID, w[0], w[1]);
+}
+
+/* chi2/buckets ~1.0 for a uniform hash */
+static void
+bench_distribution(int set, int bits)
+{
+	uint32_t nr = 1 << bits, mask = nr - 1, max = 0, empty = 0;
+	double e = (double) count / nr, chi2 = 0;
+	unsigned long i;
+
+	memset(bucket, 0, nr * sizeof(uint32_t));
+	for (i = 0; i < count; i++)
+		bucket[bench_hash(key_words[set], key_w[i]) & mask]++;
+
+	for (i = 0; i < nr; i++) {
+		chi2 += (bucket[i] - e) * (bucket[i] - e) / e;
+		max = (bucket[i] > max) ? bucket[i] : max;
+		empty += !bucket[i];
+	}
+
+	printf("  2^%-2d buckets  chi2/n:%7.3f  max:%5u  empty:%5.1f%%", bits
+	       , chi2 / nr, max, 100.0 * empty / nr);
+}
+
+static void
+bench_throughput(int set)
+{
+	struct timespec ts, te;
+	volatile uint32_t sink;
+	uint32_t acc = 0;
+	unsigned long i;
+	int r;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	for (r = 0; r < BENCH_ROUNDS; r++)
+		for (i = 0; i < count; i++)
+			acc += bench_hash(key_words[set], key_w[i]);
+	clock_gettime(CLOCK_MONOTONIC, &te);
+	sink = acc;
+
+	printf("  %5.2f ns/key\n"
+	       , ((te.tv_sec - ts.tv_sec) * 1e9 + (te.tv_nsec - ts.tv_nsec)) / (count * BENCH_ROUNDS));
+	(void) sink;
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt, set, algo;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n keys]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	gtp_hash_init();
+	key_w = malloc(count * sizeof(*key_w));
+	bucket = malloc(CONN_HASHTAB_SIZE * sizeof(uint32_t));
+
+	for (set = 0; set < KEY_MAX; set++) {
+		bench_keys(set);
+		printf("%s (%lu keys)\n", key_name[set], count);
+		for (algo = 0; algo < GTP_HASH_ALGO_MAX; algo++) {
+			gtp_hash_algo[BENCH_ID] = algo;
+			if (gtp_hash_algo[BENCH_ID] != algo)
+				continue;
+			printf(" %-7s", gtp_hash_algo_name(algo));
+			bench_distribution(set, DLOCK_HASHTAB_BITS);
+			printf("\n        ");
+			bench_distribution(set, CONN_HASHTAB_BITS);
+			bench_throughput(set);
+		}
+	}
+
+	free(key_w);
+	free(bucket);
+	exit(0);
+}
@@ -0,0 +1,250 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <sys/socket.h>
+
+#include "dns.h"
+
+/*
+ *	Stand-in DNS server
+ *
+ * Answers NAPTR/SRV/A queries with a fixed 3GPP-like topology:
+ *   <apn>.apn.epc.<plmn>.3gppnetwork.org.  NAPTR -> _nodes._pgw.pgw<N>.example.org
+ *   _nodes._pgw.pgw<N>.example.org.        SRV   -> topon.pgw<N>-{a,b}.example.org
+ *   topon.pgw<N>-<x>.example.org.          A     -> 10.0.<N>.<x-'a'+1>
+ * Any name starting with "unknown." gets NXDOMAIN.
+ */
+static int dns_fd = -1;
+static uint32_t dns_ttl;
+static unsigned dns_delay_ms;
+dns_stats_t dns_stats;
+
+static uint8_t *
+dns_put16(uint8_t *cp, uint16_t v)
+{
+	*cp++ = v >> 8;
+	*cp++ = v;
+	return cp;
+}
+
+static uint8_t *
+dns_put32(uint8_t *cp, uint32_t v)
+{
+	cp = dns_put16(cp, v >> 16);
+	return dns_put16(cp, v);
+}
+
+static uint8_t *
+dns_put_str(uint8_t *cp, const char *str)
+{
+	size_t len = strlen(str);
+
+	*cp++ = len;
+	memcpy(cp, str, len);
+	return cp + len;
+}
+
+static uint8_t *
+dns_put_name(uint8_t *cp, const char *name)
+{
+	const char *end;
+	size_t len;
+
+	while (*name) {
+		end = strchr(name, '.');
+		len = (end) ? end - name : strlen(name);
+		*cp++ = len;
+		memcpy(cp, name, len);
+		cp += len;
+		name += len;
+		if (*name == '.')
+			name++;
+	}
+	*cp++ = 0;
+	return cp;
+}
+
+static uint8_t *
+dns_put_rr(uint8_t *cp, uint16_t type, uint8_t **rdlen)
+{
+	cp = dns_put16(cp, 0xc00c);	/* pointer to question name */
+	cp = dns_put16(cp, type);
+	cp = dns_put16(cp, ns_c_in);
+	cp = dns_put32(cp, dns_ttl);
+	*rdlen = cp;
+	return cp + 2;
+}
+
+static void
+dns_end_rr(uint8_t *rdlen, uint8_t *cp)
+{
+	dns_put16(rdlen, cp - rdlen - 2);
+}
+
+static int
+dns_answer(const char *qname, uint16_t qtype, uint8_t *cp, uint8_t **end)
+{
+	char name[256];
+	uint8_t *rdlen;
+	const char *p;
+	int n = 0, i;
+
+	if (!strncmp(qname, "unknown.", 8))
+		return -1;
+
+	switch (qtype) {
+	case ns_t_naptr:
+		__sync_add_and_fetch(&dns_stats.naptr, 1);
+		for (i = 1; i <= 2; i++) {
+			cp = dns_put_rr(cp, ns_t_naptr, &rdlen);
+			cp = dns_put16(cp, i * 10);	/* order */
+			cp = dns_put16(cp, 10);		/* preference */
+			cp = dns_put_str(cp, "s");
+			cp = dns_put_str(cp, "x-3gpp-pgw:x-s5-gtp:x-s8-gtp");
+			cp = dns_put_str(cp, "");
+			snprintf(name, sizeof(name), "_nodes._pgw.pgw%d.example.org", i);
+			cp = dns_put_name(cp, name);
+			dns_end_rr(rdlen, cp);
+			n++;
+		}
+		break;
+	case ns_t_srv:
+		__sync_add_and_fetch(&dns_stats.srv, 1);
+		p = strstr(qname, "pgw");
+		if (!p || !strstr(p + 1, "pgw"))
+			return -1;
+		p = strstr(p + 1, "pgw") + 3;
+		for (i = 0; i < 2; i++) {
+			cp = dns_put_rr(cp, ns_t_srv, &rdlen);
+			cp = dns_put16(cp, 10);		/* priority */
+			cp = dns_put16(cp, 10 + i * 10);	/* weight */
+			cp = dns_put16(cp, 2123);
+			snprintf(name, sizeof(name), "topon.pgw%c-%c.example.org", *p, 'a' + i);
+			cp = dns_put_name(cp, name);
+			dns_end_rr(rdlen, cp);
+			n++;
+		}
+		break;
+	case ns_t_a:
+		__sync_add_and_fetch(&dns_stats.a, 1);
+		p = strstr(qname, "pgw");
+		if (!p || !p[3] || p[4] != '-')
+			return -1;
+		cp = dns_put_rr(cp, ns_t_a, &rdlen);
+		*cp++ = 10;
+		*cp++ = 0;
+		*cp++ = p[3] - '0';
+		*cp++ = p[5] - 'a' + 1;
+		dns_end_rr(rdlen, cp);
+		n++;
+		break;
+	default:
+		return -1;
+	}
+
+	*end = cp;
+	return n;
+}
+
+static void *
+dns_server_task(void *arg)
+{
+	uint8_t buf[4096], *cp, *qend, *end;
+	struct sockaddr_storage peer;
+	socklen_t peerlen;
+	char qname[256];
+	uint16_t qtype;
+	ssize_t len;
+	int n, off;
+
+	for (;;) {
+		peerlen = sizeof(peer);
+		len = recvfrom(dns_fd, buf, 512, 0, (struct sockaddr *) &peer, &peerlen);
+		if (len < NS_HFIXEDSZ + NS_QFIXEDSZ + 1)
+			continue;
+
+		/* Question section, uncompressed */
+		off = 0;
+		for (cp = buf + NS_HFIXEDSZ; cp < buf + len && *cp; cp += *cp + 1) {
+			if (off + *cp + 1 >= sizeof(qname))
+				break;
+			memcpy(qname + off, cp + 1, *cp);
+			off += *cp;
+			qname[off++] = '.';
+		}
+		qname[off] = 0;
+		qend = cp + 1 + NS_QFIXEDSZ;
+		if (qend > buf + len)
+			continue;
+		qtype = (cp[1] << 8) | cp[2];
+
+		if (dns_delay_ms)
+			usleep(dns_delay_ms * 1000);
+
+		n = dns_answer(qname, qtype, qend, &end);
+		buf[2] = 0x81;					/* QR, RD */
+		buf[3] = (n < 0) ? 0x80 | ns_r_nxdomain : 0x80;	/* RA, rcode */
+		dns_put16(buf + 6, (n < 0) ? 0 : n);		/* ancount */
+		dns_put16(buf + 8, 0);
+		dns_put16(buf + 10, 0);
+		if (n < 0)
+			end = qend;
+
+		sendto(dns_fd, buf, end - buf, 0, (struct sockaddr *) &peer, peerlen);
+	}
+
+	return NULL;
+}
+
+int
+dns_server_start(uint16_t port, uint32_t ttl, unsigned delay_ms)
+{
+	struct sockaddr_in addr;
+	pthread_t task;
+
+	dns_ttl = ttl;
+	dns_delay_ms = delay_ms;
+
+	dns_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (dns_fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(dns_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(dns_fd);
+		return -1;
+	}
+
+	pthread_create(&task, NULL, dns_server_task, NULL);
+	pthread_detach(task);
+	return 0;
+}
@@ -34,8 +34,10 @@
 #include <getopt.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "gtp_guard.h"
+#include "dns.h"
 
 /* Local data */
 data_t *daemon_data;
@@ -44,6 +46,19 @@ const char *apn_str;
 const char *plmn_str;
 const char *nameserver;
 const char *service_selection;
+int local_dns_port;
+int dns_ttl = 2;
+int dns_delay;
+int nr_loops = 100000;
+int nr_threads = 8;
+
+/* Path purge hands sessions over to the reaper. No session is ever
+ * registered on a path here, so reaper is left out and stubbed. */
+int
+gtp_reaper_session_add(gtp_session_t *s)
+{
+	return -1;
+}
 
 /*
  *      Usage function
@@ -56,6 +71,11 @@ usage(const char *prog)
 	fprintf(stderr, "  -p, --plmn                   PLMN\n");
 	fprintf(stderr, "  -s, --name-server            Nameserver IP Address\n");
 	fprintf(stderr, "  -S, --service-selection      Service selection string\n");
+	fprintf(stderr, "  -l, --local-dns              Run stand-in DNS server on 127.0.0.1:<port>\n");
+	fprintf(stderr, "  -t, --ttl                    Stand-in DNS records TTL (default: 2)\n");
+	fprintf(stderr, "  -d, --delay                  Stand-in DNS answer delay in ms (default: 0)\n");
+	fprintf(stderr, "  -n, --loops                  Number of cached lookups (default: 100000)\n");
+	fprintf(stderr, "  -T, --threads                Number of concurrent lookup threads (default: 8)\n");
 	fprintf(stderr, "  -h, --help                   Display this help message\n");
 }
 
@@ -74,6 +94,11 @@ parse_cmdline(int argc, char **argv)
 		{"plmn",		required_argument,	NULL, 'p'},
 		{"name-server",		required_argument,	NULL, 's'},
 		{"service-selection",	required_argument,	NULL, 'S'},
+		{"local-dns",		required_argument,	NULL, 'l'},
+		{"ttl",			required_argument,	NULL, 't'},
+		{"delay",		required_argument,	NULL, 'd'},
+		{"loops",		required_argument,	NULL, 'n'},
+		{"threads",		required_argument,	NULL, 'T'},
 		{"help",                no_argument,		NULL, 'h'},
 		{NULL,                  0,			NULL,  0 }
 	};
@@ -82,7 +107,7 @@ parse_cmdline(int argc, char **argv)
 		return -1;
 
 	curind = optind;
-	while (longindex = -1, (c = getopt_long(argc, argv, ":ha:p:s:S:"
+	while (longindex = -1, (c = getopt_long(argc, argv, ":ha:p:s:S:l:t:d:n:T:"
 						, long_options, &longindex)) != -1) {
 		if (longindex >= 0 && long_options[longindex].has_arg == required_argument &&
 		    optarg && !optarg[0]) {
@@ -107,6 +132,21 @@ parse_cmdline(int argc, char **argv)
 		case 'S':
 			service_selection = optarg;
 			break;
+		case 'l':
+			local_dns_port = atoi(optarg);
+			break;
+		case 't':
+			dns_ttl = atoi(optarg);
+			break;
+		case 'd':
+			dns_delay = atoi(optarg);
+			break;
+		case 'n':
+			nr_loops = atoi(optarg);
+			break;
+		case 'T':
+			nr_threads = atoi(optarg);
+			break;
 		case '?':
 			if (optopt && argv[curind][1] != '-')
 				fprintf(stderr, "Unknown option -%c\n", optopt);
@@ -144,40 +184,235 @@ parse_cmdline(int argc, char **argv)
 
 
 
+/*
+ *	Resolver cache test
+ */
+static gtp_apn_t *apn;
+
+static uint64_t
+usec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int
+sched(const char *apn_name, struct sockaddr_in *pgw, uint64_t *lat)
+{
+	struct sockaddr_in sgw;
+	uint64_t start = usec_now();
+	int err;
+
+	memset(&sgw, 0, sizeof(struct sockaddr_in));
+	err = gtp_sched_dynamic(apn, apn_name, plmn_str, pgw, &sgw);
+	if (lat)
+		*lat = usec_now() - start;
+	return err;
+}
+
+/* Poll until the asynchronous resolution has landed */
+static int
+sched_wait(const char *apn_name, struct sockaddr_in *pgw, uint64_t *elapsed)
+{
+	uint64_t start = usec_now();
+	int i, err = -1;
+
+	for (i = 0; i < 1000 && err; i++) {
+		err = sched(apn_name, pgw, NULL);
+		if (err)
+			usleep(10000);
+	}
+
+	*elapsed = usec_now() - start;
+	return err;
+}
+
+static void *
+sched_thread(void *arg)
+{
+	struct sockaddr_in pgw;
+
+	sched(arg, &pgw, NULL);
+	return NULL;
+}
+
+/* Poll until the resolver workers have completed nr resolutions */
+static void
+resolv_wait(uint64_t nr)
+{
+	gtp_resolv_cache_stats_t s;
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		gtp_resolv_cache_stats(&s);
+		if (s.resolved + s.failed >= nr)
+			return;
+		usleep(10000);
+	}
+}
+
+static uint64_t
+resolv_count(void)
+{
+	gtp_resolv_cache_stats_t s;
+
+	gtp_resolv_cache_stats(&s);
+	return s.resolved + s.failed;
+}
+
+static void
+stats_dump(void)
+{
+	gtp_resolv_cache_stats_t s;
+
+	gtp_resolv_cache_stats(&s);
+	printf("  cache: hit:%ld stale:%ld negative:%ld miss:%ld inflight:%ld"
+	       " resolved:%ld failed:%ld lat-avg:%ldus lat-max:%ldus\n"
+	       , s.hit, s.stale, s.negative, s.miss, s.inflight
+	       , s.resolved, s.failed
+	       , (s.resolved + s.failed) ? s.lat_sum / (s.resolved + s.failed) : 0
+	       , s.lat_max);
+	if (local_dns_port)
+		printf("  stand-in dns queries: naptr:%ld srv:%ld a:%ld\n"
+		       , dns_stats.naptr, dns_stats.srv, dns_stats.a);
+}
+
+static int
+run_tests(void)
+{
+	gtp_resolv_cache_stats_t s;
+	struct sockaddr_in pgw;
+	pthread_t *tasks;
+	uint64_t lat, elapsed, naptr, nr_resolv, negative;
+	int i, err, failed = 0;
+
+	/* Cold miss must not wait for DNS */
+	err = sched(apn_str, &pgw, &lat);
+	printf("cold lookup: %s in %ldus\n", (err) ? "miss" : "hit", lat);
+	if (!err || lat > 10000) {
+		printf("  FAILED: cold lookup expected to fail fast\n");
+		failed++;
+	}
+
+	err = sched_wait(apn_str, &pgw, &elapsed);
+	if (err) {
+		fprintf(stderr, " Unable to schedule pGW for apn:'%s.apn.epc.%s.3gppnetwork.org.'\n"
+			      , apn_str, plmn_str);
+		return -1;
+	}
+	printf("resolved in %ldus, scheduled pGW : %u.%u.%u.%u\n"
+	       , elapsed, NIPQUAD(pgw.sin_addr.s_addr));
+
+	/* Hit path */
+	elapsed = usec_now();
+	for (i = 0; i < nr_loops; i++)
+		sched(apn_str, &pgw, NULL);
+	elapsed = usec_now() - elapsed;
+	printf("%d cached lookups: %ldns/lookup\n"
+	       , nr_loops, (nr_loops) ? elapsed * 1000 / nr_loops : 0);
+	stats_dump();
+
+	if (!local_dns_port)
+		return failed;
+
+	/* In-flight deduplication: concurrent misses on a fresh key */
+	naptr = dns_stats.naptr;
+	tasks = calloc(nr_threads, sizeof(pthread_t));
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&tasks[i], NULL, sched_thread, "dedup");
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(tasks[i], NULL);
+	free(tasks);
+	sched_wait("dedup", &pgw, &elapsed);
+	printf("%d concurrent misses: %ld NAPTR query sent\n"
+	       , nr_threads, dns_stats.naptr - naptr);
+	if (dns_stats.naptr - naptr != 1) {
+		printf("  FAILED: expected a single in-flight resolution\n");
+		failed++;
+	}
+
+	/* TTL expiry: stale entry served while refreshing */
+	naptr = dns_stats.naptr;
+	nr_resolv = resolv_count();
+	sleep(((dns_ttl < GTP_RESOLV_CACHE_TTL_MIN) ? GTP_RESOLV_CACHE_TTL_MIN : dns_ttl) + 1);
+	err = sched(apn_str, &pgw, &lat);
+	printf("expired lookup: %s in %ldus\n", (err) ? "miss" : "stale hit", lat);
+	if (err) {
+		printf("  FAILED: expected stale entry to be served\n");
+		failed++;
+	}
+	resolv_wait(nr_resolv + 1);
+	printf("  background refresh: %ld NAPTR query sent\n", dns_stats.naptr - naptr);
+	if (dns_stats.naptr == naptr) {
+		printf("  FAILED: expected a background refresh\n");
+		failed++;
+	}
+
+	/* Negative caching */
+	nr_resolv = resolv_count();
+	sched("unknown", &pgw, NULL);
+	resolv_wait(nr_resolv + 1);
+	gtp_resolv_cache_stats(&s);
+	negative = s.negative;
+	naptr = dns_stats.naptr;
+	err = sched("unknown", &pgw, NULL);
+	gtp_resolv_cache_stats(&s);
+	printf("unknown apn: %s, %ld NAPTR query sent\n"
+	       , (s.negative > negative) ? "negative hit" : "miss"
+	       , dns_stats.naptr - naptr);
+	if (!err || s.negative == negative || dns_stats.naptr != naptr) {
+		printf("  FAILED: expected negative cache hit\n");
+		failed++;
+	}
+
+	stats_dump();
+	return failed;
+}
+
 int main(int argc, char **argv)
 {
-	struct sockaddr_in pgw, sgw;
-	gtp_apn_t *apn;
 	gtp_service_t *svc;
 	int err;
 
         /* Command line parsing */
         err = parse_cmdline(argc, argv);
-	if (err) {
+	if (err || (!nameserver && !local_dns_port) || !apn_str || !plmn_str) {
 		usage(argv[0]);
 		exit(-1);
 	}
 
+	if (!service_selection)
+		service_selection = "x-3gpp-pgw:x-s5-gtp";
+
 	PMALLOC(apn);
 	INIT_LIST_HEAD(&apn->service_selection);
-	strlcpy(apn->name, "*", GTP_APN_MAX_LEN);
-	inet_stosockaddr(nameserver, 53, &apn->nameserver);
+	pthread_mutex_init(&apn->mutex, NULL);
+	bsd_strlcpy(apn->name, "*", GTP_APN_MAX_LEN);
+	apn->nameserver_timeout = 1;
+	apn->resolv_max_retry = 1;
+	if (local_dns_port) {
+		err = dns_server_start(local_dns_port, dns_ttl, dns_delay);
+		if (err) {
+			fprintf(stderr, " Unable to start stand-in DNS server on port %d\n"
+				      , local_dns_port);
+			exit(-1);
+		}
+		inet_stosockaddr("127.0.0.1", local_dns_port, &apn->nameserver);
+	} else {
+		inet_stosockaddr(nameserver, 53, &apn->nameserver);
+	}
 	PMALLOC(svc);
 	INIT_LIST_HEAD(&svc->next);
 	svc->prio = 10;
-	strlcpy(svc->str, service_selection, GTP_APN_MAX_LEN);
+	bsd_strlcpy(svc->str, service_selection, GTP_APN_MAX_LEN);
 	list_add_tail(&svc->next, &apn->service_selection);
 
-	memset(&pgw, 0, sizeof(struct sockaddr_in));
-	memset(&sgw, 0, sizeof(struct sockaddr_in));
-	err = gtp_sched_dynamic(apn, apn_str, plmn_str, &pgw, &sgw);
-	if (err) {
-		fprintf(stderr, " Unable to schedule pGW for apn:'%s.apn.epc.%s.3gppnetwork.org.'"
-			      , apn_str, plmn_str);
-		exit(-1);
-	}
-
-	printf("Scheduled pGW : %u.%u.%u.%u\n", NIPQUAD(pgw.sin_addr.s_addr));
+	gtp_resolv_cache_init();
+	err = run_tests();
+	gtp_resolv_cache_destroy();
 
-	exit(0);
+	printf("%s\n", (err) ? "FAILED" : "PASSED");
+	exit((err) ? -1 : 0);
 }
@@ -0,0 +1,530 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+
+#include "gtp_guard.h"
+
+/* Local data */
+data_t *daemon_data;
+thread_master_t *master = NULL;
+
+#define BENCH_PORT		21230
+#define BENCH_BATCH		32
+#define BENCH_FLOWS		8	/* source sockets per sender */
+#define BENCH_MAX_WORKERS	64
+
+static int workers_cnt = 4;
+static int senders_cnt = 4;
+static unsigned long sessions = 1 << 16;
+static unsigned long packets = 1000000;
+static int shard_bits;
+static gtp_htab_t vteid_tab;
+static gtp_idpool_t *vteid_pool[BENCH_MAX_WORKERS];
+static gtp_teid_t **session_teid;
+
+typedef struct _bench_worker {
+	pthread_t		task;
+	int			id;
+	int			fd;
+	uint64_t		rx;
+	uint64_t		foreign;
+	uint64_t		last_ns;
+} bench_worker_t;
+
+typedef struct _bench_sender {
+	pthread_t		task;
+	int			id;
+	int			fd[BENCH_FLOWS];
+	uint64_t		tx;
+} bench_sender_t;
+
+typedef struct _bench_locker {
+	pthread_t		task;
+	int			id;
+	int			steering;
+	uint64_t		ops;
+	uint64_t		contended;
+	uint64_t		wait_ns;
+	uint64_t		run_ns;
+} bench_locker_t;
+
+static bench_worker_t bench_workers[BENCH_MAX_WORKERS];
+static volatile int bench_stop;
+static pthread_barrier_t bench_barrier;
+
+static uint64_t
+bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/*
+ *	Sessions: VTEID allocated from per worker pools, round-robin
+ *	over workers, so that each worker owns its TEID shard.
+ */
+static void
+bench_sessions_init(void)
+{
+	unsigned int seed = time(NULL);
+	gtp_teid_t *t;
+	unsigned long i;
+
+	gtp_htab_init(&vteid_tab, CONN_HASHTAB_SIZE);
+	for (i = 0; i < workers_cnt; i++)
+		vteid_pool[i] = gtp_idpool_alloc((uint32_t) i << (32 - shard_bits)
+						 , 32 - shard_bits, GTP_IDPOOL_MAX_SIZE, true);
+
+	session_teid = calloc(sessions, sizeof(gtp_teid_t *));
+	for (i = 0; i < sessions; i++) {
+		PMALLOC(t);
+		t->id = i;
+		gtp_vteid_alloc(&vteid_tab, t, vteid_pool[i % workers_cnt], &seed);
+		session_teid[i] = t;
+	}
+}
+
+static void
+bench_sessions_destroy(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < sessions; i++) {
+		gtp_vteid_unhash(&vteid_tab, session_teid[i]);
+		FREE(session_teid[i]);
+	}
+	free(session_teid);
+	gtp_htab_destroy(&vteid_tab);
+	for (i = 0; i < workers_cnt; i++)
+		gtp_idpool_free(vteid_pool[i]);
+}
+
+
+/*
+ *	Workers: one SO_REUSEPORT socket each, as gtp_server does
+ */
+static int
+bench_socket(int reuseport)
+{
+	struct sockaddr_in addr;
+	int fd, on = 1, rcvbuf = 8 << 20;
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if (!reuseport)
+		return fd;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(BENCH_PORT);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "bind error (%m)\n");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Classic BPF flavour of bpf/gtp_reuseport.c TEID path. Index
+ * returned is socket position in the reuseport group, which is
+ * bind() order, ie: worker id */
+static int
+bench_steering_attach(int fd)
+{
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 4),
+		BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 32 - shard_bits),
+		BPF_STMT(BPF_RET | BPF_A, 0),
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+		fprintf(stderr, "SO_ATTACH_REUSEPORT_CBPF error (%m)\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *
+bench_worker_task(void *arg)
+{
+	bench_worker_t *w = arg;
+	uint8_t buffer[GTP_BUFFER_SIZE];
+	gtp_hdr_t *h = (gtp_hdr_t *) buffer;
+	gtp_teid_t *t;
+	uint32_t vid;
+	ssize_t len;
+
+	while (!bench_stop) {
+		len = recv(w->fd, buffer, sizeof(buffer), 0);
+		if (len < (ssize_t) sizeof(gtp_hdr_t))
+			continue;
+
+		/* What a GTP-C handler does first: TEID lookup and
+		 * some session tracking update */
+		vid = ntohl(h->teid);
+		t = gtp_vteid_get(&vteid_tab, vid);
+		if (!t)
+			continue;
+		dlock_lock_id(vteid_tab.dlock, vid, 0);
+		t->sqn = ntohl(h->sqn);
+		t->vsqn++;
+		dlock_unlock_id(vteid_tab.dlock, vid, 0);
+		__sync_sub_and_fetch(&t->refcnt, 1);
+
+		if (shard_bits && (vid >> (32 - shard_bits)) != w->id)
+			w->foreign++;
+		w->rx++;
+		w->last_ns = bench_ns();
+	}
+
+	return NULL;
+}
+
+
+/*
+ *	Senders: a few flows each, like a handful of peers would do
+ */
+static void *
+bench_sender_task(void *arg)
+{
+	bench_sender_t *s = arg;
+	uint8_t msg[BENCH_BATCH][GTPV2C_HEADER_LEN + 16];
+	struct mmsghdr mmsg[BENCH_BATCH];
+	struct iovec iov[BENCH_BATCH];
+	struct sockaddr_in addr;
+	unsigned int seed = s->id + 1;
+	unsigned long sent, count = packets / senders_cnt;
+	gtp_hdr_t *h;
+	int i, ret, flow = 0;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(BENCH_PORT);
+
+	memset(msg, 0, sizeof(msg));
+	memset(mmsg, 0, sizeof(mmsg));
+	for (i = 0; i < BENCH_BATCH; i++) {
+		h = (gtp_hdr_t *) msg[i];
+		h->version = 2;
+		h->teid_presence = 1;
+		h->type = GTP_MODIFY_BEARER_REQUEST_TYPE;
+		h->length = htons(sizeof(msg[i]) - 4);
+		iov[i].iov_base = msg[i];
+		iov[i].iov_len = sizeof(msg[i]);
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+		mmsg[i].msg_hdr.msg_name = &addr;
+		mmsg[i].msg_hdr.msg_namelen = sizeof(addr);
+	}
+
+	for (sent = 0; sent < count; sent += BENCH_BATCH) {
+		for (i = 0; i < BENCH_BATCH; i++) {
+			h = (gtp_hdr_t *) msg[i];
+			h->teid = htonl(session_teid[rand_r(&seed) % sessions]->vid);
+			h->sqn = htonl(sent + i);
+		}
+
+		ret = sendmmsg(s->fd[flow], mmsg, BENCH_BATCH, 0);
+		if (ret > 0)
+			s->tx += ret;
+		flow = (flow + 1) % BENCH_FLOWS;
+	}
+
+	return NULL;
+}
+
+
+/*
+ *	Bench
+ */
+static void
+bench_run(const char *label, int steering)
+{
+	bench_sender_t *senders;
+	uint64_t start, rx = 0, tx = 0, foreign = 0, last = 0, min = ~0ULL, max = 0;
+	int i, j;
+
+	memset(bench_workers, 0, sizeof(bench_workers));
+	bench_stop = 0;
+	for (i = 0; i < workers_cnt; i++) {
+		bench_workers[i].id = i;
+		bench_workers[i].fd = bench_socket(1);
+		if (bench_workers[i].fd < 0)
+			exit(-1);
+	}
+
+	if (steering && bench_steering_attach(bench_workers[0].fd) < 0)
+		exit(-1);
+
+	for (i = 0; i < workers_cnt; i++)
+		pthread_create(&bench_workers[i].task, NULL, bench_worker_task, &bench_workers[i]);
+
+	senders = calloc(senders_cnt, sizeof(bench_sender_t));
+	for (i = 0; i < senders_cnt; i++) {
+		senders[i].id = i;
+		for (j = 0; j < BENCH_FLOWS; j++)
+			senders[i].fd[j] = bench_socket(0);
+	}
+
+	start = bench_ns();
+	for (i = 0; i < senders_cnt; i++)
+		pthread_create(&senders[i].task, NULL, bench_sender_task, &senders[i]);
+	for (i = 0; i < senders_cnt; i++) {
+		pthread_join(senders[i].task, NULL);
+		tx += senders[i].tx;
+		for (j = 0; j < BENCH_FLOWS; j++)
+			close(senders[i].fd[j]);
+	}
+	free(senders);
+
+	/* Let workers drain */
+	do {
+		rx = 0;
+		for (i = 0; i < workers_cnt; i++)
+			rx += bench_workers[i].rx;
+		usleep(300000);
+		for (i = 0; i < workers_cnt; i++)
+			rx -= bench_workers[i].rx;
+	} while (rx);
+
+	bench_stop = 1;
+	for (i = 0; i < workers_cnt; i++) {
+		pthread_join(bench_workers[i].task, NULL);
+		close(bench_workers[i].fd);
+		rx += bench_workers[i].rx;
+		foreign += bench_workers[i].foreign;
+		if (bench_workers[i].last_ns > last)
+			last = bench_workers[i].last_ns;
+		if (bench_workers[i].rx < min)
+			min = bench_workers[i].rx;
+		if (bench_workers[i].rx > max)
+			max = bench_workers[i].rx;
+	}
+
+	printf("%-22s: %8.0f pkt/s  rx:%lu/%lu (drop %.1f%%)"
+	       "  foreign-shard:%.1f%%  worker min/max:%lu/%lu\n"
+	       , label
+	       , (last > start) ? rx * 1e9 / (last - start) : 0
+	       , rx, tx
+	       , (tx) ? 100. * (tx - rx) / tx : 0
+	       , (rx) ? 100. * foreign / rx : 0
+	       , min, max);
+}
+
+
+/*
+ *	Lock contention: same TEID lookup and tracking update as
+ *	workers, without sockets so hashtab bucket locks are the only
+ *	shared resource. 4-tuple spread lets any worker hit any session,
+ *	steering keeps each worker on the sessions of its own shard.
+ */
+
+/* dlock_lock_id() with a trylock first: only contended acquisitions
+ * are timed, so clock reading cost doesn't show up as wait time */
+static void
+bench_dlock_lock(bench_locker_t *l, uint32_t id)
+{
+	dlock_mutex_t *m = vteid_tab.dlock +
+			   (gtp_hash_2words(GTP_HASH_DLOCK, id, 0) & DLOCK_HASHTAB_MASK);
+	uint64_t t0;
+
+	if (pthread_mutex_trylock(&m->mutex)) {
+		t0 = bench_ns();
+		pthread_mutex_lock(&m->mutex);
+		l->wait_ns += bench_ns() - t0;
+		l->contended++;
+	}
+	__sync_add_and_fetch(&m->refcnt, 1);
+}
+
+static void *
+bench_lock_task(void *arg)
+{
+	bench_locker_t *l = arg;
+	unsigned int seed = l->id + 1;
+	unsigned long n, idx, count = packets / workers_cnt;
+	uint64_t start;
+	gtp_teid_t *t;
+	uint32_t vid;
+
+	pthread_barrier_wait(&bench_barrier);
+	start = bench_ns();
+	for (n = 0; n < count; n++) {
+		idx = rand_r(&seed) % sessions;
+		if (l->steering) {
+			/* Sessions are owned round-robin */
+			idx = idx - idx % workers_cnt + l->id;
+			if (idx >= sessions)
+				idx = l->id;
+		}
+		vid = session_teid[idx]->vid;
+
+		t = gtp_vteid_get(&vteid_tab, vid);
+		if (!t)
+			continue;
+
+		bench_dlock_lock(l, vid);
+		t->sqn = n;
+		t->vsqn++;
+		dlock_unlock_id(vteid_tab.dlock, vid, 0);
+		__sync_sub_and_fetch(&t->refcnt, 1);
+		l->ops++;
+	}
+	l->run_ns = bench_ns() - start;
+
+	return NULL;
+}
+
+static void
+bench_lock_run(const char *label, int steering)
+{
+	bench_locker_t lockers[BENCH_MAX_WORKERS];
+	uint64_t ops = 0, contended = 0, wait = 0, run = 0;
+	int i;
+
+	memset(lockers, 0, sizeof(lockers));
+	pthread_barrier_init(&bench_barrier, NULL, workers_cnt);
+	for (i = 0; i < workers_cnt; i++) {
+		lockers[i].id = i;
+		lockers[i].steering = steering;
+		pthread_create(&lockers[i].task, NULL, bench_lock_task, &lockers[i]);
+	}
+
+	for (i = 0; i < workers_cnt; i++) {
+		pthread_join(lockers[i].task, NULL);
+		ops += lockers[i].ops;
+		contended += lockers[i].contended;
+		wait += lockers[i].wait_ns;
+		run = (lockers[i].run_ns > run) ? lockers[i].run_ns : run;
+	}
+	pthread_barrier_destroy(&bench_barrier);
+
+	printf("%-22s: %8.0f ops/s  contended:%.3f%%  lock wait:%.1f ns/op"
+	       " (%.2f%% of thread time)\n"
+	       , label
+	       , (run) ? ops * 1e9 / run : 0
+	       , (ops) ? 100. * contended / ops : 0
+	       , (ops) ? (double) wait / ops : 0
+	       , (run) ? 100. * wait / ((double) run * workers_cnt) : 0);
+}
+
+
+/*
+ *	Usage function
+ */
+static void
+usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [OPTION...]\n", prog);
+	fprintf(stderr, "  -w, --workers                Number of SO_REUSEPORT workers (power of 2)\n");
+	fprintf(stderr, "  -s, --senders                Number of sender threads\n");
+	fprintf(stderr, "  -n, --packets                Number of GTP-C messages to send\n");
+	fprintf(stderr, "  -S, --sessions               Number of sessions\n");
+	fprintf(stderr, "  -h, --help                   Display this help message\n");
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+
+	struct option long_options[] = {
+		{"workers",		required_argument,	NULL, 'w'},
+		{"senders",		required_argument,	NULL, 's'},
+		{"packets",		required_argument,	NULL, 'n'},
+		{"sessions",		required_argument,	NULL, 'S'},
+		{"help",                no_argument,		NULL, 'h'},
+		{NULL,                  0,			NULL,  0 }
+	};
+
+	while ((c = getopt_long(argc, argv, "hw:s:n:S:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'w':
+			workers_cnt = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			senders_cnt = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			packets = strtoul(optarg, NULL, 10);
+			break;
+		case 'S':
+			sessions = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
+
+	if (workers_cnt < 2 || workers_cnt > BENCH_MAX_WORKERS ||
+	    (workers_cnt & (workers_cnt - 1)) || !senders_cnt || !sessions) {
+		usage(argv[0]);
+		exit(-1);
+	}
+
+	shard_bits = __builtin_ctz(workers_cnt);
+	bench_sessions_init();
+
+	printf("%d workers, %d senders x %d flows, %lu sessions, %lu messages\n"
+	       , workers_cnt, senders_cnt, BENCH_FLOWS, sessions, packets);
+	bench_run("4-tuple (current)", 0);
+	bench_run("TEID shard steering", 1);
+
+	printf("%d threads, hashtab bucket locks, %lu lookups+updates\n"
+	       , workers_cnt, packets);
+	bench_lock_run("4-tuple (current)", 0);
+	bench_lock_run("TEID shard steering", 1);
+
+	bench_sessions_destroy();
+	exit(0);
+}
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "gtp_guard.h"
+
+/* Local data */
+data_t *daemon_data;
+thread_master_t *master = NULL;
+
+static int nr_rules = 10000;
+static unsigned long lookups = 1000000;
+static gtp_apn_t apn;
+static uint8_t (*imsi)[8];
+
+/* Previous list walk, kept as reference */
+static gtp_rewrite_rule_t *
+bench_list_lookup(uint8_t *key)
+{
+	gtp_rewrite_rule_t *rule;
+
+	list_for_each_entry(rule, &apn.imsi_match, next) {
+		if (memcmp(rule->match, key, rule->match_len / 2) == 0) {
+			if (!!(rule->match_len % 2)) {
+				if ((key[rule->match_len / 2] & 0x0f) == (rule->match[rule->match_len / 2] & 0x0f))
+					return rule;
+			} else {
+				return rule;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void
+bench_digits(char *buf, int len, unsigned int *seed)
+{
+	static const char *plmn[] = { "20801", "20810", "20820", "310260", "23415", "26201" };
+	int i;
+
+	/* Partner PLMN then random MSIN digits */
+	strcpy(buf, plmn[rand_r(seed) % 6]);
+	for (i = strlen(buf); i < len; i++)
+		buf[i] = '0' + rand_r(seed) % 10;
+	buf[len] = 0;
+}
+
+static void
+bench_init(void)
+{
+	gtp_rewrite_rule_t *rule;
+	unsigned int seed = 1;
+	char str[16];
+	unsigned long i;
+
+	INIT_LIST_HEAD(&apn.imsi_match);
+	pthread_mutex_init(&apn.mutex, NULL);
+	for (i = 0; i < nr_rules; i++) {
+		PMALLOC(rule);
+		bench_digits(str, 7 + rand_r(&seed) % 5, &seed);
+		stringtohex(str, 15, rule->match, GTP_MATCH_MAX_LEN);
+		swapbuffer((uint8_t *) rule->match, 8, (uint8_t *) rule->match);
+		rule->match_len = strlen(str);
+		list_add_tail(&rule->next, &apn.imsi_match);
+	}
+
+	imsi = calloc(lookups, sizeof(*imsi));
+	for (i = 0; i < lookups; i++) {
+		bench_digits(str, 15, &seed);
+		stringtohex(str, 15, (char *) imsi[i], 8);
+		swapbuffer(imsi[i], 8, imsi[i]);
+	}
+}
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+	gtp_rewrite_rule_t *rule;
+	gtp_rewrite_trie_t *t;
+	unsigned long i, hit = 0, err = 0;
+	double start, list_ns, trie_ns;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:l:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			nr_rules = atoi(optarg);
+			break;
+		case 'l':
+			lookups = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-r rules] [-l lookups]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	bench_init();
+
+	start = bench_now();
+	gtp_rewrite_trie_rebuild(&apn, GTP_REWRITE_IMSI);
+	t = gtp_rewrite_trie_get(&apn, GTP_REWRITE_IMSI);
+	gtp_rewrite_trie_put(t);
+	printf("trie build: %d rules, %u nodes, %zu KB, %.1f ms\n", nr_rules, t->nr_node
+	       , t->nr_node * sizeof(gtp_rewrite_node_t) >> 10, (bench_now() - start) * 1e3);
+
+	for (i = 0; i < lookups; i++) {
+		rule = bench_list_lookup(imsi[i]);
+		hit += !!rule;
+		err += (rule != gtp_rewrite_trie_lookup(t, imsi[i], 16));
+	}
+	printf("%lu lookups, %lu hits, %lu mismatches\n", lookups, hit, err);
+
+	start = bench_now();
+	for (i = 0; i < lookups; i++)
+		hit += !!bench_list_lookup(imsi[i]);
+	list_ns = (bench_now() - start) * 1e9 / lookups;
+
+	start = bench_now();
+	for (i = 0; i < lookups; i++) {
+		t = gtp_rewrite_trie_get(&apn, GTP_REWRITE_IMSI);
+		hit += !!gtp_rewrite_trie_lookup(t, imsi[i], 16);
+		gtp_rewrite_trie_put(t);
+	}
+	trie_ns = (bench_now() - start) * 1e9 / lookups;
+
+	printf("list walk: %10.1f ns/lookup\n", list_ns);
+	printf("trie     : %10.1f ns/lookup (x%.0f)\n", trie_ns, list_ns / trie_ns);
+
+	gtp_rewrite_trie_destroy(&apn);
+	exit(err ? 1 : 0);
+}
@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: AGPL-3.0-or-later */
+/*
+ * Soft:        The main goal of gtp-guard is to provide robust and secure
+ *              extensions to GTP protocol (GPRS Tunneling Procol). GTP is
+ *              widely used for data-plane in mobile core-network. gtp-guard
+ *              implements a set of 3 main frameworks:
+ *              A Proxy feature for data-plane tweaking, a Routing facility
+ *              to inter-connect and a Firewall feature for filtering,
+ *              rewriting and redirecting.
+ *
+ * Authors:     Alexandre Cassen, <acassen@gmail.com>
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU Affero General Public
+ *              License Version 3.0 as published by the Free Software Foundation;
+ *              either version 3.0 of the License, or (at your option) any later
+ *              version.
+ *
+ * Copyright (C) 2023-2024 Alexandre Cassen, <acassen@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <malloc.h>
+
+#include "gtp_guard.h"
+
+/* Local data */
+data_t *daemon_data;
+thread_master_t *master = NULL;
+
+static unsigned long nr_session = 1000000;
+static int teid_per_session = 4;
+
+static size_t
+rss_bytes(void)
+{
+	unsigned long size, rss = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		return 0;
+	if (fscanf(fp, "%lu %lu", &size, &rss) != 2)
+		rss = 0;
+	fclose(fp);
+	return rss * sysconf(_SC_PAGESIZE);
+}
+
+static void
+report(const char *name, size_t size, unsigned long count)
+{
+	void *p = malloc(size);
+
+	printf("%-14s sizeof:%4zu malloc:%4zu x %9lu = %8.1f MB\n"
+	       , name, size, malloc_usable_size(p) + sizeof(size_t)
+	       , count, (double) count * (malloc_usable_size(p) + sizeof(size_t)) / (1 << 20));
+	free(p);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long i, nr_teid;
+	gtp_session_t **s;
+	gtp_teid_t **t;
+	size_t rss;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:t:h")) != -1) {
+		switch (opt) {
+		case 's':
+			nr_session = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			teid_per_session = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s sessions] [-t teid_per_session]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	nr_teid = nr_session * teid_per_session;
+
+	report("gtp_session_t", sizeof(gtp_session_t), nr_session);
+	report("gtp_teid_t", sizeof(gtp_teid_t), nr_teid);
+
+	s = malloc(nr_session * sizeof(*s));
+	t = malloc(nr_teid * sizeof(*t));
+	if (!s || !t)
+		exit(EXIT_FAILURE);
+
+	/* Same allocation pattern as gtp_session_alloc() & gtp_teid_malloc() */
+	rss = rss_bytes();
+	for (i = 0; i < nr_session; i++)
+		s[i] = calloc(1, sizeof(gtp_session_t));
+	for (i = 0; i < nr_teid; i++)
+		t[i] = calloc(1, sizeof(gtp_teid_t));
+	rss = rss_bytes() - rss;
+
+	printf("%lu sessions + %lu teids: RSS +%.1f MB\n"
+	       , nr_session, nr_teid, (double) rss / (1 << 20));
+
+	for (i = 0; i < nr_session; i++)
+		free(s[i]);
+	for (i = 0; i < nr_teid; i++)
+		free(t[i]);
+	free(s);
+	free(t);
+	exit(EXIT_SUCCESS);
+}